@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_HOSTEDSERIAL_H
+#define TASKMANAGERIO_HOSTEDSERIAL_H
+
+/**
+ * @file HostedSerial.h
+ * @brief Included ahead of each example in the hosted build, it gives the examples a Serial that prints to stdout.
+ */
+
+#include <cstdio>
+#include <cstdint>
+
+class HostedSerial {
+public:
+    void begin(unsigned long) {}
+    void print(const char* text) { fputs(text, stdout); }
+    void print(int value) { printf("%d", value); }
+    void print(unsigned int value) { printf("%u", value); }
+    void print(long value) { printf("%ld", value); }
+    void print(unsigned long value) { printf("%lu", value); }
+    void print(double value) { printf("%.2f", value); }
+    template<class T> void println(T value) {
+        print(value);
+        putchar('\n');
+        fflush(stdout);
+    }
+};
+
+extern HostedSerial Serial;
+
+#endif //TASKMANAGERIO_HOSTEDSERIAL_H
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_HOSTED_IOLOGGING_H
+#define TASKMANAGERIO_HOSTED_IOLOGGING_H
+
+/**
+ * @file IoLogging.h
+ * @brief Used by the hosted build when TcMenuLog is not available, all logging compiles away.
+ */
+
+#define SER_WARNING 1
+#define SER_ERROR 2
+#define SER_IOA_INFO 3
+#define SER_IOA_DEBUG 4
+#define SER_TCMENU_INFO 5
+
+#define serlogF(l, x) ((void)0)
+#define serlogF2(l, x, y) ((void)(y))
+#define serlogF3(l, x, y, z) ((void)(y), (void)(z))
+#define serlogF4(l, x, y, z, w) ((void)(y), (void)(z), (void)(w))
+#define serlogFHex(l, x, y) ((void)(y))
+#define serdebugF(x) ((void)0)
+#define serdebug(x) ((void)(x))
+#define serdebugF2(x, y) ((void)(y))
+#define serdebugF3(x, y, z) ((void)(y), (void)(z))
+#define serdebugF4(x, y, z, w) ((void)(y), (void)(z), (void)(w))
+
+#endif //TASKMANAGERIO_HOSTED_IOLOGGING_H
@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include <TaskManagerIO.h>
+#include <cstdlib>
+#include "HostedSerial.h"
+
+HostedSerial Serial;
+
+void setup();
+void loop();
+
+// runs the example as Arduino would, setup once and then loop, for the number of seconds given, or forever.
+int main(int argc, char** argv) {
+    uint32_t runForMillis = (argc > 1) ? uint32_t(strtoul(argv[1], nullptr, 10) * 1000UL) : 0;
+    uint32_t started = millis();
+    setup();
+    while(runForMillis == 0 || (millis() - started) < runForMillis) {
+        loop();
+    }
+    return 0;
+}
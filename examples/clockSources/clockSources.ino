@@ -0,0 +1,79 @@
+/**
+ * An example that measures the cost of reading each clock source, so that you can choose one for the scheduler. Each
+ * source is read many times in a loop, and the average cost per read is printed to serial in nanoseconds, along with
+ * micros() itself for comparison. In the hosted Linux build this includes CLOCK_MONOTONIC and, where the processor has
+ * an invariant TSC, the time stamp counter, see cmake/hosted. The best source is then set as the scheduler clock, and
+ * a task prints the 64 bit time.
+ *
+ * There is a getting started guide including video available:
+ * https://www.thecoderscorner.com/products/arduino-libraries/taskmanager-io/
+ */
+
+#include <TaskManagerIO.h>
+#include <TmClockSource.h>
+
+#define READS_PER_SOURCE 100000UL
+
+volatile uint64_t clockSink = 0;
+
+// micros() is measured the same way as the sources, to show what they cost compared to it.
+class PlainMicrosSource : public TmClockSource {
+public:
+    uint64_t nowMicros() override { return micros(); }
+    const char* getName() const override { return "micros (32 bit)"; }
+};
+
+PlainMicrosSource plainMicros;
+TmMicrosClockSource extendedMicros;
+
+void benchmarkSource(TmClockSource* source) {
+    TmClockSource* reference = getBestClockSource();
+    uint64_t started = reference->nowNanos();
+    uint64_t sum = 0;
+    for(uint32_t i = 0; i < READS_PER_SOURCE; i++) {
+        sum += source->nowNanos();
+    }
+    uint64_t took = reference->nowNanos() - started;
+    clockSink = sum;
+
+    Serial.print(source->getName());
+    Serial.print(", ns per read ");
+    Serial.println(float(took) / float(READS_PER_SOURCE));
+}
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("Clock source read cost");
+
+    benchmarkSource(&plainMicros);
+    benchmarkSource(&extendedMicros);
+#ifdef TM_MONOTONIC_CLOCK_SUPPORT
+    TmMonotonicClockSource monotonic;
+    benchmarkSource(&monotonic);
+#endif
+#ifdef TM_TSC_CLOCK_SUPPORT
+    TmTscClockSource tsc;
+    if(tsc.calibrate()) {
+        benchmarkSource(&tsc);
+    }
+    else {
+        Serial.println("tsc, not invariant on this processor");
+    }
+#endif
+
+#ifdef TM_SCHEDULER_CLOCK_SOURCE
+    // set before scheduling anything, so that every deadline is from the same clock
+    setSchedulerClockSource(getBestClockSource());
+    Serial.print("Scheduler clock is ");
+    Serial.println(getBestClockSource()->getName());
+#endif
+
+    taskManager.scheduleFixedRate(1000, [] {
+        Serial.print("64 bit micros ");
+        Serial.println(double(getBestClockSource()->nowMicros()));
+    });
+}
+
+void loop() {
+    taskManager.runLoop();
+}
@@ -0,0 +1,121 @@
+/**
+ * An example that measures how long it takes to acquire a SimpleSpinLock when several threads contend for it. For
+ * 1, 2, 4 and 8 contending threads, each thread repeatedly takes the lock, does a small amount of work and releases
+ * it, recording the time between asking for the lock and getting it. The average and worst case acquire latency are
+ * then printed to serial, along with how long the whole run took.
+ *
+ * This needs a board with threads, on ESP32 the contending threads are FreeRTOS tasks, and in the hosted Linux build
+ * they are std::thread, see cmake/hosted. On other boards it prints the uncontended acquire latency only.
+ *
+ * There is a getting started guide including video available:
+ * https://www.thecoderscorner.com/products/arduino-libraries/taskmanager-io/
+ */
+
+#include <TaskManagerIO.h>
+#include <SimpleSpinLock.h>
+#if defined(BUILD_FOR_HOSTED)
+#include <thread>
+#endif
+
+// a host is fast enough to get through a small run within one time slice, so it runs for longer to see contention.
+#if defined(BUILD_FOR_HOSTED)
+#define ACQUIRES_PER_THREAD 200000
+#else
+#define ACQUIRES_PER_THREAD 2000
+#endif
+#define MAX_CONTENDING_THREADS 8
+
+SimpleSpinLock contendedLock;
+volatile uint32_t sharedCounter = 0;
+
+struct ContentionResult {
+    uint32_t totalWait;
+    uint32_t maxWait;
+    volatile bool done;
+};
+
+ContentionResult results[MAX_CONTENDING_THREADS];
+
+void contendForLock(ContentionResult* result) {
+    for(int i = 0; i < ACQUIRES_PER_THREAD; i++) {
+        auto requested = micros();
+        contendedLock.lock();
+        auto waited = micros() - requested;
+        // a little work while holding the lock, so that there is something to contend for.
+        for(int j = 0; j < 10; j++) sharedCounter = sharedCounter + 1;
+        contendedLock.unlock();
+
+        result->totalWait += waited;
+        if(waited > result->maxWait) result->maxWait = waited;
+    }
+    result->done = true;
+}
+
+#ifdef ESP32
+void contentionThread(void* param) {
+    contendForLock(static_cast<ContentionResult*>(param));
+    vTaskDelete(nullptr);
+}
+#endif
+
+void runContention(int threads) {
+    for(int i = 0; i < threads; i++) {
+        results[i].totalWait = 0;
+        results[i].maxWait = 0;
+        results[i].done = false;
+    }
+    auto runStarted = millis();
+
+#ifdef ESP32
+    for(int i = 0; i < threads; i++) {
+        xTaskCreatePinnedToCore(contentionThread, "contend", 2048, &results[i], 1, nullptr, i % 2);
+    }
+    for(int i = 0; i < threads; i++) {
+        while(!results[i].done) vTaskDelay(1);
+    }
+#elif defined(BUILD_FOR_HOSTED)
+    std::thread contenders[MAX_CONTENDING_THREADS];
+    for(int i = 0; i < threads; i++) {
+        contenders[i] = std::thread(contendForLock, &results[i]);
+    }
+    for(int i = 0; i < threads; i++) {
+        contenders[i].join();
+    }
+#else
+    // no threads on this board, so there is only ever one contender.
+    threads = 1;
+    contendForLock(&results[0]);
+#endif
+    auto runTook = millis() - runStarted;
+
+    uint32_t totalWait = 0;
+    uint32_t maxWait = 0;
+    for(int i = 0; i < threads; i++) {
+        totalWait += results[i].totalWait;
+        if(results[i].maxWait > maxWait) maxWait = results[i].maxWait;
+    }
+
+    Serial.print("Threads ");
+    Serial.print(threads);
+    Serial.print(", average acquire us ");
+    Serial.print(float(totalWait) / float(threads * ACQUIRES_PER_THREAD));
+    Serial.print(", max acquire us ");
+    Serial.print(maxWait);
+    Serial.print(", run took ms ");
+    Serial.println(runTook);
+}
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("SimpleSpinLock contention benchmark");
+
+    taskManager.scheduleOnce(100, [] {
+        for(int threads = 1; threads <= MAX_CONTENDING_THREADS; threads *= 2) {
+            runContention(threads);
+        }
+    });
+}
+
+void loop() {
+    taskManager.runLoop();
+}
@@ -0,0 +1,91 @@
+/**
+ * An example that shows how to use TmWorkerPool to split data parallel work, such as a DSP block or a batch of
+ * conversions, across more than one core. It also acts as a simple benchmark, timing the same array transform with
+ * only the calling thread, and then with a worker task manager running on the other core.
+ *
+ * On ESP32 a second task manager is run on core 0 using a FreeRTOS task, on single core boards there are no workers
+ * and the caller does all the work, so both timings should be about the same.
+ *
+ * There is a getting started guide including video available:
+ * https://www.thecoderscorner.com/products/arduino-libraries/taskmanager-io/
+ */
+
+#include <TaskManagerIO.h>
+#include <TmParallel.h>
+
+#ifdef __AVR__
+# define SAMPLE_COUNT 256
+#else
+# define SAMPLE_COUNT 8192
+#endif
+
+float inputSamples[SAMPLE_COUNT];
+float outputSamples[SAMPLE_COUNT];
+
+// the worker pool and the task manager that will run on the other core.
+TmWorkerPool workerPool;
+TmWorkerPool singleThreadPool;
+TaskManager workerTaskManager;
+
+#ifdef ESP32
+void workerThread(void*) {
+    while(true) {
+        workerTaskManager.runLoop();
+        // allow the idle task on this core to run, otherwise the watchdog triggers.
+        if(workerTaskManager.getFirstTask() == nullptr) vTaskDelay(1);
+    }
+}
+#endif
+
+void transformChunk(uint32_t begin, uint32_t end) {
+    for(auto i = begin; i < end; i++) {
+        outputSamples[i] = sinf(inputSamples[i]) * cosf(inputSamples[i] * 0.5F);
+    }
+}
+
+uint32_t timeTransform(TmWorkerPool& pool) {
+    auto started = micros();
+    for(int i = 0; i < 10; i++) {
+        pool.parallelFor(0, SAMPLE_COUNT, 256, transformChunk);
+    }
+    return micros() - started;
+}
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("Parallel for example starting");
+
+    for(int i = 0; i < SAMPLE_COUNT; i++) inputSamples[i] = float(i) * 0.01F;
+
+#ifdef ESP32
+    xTaskCreatePinnedToCore(workerThread, "tmWorker", 4096, nullptr, 1, nullptr, 0);
+    workerPool.addWorker(&workerTaskManager);
+#endif
+
+    taskManager.schedule(repeatSeconds(5), [] {
+        auto singleTime = timeTransform(singleThreadPool);
+        auto pooledTime = timeTransform(workerPool);
+
+        // reduce the output to a single value, summing each chunk and then the partial sums.
+        float total = workerPool.parallelReduce(0, SAMPLE_COUNT, 256, 0.0F, [](uint32_t begin, uint32_t end) {
+            float sum = 0.0F;
+            for(auto i = begin; i < end; i++) sum += outputSamples[i];
+            return sum;
+        }, [](float a, float b) { return a + b; });
+
+        Serial.print("Participants: ");
+        Serial.print(workerPool.getParticipantCount());
+        Serial.print(", caller only us: ");
+        Serial.print(singleTime);
+        Serial.print(", pooled us: ");
+        Serial.print(pooledTime);
+        Serial.print(", speedup: ");
+        Serial.print(float(singleTime) / float(pooledTime));
+        Serial.print(", total: ");
+        Serial.println(total);
+    });
+}
+
+void loop() {
+    taskManager.runLoop();
+}
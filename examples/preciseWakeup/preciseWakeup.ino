@@ -0,0 +1,110 @@
+/**
+ * An example that reports the dispatch jitter of a microsecond task, first when loop sleeps until the next task is due
+ * and then calls runLoop, and then with TmPreciseWakeup, which sleeps until just before the task is due and spins
+ * for the rest. For each, a task is scheduled every 2 milliseconds, and the time between each run and the one before
+ * is compared with 2 milliseconds. The average, 99th percentile and worst lateness are printed to serial, along with
+ * the margin that the precise wakeup calibrated itself to.
+ *
+ * In the hosted Linux build, see cmake/hosted, the sleep is usleep. On other boards it is delay for the whole
+ * milliseconds, which on RTOS based boards such as ESP32 is a sleep that ends on an RTOS tick, followed by
+ * delayMicroseconds for the rest.
+ *
+ * There is a getting started guide including video available:
+ * https://www.thecoderscorner.com/products/arduino-libraries/taskmanager-io/
+ */
+
+#include <TaskManagerIO.h>
+#include <TmPreciseWakeup.h>
+#if defined(BUILD_FOR_HOSTED)
+#include <unistd.h>
+#endif
+
+#define TASK_PERIOD_MICROS 2000UL
+#define JITTER_SAMPLES 250
+
+uint16_t lateness[JITTER_SAMPLES];
+volatile int samplesTaken = 0;
+uint32_t lastRun = 0;
+
+void sleepMicros(uint32_t sleepFor) {
+#if defined(BUILD_FOR_HOSTED)
+    usleep(sleepFor);
+#else
+    if(sleepFor >= 1000UL) delay(sleepFor / 1000UL);
+    if((sleepFor % 1000UL) != 0) delayMicroseconds(sleepFor % 1000UL);
+#endif
+}
+
+void recordRun() {
+    uint32_t now = micros();
+    // the first run has nothing to compare with
+    if(lastRun != 0 && samplesTaken < JITTER_SAMPLES) {
+        uint32_t late = (now - lastRun > TASK_PERIOD_MICROS) ? (now - lastRun - TASK_PERIOD_MICROS) : 0;
+        lateness[samplesTaken] = (late > 0xffffUL) ? 0xffff : uint16_t(late);
+        samplesTaken = samplesTaken + 1;
+    }
+    lastRun = now;
+}
+
+void printReport(const char* mode) {
+    // a simple insertion sort is plenty for this many samples, and needs no extra memory
+    for(int i = 1; i < JITTER_SAMPLES; i++) {
+        uint16_t value = lateness[i];
+        int j = i - 1;
+        while(j >= 0 && lateness[j] > value) {
+            lateness[j + 1] = lateness[j];
+            j--;
+        }
+        lateness[j + 1] = value;
+    }
+    uint32_t total = 0;
+    for(auto sample : lateness) total += sample;
+
+    Serial.print(mode);
+    Serial.print(", late us avg ");
+    Serial.print(total / JITTER_SAMPLES);
+    Serial.print(", median ");
+    Serial.print(lateness[JITTER_SAMPLES / 2]);
+    Serial.print(", p99 ");
+    Serial.print(lateness[(JITTER_SAMPLES * 99) / 100]);
+    Serial.print(", max ");
+    Serial.println(lateness[JITTER_SAMPLES - 1]);
+}
+
+taskid_t startMeasuring() {
+    samplesTaken = 0;
+    lastRun = 0;
+    return taskManager.scheduleFixedRate(TASK_PERIOD_MICROS, recordRun, TIME_MICROS);
+}
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("Dispatch jitter of a 2ms task");
+
+    // before: sleep until the next task is due, then run it
+    auto taskId = startMeasuring();
+    while(samplesTaken < JITTER_SAMPLES) {
+        sleepMicros(taskManager.microsToNextTask());
+        taskManager.runLoop();
+    }
+    taskManager.cancelTask(taskId);
+    printReport("sleep until due");
+
+    // after: sleep until a calibrated margin before it is due, then spin
+    TmPreciseWakeup preciseWakeup(sleepMicros);
+    taskId = startMeasuring();
+    while(samplesTaken < JITTER_SAMPLES) {
+        preciseWakeup.runLoop();
+    }
+    taskManager.cancelTask(taskId);
+    printReport("precise wakeup");
+
+    Serial.print("Calibrated margin us ");
+    Serial.print(preciseWakeup.getMarginMicros());
+    Serial.print(", late wakes ");
+    Serial.println(preciseWakeup.getLateWakeCount());
+}
+
+void loop() {
+    taskManager.runLoop();
+}
@@ -19,7 +19,7 @@ int counter = 0;
 
 // here we globally store the task ID of our repeating task, we need this to cancel it later.
 // ADVANCED: On supported 32 bit boards you could enable the lambda support and pass this to the other task.
-int taskId;
+taskid_t taskId;
 
 //
 // A simple logging function that logs the time and the log line.
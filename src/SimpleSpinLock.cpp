@@ -4,6 +4,50 @@
  */
 
 #include "SimpleSpinLock.h"
+#if defined(BUILD_FOR_HOSTED)
+#include <time.h>
+#endif
+
+#define TM_LOCK_BACK_OFF_MICROS 50
+
+/**
+ * Tells the CPU that we are in a spin wait, on cores that support it this saves power and frees the pipeline for the
+ * other hardware thread, elsewhere it does nothing.
+ */
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || (defined(__ARM_ARCH) && __ARM_ARCH >= 7)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+#if defined(ESP32)
+SimpleSpinLock::SimpleSpinLock() {
+    parkSemaphore = xSemaphoreCreateBinaryStatic(&parkBuffer);
+#elif defined(TM_LOCK_CAN_PARK) && !defined(BUILD_FOR_HOSTED)
+SimpleSpinLock::SimpleSpinLock() : parkSemaphore(0, 1) {
+#else
+SimpleSpinLock::SimpleSpinLock() {
+#endif
+#if defined(BUILD_FOR_HOSTED)
+    sem_init(&parkSemaphore, 0, 0);
+#endif
+#ifdef TM_LOCK_CAN_PARK
+    tm_internal::atomicWriteCounter(&parkedWaiters, 0);
+#endif
+    initiatingTask = nullptr;
+    locked = false;
+    count = 0;
+}
+
+SimpleSpinLock::~SimpleSpinLock() {
+#if defined(ESP32)
+    vSemaphoreDelete(parkSemaphore);
+#elif defined(BUILD_FOR_HOSTED)
+    sem_destroy(&parkSemaphore);
+#endif
+}
 
 bool SimpleSpinLock::tryLock() {
 #if defined(IOA_MULTITHREADED)
@@ -15,26 +59,86 @@ bool SimpleSpinLock::tryLock() {
 #endif
 }
 
+bool SimpleSpinLock::tryAcquire() {
+    // test before the swap, so that spinning waiters only read the flag and do not fight over the cache line.
+    if(tm_internal::atomicReadBool(&locked) || !tm_internal::atomicSwapBool(&locked, false, true)) return false;
+
+    tm_internal::atomicWritePtr(&initiatingTask, taskManager.getRunningTask());
+#if defined(IOA_MULTITHREADED)
+    currentThread = (void*)getCurrentThreadId();
+#endif
+    return true;
+}
+
+void SimpleSpinLock::backOff(unsigned long maxMicros) {
+    // a task on the task manager thread keeps other tasks running while it waits
+    if(taskManager.getRunningTask() != nullptr && taskManager.isRunLoopThread()) {
+        taskManager.yieldForMicros(TM_LOCK_BACK_OFF_MICROS);
+        return;
+    }
+
+#ifdef TM_LOCK_CAN_PARK
+    // say that we are waiting before the last check, so that an unlock after it is sure to see us and give the
+    // semaphore, which then stays given until we take it, so the wakeup cannot be lost.
+    tm_internal::atomicAddCounter(&parkedWaiters, 1);
+    if(!tm_internal::atomicReadBool(&locked)) {
+        tm_internal::atomicAddCounter(&parkedWaiters, -1);
+        return;
+    }
+
+    if(maxMicros > TM_LOCK_PARK_MAX_MICROS) maxMicros = TM_LOCK_PARK_MAX_MICROS;
+# if defined(ESP32)
+    TickType_t ticks = pdMS_TO_TICKS((maxMicros + 999UL) / 1000UL);
+    xSemaphoreTake(parkSemaphore, ticks != 0 ? ticks : 1);
+# elif defined(BUILD_FOR_HOSTED)
+    timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += long(maxMicros) * 1000L;
+    if(until.tv_nsec >= 1000000000L) {
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec = until.tv_nsec % 1000000000L;
+    }
+    sem_timedwait(&parkSemaphore, &until);
+# else
+    parkSemaphore.try_acquire_for(rtos::Kernel::Clock::duration_u32((maxMicros + 999UL) / 1000UL));
+# endif
+    tm_internal::atomicAddCounter(&parkedWaiters, -1);
+#else
+    (void)maxMicros;
+    delayMicroseconds(TM_LOCK_BACK_OFF_MICROS);
+#endif // TM_LOCK_CAN_PARK
+}
+
 bool SimpleSpinLock::spinLock(unsigned long iterations) {
     if(tryLock()) {
         ++count;
         return true;
     }
 
-    // otherwise we contend to get the lock in a spin wait until we exhaust the micros provided.
-    while(iterations) {
-        if (tm_internal::atomicSwapBool(&locked, false, true)) {
-            tm_internal::atomicWritePtr(&initiatingTask, taskManager.getRunningTask());
-#if defined(IOA_MULTITHREADED)
-            currentThread = (void*)getCurrentThreadId();
-#endif
+    // first spin for a short time, as the lock is usually released quickly, then back off or park between attempts
+    // until the iterations are used up.
+    for(int spin = 0; spin < TM_LOCK_SPIN_COUNT; spin++) {
+        if(tryAcquire()) {
             ++count;
             return true;
         }
-        else {
-            delayMicroseconds(50);
+        cpuRelax();
+    }
+
+    while(iterations) {
+        auto backOffStarted = micros();
+        bool longWait = iterations > (0xffffffffUL / TM_LOCK_BACK_OFF_MICROS);
+        backOff(longWait ? 0xffffffffUL : iterations * TM_LOCK_BACK_OFF_MICROS);
+
+        if(tryAcquire()) {
+            ++count;
+            return true;
         }
-        --iterations;
+
+        // a back off can last much longer than an iteration, for example while parked, so count the time actually spent.
+        unsigned long waited = (micros() - backOffStarted) / TM_LOCK_BACK_OFF_MICROS;
+        if(waited == 0) waited = 1;
+        iterations = (waited >= iterations) ? 0 : iterations - waited;
     }
 
     return false;
@@ -49,12 +153,23 @@ void SimpleSpinLock::unlock() {
 
     if(count == 0) {
         tm_internal::atomicWritePtr(&initiatingTask, nullptr);
-        tm_internal::atomicWriteBool(&locked, false);
-
 #if defined(IOA_MULTITHREADED)
         currentThread = nullptr;
 #endif
-
+        tm_internal::atomicWriteBool(&locked, false);
+#ifdef TM_LOCK_CAN_PARK
+        // only a waiter that has parked, or is about to, needs waking, so an uncontended unlock costs one read here.
+        if(tm_internal::atomicReadCounter(&parkedWaiters) != 0) {
+# if defined(ESP32)
+            xSemaphoreGive(parkSemaphore);
+# elif defined(BUILD_FOR_HOSTED)
+            // the semaphore counts, keep it at most one like the binary ones, an extra wakeup would only cost a retry.
+            int value = 0;
+            if(sem_getvalue(&parkSemaphore, &value) != 0 || value == 0) sem_post(&parkSemaphore);
+# else
+            parkSemaphore.release();
+# endif
+        }
+#endif // TM_LOCK_CAN_PARK
     }
 }
-
@@ -8,11 +8,47 @@
 
 #include "TaskManagerIO.h"
 
+//
+// The number of times the lock is retried with a CPU relax hint before a waiter backs off, an uncontended handoff is
+// nearly always picked up within this window. Define it yourself to change.
+//
+#ifndef TM_LOCK_SPIN_COUNT
+#define TM_LOCK_SPIN_COUNT 64
+#endif
+
+//
+// Where there is an RTOS, waiters that have spun without getting the lock park on a semaphore that unlock gives
+// whenever there are waiters, rather than polling.
+//
+#if defined(ESP32) || defined(ARDUINO_MBED_MODE) || (defined(IOA_USE_MBED) && !defined(PIO_NEEDS_RTOS_WORKAROUND)) || defined(BUILD_FOR_HOSTED)
+# define TM_LOCK_CAN_PARK
+# if defined(ESP32)
+#  include <freertos/semphr.h>
+# elif defined(BUILD_FOR_HOSTED)
+#  include <semaphore.h>
+# endif
+#endif
+
+//
+// The longest a parked waiter sleeps before it checks the lock again itself, in case a wakeup went to another waiter
+// that then did not take the lock. Define it yourself to change.
+//
+#ifndef TM_LOCK_PARK_MAX_MICROS
+#define TM_LOCK_PARK_MAX_MICROS 10000UL
+#endif
+
 /**
  * A very simple lock that can be used to provide a very simple mutex like behaviour based on task manager
  * atomic constructs. It has the ability to try and spin lock, and also to fully lock in conjunction with
- * TaskMgrLock class. Use only for activities that do not take very long, it cannot relinquish control to
- * task manager, it freezes the bus when locked. You must never call yieldForMicros while locked.
+ * TaskMgrLock class. Use only for activities that do not take very long. You must never call yieldForMicros while
+ * locked.
+ *
+ * Waiting is spin then park, the lock is first retried for a short time with a CPU relax hint, as it is usually
+ * released quickly. When the waiter is a task on the task manager thread, it then backs off by calling yieldForMicros
+ * so other tasks can still run. Otherwise, on ESP32, mbed and the hosted build the waiter parks on a semaphore, it
+ * uses no CPU until unlock gives the semaphore, which unlock only does when there are waiters. On other boards the
+ * waiter delays for 50 micros between attempts. A woken waiter still has to take the lock, so the lock is not fair,
+ * a thread that arrives just as it is released can take it first.
  */
 class SimpleSpinLock {
 private:
@@ -22,15 +58,30 @@ private:
 #endif
     tm_internal::TmAtomicBool locked;
     volatile uint8_t count;
+#ifdef TM_LOCK_CAN_PARK
+    tm_internal::TmAtomicCounter parkedWaiters;
+# if defined(ESP32)
+    StaticSemaphore_t parkBuffer;
+    SemaphoreHandle_t parkSemaphore;
+# elif defined(BUILD_FOR_HOSTED)
+    sem_t parkSemaphore;
+# else
+    rtos::Semaphore parkSemaphore;
+# endif
+#endif // TM_LOCK_CAN_PARK
+
+    bool tryAcquire();
+    void backOff(unsigned long maxMicros);
 public:
     /**
      * Construct a lock that represents this object
      */
-    SimpleSpinLock() {
-        initiatingTask = nullptr;
-        locked = false;
-        count = 0;
-    }
+    SimpleSpinLock();
+
+    SimpleSpinLock(const SimpleSpinLock&) = delete;
+    SimpleSpinLock& operator=(const SimpleSpinLock&) = delete;
+
+    ~SimpleSpinLock();
 
     /**
      * Take the lock waiting the longest possible time for it to become available.
@@ -46,8 +97,9 @@ public:
     bool tryLock();
 
     /**
-     * Attempt to take the lock using a spin wait, it only returns true if the lock was taken.
-     * @param number of iterations to wait, each iteration is at least 100 mics
+     * Attempt to take the lock, spinning briefly and then backing off or parking, it only returns true if the lock was
+     * taken.
+     * @param number of iterations to wait, each iteration is about 50 micros of waiting time
      * @return true if the lock was taken, otherwise false
      */
     bool spinLock(unsigned long iterations);
@@ -17,19 +17,31 @@
 /**
  * This is an internal class, and users of the library generally don't see it.
  *
- * Task manager can never deallocate memory that it has already allocated for tasks, this is in order to make thread
- * safety much easier. Given this we allocate tasks in blocks of DEFAULT_TASK_SIZE and each tranche contains it's start
- * and end point in the "array". DEFAULT task size is set to 20 on 32 bit hardware where the size is negligible, 10
- * on MEGA2560 and all other AVR boards default to 6. We allow up to 8 tranches on AVR and up to 16 on 32 bit boards.
- * This should provide more than enough tasks for most boards.
+ * Task blocks never move in memory once allocated, this is in order to make thread safety much easier. Given this we
+ * allocate tasks in blocks of DEFAULT_TASK_SIZE and each tranche contains it's start and end point in the "array".
+ * DEFAULT task size is set to 16 on 32 bit hardware where the size is negligible, 12 on MEGA2560 and all other AVR
+ * boards default to 6. Up to TM_MAX_TASK_BLOCKS tranches are allocated as needed.
+ *
+ * A block at the end that has no tasks in use can be marked as retiring, after which nothing more is allocated from
+ * it. Only after it has stayed empty while retiring for long enough is it removed, see TaskManager::reclaimEmptyBlocks.
+ * A block that replaces a removed one starts each slot at a generation the old block never reached, so task IDs from
+ * the removed block don't match a task in the new one until the generation wraps, after 256 reuses of a slot on AVR
+ * and 65536 elsewhere, see taskid_t.
  */
 class TaskBlock {
 private:
     TimerTask tasks[DEFAULT_TASK_SIZE];
     const taskid_t first;
     const taskid_t tasksSize;
+    const taskid_t generationBase;
+    volatile bool retiring;
+    unsigned long retiringSince;
 public:
-    explicit TaskBlock(taskid_t first_) : first(first_), tasksSize(DEFAULT_TASK_SIZE) {}
+    explicit TaskBlock(taskid_t first_, taskid_t generationBase_ = 0) : first(first_), tasksSize(DEFAULT_TASK_SIZE),
+                                                                     generationBase(generationBase_), retiring(false),
+                                                                     retiringSince(0) {
+        for(auto& task : tasks) task.setGeneration(generationBase);
+    }
 
     /**
      * Checks if taskId is contained within this block
@@ -44,21 +56,85 @@ public:
         return isTaskContained(task) ? &tasks[task - first] : nullptr;
     }
 
-    void clearAll() {
+    /**
+     * Gets the ID of a task that is within this block
+     * @param task the task to find
+     * @return the task ID or TASKMGR_INVALIDID if it is not contained in this block
+     */
+    taskid_t getTaskId(const TimerTask* task) const {
+        return (task >= tasks && task < (tasks + tasksSize)) ? taskid_t(first + (task - tasks)) : TASKMGR_INVALIDID;
+    }
+
+    /**
+     * Frees every task in the block, apart from any that another thread is still working on through its ID, they are
+     * left retiring for task manager to finish freeing, see TimerTask::retireHandle.
+     * @return the number of tasks left retiring
+     */
+    taskid_t clearAll() {
+        taskid_t stillRetiring = 0;
         for(taskid_t i=0; i<tasksSize;i++) {
-            tasks[i].clear();
+            if(!tasks[i].isInUse() || tasks[i].isRetiring()) continue;
+            if(tasks[i].retireHandle()) {
+                tasks[i].clear();
+            }
+            else {
+                stillRetiring++;
+            }
         }
+        return stillRetiring;
     }
 
     taskid_t allocateTask() {
+        if(retiring) return TASKMGR_INVALIDID;
         for(taskid_t i=0; i<tasksSize; i++) {
             if(tasks[i].allocateIfPossible()) {
+                // the block may have started retiring while we were allocating, if so give the slot back
+                if(retiring) {
+                    tasks[i].clear();
+                    return TASKMGR_INVALIDID;
+                }
                 return i + first;
             }
         }
         return TASKMGR_INVALIDID;
     }
 
+    /**
+     * @return true if none of the tasks in this block are in use
+     */
+    bool isEmpty() {
+        for(taskid_t i=0; i<tasksSize; i++) {
+            if(tasks[i].isInUse()) return false;
+        }
+        return true;
+    }
+
+    bool isRetiring() const { return retiring; }
+
+    void setRetiring(bool retire) {
+        if(retire && !retiring) retiringSince = millis();
+        retiring = retire;
+    }
+
+    /**
+     * @return the number of milliseconds since the block was marked as retiring, only valid while it is retiring
+     */
+    unsigned long millisRetiring() const { return millis() - retiringSince; }
+
+    /**
+     * Works out the generation that slots in a block replacing this one should start at, it is one past the furthest
+     * any slot in this block has moved on from the base this block started with.
+     * @return the generation base for the block that replaces this one
+     */
+    taskid_t nextGenerationBase() const {
+        taskid_t furthest = 0;
+        for(taskid_t i=0; i<tasksSize; i++) {
+            auto moved = taskid_t(tasks[i].getGeneration() - generationBase) & TM_TASK_GENERATION_MASK;
+            if(moved > furthest) furthest = moved;
+        }
+        return taskid_t(generationBase + furthest + 1) & TM_TASK_GENERATION_MASK;
+    }
+
     taskid_t lastSlot() const {
         return first + tasksSize - 1;
     }
@@ -6,6 +6,7 @@
 #include "TaskPlatformDeps.h"
 #include "TaskManagerIO.h"
 #include "ExecWithParameter.h"
+#include "TmClockSource.h"
 #include <IoLogging.h>
 
 #ifdef BUILD_FOR_PICO_CMAKE
@@ -23,6 +24,27 @@ void yield() {
 }
 #endif
 
+#ifdef BUILD_FOR_HOSTED
+#include <sched.h>
+#include <time.h>
+
+void yield() {
+    sched_yield();
+}
+
+uint32_t millis() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint32_t((uint64_t(ts.tv_sec) * 1000ULL) + (uint64_t(ts.tv_nsec) / 1000000ULL));
+}
+
+uint32_t micros() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint32_t((uint64_t(ts.tv_sec) * 1000000ULL) + (uint64_t(ts.tv_nsec) / 1000ULL));
+}
+#endif
+
 #ifdef IOA_USE_MBED
 
 void yield() {
@@ -35,36 +57,142 @@ void yield() {
 }
 #endif
 
+// every slot must fit in the slot part of a task ID, leaving the highest value unused so no ID can be invalid.
+static_assert((TM_MAX_TASK_BLOCKS * DEFAULT_TASK_SIZE) < TM_TASK_SLOT_MASK, "too many task slots for taskid_t");
 
 TaskManager taskManager;
 
-class TmSpinLock {
+//
+// The number of times a waiter checks the ticket lock before it starts to yield between checks, define it yourself to
+// change it.
+//
+#ifndef TM_TICKET_SPIN_COUNT
+#define TM_TICKET_SPIN_COUNT 100
+#endif
+
+//
+// The number of times a waiter yields before it sleeps for a tick between checks instead, see TmSpinLock for why.
+// Define it yourself to change it.
+//
+#ifndef TM_TICKET_YIELD_COUNT
+#define TM_TICKET_YIELD_COUNT 100
+#endif
+
+/**
+ * Gives way to other threads for a while, on an RTOS this lets threads of lower priority run too, which yield does not.
+ */
+static void ticketLockSleep() {
+#if defined(ESP32)
+    vTaskDelay(1);
+#elif defined(ARDUINO_MBED_MODE)
+    rtos::ThisThread::sleep_for(std::chrono::milliseconds(1));
+#elif defined(IOA_USE_MBED) && !defined(PIO_NEEDS_RTOS_WORKAROUND)
+    ThisThread::sleep_for(std::chrono::milliseconds(1));
+#elif defined(BUILD_FOR_HOSTED)
+    delayMicroseconds(1000);
+#else
+    // no RTOS, so there are no priorities to invert.
+    yield();
+#endif
+}
+
+TmSpinLock::TmSpinLock(tm_internal::TmTicketLock* toLockOn) : lockObject(toLockOn) {
+    ticket = uint32_t(tm_internal::atomicAddCounter(&lockObject->nextTicket, 1) - 1);
+    if(tm_internal::atomicReadCounter(&lockObject->nowServing) == ticket) return;
+
+    // contended, so we time the wait, the clock is only read when we actually have to wait.
+    auto waitStarted = micros();
+    int count = 0;
+    while(tm_internal::atomicReadCounter(&lockObject->nowServing) != ticket) {
+        if(count > TM_TICKET_SPIN_COUNT + TM_TICKET_YIELD_COUNT) {
+            ticketLockSleep();
+        }
+        else if(++count > TM_TICKET_SPIN_COUNT) {
+            yield(); // something else has the lock, let it get control to finish up!
+            if(count > TM_TICKET_SPIN_COUNT + TM_TICKET_YIELD_COUNT) serlogF(SER_WARNING, "TM lock wait, sleeping");
+        }
+    }
+
+    uint32_t waited = micros() - waitStarted;
+    tm_internal::atomicAddCounter(&lockObject->contendedCount, 1);
+    uint32_t maxWait;
+    do {
+        maxWait = tm_internal::atomicReadCounter(&lockObject->maxWaitMicros);
+    } while(waited > maxWait && !tm_internal::atomicSwapCounter(&lockObject->maxWaitMicros, maxWait, waited));
+}
+
+/**
+ * Registers a call that looks through the task blocks without holding the block lock, for as long as it exists. Blocks
+ * taken out of use are only freed while there are no readers, so a reader that found a block before it was taken out
+ * of use is always finished with it first, see TaskManager::reclaimEmptyBlocks.
+ */
+class TmBlockReader {
 private:
-    tm_internal::TmAtomicBool* lockObject;
+    TaskManager* tm;
 public:
-    explicit TmSpinLock(tm_internal::TmAtomicBool* toLockOn) : lockObject(toLockOn) {
-        bool locked;
-        int count = 0;
-        do {
-            locked = tm_internal::atomicSwapBool(lockObject, false, true);
-            if(!locked) {
-                yield(); // something else has the lock, let it get control to finish up!
-                if(++count == 1000) serlogF(SER_WARNING, "TM spin>1000");
-            }
-        } while(!locked);
+    explicit TmBlockReader(TaskManager* tm) : tm(tm) {
+        tm_internal::atomicAddCounter(&tm->blockReaders, 1);
     }
 
-    ~TmSpinLock() {
-        if(!tm_internal::atomicSwapBool(lockObject, true, false)) {
-            serlogF(SER_ERROR, "TM lock fail");
-        }
+    ~TmBlockReader() {
+        tm_internal::atomicAddCounter(&tm->blockReaders, -1);
+    }
+};
+
+/**
+ * Holds a task for the duration of a call made with its task ID, so that it cannot be freed meanwhile. When the ID no
+ * longer matches, get returns nullptr and the call does nothing, see TimerTask::acquireHandle. The block that holds
+ * the task cannot be freed meanwhile either.
+ */
+class TaskHandleHolder {
+private:
+    TaskManager* tm;
+    TmBlockReader reader;
+    TimerTask* task;
+    bool current;
+public:
+    TaskHandleHolder(TaskManager* tm, taskid_t taskId) : tm(tm), reader(tm),
+                                                         task(tm->getTaskInSlot(tmSlotOfTaskId(taskId))), current(false) {
+        if(task != nullptr) current = task->acquireHandle(tmGenerationOfTaskId(taskId));
     }
+
+    ~TaskHandleHolder() {
+        // if the task was freed meanwhile, task manager finishes freeing it once it deals with interrupts.
+        if(task != nullptr && task->releaseHandle()) tm->interrupted = true;
+    }
+
+    TimerTask* get() { return current ? task : nullptr; }
 };
 
+static void initialiseTicketLock(tm_internal::TmTicketLock& lock) {
+    tm_internal::atomicWriteCounter(&lock.nextTicket, 0);
+    tm_internal::atomicWriteCounter(&lock.nowServing, 0);
+    tm_internal::atomicWriteCounter(&lock.contendedCount, 0);
+    tm_internal::atomicWriteCounter(&lock.maxWaitMicros, 0);
+}
 
 ISR_ATTR void TaskManager::markInterrupted(pintype_t interruptNo) {
-	taskManager.lastInterruptTrigger = interruptNo;
-	taskManager.interrupted = true;
+	taskManager.queueInterrupt(interruptNo);
+}
+
+ISR_ATTR void TaskManager::queueInterrupt(pintype_t interruptNo) {
+    // reserve a position in the ring, the head only moves forward if there is space between it and the tail.
+    uint32_t head;
+    do {
+        head = tm_internal::atomicReadCounter(&interruptQueueHead);
+        if((head - tm_internal::atomicReadCounter(&interruptQueueTail)) >= TM_INTERRUPT_QUEUE_SIZE) {
+            tm_internal::atomicAddCounter(&interruptOverflows, 1);
+            interrupted = true;
+            return;
+        }
+    } while(!tm_internal::atomicSwapCounter(&interruptQueueHead, head, head + 1));
+
+    // now we own the record, fill it in and then mark it ready for task manager to read.
+    auto& record = interruptQueue[head & (TM_INTERRUPT_QUEUE_SIZE - 1U)];
+    record.pin = interruptNo;
+    record.microsAtInterrupt = micros();
+    tm_internal::atomicWriteBool(&record.ready, true);
+    interrupted = true;
 }
 
 TaskManager::TaskManager() : taskBlocks {} {
@@ -74,50 +202,91 @@ TaskManager::TaskManager() : taskBlocks {} {
 	interrupted = false;
 	tm_internal::atomicWritePtr(&first, nullptr);
 	interruptCallback = nullptr;
-	lastInterruptTrigger = 0;
+	timedInterruptCallback = nullptr;
+	for(auto& record : interruptQueue) {
+	    record.pin = 0;
+	    record.microsAtInterrupt = 0;
+	    tm_internal::atomicWriteBool(&record.ready, false);
+	}
+	tm_internal::atomicWriteCounter(&interruptQueueHead, 0);
+	tm_internal::atomicWriteCounter(&interruptQueueTail, 0);
+	tm_internal::atomicWriteCounter(&interruptOverflows, 0);
 	taskBlocks[0] = new TaskBlock(0);
 	numberOfBlocks = 1;
+	reservedBlocks = 1;
+	for(auto& base : blockGenerations) base = 0;
+	tm_internal::atomicWriteCounter(&blockReaders, 0);
+	tm_internal::atomicWriteCounter(&slotsInUse, 0);
+	tm_internal::atomicWriteCounter(&peakSlotsInUse, 0);
 	runningTask = nullptr;
-	tm_internal::atomicWriteBool(&memLockerFlag, false);
+	tm_internal::atomicWriteCounter(&runningTaskStarted, 0);
+	yieldDepth = 0;
+	maxYieldDepth = TM_DEFAULT_MAX_YIELD_DEPTH;
+	overloadPolicy = TmOverloadPolicy { 0, 0, TM_SHED_SKIP, 2, 10000UL, 0 };
+	overloaded = false;
+	recovering = false;
+	recoveringSince = 0;
+	utilizationEstimate = 0;
+#ifndef TM_NO_UTILIZATION_ACCOUNTING
+	busyMicros = 0;
+	yieldedMicros = 0;
+	utilizationSampleStart = 0;
+	utilizationSampleBusy = 0;
+#endif
+	overloadEpisodes = 0;
+	shedExecutions = 0;
+#if defined(IOA_MULTITHREADED)
+	runLoopThread = nullptr;
+#endif
+	initialiseTicketLock(blockLock);
+	initialiseTicketLock(queueLock);
 }
 
 TaskManager::~TaskManager() {
-    for(taskid_t i=0; i<numberOfBlocks; i++) {
-        delete taskBlocks[i];
+    // this includes any blocks that have been taken out of use but are not yet freed
+    for(auto block : taskBlocks) {
+        delete block;
     }
 }
 
 taskid_t TaskManager::findFreeTask() {
+    TmBlockReader reader(this);
     int retries = 0;
     while(retries < 100) {
         for (taskid_t i=0; i<numberOfBlocks;i++) {
-            auto taskId = taskBlocks[i]->allocateTask();
-            if(taskId != TASKMGR_INVALIDID) {
-                serlogF2(SER_IOA_DEBUG, "TM alloc", taskId);
+            auto slot = taskBlocks[i]->allocateTask();
+            if(slot != TASKMGR_INVALIDID) {
+                serlogF2(SER_IOA_DEBUG, "TM alloc", slot);
+                auto taskId = tmMakeTaskId(slot, taskBlocks[i]->getContainedTask(slot)->getGeneration());
+                auto inUse = tm_internal::atomicAddCounter(&slotsInUse, 1);
+                auto peak = tm_internal::atomicReadCounter(&peakSlotsInUse);
+                while(inUse > peak && !tm_internal::atomicSwapCounter(&peakSlotsInUse, peak, inUse)) {
+                    peak = tm_internal::atomicReadCounter(&peakSlotsInUse);
+                }
                 return taskId;
             }
         }
 
-        // already full, cannot allocate further.
-        if(numberOfBlocks == DEFAULT_TASK_BLOCKS) {
-            serlogF(SER_ERROR, "TM full");
-            return TASKMGR_INVALIDID;
-        }
-
-        // now we need to take an atomic lock memLockerFlag before proceeding to ensure nobody else is allocating tasks
-        // if two threads come here at once, only one will be able to enter the allocate block, the other will go into
-        // the else block and let other tasks run for a while and then loop again
+        // now we need to take the block lock before proceeding to ensure nobody else is allocating blocks, this is a
+        // separate lock to the queue, so scheduling on other threads carries on. If two threads come here at once,
+        // the second waits, and then finds the block that the first added, so it tries to allocate from it again.
         {
-            TmSpinLock spinLock(&memLockerFlag);
-            auto nextIdSpace = taskBlocks[numberOfBlocks - 1]->lastSlot() + 1;
-            taskBlocks[numberOfBlocks] = new TaskBlock(nextIdSpace);
-            if(taskBlocks[numberOfBlocks] != nullptr) {
-                serlogF2(SER_IOA_DEBUG, "TM alloc: ", numberOfBlocks);
-                numberOfBlocks++;
+            auto blocksBefore = numberOfBlocks;
+            TmSpinLock spinLock(&blockLock);
+            if(numberOfBlocks != blocksBefore) continue;
+
+            // blocks that are retiring still have room, so use them again before adding any more.
+            bool anyRetiring = false;
+            for(taskid_t i=0; i<numberOfBlocks; i++) {
+                if(taskBlocks[i]->isRetiring()) {
+                    taskBlocks[i]->setRetiring(false);
+                    anyRetiring = true;
+                }
             }
-            else {
+
+            if(!anyRetiring && !addTaskBlock()) {
                 serlogF(SER_ERROR, "TM full");
-                break;  // no point to continue here, new has failed.
+                break;  // no point to continue here, either at the limit or new has failed.
             }
         }
 
@@ -128,6 +297,91 @@ taskid_t TaskManager::findFreeTask() {
 	return TASKMGR_INVALIDID;
 }
 
+bool TaskManager::addTaskBlock() {
+    if(numberOfBlocks == TM_MAX_TASK_BLOCKS) return false;
+
+    // a block that was taken out of use but not yet freed can go straight back into use, it has the right ID space
+    if(taskBlocks[numberOfBlocks] == nullptr) {
+        auto nextIdSpace = taskBlocks[numberOfBlocks - 1]->lastSlot() + 1;
+        taskBlocks[numberOfBlocks] = new TaskBlock(nextIdSpace, blockGenerations[numberOfBlocks]);
+        if(taskBlocks[numberOfBlocks] == nullptr) return false;
+    }
+    taskBlocks[numberOfBlocks]->setRetiring(false);
+    serlogF2(SER_IOA_DEBUG, "TM alloc: ", numberOfBlocks);
+    numberOfBlocks++;
+    return true;
+}
+
+bool TaskManager::reserve(taskid_t slots) {
+    TmSpinLock spinLock(&blockLock);
+    while(getSlotCapacity() < slots) {
+        if(!addTaskBlock()) {
+            serlogF(SER_ERROR, "TM reserve failed");
+            break;
+        }
+    }
+    if(numberOfBlocks > reservedBlocks) reservedBlocks = numberOfBlocks;
+    return getSlotCapacity() >= slots;
+}
+
+taskid_t TaskManager::reclaimEmptyBlocks(unsigned long emptyForMillis) {
+    TmSpinLock spinLock(&blockLock);
+
+    // working back from the end, take retiring blocks that have stayed empty for long enough out of use, and mark
+    // empty blocks as retiring. The first block that is in use stops this, it and all blocks before it stay in use.
+    bool stillEmpty = true;
+    for(taskid_t i=numberOfBlocks; i > 0; i--) {
+        auto block = taskBlocks[i - 1];
+        if(stillEmpty && i > reservedBlocks && block->isEmpty()) {
+            if(block->isRetiring() && i == numberOfBlocks && block->millisRetiring() >= emptyForMillis) {
+                numberOfBlocks = i - 1;
+            }
+            else {
+                block->setRetiring(true);
+            }
+        }
+        else {
+            stillEmpty = false;
+            block->setRetiring(false);
+        }
+    }
+
+    // blocks out of use can only be freed when no other thread is looking through the blocks, as it may have found
+    // one of them before it was taken out of use. Readers that start after this only see the blocks still in use. If
+    // there are readers, the blocks are freed on a later call instead. Each block remembers how far its generations
+    // got, so that IDs from it don't match tasks in a block created later in its place until the generation wraps.
+    taskid_t freed = 0;
+    if(tm_internal::atomicAddCounter(&blockReaders, 0) == 0) {
+        for(taskid_t i=numberOfBlocks; i<TM_MAX_TASK_BLOCKS && taskBlocks[i] != nullptr; i++) {
+            blockGenerations[i] = taskBlocks[i]->nextGenerationBase();
+            delete taskBlocks[i];
+            taskBlocks[i] = nullptr;
+            freed++;
+        }
+    }
+
+    if(freed != 0) serlogF2(SER_IOA_DEBUG, "TM reclaimed: ", freed);
+    return freed;
+}
+
+void TaskManager::freeTask(TimerTask* task) {
+    auto canFree = task->retireHandle();
+    removeFromQueue(task);
+    if(!canFree) return; // another thread is working on it through its ID, see finishRetiredTask
+
+    task->clear();
+    tm_internal::atomicAddCounter(&slotsInUse, -1);
+}
+
+void TaskManager::finishRetiredTask(TimerTask* task) {
+    if(!task->finishRetiring()) return;
+
+    // the other thread may have put the task back into the queue before it saw that the ID no longer matched.
+    removeFromQueue(task);
+    task->clear();
+    tm_internal::atomicAddCounter(&slotsInUse, -1);
+}
+
 taskid_t TaskManager::scheduleOnce(uint32_t when, TimerFn timerFunction, TimerUnit timeUnit) {
 	auto taskId = findFreeTask();
 	if (taskId != TASKMGR_INVALIDID) {
@@ -148,6 +402,18 @@ taskid_t TaskManager::scheduleFixedRate(uint32_t when, TimerFn timerFunction, Ti
 	return taskId;
 }
 
+#ifdef TM_ALLOW_CAPTURED_LAMBDA
+taskid_t TaskManager::scheduleFunctionPointer(uint32_t when, TimerFnPointer timerFunction, TimerUnit timeUnit, bool repeating) {
+    auto taskId = findFreeTask();
+    if (taskId != TASKMGR_INVALIDID) {
+        auto task = getTask(taskId);
+        task->initialise(when, timeUnit, timerFunction, repeating);
+        putItemIntoQueue(task);
+    }
+    return taskId;
+}
+#endif // TM_ALLOW_CAPTURED_LAMBDA
+
 taskid_t TaskManager::scheduleOnce(uint32_t when, Executable* execRef, TimerUnit timeUnit, bool deleteWhenDone) {
 	auto taskId = findFreeTask();
 	if (taskId != TASKMGR_INVALIDID) {
@@ -179,69 +445,209 @@ taskid_t TaskManager::registerEvent(BaseEvent *eventToAdd, bool deleteWhenDone)
 }
 
 void TaskManager::setTaskEnabled(taskid_t taskId, bool ena) {
-    auto task = getTask(taskId);
-    if(task == nullptr || !task->isInUse()) return;
+    TaskHandleHolder holder(this, taskId);
+    auto task = holder.get();
+    if(task == nullptr) return;
 
     task->setEnabled(ena);
 
     if(ena) putItemIntoQueue(task);
 }
 
+bool TaskManager::rescheduleTask(taskid_t taskId, const TimePeriod& when) {
+    TaskHandleHolder holder(this, taskId);
+    auto task = holder.get();
+    if(task == nullptr || task->isEvent()) return false;
+
+#if defined(IOA_MULTITHREADED)
+    if(!isRunLoopThread()) {
+        // the schedule and flags are only ever changed on the task manager thread, so the change is left in the task
+        // for task manager to apply when it deals with interrupts. If the task finishes first, the change is dropped.
+        task->setPendingSchedule(sched_t(when.getAmount()), when.getUnit(), when.getRepeating());
+        interrupted = true;
+        return true;
+    }
+#endif // IOA_MULTITHREADED
+
+    applySchedule(task, sched_t(when.getAmount()), when.getUnit(), when.getRepeating());
+    return true;
+}
+
+void TaskManager::applySchedule(TimerTask* task, sched_t when, TimerUnit unit, bool repeating) {
+    if(!task->isRunning()) {
+        removeFromQueue(task);
+        task->changeSchedule(when, unit, repeating);
+        putItemIntoQueue(task);
+    }
+    else {
+        // the loop puts it back into the queue when it finishes running. Until then it is still in the queue, where
+        // other threads adding tasks read its schedule, so it is changed with the queue lock held.
+        TmSpinLock spinLock(&queueLock);
+        task->changeSchedule(when, unit, repeating);
+        task->markRescheduled();
+    }
+}
+
+bool TaskManager::rescheduleRunningTask(const TimePeriod& when) {
+    auto task = getRunningTask();
+    if(task == nullptr) return false;
+    return rescheduleTask(getTaskId(task), when);
+}
+
+void TaskManager::setTaskLabel(taskid_t taskId, const char* label) {
+    TaskHandleHolder holder(this, taskId);
+    if(holder.get() != nullptr) holder.get()->setLabel(label);
+}
+
+void TaskManager::setTaskBudget(taskid_t taskId, uint32_t budgetMicros) {
+    TaskHandleHolder holder(this, taskId);
+    if(holder.get() != nullptr) holder.get()->setBudgetMicros(budgetMicros);
+}
+
+void TaskManager::setTaskSheddable(taskid_t taskId, bool sheddable) {
+    TaskHandleHolder holder(this, taskId);
+    if(holder.get() != nullptr) holder.get()->setSheddable(sheddable);
+}
+
 void TaskManager::cancelTask(taskid_t taskId) {
-    auto task = getTask(taskId);
+    // a task ID that no longer matches is ignored straight away, without queueing anything.
+    if(getTask(taskId) == nullptr) return;
+
     // always create a new task to ensure the task is never, ever cancelled on anything other than the task thread.
-	if (task) {
-	    taskManager.execute(new ExecWith2Parameters<TimerTask*, TaskManager*>([](TimerTask* task, TaskManager* tm) {
-            tm->removeFromQueue(task);
-            serlogF(SER_IOA_DEBUG, "TM free");
-            task->clear();
-	    }, task, this), true);
-	}
+    // The ID is checked again there, as the task may have finished meanwhile, and its slot been used again.
+    taskManager.execute(new ExecWith2Parameters<taskid_t, TaskManager*>([](taskid_t id, TaskManager* tm) {
+        auto task = tm->getTask(id);
+        if(task == nullptr || !task->isInUse()) return;
+        serlogF(SER_IOA_DEBUG, "TM free");
+        tm->freeTask(task);
+    }, taskId, this), true);
 }
 
 void TaskManager::yieldForMicros(uint32_t microsToWait) {
 	yield();
 
 	auto* prevTask = getRunningTask();
-	unsigned long microsStart = micros();
-	do {
-        runLoop();
-	} while((micros() - microsStart) < microsToWait);
+	unsigned long microsStart = tm_internal::schedulerMicros();
+#ifndef TM_NO_UTILIZATION_ACCOUNTING
+	// only a yield from within a task needs timing, it is taken off that task's busy time once it finishes.
+	uint32_t yieldStarted = (prevTask != nullptr) ? micros() : 0;
+#endif
+	if(yieldDepth >= maxYieldDepth) {
+	    // nested too deeply to run any more tasks, so this behaves as a delay that still lets the platform yield.
+	    while((tm_internal::schedulerMicros() - microsStart) < microsToWait) {
+	        yield();
+	    }
+	}
+	else {
+	    yieldDepth = yieldDepth + 1;
+	    do {
+	        runLoop();
+	    } while((tm_internal::schedulerMicros() - microsStart) < microsToWait);
+	    yieldDepth = yieldDepth - 1;
+	}
+#ifndef TM_NO_UTILIZATION_ACCOUNTING
+	// the tasks run meanwhile have counted their own time, so the task that yielded must not count any of it.
+	if(prevTask != nullptr) yieldedMicros += micros() - yieldStarted;
+#endif
 	tm_internal::atomicWritePtr(&runningTask, prevTask);
 }
 
 class TaskExecutionRecorder {
 private:
     TimerTask* prevTask;
+    TimerTask* task;
     TaskManager* taskMgr;
+    uint32_t prevStarted;
+    uint32_t started;
+#ifndef TM_NO_UTILIZATION_ACCOUNTING
+    uint32_t prevYielded;
+#endif
 public:
-    TaskExecutionRecorder(TaskManager* tm, TimerTask* task) : taskMgr(tm) {
+    TaskExecutionRecorder(TaskManager* tm, TimerTask* task) : task(task), taskMgr(tm) {
+#ifndef TM_NO_UTILIZATION_ACCOUNTING
+        // yielded time is kept for each level of nesting, the task that this one interrupted gets its own back after.
+        prevYielded = tm->yieldedMicros;
+        tm->yieldedMicros = 0;
+#endif
         prevTask = tm->getRunningTask();
+        prevStarted = tm->getRunningTaskStartMicros();
+        // the start time is written first, so that anything reading the running task sees a start time to match.
+        started = micros();
+        tm_internal::atomicWriteCounter(&tm->runningTaskStarted, started);
         tm_internal::atomicWritePtr(&tm->runningTask, task);
     }
 
     ~TaskExecutionRecorder() {
+        // this and the read on construction are the only clock reads needed for both accounting and budgets.
+        uint32_t finished = micros();
+        uint32_t took = finished - started;
+#ifndef TM_NO_UTILIZATION_ACCOUNTING
+        // each task counts only its own time, time spent in yieldForMicros is either idle or counted by nested tasks.
+        taskMgr->busyMicros += took - taskMgr->yieldedMicros;
+        taskMgr->yieldedMicros = prevYielded;
+        taskMgr->sampleUtilization(finished);
+#endif
+        auto budget = task->getBudgetMicros();
+        if(budget != 0 && took <= budget) task->clearOverruns();
+        // the reverse order to construction, the running task is restored before its start time, so that nothing reading
+        // the running task can pair this task with the earlier start time of the task it interrupted.
         tm_internal::atomicWritePtr(&taskMgr->runningTask, prevTask);
+        tm_internal::atomicWriteCounter(&taskMgr->runningTaskStarted, prevStarted);
     }
 };
 
 void TaskManager::dealWithInterrupt() {
     interrupted = false;
-    if(interruptCallback != nullptr) interruptCallback(lastInterruptTrigger);
 
-    auto lastSlot = taskBlocks[numberOfBlocks - 1]->lastSlot() + 1;
-    for(taskid_t i=0; i<lastSlot; i++) {
-        auto* task = getTask(i);
-        if(task->isInUse() && task->isEvent()) {
+    // deliver every queued interrupt in the order it was raised, only task manager moves the tail.
+    auto tail = tm_internal::atomicReadCounter(&interruptQueueTail);
+    while(tail != tm_internal::atomicReadCounter(&interruptQueueHead)) {
+        auto& record = interruptQueue[tail & (TM_INTERRUPT_QUEUE_SIZE - 1U)];
+        if(!tm_internal::atomicReadBool(&record.ready)) {
+            // reserved but still being written by an interrupt on another core, pick it up next time around.
+            interrupted = true;
+            break;
+        }
+        auto pin = record.pin;
+        auto when = record.microsAtInterrupt;
+        tm_internal::atomicWriteBool(&record.ready, false);
+        tm_internal::atomicWriteCounter(&interruptQueueTail, ++tail);
+
+        if(timedInterruptCallback != nullptr) timedInterruptCallback(pin, when);
+        else if(interruptCallback != nullptr) interruptCallback(pin);
+    }
+
+    // walk each block's slots directly, rather than searching the blocks again for every slot.
+    TmBlockReader reader(this);
+    for(taskid_t i=0; i<numberOfBlocks; i++) {
+        auto block = taskBlocks[i];
+        auto last = block->lastSlot() + 1;
+        for(taskid_t j=block->firstSlot(); j < last; j++) {
+            auto* task = block->getContainedTask(j);
+            if(task->isRetiring()) {
+                finishRetiredTask(task);
+                continue;
+            }
+            if(!task->isInUse()) continue;
+#if defined(IOA_MULTITHREADED)
+            sched_t pendingWhen;
+            TimerUnit pendingUnit;
+            bool pendingRepeating;
+            if(task->takePendingSchedule(pendingWhen, pendingUnit, pendingRepeating)) {
+                applySchedule(task, pendingWhen, pendingUnit, pendingRepeating);
+            }
+#endif // IOA_MULTITHREADED
+            if(!task->isEvent()) continue;
+
             if (!task->isRunning()) {
                 TaskExecutionRecorder taskExecutionRecorder(this, task);
                 task->processEvent();
-                removeFromQueue(task);
                 if (task->isRepeating()) {
+                    removeFromQueue(task);
                     putItemIntoQueue(task);
                 }
                 else {
-                    task->clear();
+                    freeTask(task);
                     serlogF(SER_IOA_DEBUG, "TM free int");
                 }
             }
@@ -253,28 +659,44 @@ void TaskManager::dealWithInterrupt() {
 }
 
 void TaskManager::runLoop() {
+    runLoopFor(0, 0);
+}
+
+bool TaskManager::runLoopFor(uint32_t maxMicros, uint16_t maxTasks) {
+#if defined(IOA_MULTITHREADED)
+	runLoopThread = getCurrentThreadId();
+#endif
+    uint32_t startMicros = (maxMicros != 0) ? tm_internal::schedulerMicros() : 0;
+    uint16_t tasksRun = 0;
+
 	// when there's an interrupt, we marshall it into a timer interrupt.
 	if (interrupted) dealWithInterrupt();
 
+	updateOverloadState();
+
 	// go through the timer (scheduled) tasks in priority order. they are stored
 	// in a linked list ordered by first to be scheduled. So we only go through
 	// these until the first one that isn't ready.
 	TimerTask* tm = tm_internal::atomicReadPtr(&first);
 
     while (tm && tm->microsFromNow() == 0) {
-        if(!tm->isRunning()) {
+        if(!tm->isRunning() && !tm->isRetiring() && !(overloaded && shedIfNeeded(tm))) {
             // by here we know that the task is in use. If it's in use nothing will touch it until it's marked as
             // available. We can do this part without a lock, knowing that we are the only thing that will touch
             // the task. We further know that all non-immutable fields on TimerTask are volatile.
             TaskExecutionRecorder executionRecorder(this, tm);
             tm->execute();
-            removeFromQueue(tm);
-            if (tm->isRepeating()) {
+            if (tm->clearRescheduled() || tm->isRepeating()) {
+                removeFromQueue(tm);
                 putItemIntoQueue(tm);
             } else {
-                tm->clear();
+                freeTask(tm);
                 serlogF(SER_IOA_DEBUG, "TM free loop");
             }
+
+            if((maxTasks != 0 && ++tasksRun >= maxTasks) || (maxMicros != 0 && (tm_internal::schedulerMicros() - startMicros) >= maxMicros)) {
+                break;
+            }
         }
         tm = tm->getNext();
 
@@ -285,15 +707,137 @@ void TaskManager::runLoop() {
 	    }
 #endif
     }
+
+    // there is more to do if an interrupt arrived meanwhile, or the head of the queue is already due.
+    if(interrupted) return true;
+    auto head = tm_internal::atomicReadPtr(&first);
+    return head != nullptr && !head->isRunning() && !head->isRetiring() && head->microsFromNow() == 0;
 }
 
-void TaskManager::putItemIntoQueue(TimerTask* tm) {
-    // we must own the lock before adding to the queue, as someone else could be removing.
-    TmSpinLock spinLock(&memLockerFlag);
+tm_internal::TmUtilizationTracker::TmUtilizationTracker() : periodStart(0), periodStartBusy(0), seconds{}, tenSeconds{},
+                                                            windows{}, secondIndex(0), secondsFilled(0),
+                                                            tenSecondIndex(0), tenSecondsFilled(0) {
+}
+
+static uint16_t averageOf(const uint16_t* values, uint8_t count) {
+    uint32_t total = 0;
+    for(uint8_t i = 0; i < count; i++) total += values[i];
+    return (count == 0) ? 0 : uint16_t(total / count);
+}
+
+void tm_internal::TmUtilizationTracker::update(uint32_t now, uint32_t busyTotal) {
+    uint32_t elapsed = now - periodStart;
+    if(elapsed < 1000000UL) return;
+
+    uint32_t busy = busyTotal - periodStartBusy;
+    periodStart = now;
+    periodStartBusy = busyTotal;
+    uint16_t perMille = (busy >= elapsed) ? 1000U : uint16_t(busy / (elapsed / 1000UL));
+
+    windows[TM_UTILIZATION_1S] = perMille;
+    seconds[secondIndex] = perMille;
+    secondIndex = (secondIndex + 1) % 10;
+    if(secondsFilled < 10) secondsFilled++;
+    windows[TM_UTILIZATION_10S] = averageOf(seconds, secondsFilled);
+
+    // every ten seconds, the ten second value moves into the sixty second window.
+    if(secondIndex == 0) {
+        tenSeconds[tenSecondIndex] = windows[TM_UTILIZATION_10S];
+        tenSecondIndex = (tenSecondIndex + 1) % 6;
+        if(tenSecondsFilled < 6) tenSecondsFilled++;
+    }
+    windows[TM_UTILIZATION_60S] = (tenSecondsFilled == 0) ? windows[TM_UTILIZATION_10S] : averageOf(tenSeconds, tenSecondsFilled);
+}
+
+#ifndef TM_NO_UTILIZATION_ACCOUNTING
+void TaskManager::sampleUtilization(uint32_t now) {
+    uint32_t elapsed = now - utilizationSampleStart;
+    if(elapsed >= TM_UTILIZATION_SAMPLE_MICROS) {
+        uint32_t busy = busyMicros - utilizationSampleBusy;
+        utilizationSampleBusy = busyMicros;
+        utilizationSampleStart = now;
+        uint32_t percent = (busy >= elapsed) ? 100 : busy / (elapsed / 100UL);
+        utilizationEstimate = uint8_t(((utilizationEstimate * 3U) + percent) / 4U);
+        utilization.update(now, busyMicros);
+    }
+}
+#endif
+
+void TaskManager::updateOverloadState() {
+    auto maxLateness = overloadPolicy.maxLatenessMicros;
+    auto maxUtilization = overloadPolicy.maxUtilizationPercent;
+#ifdef TM_NO_UTILIZATION_ACCOUNTING
+    // without an estimate, utilization can never go over its maximum, so check lateness instead.
+    if(maxUtilization != 0) {
+        if(maxLateness == 0) maxLateness = TM_FALLBACK_MAX_LATENESS_MICROS;
+        maxUtilization = 0;
+    }
+#endif
+    if(maxLateness == 0 && maxUtilization == 0) {
+        overloaded = false;
+        return;
+    }
+
+    auto head = tm_internal::atomicReadPtr(&first);
+    uint32_t lateness = (head != nullptr && !head->isRunning()) ? head->microsOverdue() : 0;
 
+    if(!overloaded) {
+        if((maxLateness != 0 && lateness > maxLateness) || (maxUtilization != 0 && utilizationEstimate > maxUtilization)) {
+            overloaded = true;
+            recovering = false;
+            overloadEpisodes++;
+            serlogF2(SER_IOA_DEBUG, "TM overloaded ", lateness);
+        }
+    }
+    else {
+        bool latenessRecovered = maxLateness == 0 || lateness <= (maxLateness / 2);
+        bool utilizationRecovered = maxUtilization == 0 || (utilizationEstimate + 10U) <= maxUtilization;
+        if(!latenessRecovered || !utilizationRecovered) {
+            recovering = false;
+        }
+        else if(!recovering) {
+            // only leave once it has stayed recovered for the dwell time, the clock is only read while overloaded.
+            recovering = true;
+            recoveringSince = tm_internal::schedulerMicros();
+            if(overloadPolicy.dwellMicros == 0) overloaded = false;
+        }
+        else if((tm_internal::schedulerMicros() - recoveringSince) >= overloadPolicy.dwellMicros) {
+            overloaded = false;
+        }
+    }
+}
+
+bool TaskManager::shedIfNeeded(TimerTask* task) {
+    if(!task->isSheddable() || task->isEvent()) return false;
+
+    auto action = overloadPolicy.action;
+    if(action == TM_SHED_STRETCH) {
+        auto factor = overloadPolicy.stretchFactor;
+        if(factor < 2 || (task->incrementShedCount() % factor) == 0) return false;
+    }
+
+    removeFromQueue(task);
+    if(action == TM_SHED_DEFER || !task->isRepeating()) {
+        task->deferFor(overloadPolicy.deferMicros);
+    }
+    else {
+        // skipping this run, so the next one is a whole interval from now.
+        task->setFirstRunIn(task->getSchedule());
+    }
+    putItemIntoQueue(task);
+    shedExecutions++;
+    return true;
+}
+
+void TaskManager::putItemIntoQueue(TimerTask* tm) {
     // we can never schedule a task that is not enabled.
     if(!tm->isEnabled()) return;
 
+    // we must own the lock before adding to the queue, as someone else could be removing.
+    TmSpinLock spinLock(&queueLock);
+
+    // our own time only needs working out once, rather than on every comparison.
+    auto ourMicrosFromNow = tm->microsFromNow();
     auto theFirst = tm_internal::atomicReadPtr(&first);
 
 	// shortcut, no first yet, so we are at the top!
@@ -304,7 +848,7 @@ void TaskManager::putItemIntoQueue(TimerTask* tm) {
 	}
 
 	// if we need to execute now or before the next task, then we are first. For performance, we use unfair semantics
-	if (theFirst->microsFromNow() >= tm->microsFromNow()) {
+	if (theFirst->microsFromNow() >= ourMicrosFromNow) {
         tm->setNext(theFirst);
 		tm_internal::atomicWritePtr(&first, tm);
         return;
@@ -315,7 +859,7 @@ void TaskManager::putItemIntoQueue(TimerTask* tm) {
 	TimerTask* previous = theFirst;
 
 	while (current != nullptr) {
-		if (current->microsFromNow() > tm->microsFromNow()) {
+		if (current->microsFromNow() > ourMicrosFromNow) {
             tm->setNext(current);
             previous->setNext(tm);
 			return;
@@ -336,7 +880,7 @@ void TaskManager::removeFromQueue(TimerTask* tm) {
 	// from cancelTask, this is now marshalled back onto task manager as a task to remove the item.
 
     // we must own the lock before we can modify the queue, as someone else could otherwise be adding..
-    TmSpinLock spinLock(&memLockerFlag);
+    TmSpinLock spinLock(&queueLock);
     auto theFirst = tm_internal::atomicReadPtr(&first);
 
     // there must be at least one item to proceed.
@@ -368,86 +912,35 @@ void TaskManager::removeFromQueue(TimerTask* tm) {
 	}
 }
 
-ISR_ATTR void interruptHandler1() {
-	taskManager.markInterrupted(1);
-}
-ISR_ATTR void interruptHandler2() {
-	taskManager.markInterrupted(2);
-}
-ISR_ATTR void interruptHandler3() {
-	taskManager.markInterrupted(3);
-}
-ISR_ATTR void interruptHandler4() {
-	taskManager.markInterrupted(4);
-}
-ISR_ATTR void interruptHandler5() {
-	taskManager.markInterrupted(5);
-}
-ISR_ATTR void interruptHandler6() {
-	taskManager.markInterrupted(6);
-}
-ISR_ATTR void interruptHandler7() {
-	taskManager.markInterrupted(7);
-}
-ISR_ATTR void interruptHandler8() {
-	taskManager.markInterrupted(8);
-}
-ISR_ATTR void interruptHandler9() {
-	taskManager.markInterrupted(9);
-}
-ISR_ATTR void interruptHandler10() {
-	taskManager.markInterrupted(10);
-}
-ISR_ATTR void interruptHandler11() {
-	taskManager.markInterrupted(11);
-}
-ISR_ATTR void interruptHandler12() {
-	taskManager.markInterrupted(12);
-}
-ISR_ATTR void interruptHandler13() {
-	taskManager.markInterrupted(13);
-}
-ISR_ATTR void interruptHandler14() {
-	taskManager.markInterrupted(14);
-}
-ISR_ATTR void interruptHandler15() {
-	taskManager.markInterrupted(15);
-}
-ISR_ATTR void interruptHandler18() {
-	taskManager.markInterrupted(18);
-}
+/**
+ * The raw ISR for a given pin when interrupts are marshalled by the global task manager, one is generated for each pin
+ * below TM_MAX_INTERRUPT_PINS.
+ */
+template<pintype_t PIN> struct TaskManagerPinIsr {
+    static ISR_ATTR void handle() {
+        TaskManager::markInterrupted(PIN);
+    }
+};
+
 ISR_ATTR void interruptHandlerOther() {
 	taskManager.markInterrupted(0xff);
 }
 
 void TaskManager::addInterrupt(InterruptAbstraction* ioDevice, pintype_t pin, uint8_t mode) {
-	if (interruptCallback == nullptr) return;
-
-	switch (pin) {
-	case 1: ioDevice->attachInterrupt(pin, interruptHandler1, mode); break;
-	case 2: ioDevice->attachInterrupt(pin, interruptHandler2, mode); break;
-	case 3: ioDevice->attachInterrupt(pin, interruptHandler3, mode); break;
-	case 4: ioDevice->attachInterrupt(pin, interruptHandler4, mode); break;
-	case 5: ioDevice->attachInterrupt(pin, interruptHandler5, mode); break;
-	case 6: ioDevice->attachInterrupt(pin, interruptHandler6, mode); break;
-	case 7: ioDevice->attachInterrupt(pin, interruptHandler7, mode); break;
-	case 8: ioDevice->attachInterrupt(pin, interruptHandler8, mode); break;
-	case 9: ioDevice->attachInterrupt(pin, interruptHandler9, mode); break;
-	case 10: ioDevice->attachInterrupt(pin, interruptHandler10, mode); break;
-	case 11: ioDevice->attachInterrupt(pin, interruptHandler11, mode); break;
-	case 12: ioDevice->attachInterrupt(pin, interruptHandler12, mode); break;
-	case 13: ioDevice->attachInterrupt(pin, interruptHandler13, mode); break;
-	case 14: ioDevice->attachInterrupt(pin, interruptHandler14, mode); break;
-	case 15: ioDevice->attachInterrupt(pin, interruptHandler15, mode); break;
-	case 18: ioDevice->attachInterrupt(pin, interruptHandler18, mode); break;
-	default: ioDevice->attachInterrupt(pin, interruptHandlerOther, mode); break;
-	}
+	if (interruptCallback == nullptr && timedInterruptCallback == nullptr) return;
+
+	auto handler = tm_internal::TrampolineSelector<TaskManagerPinIsr, TM_MAX_INTERRUPT_PINS>::select(pin);
+	ioDevice->attachInterrupt(pin, handler != nullptr ? handler : interruptHandlerOther, mode);
 }
 
 void TaskManager::setInterruptCallback(InterruptFn handler) {
 	interruptCallback = handler;
 }
 
+void TaskManager::setTimedInterruptCallback(TimedInterruptFn handler) {
+    timedInterruptCallback = handler;
+}
+
 char* TaskManager::checkAvailableSlots(char* data, size_t dataSize) const {
     auto maxLen = internal_min(taskid_t(dataSize - 1), taskBlocks[numberOfBlocks - 1]->lastSlot());
     size_t position = 0;
@@ -467,13 +960,28 @@ char* TaskManager::checkAvailableSlots(char* data, size_t dataSize) const {
 }
 
 TimerTask *TaskManager::getTask(taskid_t taskId) {
+    auto task = getTaskInSlot(tmSlotOfTaskId(taskId));
+    return (task != nullptr && task->getGeneration() == tmGenerationOfTaskId(taskId)) ? task : nullptr;
+}
+
+TimerTask *TaskManager::getTaskInSlot(taskid_t slot) {
+    TmBlockReader reader(this);
     for(taskid_t i=0; i<numberOfBlocks; i++) {
-        auto possibleTask = taskBlocks[i]->getContainedTask(taskId);
+        auto possibleTask = taskBlocks[i]->getContainedTask(slot);
         if(possibleTask != nullptr) return possibleTask;
     }
     return nullptr;
 }
 
+taskid_t TaskManager::getTaskId(const TimerTask* task) {
+    TmBlockReader reader(this);
+    for(taskid_t i=0; i<numberOfBlocks; i++) {
+        auto slot = taskBlocks[i]->getTaskId(task);
+        if(slot != TASKMGR_INVALIDID) return tmMakeTaskId(slot, task->getGeneration());
+    }
+    return TASKMGR_INVALIDID;
+}
+
 taskid_t TaskManager::schedule(const TimePeriod &when, TimerFn timerFunction) {
     if(when.getRepeating()) {
         return scheduleFixedRate(when.getAmount(), timerFunction, when.getUnit());
@@ -22,7 +22,7 @@ enum InterruptMode;
  * outside of task manager can add, remove and manage tasks even while task manager is running.
  */
 
-#if defined(IOA_USE_MBED) || defined(BUILD_FOR_PICO_CMAKE)
+#if defined(IOA_USE_MBED) || defined(BUILD_FOR_PICO_CMAKE) || defined(BUILD_FOR_HOSTED)
 #include <cstdint>
 /** This defines the yield function for environments that don't have the function, as per framework on Arduino */
 void yield();
@@ -32,6 +32,9 @@ uint32_t millis();
 uint32_t micros();
 #ifdef IOA_USE_MBED
 #define delayMicroseconds(x) wait_us(x)
+#elif defined(BUILD_FOR_HOSTED)
+#include <unistd.h>
+#define delayMicroseconds(x) usleep(x)
 #else
 #define delayMicroseconds(x) sleep_us(x)
 #endif // DELAY Microseconds code
@@ -49,6 +52,48 @@ typedef void (*RawIntHandler)();
  */
 typedef void (*InterruptFn)(pintype_t pin);
 
+/**
+ * Definition of a function to be called back for each interrupt that task manager marshalled, it receives both the
+ * pin and the value of micros() when the interrupt was raised, so the latency of handling can be measured.
+ * @param pin the pin on which the interrupt occurred
+ * @param microsAtInterrupt the value of micros() in the interrupt service routine
+ */
+typedef void (*TimedInterruptFn)(pintype_t pin, uint32_t microsAtInterrupt);
+
+//
+// The number of interrupts that can be queued up waiting for task manager to process them, if more arrive before
+// runLoop is called, they are counted as overflows. Define TM_INTERRUPT_QUEUE_SIZE yourself to change it, it must be
+// a power of two so that the ring is indexed with a mask.
+//
+#ifndef TM_INTERRUPT_QUEUE_SIZE
+# ifdef __AVR__
+#  define TM_INTERRUPT_QUEUE_SIZE 4
+# else
+#  define TM_INTERRUPT_QUEUE_SIZE 16
+# endif
+#endif // TM_INTERRUPT_QUEUE_SIZE
+
+//
+// The default limit on how deeply calls to yieldForMicros can nest, once reached, yieldForMicros waits without running
+// any more tasks. Define TM_DEFAULT_MAX_YIELD_DEPTH yourself to change it, or call setMaxYieldDepth at runtime.
+//
+#ifndef TM_DEFAULT_MAX_YIELD_DEPTH
+# ifdef __AVR__
+#  define TM_DEFAULT_MAX_YIELD_DEPTH 4
+# else
+#  define TM_DEFAULT_MAX_YIELD_DEPTH 8
+# endif
+#endif // TM_DEFAULT_MAX_YIELD_DEPTH
+
+/**
+ * Internal structure, holds one interrupt that is waiting to be processed by task manager.
+ */
+struct TmInterruptRecord {
+    uint32_t microsAtInterrupt;
+    pintype_t pin;
+    tm_internal::TmAtomicBool ready;
+};
+
 /**
  * Abstracts the method by which interrupts are registered on the platform. Generally speaking this is implemented by
  * all IoAbstractionRef implementations, so having any abstraction means you already have one of these. You can either
@@ -68,6 +113,77 @@ public:
     virtual void attachInterrupt(pintype_t pin, RawIntHandler fn, uint8_t mode) = 0;
 };
 
+//
+// The number of pins for which interrupt trampolines are generated at compile time, each pin below this value gets its
+// own raw ISR that knows which pin it belongs to. Pins above this share one handler and lose their identity. Define
+// TM_MAX_INTERRUPT_PINS yourself to change it.
+//
+#ifndef TM_MAX_INTERRUPT_PINS
+# ifdef __AVR__
+#  define TM_MAX_INTERRUPT_PINS 22
+# elif defined(ESP32)
+#  define TM_MAX_INTERRUPT_PINS 40
+# else
+#  define TM_MAX_INTERRUPT_PINS 64
+# endif
+#endif // TM_MAX_INTERRUPT_PINS
+
+namespace tm_internal {
+    /**
+     * Internal: selects the raw ISR trampoline for a pin at runtime, from trampolines that are generated at compile
+     * time for every pin below N. ISR_TYPE<PIN>::handle must be a static function that handles the interrupt for PIN.
+     * The lookup is only done when attaching, each trampoline has the pin built in so dispatch is constant time.
+     */
+    template<template<pintype_t> class ISR_TYPE, pintype_t N> struct TrampolineSelector {
+        static RawIntHandler select(pintype_t pin) {
+            return (pin == (N - 1)) ? &ISR_TYPE<N - 1>::handle : TrampolineSelector<ISR_TYPE, N - 1>::select(pin);
+        }
+    };
+
+    template<template<pintype_t> class ISR_TYPE> struct TrampolineSelector<ISR_TYPE, 0> {
+        static RawIntHandler select(pintype_t /*pin*/) {
+            return nullptr;
+        }
+    };
+}
+
+namespace tm_internal {
+    /**
+     * Internal: the state of a fair ticket lock, each waiter takes the next ticket and then waits for it to be served,
+     * so the lock is always handed over in the order it was asked for. It also records how often a waiter had to wait
+     * and the longest wait seen. It is acquired and released by the TmSpinLock class within task manager.
+     */
+    struct TmTicketLock {
+        TmAtomicCounter nextTicket;
+        TmAtomicCounter nowServing;
+        TmAtomicCounter contendedCount;
+        TmAtomicCounter maxWaitMicros;
+    };
+}
+
+/**
+ * Internal: holds a ticket lock for the life of the object, waiters are served in the order they arrive so that no
+ * thread is starved of the lock. Waiters spin for a short while, then yield between checks, and after a bounded number
+ * of yields sleep for a tick between checks on ESP32, mbed and the hosted build.
+ *
+ * The sleep is what bounds a wait under priority inversion. On an RTOS, yield only gives way to threads of the same
+ * priority, so a higher priority waiter on the same core as a lower priority holder would yield forever without the
+ * holder ever running. Sleeping lets the holder run and release the lock. This is not priority inheritance: a thread
+ * of medium priority can still keep the holder off the core, and the waiter then waits for as long as it does.
+ */
+class TmSpinLock {
+private:
+    tm_internal::TmTicketLock* lockObject;
+    uint32_t ticket;
+public:
+    explicit TmSpinLock(tm_internal::TmTicketLock* toLockOn);
+
+    ~TmSpinLock() {
+        // only the holder ever moves now serving forward, so it can simply be written.
+        tm_internal::atomicWriteCounter(&lockObject->nowServing, ticket + 1);
+    }
+};
+
 class TaskExecutionRecorder;
 
 /**
@@ -142,6 +258,110 @@ inline TimePeriod onceMillis(uint32_t millis) { return {millis, TIME_MILLIS, fal
  */
 inline TimePeriod onceMicros(uint32_t micros) { return {micros, TIME_MICROS, false}; }
 
+//
+// How long a task block must stay empty after being marked as retiring before reclaimEmptyBlocks frees it, unless
+// another period is given in the call. Define TM_BLOCK_RECLAIM_MILLIS yourself to change it.
+//
+#ifndef TM_BLOCK_RECLAIM_MILLIS
+# define TM_BLOCK_RECLAIM_MILLIS 5000UL
+#endif // TM_BLOCK_RECLAIM_MILLIS
+
+//
+// How often the utilization estimate is updated, it is a moving average of the busy time in each period.
+//
+#ifndef TM_UTILIZATION_SAMPLE_MICROS
+# define TM_UTILIZATION_SAMPLE_MICROS 100000UL
+#endif // TM_UTILIZATION_SAMPLE_MICROS
+
+//
+// When compiled with TM_NO_UTILIZATION_ACCOUNTING there is no utilization estimate, so an overload policy that only
+// sets maxUtilizationPercent checks that the head of the queue is no later than this instead.
+//
+#ifndef TM_FALLBACK_MAX_LATENESS_MICROS
+# define TM_FALLBACK_MAX_LATENESS_MICROS 10000UL
+#endif // TM_FALLBACK_MAX_LATENESS_MICROS
+
+/**
+ * What happens to a sheddable task that comes due while task manager is overloaded.
+ */
+enum TmShedAction : uint8_t {
+    /** the run is skipped, a repeating task next runs a whole interval later, a one shot task is deferred */
+    TM_SHED_SKIP,
+    /** the run is postponed by the defer time, or by the task's interval if that is shorter */
+    TM_SHED_DEFER,
+    /** only one in every stretch factor runs goes ahead, so the interval is stretched by that factor */
+    TM_SHED_STRETCH
+};
+
+/**
+ * Decides when task manager is overloaded and what happens to sheddable tasks when it is. Task manager is overloaded
+ * when the task at the head of the queue is later than maxLatenessMicros, or the utilization estimate is above
+ * maxUtilizationPercent. It stays overloaded until the lateness is back below half the maximum and the utilization is
+ * at least 10 percent below its maximum, and has stayed there for dwellMicros, so that it does not flip back and forth
+ * on every run. Either check is off when set to 0, and by default both are off.
+ */
+struct TmOverloadPolicy {
+    /** overloaded when the head of the queue is later than this, 0 to not check lateness */
+    uint32_t maxLatenessMicros;
+    /** overloaded when the utilization estimate is above this percentage, 0 to not check utilization. Utilization is
+     * not available when compiled with TM_NO_UTILIZATION_ACCOUNTING, lateness is checked instead, see
+     * TM_FALLBACK_MAX_LATENESS_MICROS */
+    uint8_t maxUtilizationPercent;
+    /** what to do with sheddable tasks while overloaded */
+    TmShedAction action;
+    /** for TM_SHED_STRETCH, one in this many runs goes ahead */
+    uint8_t stretchFactor;
+    /** for TM_SHED_DEFER and one shot tasks, how long to postpone each run by, should not be 0. Tasks scheduled in
+     * milliseconds are postponed by at least a millisecond */
+    uint32_t deferMicros;
+    /** once overloaded, how long the load must stay below the recovery levels before it is no longer overloaded */
+    uint32_t dwellMicros;
+};
+
+/**
+ * The windows over which utilization is reported, see TaskManager::getUtilization
+ */
+enum TmUtilizationWindow : uint8_t {
+    /** the last complete second */
+    TM_UTILIZATION_1S,
+    /** the last ten complete seconds */
+    TM_UTILIZATION_10S,
+    /** the last sixty seconds, updated every ten seconds */
+    TM_UTILIZATION_60S
+};
+
+namespace tm_internal {
+    /**
+     * Internal class: keeps the rolling utilization windows from the running total of busy time. It is sampled once a
+     * second, keeping ten one second values and six ten second values, each in parts per thousand, so the windows are
+     * worked out when sampled and reading them costs nothing.
+     */
+    class TmUtilizationTracker {
+    private:
+        uint32_t periodStart;
+        uint32_t periodStartBusy;
+        uint16_t seconds[10];
+        uint16_t tenSeconds[6];
+        uint16_t windows[3];
+        uint8_t secondIndex;
+        uint8_t secondsFilled;
+        uint8_t tenSecondIndex;
+        uint8_t tenSecondsFilled;
+    public:
+        TmUtilizationTracker();
+
+        /**
+         * Take a sample if at least a second has passed, if no task runs for longer than that, the whole time is
+         * treated as one sample.
+         * @param now the current micros()
+         * @param busyTotal the running total of busy microseconds, it is fine for it to wrap
+         */
+        void update(uint32_t now, uint32_t busyTotal);
+
+        uint16_t get(TmUtilizationWindow window) const { return windows[window]; }
+    };
+}
+
 /**
  * TaskManager is a lightweight cooperative co-routine implementation for Arduino, it works by scheduling tasks to be
  * done either immediately, or at a future point in time. It is quite efficient at scheduling tasks as internally tasks
@@ -158,19 +378,53 @@ inline TimePeriod onceMicros(uint32_t micros) { return {micros, TIME_MICROS, fal
 class TaskManager {
 protected:
     // the memory that holds all the tasks is an array of task blocks, allocated on demand
-    TaskBlock* volatile taskBlocks[DEFAULT_TASK_BLOCKS];  // task blocks never ever move in memory, they are not volatile but the pointer is
+    TaskBlock* volatile taskBlocks[TM_MAX_TASK_BLOCKS];  // task blocks never ever move in memory, they are not volatile but the pointer is
     volatile taskid_t numberOfBlocks; // this holds the current number of blocks available.
+    taskid_t reservedBlocks;          // reclaiming never takes the number of blocks below this.
+    taskid_t blockGenerations[TM_MAX_TASK_BLOCKS]; // the generation that slots start at when a block is created again
+    tm_internal::TmAtomicCounter blockReaders;     // calls that may be looking at a block, see TmBlockReader
+    tm_internal::TmAtomicCounter slotsInUse;
+    tm_internal::TmAtomicCounter peakSlotsInUse;
 
     // here we have a linked list of tasks, this linked list is in time order, nearest task first.
     tm_internal::TimerTaskAtomicPtr first;
 
-    // interrupt handling variables, store the interrupt state and probable pin cause if applicable
-    volatile pintype_t lastInterruptTrigger;
+    // interrupt handling variables, each interrupt is queued along with its pin and time in a ring that is written
+    // by interrupts and drained by task manager. Events use the interrupted flag without needing a queue entry.
+    static_assert(TM_INTERRUPT_QUEUE_SIZE != 0 && (TM_INTERRUPT_QUEUE_SIZE & (TM_INTERRUPT_QUEUE_SIZE - 1)) == 0,
+                  "TM_INTERRUPT_QUEUE_SIZE must be a power of two");
+    TmInterruptRecord interruptQueue[TM_INTERRUPT_QUEUE_SIZE];
+    tm_internal::TmAtomicCounter interruptQueueHead;
+    tm_internal::TmAtomicCounter interruptQueueTail;
+    tm_internal::TmAtomicCounter interruptOverflows;
     volatile bool interrupted;
     volatile InterruptFn interruptCallback;
+    volatile TimedInterruptFn timedInterruptCallback;
 
-    tm_internal::TmAtomicBool memLockerFlag;      // memory and list operations are locked by this flag using the TmSpinLocker
+    tm_internal::TmTicketLock blockLock;          // allocation of new task blocks is locked by this using TmSpinLock
+    tm_internal::TmTicketLock queueLock;          // queue insertion and removal is locked by this using TmSpinLock
     tm_internal::TimerTaskAtomicPtr runningTask;
+    tm_internal::TmAtomicCounter runningTaskStarted;
+    volatile uint8_t yieldDepth;
+    uint8_t maxYieldDepth;
+
+    TmOverloadPolicy overloadPolicy;
+    bool overloaded;
+    bool recovering;
+    uint32_t recoveringSince;
+    uint8_t utilizationEstimate;
+#ifndef TM_NO_UTILIZATION_ACCOUNTING
+    uint32_t busyMicros;
+    uint32_t yieldedMicros;
+    uint32_t utilizationSampleStart;
+    uint32_t utilizationSampleBusy;
+    tm_internal::TmUtilizationTracker utilization;
+#endif
+    uint32_t overloadEpisodes;
+    uint32_t shedExecutions;
+#if defined(IOA_MULTITHREADED)
+    void* volatile runLoopThread;
+#endif
 public:
     /**
      * On all platforms there is a default instance of TaskManager called taskManager. You can create other instances
@@ -267,6 +521,33 @@ public:
      */
     taskid_t scheduleFixedRate(uint32_t when, Executable* execRef, TimerUnit timeUnit = TIME_MILLIS, bool deleteWhenDone = false);
 
+#ifdef TM_ALLOW_CAPTURED_LAMBDA
+    //
+    // When lambdas are allowed, TimerFn is a std::function, and once a plain function is stored in one it can no longer
+    // be told apart from a lambda. These overloads take plain functions directly so that the function is recorded with
+    // the task, see TimerTask::getFunctionPointer. Lambdas do not match them, and use the TimerFn versions above.
+    //
+    template<class F, typename std::enable_if<std::is_same<F, void()>::value, int>::type = 0>
+    taskid_t scheduleOnce(uint32_t when, F* timerFunction, TimerUnit timeUnit = TIME_MILLIS) {
+        return scheduleFunctionPointer(when, timerFunction, timeUnit, false);
+    }
+
+    template<class F, typename std::enable_if<std::is_same<F, void()>::value, int>::type = 0>
+    taskid_t scheduleFixedRate(uint32_t when, F* timerFunction, TimerUnit timeUnit = TIME_MILLIS) {
+        return scheduleFunctionPointer(when, timerFunction, timeUnit, true);
+    }
+
+    template<class F, typename std::enable_if<std::is_same<F, void()>::value, int>::type = 0>
+    taskid_t schedule(const TimePeriod& when, F* timerFunction) {
+        return scheduleFunctionPointer(when.getAmount(), timerFunction, when.getUnit(), when.getRepeating());
+    }
+
+    template<class F, typename std::enable_if<std::is_same<F, void()>::value, int>::type = 0>
+    taskid_t execute(F* workToDo) {
+        return scheduleFunctionPointer(2, workToDo, TIME_MICROS, false);
+    }
+#endif // TM_ALLOW_CAPTURED_LAMBDA
+
     /**
      * Adds an event to task manager that can be triggered either once or can be repeated. See the
      * BaseEvent interface for more details of the interaction with taskManager.
@@ -280,7 +561,6 @@ public:
      * one event has now triggered and needs to be evaluated.
      */
     ISR_ATTR void triggerEvents() {
-        lastInterruptTrigger = 0xff; // 0xff is the shorthand for event trigger basically.
         interrupted = true;
     }
 
@@ -301,6 +581,35 @@ public:
      */
     void setInterruptCallback(InterruptFn handler);
 
+    /**
+     * Sets an interrupt callback that is given the time of each interrupt as well as the pin, use this in place of
+     * setInterruptCallback when you need to know when each interrupt occurred. Every queued interrupt is delivered
+     * in order, the callback is called back by task manager and not in interrupt context.
+     * @param handler the timed interrupt handler
+     */
+    void setTimedInterruptCallback(TimedInterruptFn handler);
+
+    /**
+     * @return the number of interrupts that were lost because the interrupt queue was full, see TM_INTERRUPT_QUEUE_SIZE
+     */
+    uint32_t getInterruptOverflowCount() { return tm_internal::atomicReadCounter(&interruptOverflows); }
+
+    /**
+     * @return the number of times that a thread had to wait for one of task manager's internal locks.
+     */
+    uint32_t getLockContentionCount() {
+        return tm_internal::atomicReadCounter(&blockLock.contendedCount) + tm_internal::atomicReadCounter(&queueLock.contendedCount);
+    }
+
+    /**
+     * @return the longest time in micros that any thread waited for one of task manager's internal locks.
+     */
+    uint32_t getLockMaxWaitMicros() {
+        auto blockWait = tm_internal::atomicReadCounter(&blockLock.maxWaitMicros);
+        auto queueWait = tm_internal::atomicReadCounter(&queueLock.maxWaitMicros);
+        return blockWait > queueWait ? blockWait : queueWait;
+    }
+
     /**
      * Stop a task from executing or cancel it from executing again if it is a repeating task
      * @param task the task ID returned from the schedule call
@@ -316,6 +625,46 @@ public:
      */
     void setTaskEnabled(taskid_t task, bool ena);
 
+    /**
+     * Changes when a task runs, keeping the same slot and what it calls, so there is no cancel and schedule again. For
+     * example a repeating task can be changed to a new interval, or a one shot task given a new delay. The next run is
+     * the time given from now. A task can call this on itself while running, to set the delay before it next runs, a
+     * one shot task that does so runs again rather than being freed, see also rescheduleRunningTask.
+     *
+     * On the task manager thread, the task is moved to its new place in the queue straight away. From other threads,
+     * the change is stored in the task itself, without allocating, and task manager applies it on the next runLoop. A
+     * second change made before then replaces the first. It is not suitable for use in an interrupt. Events cannot be
+     * rescheduled, they decide their own timing.
+     * @param task the task to change
+     * @param when the new schedule, for example repeatMillis(250) or onceMicros(500)
+     * @return true if the task was changed, or the change stored, false if the ID no longer matches a task or it is an
+     * event.
+     */
+    bool rescheduleTask(taskid_t task, const TimePeriod& when);
+
+    /**
+     * For use within a task, changes when the task that is running now next runs, see rescheduleTask.
+     * @param when the new schedule, for example onceMillis(20) to run once more in 20 milliseconds
+     * @return true if changed, false if called outside of a task or from an event.
+     */
+    bool rescheduleRunningTask(const TimePeriod& when);
+
+    /**
+     * Gives a task a label that is shown by the diagnostics in TmDiagnostics.h, the label is removed when the task
+     * completes or is cancelled.
+     * @param task the task to label
+     * @param label a string that is never freed, such as a literal
+     */
+    void setTaskLabel(taskid_t task, const char* label);
+
+    /**
+     * Sets the longest time that a single run of a task should take, a TmOverrunMonitor reports any run that goes
+     * over budget while it is still running. The budget is removed when the task completes or is cancelled.
+     * @param task the task to set the budget of
+     * @param budgetMicros the budget in microseconds, 0 for no limit
+     */
+    void setTaskBudget(taskid_t task, uint32_t budgetMicros);
+
     /**
      * Use instead of delays or wait loops inside code that needs to perform timing functions. It will
      * not call back until at least `micros` time has passed.
@@ -323,27 +672,115 @@ public:
      */
     virtual void yieldForMicros(uint32_t micros);
 
+    /**
+     * Limits how deeply calls to yieldForMicros can nest, each nested call runs tasks that may yield again. Once the
+     * limit is reached, yieldForMicros waits for the time requested without running any tasks, which keeps the stack
+     * and the time before the outermost call returns bounded.
+     * @param maxDepth the maximum nesting depth, 0 stops yieldForMicros from running tasks at all.
+     */
+    void setMaxYieldDepth(uint8_t maxDepth) { maxYieldDepth = maxDepth; }
+
+    /**
+     * @return the number of calls to yieldForMicros that are currently running tasks
+     */
+    uint8_t getYieldDepth() const { return yieldDepth; }
+
+    /**
+     * Sets how task manager decides that it is overloaded, and what happens to sheddable tasks when it is, see
+     * TmOverloadPolicy. Only tasks marked with setTaskSheddable are affected, others always run when due.
+     * @param policy the overload policy
+     */
+    void setOverloadPolicy(const TmOverloadPolicy& policy) { overloadPolicy = policy; }
+
+    /**
+     * Mark a task as sheddable, so that it can be skipped, deferred or run less often when task manager is overloaded.
+     * Events are never shed.
+     * @param task the task to mark
+     * @param sheddable true if it can be shed
+     */
+    void setTaskSheddable(taskid_t task, bool sheddable);
+
+    /**
+     * @return true if task manager is overloaded according to the overload policy
+     */
+    bool isOverloaded() const { return overloaded; }
+
+    /**
+     * @return the estimated percentage of time spent running tasks, a fast moving average used to detect overload. It
+     * is brought up to date as each task finishes, so that no clock read is added to runLoop.
+     */
+    uint8_t getUtilizationEstimate() const { return utilizationEstimate; }
+
+    /**
+     * Gets how busy task manager has been over a window, this is the time spent running tasks and events compared
+     * with the wall clock, the rest of the time was idle or spent outside of task manager. Time that a task spends
+     * waiting in yieldForMicros is not counted, but the tasks that run meanwhile are. Always 0 when compiled with
+     * TM_NO_UTILIZATION_ACCOUNTING.
+     * @param window the window to report
+     * @return the utilization in parts per thousand, so 1000 means busy all the time.
+     */
+    uint16_t getUtilization(TmUtilizationWindow window) {
+#ifndef TM_NO_UTILIZATION_ACCOUNTING
+        // samples are normally taken as tasks finish, so bring them up to date in case nothing has run for a while.
+        sampleUtilization(micros());
+        return utilization.get(window);
+#else
+        (void)window;
+        return 0;
+#endif
+    }
+
+    /**
+     * @return the number of times that task manager has become overloaded
+     */
+    uint32_t getOverloadEpisodes() const { return overloadEpisodes; }
+
+    /**
+     * @return the number of task runs that have been skipped or deferred while overloaded
+     */
+    uint32_t getShedExecutions() const { return shedExecutions; }
+
     /**
      * This should be called in the loop() method of your sketch, ensure that your loop method does
      * not do anything that will unduly delay calling this method.
      */
     void runLoop();
 
+    /**
+     * Runs the tasks that are due in the same way as runLoop, but returns once either limit is reached, so that a loop
+     * that also services networking or a display gets control back in a bounded time. The limits are checked after
+     * each task, so a single long task can still go over. Pending interrupts are always delivered first.
+     * @param maxMicros the most time to spend running tasks, 0 for no limit
+     * @param maxTasks the most tasks to run, 0 for no limit
+     * @return true if there is more work due now, in which case call again soon
+     */
+    bool runLoopFor(uint32_t maxMicros, uint16_t maxTasks = 0);
+
     /**
      * Used internally by the interrupt handlers to tell task manager an interrupt is waiting. Not for external use.
      */
     static void markInterrupted(pintype_t interruptNo);
 
+    /**
+     * Queues an interrupt on this task manager instance, safe to call from an interrupt service routine or any thread.
+     * If the interrupt queue is full, the interrupt is counted as an overflow instead.
+     * @param interruptNo the pin or identifier of the interrupt
+     */
+    void queueInterrupt(pintype_t interruptNo);
+
     /**
      * Reset the task manager such that all current tasks are cleared, back to power on state.
      */
     void reset() {
-        // all the slots should be cleared
+        // all the slots should be cleared, apart from any another thread is still working on, they are freed later.
+        taskid_t stillRetiring = 0;
         for(taskid_t i =0; i<numberOfBlocks; i++) {
-            taskBlocks[i]->clearAll();
+            stillRetiring += taskBlocks[i]->clearAll();
         }
         // the queue must be completely cleared too.
         tm_internal::atomicWritePtr(&first, nullptr);
+        tm_internal::atomicWriteCounter(&slotsInUse, stillRetiring);
+        tm_internal::atomicWriteCounter(&peakSlotsInUse, 0);
     }
 
     /**
@@ -366,12 +803,80 @@ public:
     }
 
     /**
-     * Gets the underlying TimerTask variable associated with this task ID.
+     * Allocate enough task blocks up front for at least the number of tasks given, for example in setup so that no
+     * allocation happens later on. Blocks that are reserved are never reclaimed by reclaimEmptyBlocks.
+     * @param slots the number of tasks that should be available
+     * @return true if there is now room for that many tasks, false if it would be more than TM_MAX_TASK_BLOCKS allow,
+     * or memory ran out.
+     */
+    bool reserve(taskid_t slots);
+
+    /**
+     * Frees task blocks at the end that have stayed empty, so that memory taken during a spike in the number of tasks
+     * is given back. A block that is empty is first marked as retiring, so that nothing more is allocated from it. If
+     * it is still empty once it has been retiring for emptyForMillis, it is taken out of use, and it is freed as soon
+     * as no other thread is looking up tasks, which is normally straight away. If more tasks are needed meanwhile,
+     * retiring blocks are used again first. Task IDs from a freed block don't match tasks in a block created later in
+     * its place until the slot generation wraps, see taskid_t. Call this on the task manager thread every so often, for
+     * example once a minute:
+     *
+     * ```
+     * taskManager.scheduleFixedRate(60, [] { taskManager.reclaimEmptyBlocks(); }, TIME_SECONDS);
+     * ```
+     *
+     * @param emptyForMillis how long a block must be retiring before it is taken out of use
+     * @return the number of blocks freed by this call
+     */
+    taskid_t reclaimEmptyBlocks(unsigned long emptyForMillis = TM_BLOCK_RECLAIM_MILLIS);
+
+    /**
+     * @return the number of task blocks that are currently allocated and in use, each holds DEFAULT_TASK_SIZE tasks
+     */
+    taskid_t getNumberOfBlocks() const { return numberOfBlocks; }
+
+    /**
+     * @return the number of tasks that can be scheduled without allocating another block
+     */
+    taskid_t getSlotCapacity() const { return numberOfBlocks * DEFAULT_TASK_SIZE; }
+
+    /**
+     * @return the number of task slots in use right now
+     */
+    uint32_t getSlotsInUse() { return tm_internal::atomicReadCounter(&slotsInUse); }
+
+    /**
+     * @return the most task slots that have been in use at once since reset or resetPeakSlotsInUse, useful for
+     * working out how many tasks to reserve, or what to set TM_MAX_TASK_BLOCKS to for a deployment.
+     */
+    uint32_t getPeakSlotsInUse() { return tm_internal::atomicReadCounter(&peakSlotsInUse); }
+
+    /**
+     * Starts measuring the peak number of slots in use again from the number in use now.
+     */
+    void resetPeakSlotsInUse() { tm_internal::atomicWriteCounter(&peakSlotsInUse, getSlotsInUse()); }
+
+    /**
+     * Gets the underlying TimerTask variable associated with this task ID. The pointer is only checked against the ID
+     * at the time of the call, on other threads the task could finish at any time afterwards.
      * @param task the task's ID
-     * @return the task or nullptr.
+     * @return the task or nullptr if there is no such slot, or the task with this ID has finished or been cancelled.
      */
     TimerTask* getTask(taskid_t task);
 
+    /**
+     * Gets the TimerTask in a slot, whatever is in it now, mainly for iterating over all the slots.
+     * @param slot the slot number, starting at 0
+     * @return the task or nullptr if there is no such slot.
+     */
+    TimerTask* getTaskInSlot(taskid_t slot);
+
+    /**
+     * Finds the ID of a task from its TimerTask, for example from getFirstTask or getRunningTask.
+     * @param task the task to look up
+     * @return the task's ID or TASKMGR_INVALIDID if it is not one of this task manager's tasks.
+     */
+    taskid_t getTaskId(const TimerTask* task);
+
     /**
      * Gets the number of microseconds as an unsigned long to the next task execution.
      * To convert to milliseconds: divide by 1000, to seconds divide by 1,000,000.
@@ -383,15 +888,41 @@ public:
         else return maybeTask->microsFromNow();
     }
 
+    /**
+     * @return true if an interrupt or event trigger is waiting for the next runLoop to process it.
+     */
+    bool isInterruptPending() const { return interrupted; }
+
     /**
      * Gets the currently running task, this is only useful for places where re-entrant checking is needed to ensure
      * the same task is taking the lock again for example. Never change the task state in this call, and also never
      * store this pointer.
      * @return a temporary pointer to the running task that lasts as long as it is running.
      */
-    TimerTask* getRunningTask() { return runningTask; }
+    TimerTask* getRunningTask() { return tm_internal::atomicReadPtr(&runningTask); }
+
+    /**
+     * @return the micros() value when the currently running task started, only meaningful while getRunningTask is
+     * not nullptr. Always set before the running task, and restored after it, so read the running task before and after
+     * this value and check that it is unchanged when reading from another thread.
+     */
+    uint32_t getRunningTaskStartMicros() { return tm_internal::atomicReadCounter(&runningTaskStarted); }
+
+    /**
+     * @return true if called from the thread that last called runLoop, on boards without threads this is always true.
+     */
+    bool isRunLoopThread() {
+#if defined(IOA_MULTITHREADED)
+        return runLoopThread == getCurrentThreadId();
+#else
+        return true;
+#endif
+    }
 
     friend class TaskExecutionRecorder;
+    friend class TmScheduleSnapshotBase;
+    friend class TmBlockReader;
+    friend class TaskHandleHolder;
 private:
     /**
      * Finds and allocates the next free task, once this returns a task will either have been allocated, making task
@@ -400,6 +931,34 @@ private:
      */
     taskid_t findFreeTask();
 
+#ifdef TM_ALLOW_CAPTURED_LAMBDA
+    /**
+     * Schedules a plain function, recording the function pointer with the task, see the function pointer overloads.
+     */
+    taskid_t scheduleFunctionPointer(uint32_t when, TimerFnPointer timerFunction, TimerUnit timeUnit, bool repeating);
+#endif // TM_ALLOW_CAPTURED_LAMBDA
+
+    /**
+     * Adds a task block to the end of the block list, first using a block that was taken out of use and not yet
+     * freed, if there is one. Must be called with the block lock held.
+     * @return true if a block was added, false if already at TM_MAX_TASK_BLOCKS or memory ran out.
+     */
+    bool addTaskBlock();
+
+    /**
+     * Takes a task out of the queue and clears its slot so that it can be allocated again, its ID stops matching
+     * before it is taken out of the queue, so that nothing can put it back meanwhile. If another thread is still
+     * working on it through its ID, the slot is only cleared once that finishes, see finishRetiredTask. Must be called
+     * on the task manager thread.
+     */
+    void freeTask(TimerTask* task);
+
+    /**
+     * Clears the slot of a task that was freed while another thread was working on it through its ID, once that
+     * thread has finished with it. Must be called on the task manager thread.
+     */
+    void finishRetiredTask(TimerTask* task);
+
     /**
      * Removes an item from the task queue, so it is no longer in the run linked list. Note that there is a certain
      * amount of concurrency and it's possible that this may coincide with the task running.
@@ -416,9 +975,35 @@ private:
     void putItemIntoQueue(TimerTask* tm);
 
     /**
-     * When an interrupt occurs, this goes through all active tasks
+     * Changes the schedule of a task and moves it to its new place in the queue, or if it is running, marks it to be
+     * put back when it finishes. Task manager thread only, see rescheduleTask.
+     */
+    void applySchedule(TimerTask* task, sched_t when, TimerUnit unit, bool repeating);
+
+    /**
+     * When an interrupt occurs, this delivers every queued interrupt in order, applies schedule changes made on other
+     * threads, and then goes through all active events
      */
     void dealWithInterrupt();
+
+    /**
+     * Works out if task manager is overloaded according to the policy.
+     */
+    void updateOverloadState();
+
+#ifndef TM_NO_UTILIZATION_ACCOUNTING
+    /**
+     * Updates the utilization estimate and windows if a sample period has passed.
+     * @param now the current micros()
+     */
+    void sampleUtilization(uint32_t now);
+#endif
+
+    /**
+     * Called for a due task while overloaded, either reschedules the task according to the policy, or leaves it to run.
+     * @return true if the task was shed, false if it should run as usual.
+     */
+    bool shedIfNeeded(TimerTask* task);
 };
 
 /** the global task manager, this would normally be associated with the main runLoop. */
@@ -27,6 +27,12 @@ class TimerTask;
 #if defined(BUILD_FOR_PICO_CMAKE)
 #include <pico/stdlib.h>
 #include <valarray>
+#elif defined(BUILD_FOR_HOSTED)
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cctype>
+#include <pthread.h>
 #elif !defined(__MBED__)
 #include <Arduino.h>
 #endif
@@ -117,6 +123,32 @@ namespace tm_internal {
         //core_util_atomic_store_ptr((void* volatile*)pPtr,  newValue);
         *pPtr = newValue;
     }
+
+    typedef volatile uint32_t TmAtomicCounter;
+
+    /**
+     * Sets the counter to the new value ONLY when the existing value matches expected.
+     * @return true if the replacement was done, otherwise false
+     */
+    inline bool atomicSwapCounter(TmAtomicCounter *ptr, uint32_t expected, uint32_t newValue) {
+        return core_util_atomic_cas_u32(ptr, &expected, newValue);
+    }
+
+    /**
+     * Atomically adds delta to the counter (two's complement, so negative values subtract).
+     * @return the value after the addition
+     */
+    inline uint32_t atomicAddCounter(TmAtomicCounter *ptr, int32_t delta) {
+        return core_util_atomic_incr_u32(ptr, (uint32_t)delta);
+    }
+
+    inline uint32_t atomicReadCounter(TmAtomicCounter *ptr) {
+        return *ptr;
+    }
+
+    inline void atomicWriteCounter(TmAtomicCounter *ptr, uint32_t newValue) {
+        *ptr = newValue;
+    }
 }
 #elif defined(ESP8266) || defined(ESP32) || defined(ARDUINO_PICO_REVISION)
 typedef uint8_t pintype_t;
@@ -127,8 +159,38 @@ typedef uint8_t pintype_t;
 
 #if defined(ESP8266) || defined(ARDUINO_PICO_REVISION)
 #include <atomic>
+#if defined(ARDUINO_PICO_REVISION)
+#include <hardware/sync.h>
+#endif
 namespace tm_internal {
 
+    typedef uint32_t TmInterruptState;
+
+    /**
+     * Disables interrupts and returns the state they were in, pass it to restoreInterrupts afterwards. Unlike the pair
+     * noInterrupts and interrupts, this is safe inside an interrupt, as it does not turn interrupts back on there.
+     * @return the interrupt state before the call
+     */
+    inline TmInterruptState saveAndDisableInterrupts() {
+#if defined(ESP8266)
+        return xt_rsil(15);
+#else
+        return save_and_disable_interrupts();
+#endif
+    }
+
+    /**
+     * Puts back the interrupt state returned by saveAndDisableInterrupts.
+     * @param state the state to restore
+     */
+    inline void restoreInterrupts(TmInterruptState state) {
+#if defined(ESP8266)
+        xt_wsr_ps(state);
+#else
+        restore_interrupts(state);
+#endif
+    }
+
     typedef std::atomic<TimerTask *> TimerTaskAtomicPtr;
 
     typedef std::atomic<uint32_t> TmAtomicBool;
@@ -143,12 +205,12 @@ namespace tm_internal {
     inline bool atomicSwapBool(TmAtomicBool *ptr, bool expected, bool newValue) {
         // compare and swap is not implemented on ESP8266
         auto ret = false;
-        noInterrupts();
+        auto intState = saveAndDisableInterrupts();
         if(ptr->load() == expected) {
             ptr->store(newValue);
             ret = true;
         }
-        interrupts();
+        restoreInterrupts(intState);
         return ret;
     }
 
@@ -190,6 +252,43 @@ namespace tm_internal {
     inline void atomicWritePtr(TimerTaskAtomicPtr *pPtr, TimerTask *newValue) {
         pPtr->store(newValue);
     }
+
+    typedef std::atomic<uint32_t> TmAtomicCounter;
+
+    /**
+     * Sets the counter to the new value ONLY when the existing value matches expected.
+     * @return true if the replacement was done, otherwise false
+     */
+    inline bool atomicSwapCounter(TmAtomicCounter *ptr, uint32_t expected, uint32_t newValue) {
+        auto ret = false;
+        auto intState = saveAndDisableInterrupts();
+        if(ptr->load() == expected) {
+            ptr->store(newValue);
+            ret = true;
+        }
+        restoreInterrupts(intState);
+        return ret;
+    }
+
+    /**
+     * Atomically adds delta to the counter (two's complement, so negative values subtract).
+     * @return the value after the addition
+     */
+    inline uint32_t atomicAddCounter(TmAtomicCounter *ptr, int32_t delta) {
+        auto intState = saveAndDisableInterrupts();
+        uint32_t ret = ptr->load() + (uint32_t)delta;
+        ptr->store(ret);
+        restoreInterrupts(intState);
+        return ret;
+    }
+
+    inline uint32_t atomicReadCounter(TmAtomicCounter *ptr) {
+        return ptr->load();
+    }
+
+    inline void atomicWriteCounter(TmAtomicCounter *ptr, uint32_t newValue) {
+        ptr->store(newValue);
+    }
 }
 #else
 # define IOA_MULTITHREADED
@@ -223,7 +322,8 @@ namespace tm_internal {
      * @return the boolean value.
      */
     inline bool atomicReadBool(TmAtomicBool *pPtr) {
-        return *pPtr != 0;
+        // volatile alone gives no ordering between the two cores, so use the compiler atomics which add the barriers.
+        return __atomic_load_n(pPtr, __ATOMIC_SEQ_CST) != 0;
     }
 
     /**
@@ -232,7 +332,7 @@ namespace tm_internal {
      * @param newVal the new value
      */
     inline void atomicWriteBool(TmAtomicBool *pPtr, bool newVal) {
-        *pPtr = newVal;
+        __atomic_store_n(pPtr, newVal ? 1U : 0U, __ATOMIC_SEQ_CST);
     }
 
     /**
@@ -255,6 +355,41 @@ namespace tm_internal {
     inline void atomicWritePtr(TimerTaskAtomicPtr *pPtr, TimerTask *newValue) {
         *pPtr = newValue;
     }
+
+    typedef volatile uint32_t TmAtomicCounter;
+
+    /**
+     * Sets the counter to the new value ONLY when the existing value matches expected, uses the same CAS as booleans.
+     * @return true if the replacement was done, otherwise false
+     */
+    inline bool atomicSwapCounter(TmAtomicCounter *ptr, uint32_t expected, uint32_t newValue) {
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0)
+        uxPortCompareSet(ptr, expected, &newValue);
+        return newValue == expected;
+#else
+        return esp_cpu_compare_and_set(ptr, expected, newValue);
+#endif
+    }
+
+    /**
+     * Atomically adds delta to the counter (two's complement, so negative values subtract).
+     * @return the value after the addition
+     */
+    inline uint32_t atomicAddCounter(TmAtomicCounter *ptr, int32_t delta) {
+        uint32_t existing;
+        do {
+            existing = *ptr;
+        } while(!atomicSwapCounter(ptr, existing, existing + (uint32_t)delta));
+        return existing + (uint32_t)delta;
+    }
+
+    inline uint32_t atomicReadCounter(TmAtomicCounter *ptr) {
+        return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+    }
+
+    inline void atomicWriteCounter(TmAtomicCounter *ptr, uint32_t newValue) {
+        __atomic_store_n(ptr, newValue, __ATOMIC_SEQ_CST);
+    }
 }
 #endif
 #elif defined(BUILD_FOR_PICO_CMAKE)
@@ -301,6 +436,103 @@ namespace tm_internal {
     inline TimerTask *atomicReadPtr(TimerTaskAtomicPtr *ptr) {
         return *ptr;
     }
+
+    typedef volatile uint32_t TmAtomicCounter;
+
+    inline bool atomicSwapCounter(TmAtomicCounter *ptr, uint32_t expected, uint32_t newValue) {
+        bool ret = false;
+        critical_section_enter_blocking(tmLock);
+        if(*ptr == expected) {
+            *ptr = newValue;
+            ret = true;
+        }
+        critical_section_exit(tmLock);
+        return ret;
+    }
+
+    inline uint32_t atomicAddCounter(TmAtomicCounter *ptr, int32_t delta) {
+        critical_section_enter_blocking(tmLock);
+        uint32_t ret = *ptr + (uint32_t)delta;
+        *ptr = ret;
+        critical_section_exit(tmLock);
+        return ret;
+    }
+
+    inline uint32_t atomicReadCounter(TmAtomicCounter *ptr) {
+        return *ptr;
+    }
+
+    inline void atomicWriteCounter(TmAtomicCounter *ptr, uint32_t newValue) {
+        *ptr = newValue;
+    }
+}
+#elif defined(BUILD_FOR_HOSTED)
+//
+// A hosted build runs task manager as an ordinary program on Linux or another POSIX system, for development and
+// measurement. Arduino functions such as millis and micros are provided by task manager itself, see TaskManagerIO.h,
+// the cmake/hosted build defines BUILD_FOR_HOSTED.
+//
+# define IOA_MULTITHREADED
+inline void* getCurrentThreadId() { return (void*)pthread_self(); }
+
+#if defined(TM_ENABLE_CAPTURED_LAMBDAS)
+#define TM_ALLOW_CAPTURED_LAMBDA
+#endif
+typedef uint8_t pintype_t;
+
+namespace tm_internal {
+    typedef TimerTask* volatile TimerTaskAtomicPtr;
+    typedef volatile bool TmAtomicBool;
+
+    /**
+     * Sets the boolean to the new value ONLY when the existing value matches expected.
+     * @return true if the replacement was done, otherwise false
+     */
+    inline bool atomicSwapBool(TmAtomicBool *ptr, bool expected, bool newValue) {
+        return __atomic_compare_exchange_n(ptr, &expected, newValue, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+
+    inline bool atomicReadBool(TmAtomicBool *pPtr) {
+        return __atomic_load_n(pPtr, __ATOMIC_SEQ_CST);
+    }
+
+    inline void atomicWriteBool(TmAtomicBool *pPtr, bool newVal) {
+        __atomic_store_n(pPtr, newVal, __ATOMIC_SEQ_CST);
+    }
+
+    inline TimerTask *atomicReadPtr(TimerTaskAtomicPtr *pPtr) {
+        return __atomic_load_n(pPtr, __ATOMIC_SEQ_CST);
+    }
+
+    inline void atomicWritePtr(TimerTaskAtomicPtr *pPtr, TimerTask *newValue) {
+        __atomic_store_n(pPtr, newValue, __ATOMIC_SEQ_CST);
+    }
+
+    typedef volatile uint32_t TmAtomicCounter;
+
+    /**
+     * Sets the counter to the new value ONLY when the existing value matches expected.
+     * @return true if the replacement was done, otherwise false
+     */
+    inline bool atomicSwapCounter(TmAtomicCounter *ptr, uint32_t expected, uint32_t newValue) {
+        return __atomic_compare_exchange_n(ptr, &expected, newValue, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+
+    /**
+     * Atomically adds delta to the counter (two's complement, so negative values subtract).
+     * @return the value after the addition
+     */
+    inline uint32_t atomicAddCounter(TmAtomicCounter *ptr, int32_t delta) {
+        return __atomic_add_fetch(ptr, (uint32_t)delta, __ATOMIC_SEQ_CST);
+    }
+
+    inline uint32_t atomicReadCounter(TmAtomicCounter *ptr) {
+        return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+    }
+
+    inline void atomicWriteCounter(TmAtomicCounter *ptr, uint32_t newValue) {
+        __atomic_store_n(ptr, newValue, __ATOMIC_SEQ_CST);
+    }
 }
 #else
 // fall back to using Arduino regular logic, works for all single core boards. If we end up here for a multicore
@@ -313,14 +545,63 @@ namespace tm_internal {
 typedef TimerTask *volatile TimerTaskAtomicPtr;
 typedef volatile bool TmAtomicBool;
 
+#if defined(__AVR__)
+    typedef uint8_t TmInterruptState;
+
+    /**
+     * Disables interrupts and returns the state they were in, pass it to restoreInterrupts afterwards. Unlike the pair
+     * noInterrupts and interrupts, this is safe inside an interrupt, as it does not turn interrupts back on there.
+     * @return the interrupt state before the call
+     */
+    inline TmInterruptState saveAndDisableInterrupts() {
+        TmInterruptState sreg = SREG;
+        cli();
+        return sreg;
+    }
+
+    /**
+     * Puts back the interrupt state returned by saveAndDisableInterrupts.
+     * @param state the state to restore
+     */
+    inline void restoreInterrupts(TmInterruptState state) {
+        SREG = state;
+        __asm__ __volatile__("" ::: "memory");
+    }
+#elif defined(__arm__)
+    typedef uint32_t TmInterruptState;
+
+    // on ARM Cortex-M the interrupt state is held in PRIMASK, see the AVR version above for details.
+    inline TmInterruptState saveAndDisableInterrupts() {
+        TmInterruptState primask;
+        __asm__ __volatile__("mrs %0, primask\n\tcpsid i" : "=r" (primask) :: "memory");
+        return primask;
+    }
+
+    inline void restoreInterrupts(TmInterruptState state) {
+        __asm__ __volatile__("msr primask, %0" :: "r" (state) : "memory");
+    }
+#else
+    typedef uint8_t TmInterruptState;
+
+    // there is no portable way to read the interrupt state on other boards, so here they are assumed to be enabled.
+    inline TmInterruptState saveAndDisableInterrupts() {
+        noInterrupts();
+        return 1;
+    }
+
+    inline void restoreInterrupts(TmInterruptState state) {
+        if(state) interrupts();
+    }
+#endif
+
     static bool atomicSwapBool(volatile bool* ptr, bool expected, bool newValue) {
         bool ret = false;
-        noInterrupts();
+        auto intState = saveAndDisableInterrupts();
         if(*ptr == expected) {
             *ptr = newValue;
             ret = true;
         }
-        interrupts();
+        restoreInterrupts(intState);
         return ret;
     }
 
@@ -334,15 +615,15 @@ typedef volatile bool TmAtomicBool;
 
 #if defined(__AVR__)
     inline void atomicWritePtr(TimerTaskAtomicPtr* pPtr, TimerTask* newValue) {
-        noInterrupts();
+        auto intState = saveAndDisableInterrupts();
         *pPtr = newValue;
-        interrupts();
+        restoreInterrupts(intState);
     }
 
     inline TimerTask* atomicReadPtr(TimerTaskAtomicPtr* pPtr) {
-        noInterrupts();
+        auto intState = saveAndDisableInterrupts();
         auto ptr = *pPtr;
-        interrupts();
+        restoreInterrupts(intState);
         return ptr;
     }
 #else
@@ -355,9 +636,59 @@ inline void atomicWritePtr(TimerTaskAtomicPtr* pPtr, TimerTask* newValue) {
         return *pPtr;
     }
 #endif // AVR check for PTR atomicity
+
+    typedef volatile uint32_t TmAtomicCounter;
+
+    inline bool atomicSwapCounter(TmAtomicCounter* ptr, uint32_t expected, uint32_t newValue) {
+        bool ret = false;
+        auto intState = saveAndDisableInterrupts();
+        if(*ptr == expected) {
+            *ptr = newValue;
+            ret = true;
+        }
+        restoreInterrupts(intState);
+        return ret;
+    }
+
+    inline uint32_t atomicAddCounter(TmAtomicCounter* ptr, int32_t delta) {
+        auto intState = saveAndDisableInterrupts();
+        uint32_t ret = *ptr + (uint32_t)delta;
+        *ptr = ret;
+        restoreInterrupts(intState);
+        return ret;
+    }
+
+    // on 8 bit boards a 32 bit read is not atomic, so we must protect it.
+    inline uint32_t atomicReadCounter(TmAtomicCounter* ptr) {
+        auto intState = saveAndDisableInterrupts();
+        uint32_t ret = *ptr;
+        restoreInterrupts(intState);
+        return ret;
+    }
+
+    inline void atomicWriteCounter(TmAtomicCounter* ptr, uint32_t newValue) {
+        auto intState = saveAndDisableInterrupts();
+        *ptr = newValue;
+        restoreInterrupts(intState);
+    }
 }
 #endif // All platform checks
 
+namespace tm_internal {
+    /**
+     * A full memory barrier, so that plain writes made before it are visible to other cores and interrupts before any
+     * made after it. Use this when publishing data with a counter. On 8 bit boards it only stops the compiler
+     * reordering, as that is all that is needed.
+     */
+    inline void memoryFence() {
+#if defined(__AVR__)
+        __asm__ __volatile__("" ::: "memory");
+#else
+        __sync_synchronize();
+#endif
+    }
+}
+
 // for all mbed and ESP boards we already enable lambda captures, SAMD is a known extra case that works.
 // we can only enable on larger boards with enough memory to take the extra size of the structures.
 #if defined(TM_ENABLE_CAPTURED_LAMBDAS) && defined(ARDUINO_ARCH_SAMD)
@@ -400,6 +731,21 @@ typedef uint32_t sched_t;
 #endif // DEFAULT_TASK_BLOCKS not defined when task size is
 #endif // DEFAULT_TASK_SIZE defined already
 
+//
+// TM_MAX_TASK_BLOCKS definition:
+// Task manager adds blocks of DEFAULT_TASK_SIZE tasks as they are needed, up to this many blocks. Each block allowed
+// costs one pointer even when not allocated. On AVR the default is DEFAULT_TASK_BLOCKS, on all other boards it is four
+// times that. At most DEFAULT_TASK_SIZE * TM_MAX_TASK_BLOCKS tasks can exist at once, for example 16 * 64 = 1024 on
+// 32 bit boards with the defaults. You can change it by defining TM_MAX_TASK_BLOCKS yourself.
+//
+#ifndef TM_MAX_TASK_BLOCKS
+#ifdef __AVR__
+# define TM_MAX_TASK_BLOCKS DEFAULT_TASK_BLOCKS
+#else
+# define TM_MAX_TASK_BLOCKS (DEFAULT_TASK_BLOCKS * 4)
+#endif // platform
+#endif // TM_MAX_TASK_BLOCKS
+
 //
 // Here we define an attribute needed for interrupt support on ESP8266 and ESP32 boards, any interrupt code that is
 // going to run on these boards should be marked with this attribute.
@@ -6,6 +6,7 @@
 
 #include "TaskTypes.h"
 #include "TaskManager.h"
+#include "TmClockSource.h"
 
 /**
  * A small internal helper class that manages the running state by scope. Create this lightweight class as a local
@@ -30,6 +31,20 @@ TimerTask::TimerTask() : callback() {
     timingInformation = TIME_MILLIS;
     myTimingSchedule = 0;
     scheduledAt = 0;
+    label = nullptr;
+    budgetMicros = 0;
+    overrunCount = 0;
+    shedCount = 0;
+    generation = 0;
+#ifdef TM_ALLOW_CAPTURED_LAMBDA
+    fnPointer = nullptr;
+#endif
+#ifdef IOA_MULTITHREADED
+    tm_internal::atomicWriteCounter(&handleUsers, 0);
+    pendingSchedule = 0;
+    pendingTiming = TIME_MILLIS;
+    tm_internal::atomicWriteCounter(&pendingState, TM_PENDING_NONE);
+#endif
     next = nullptr;
     taskRef = nullptr;
     executeMode = EXECTYPE_FUNCTION;
@@ -40,8 +55,20 @@ TimerTask::TimerTask() : callback() {
 void TimerTask::initialise(sched_t when, TimerUnit unit, TimerFn execCallback, bool repeating) {
     handleScheduling(when, unit, repeating);
     this->callback = execCallback;
+#ifdef TM_ALLOW_CAPTURED_LAMBDA
+    this->fnPointer = nullptr;
+#endif
+    this->executeMode = EXECTYPE_FUNCTION;
+}
+
+#ifdef TM_ALLOW_CAPTURED_LAMBDA
+void TimerTask::initialise(sched_t when, TimerUnit unit, TimerFnPointer execCallback, bool repeating) {
+    handleScheduling(when, unit, repeating);
+    this->callback = execCallback;
+    this->fnPointer = execCallback;
     this->executeMode = EXECTYPE_FUNCTION;
 }
+#endif // TM_ALLOW_CAPTURED_LAMBDA
 
 void TimerTask::handleScheduling(sched_t when, TimerUnit unit, bool repeating) {
     tm_internal::atomicWritePtr(&next, nullptr);
@@ -52,7 +79,7 @@ void TimerTask::handleScheduling(sched_t when, TimerUnit unit, bool repeating) {
     }
     this->myTimingSchedule = when;
     this->timingInformation = repeating ? TimerUnit(unit | TM_TIME_REPEATING)  : unit;
-    this->scheduledAt = (isMicrosSchedule()) ? micros() : millis();
+    this->scheduledAt = tm_internal::schedulerNow(isMicrosSchedule());
     taskEnabled = true;
 }
 
@@ -69,18 +96,97 @@ void TimerTask::initialiseEvent(BaseEvent* event, bool deleteWhenDone) {
 }
 
 unsigned long TimerTask::microsFromNow() {
-    uint32_t microsFromNow;
-    if (isMicrosSchedule()) {
-        uint32_t delay = myTimingSchedule;
-        uint32_t alreadyTaken = (micros() - scheduledAt);
-        microsFromNow =  (delay < alreadyTaken) ? 0 : (delay - alreadyTaken);
+    bool inMicros = isMicrosSchedule();
+    uint64_t delay = inMicros ? uint64_t(myTimingSchedule) : uint64_t(myTimingSchedule) * 1000ULL;
+    uint64_t alreadyTaken = tm_internal::schedulerMicrosSince(scheduledAt, inMicros);
+    if(delay <= alreadyTaken) return 0;
+    uint64_t remaining = delay - alreadyTaken;
+    return (remaining > 0xffffffffULL) ? 0xffffffffUL : uint32_t(remaining);
+}
+
+sched_t TimerTask::unitsFromNow() {
+    bool inMicros = isMicrosSchedule();
+    uint64_t delay = inMicros ? uint64_t(myTimingSchedule) : uint64_t(myTimingSchedule) * 1000ULL;
+    uint64_t alreadyTaken = tm_internal::schedulerMicrosSince(scheduledAt, inMicros);
+    if(delay <= alreadyTaken) return 0;
+    // part of a millisecond still to go counts as a whole one, so a task is never reported due before it is.
+    uint64_t remaining = delay - alreadyTaken;
+    return sched_t(inMicros ? remaining : (remaining + 999ULL) / 1000ULL);
+}
+
+void TimerTask::changeSchedule(sched_t when, TimerUnit unit, bool repeating) {
+    if(unit == TIME_SECONDS) {
+        when = when * sched_t(1000);
+        unit = TIME_MILLIS;
+    }
+    auto flags = timingInformation & (TM_TIME_RUNNING | TM_TIME_RESCHEDULED);
+    myTimingSchedule = when;
+    scheduledAt = tm_internal::schedulerNow(unit == TIME_MICROS);
+    timingInformation = TimerUnit(unit | flags | (repeating ? TM_TIME_REPEATING : 0));
+}
+
+#ifdef IOA_MULTITHREADED
+void TimerTask::setPendingSchedule(sched_t when, TimerUnit unit, bool repeating) {
+    // take the fields from either state but busy, there is at most one other writer or task manager in there briefly.
+    uint32_t state;
+    while(true) {
+        state = tm_internal::atomicReadCounter(&pendingState);
+        if(state != TM_PENDING_BUSY && tm_internal::atomicSwapCounter(&pendingState, state, TM_PENDING_BUSY)) break;
+        yield();
+    }
+    pendingSchedule = when;
+    pendingTiming = TimerUnit(unit | (repeating ? TM_TIME_REPEATING : 0));
+    tm_internal::atomicWriteCounter(&pendingState, TM_PENDING_READY);
+}
+
+bool TimerTask::takePendingSchedule(sched_t& when, TimerUnit& unit, bool& repeating) {
+    if(!tm_internal::atomicSwapCounter(&pendingState, TM_PENDING_READY, TM_PENDING_BUSY)) return false;
+    when = pendingSchedule;
+    unit = TimerUnit(pendingTiming & 0x0fU);
+    repeating = (pendingTiming & TM_TIME_REPEATING) != 0;
+    pendingTiming = TIME_MILLIS;
+    tm_internal::atomicWriteCounter(&pendingState, TM_PENDING_NONE);
+    return true;
+}
+#endif // IOA_MULTITHREADED
+
+void TimerTask::setFirstRunIn(sched_t remaining) {
+    uint32_t delay = myTimingSchedule;
+    if(remaining > delay) remaining = delay;
+    // pretend the interval started a little while ago.
+    scheduledAt = tm_internal::schedulerTimeBefore(delay - remaining, isMicrosSchedule());
+}
+
+uint32_t TimerTask::microsOverdue() {
+    bool inMicros = isMicrosSchedule();
+    uint64_t delay = inMicros ? uint64_t(myTimingSchedule) : uint64_t(myTimingSchedule) * 1000ULL;
+    uint64_t alreadyTaken = tm_internal::schedulerMicrosSince(scheduledAt, inMicros);
+    if(alreadyTaken <= delay) return 0;
+    uint64_t overdue = alreadyTaken - delay;
+    return (overdue > 0xffffffffULL) ? 0xffffffffUL : uint32_t(overdue);
+}
+
+void TimerTask::deferFor(uint32_t deferMicros) {
+    // round up for millisecond tasks, so that a short defer still postpones the task rather than leaving it due.
+    uint32_t units = isMicrosSchedule() ? deferMicros : ((deferMicros / 1000UL) + ((deferMicros % 1000UL) != 0));
+    // where the schedule is only 16 bits, the delay is limited to what it can hold.
+    auto deferUnits = (units > uint32_t(sched_t(~sched_t(0)))) ? sched_t(~sched_t(0)) : sched_t(units);
+    if(isRepeating()) {
+        setFirstRunIn(deferUnits);
     }
     else {
-        uint32_t delay = myTimingSchedule;
-        uint32_t alreadyTaken = (millis() - scheduledAt);
-        microsFromNow = (delay < alreadyTaken) ? 0 : ((delay - alreadyTaken) * 1000UL);
+        myTimingSchedule = deferUnits;
+        scheduledAt = tm_internal::schedulerNow(isMicrosSchedule());
     }
-    return microsFromNow;
+}
+
+TimerFnPointer TimerTask::getFunctionPointer() const {
+    if(getExecutionType() != EXECTYPE_FUNCTION) return nullptr;
+#ifdef TM_ALLOW_CAPTURED_LAMBDA
+    return fnPointer;
+#else
+    return callback;
+#endif
 }
 
 void TimerTask::execute() {
@@ -103,7 +209,7 @@ void TimerTask::execute() {
     }
 
     if (isRepeating() && isEnabled()) {
-        this->scheduledAt = isMicrosSchedule() ? micros() : millis();
+        this->scheduledAt = tm_internal::schedulerNow(isMicrosSchedule());
     }
 }
 
@@ -113,19 +219,40 @@ void TimerTask::clear() {
         delete taskRef;
     }
     taskRef = nullptr;
+    executeMode = EXECTYPE_FUNCTION;
 #ifdef TM_ALLOW_CAPTURED_LAMBDA
     callback = std::function<void()>();
+    fnPointer = nullptr;
 #endif
 
     // clear timing info
     scheduledAt = 0;
+    label = nullptr;
+    budgetMicros = 0;
+    overrunCount = 0;
+    shedCount = 0;
     timingInformation = TIME_MILLIS;
+#ifdef IOA_MULTITHREADED
+    // a change posted for the task that is finishing must not be applied to the next one in this slot.
+    tm_internal::atomicWriteCounter(&pendingState, TM_PENDING_NONE);
+#endif
 
     // lastly remove the next pointer and then mark as available.
     tm_internal::atomicWritePtr(&next, nullptr);
     tm_internal::atomicWriteBool(&taskInUse, false);
 }
 
+bool TimerTask::retireHandle() {
+    generation = (generation + 1) & TM_TASK_GENERATION_MASK;
+#ifdef IOA_MULTITHREADED
+    // calls through the old ID only hold the task for a few instructions, so this rarely finds any still working.
+    tm_internal::atomicAddCounter(&handleUsers, int32_t(TM_HANDLE_RETIRING));
+    return finishRetiring();
+#else
+    return true;
+#endif
+}
+
 void TimerTask::processEvent() {
     RunningState runningState(this);
     myTimingSchedule = eventRef->timeOfNextCheck();
@@ -134,7 +261,7 @@ void TimerTask::processEvent() {
         eventRef->exec();
     }
 
-    scheduledAt = micros();
+    scheduledAt = tm_internal::schedulerNow(true);
 }
 
 bool TimerTask::isRepeating() const {
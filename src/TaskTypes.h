@@ -12,15 +12,54 @@
  */
 
 #include "TaskPlatformDeps.h"
+#include "TmClockSource.h"
 
 #define TASKMGR_INVALIDID 0xffffU
 
 /**
  * Represents the identifier of a task, it can be used to query, alter and cancel tasks. You should not rely on
  * any characteristics of this type, it could change later, it is essentially no more than a handle to a task.
+ *
+ * Internally, the low bits hold the slot that the task is in, and the high bits hold the generation of that slot,
+ * which goes up each time the slot is freed. Once a task has finished or been cancelled, its ID no longer matches the
+ * slot, so any call made with it afterwards does nothing, even when the slot has since been used for another task.
+ *
+ * The generation wraps, so this holds until the slot has been reused as many times as there are generations. On AVR
+ * taskid_t is 16 bits and the generation has 8 of them, so an ID held across 256 reuses of its slot can match again.
+ * On 32 bit boards the generation has 16 bits and wraps after 65536 reuses. Don't keep an old ID around for longer
+ * than that, clear it when its task finishes.
  */
 typedef unsigned int taskid_t;
 
+#if defined(__AVR__)
+/** the number of bits of a task ID that hold the slot, the rest hold the generation, which wraps after 256 reuses */
+# define TM_TASK_SLOT_BITS 8
+#else
+/** with a 32 bit taskid_t this leaves 16 bits of generation, which wraps after 65536 reuses of a slot */
+# define TM_TASK_SLOT_BITS 16
+#endif
+#define TM_TASK_SLOT_MASK ((taskid_t(1) << TM_TASK_SLOT_BITS) - 1U)
+#define TM_TASK_GENERATION_MASK (taskid_t(~taskid_t(0)) >> TM_TASK_SLOT_BITS)
+
+/** set in the handle user count of a task that was freed while calls through its old ID were still working on it */
+#define TM_HANDLE_RETIRING 0x80000000UL
+
+/** the states of the pending schedule of a task: none, being written or read, and ready to apply */
+#define TM_PENDING_NONE 0U
+#define TM_PENDING_BUSY 1U
+#define TM_PENDING_READY 2U
+
+/** @return the slot part of a task ID */
+inline taskid_t tmSlotOfTaskId(taskid_t taskId) { return taskId & TM_TASK_SLOT_MASK; }
+
+/** @return the generation part of a task ID */
+inline taskid_t tmGenerationOfTaskId(taskid_t taskId) { return taskId >> TM_TASK_SLOT_BITS; }
+
+/** @return a task ID made from a slot and the generation of that slot */
+inline taskid_t tmMakeTaskId(taskid_t slot, taskid_t generation) {
+    return taskid_t((generation << TM_TASK_SLOT_BITS) | (slot & TM_TASK_SLOT_MASK));
+}
+
 /**
  * Any class extending from executable can be passed by reference to task manager and the exec() method will be called
  * when the scheduled time is reached.
@@ -43,6 +82,14 @@ class TaskManager;
 /** the global task manager instance that would normally be associated with the main loop */
 extern TaskManager taskManager;
 
+//
+// How often an event that is only ever woken by being triggered asks to be polled when nothing is pending, rarely, as
+// the trigger notifies task manager itself. Define it before including task manager to change it.
+//
+#ifndef TM_IDLE_CHECK_MICROS
+#define TM_IDLE_CHECK_MICROS (300UL * 1000000UL)
+#endif
+
 /**
  * BaseEvent objects represent events that can be managed by task manager. We can create a base event as either
  * a global variable, or as a new object that lasts at least as long as it's registered with task manager.
@@ -117,11 +164,18 @@ public:
  */
 #ifdef TM_ALLOW_CAPTURED_LAMBDA
 #include <functional>
+#include <type_traits>
 typedef std::function<void()> TimerFn;
 #else
 typedef void (*TimerFn)();
 #endif
 
+/**
+ * A plain function pointer with the same signature as TimerFn, used where the function must be compared or stored
+ * by address, which is not possible for captured lambdas.
+ */
+typedef void (*TimerFnPointer)();
+
 /**
  * The time units that can be used with the schedule calls.
  */
@@ -135,6 +189,7 @@ enum TimerUnit : uint8_t {
 
     TM_TIME_REPEATING = 0x10,
     TM_TIME_RUNNING = 0x20,
+    TM_TIME_RESCHEDULED = 0x40,
 };
 
 /**
@@ -149,6 +204,7 @@ enum ExecutionType : uint8_t {
 
     EXECTYPE_MASK = 0x03,
     EXECTYPE_DELETE_ON_DONE = 0x08,
+    EXECTYPE_SHEDDABLE = 0x10,
 
     EXECTYPE_DEL_EXECUTABLE = EXECTYPE_EXECUTABLE | EXECTYPE_DELETE_ON_DONE,
     EXECTYPE_DEL_EVENT = EXECTYPE_EVENT | EXECTYPE_DELETE_ON_DONE
@@ -169,6 +225,8 @@ private:
         BaseEvent *eventRef;
     };
     TimerFn callback;
+    /** the plain function when the task was created with one, as it cannot be recovered from callback */
+    TimerFnPointer fnPointer;
 #else
     /** the thing that needs to be executed when the time is reached or event is triggered */
     volatile union {
@@ -181,10 +239,14 @@ private:
     /** TimerTask is essentially stored in a linked list by time in TaskManager, this represents the next item */
     tm_internal::TimerTaskAtomicPtr next;
 
-    /** the time at which the task was last scheduled, used to compare against the current time */
-    volatile uint32_t scheduledAt;
+    /** the time at which the task was last scheduled, used to compare against the current time, see TmSchedTime */
+    volatile tm_internal::TmSchedTime scheduledAt;
     /** The timing information for this task, or it's interval */
     volatile sched_t myTimingSchedule;
+    /** An optional label for diagnostics, it must be a string that is never freed, such as a literal */
+    const char* volatile label;
+    /** The longest that a single run of this task should take in microseconds, 0 for no limit */
+    volatile uint32_t budgetMicros;
 
     // 8 bit values start here.
 
@@ -196,6 +258,22 @@ private:
     volatile ExecutionType executeMode;
     /** Stores a flag to indicate if the task is enabled */
     tm_internal::TmAtomicBool taskEnabled;
+    /** The number of runs in a row that went over budget, see TmOverrunMonitor */
+    volatile uint8_t overrunCount;
+    /** The number of times a sheddable task has come due while overloaded */
+    uint8_t shedCount;
+    /** Goes up each time the slot is freed, so that task IDs for earlier tasks in this slot no longer match */
+    volatile taskid_t generation;
+#ifdef IOA_MULTITHREADED
+    /** The number of calls currently working on this task through its ID, see acquireHandle */
+    tm_internal::TmAtomicCounter handleUsers;
+    /** A schedule change made on another thread that task manager has not yet applied, see setPendingSchedule */
+    volatile sched_t pendingSchedule;
+    /** The unit of the pending schedule, along with TM_TIME_REPEATING when it repeats */
+    volatile TimerUnit pendingTiming;
+    /** Guards the pending schedule fields, see setPendingSchedule */
+    tm_internal::TmAtomicCounter pendingState;
+#endif
 public:
     TimerTask();
 
@@ -212,6 +290,16 @@ public:
      */
     void initialise(sched_t when, TimerUnit unit, TimerFn execCallback, bool repeating);
 
+#ifdef TM_ALLOW_CAPTURED_LAMBDA
+    /**
+     * Initialise a task slot to call a plain function, the function is recorded so getFunctionPointer can return it.
+     * @param executionInfo the time of execution
+     * @param unit the unit of time measurement
+     * @param execCallback the function to call back
+     */
+    void initialise(sched_t when, TimerUnit unit, TimerFnPointer execCallback, bool repeating);
+#endif // TM_ALLOW_CAPTURED_LAMBDA
+
     /**
      * Initialise a task slot with execution information
      * @param executionInfo the time of execution
@@ -328,6 +416,237 @@ public:
      * @param ena the enablement status
      */
     void setEnabled(bool ena) { tm_internal::atomicWriteBool(&taskEnabled, ena); }
+
+    /**
+     * @return the interval of a repeating task, or the delay of a one shot task, in the units of getTimerUnit()
+     */
+    sched_t getSchedule() const { return myTimingSchedule; }
+
+    /**
+     * @return either TIME_MICROS or TIME_MILLIS, tasks scheduled in seconds are held in milliseconds.
+     */
+    TimerUnit getTimerUnit() const { return TimerUnit(timingInformation & 0x0fU); }
+
+    /**
+     * @return the execution type of this task without the memory ownership flag
+     */
+    ExecutionType getExecutionType() const { return ExecutionType(executeMode & EXECTYPE_MASK); }
+
+    /**
+     * @return the executable that this task calls, or nullptr if it is not an executable task
+     */
+    Executable* getExecutable() const { return (getExecutionType() == EXECTYPE_EXECUTABLE) ? taskRef : nullptr; }
+
+    /**
+     * @return the plain function that this task calls, or nullptr if it is not a function task, or it was created from a
+     * lambda. Where lambdas are allowed, only functions passed directly to task manager are known.
+     */
+    TimerFnPointer getFunctionPointer() const;
+
+    /**
+     * @return the time before execution in the units of getTimerUnit(), 0 means it's due or past due.
+     */
+    sched_t unitsFromNow();
+
+    /**
+     * Changes the schedule of a timed task that is already in use, keeping what it calls, the next run is the time
+     * given from now. The running and rescheduled flags are kept as they were. Only call on the task manager thread,
+     * which is the only thread that changes the flags, see TaskManager::rescheduleTask.
+     * @param when the new interval or delay
+     * @param unit the unit of when
+     * @param repeating true if the task should repeat, false to run once more
+     */
+    void changeSchedule(sched_t when, TimerUnit unit, bool repeating);
+
+    /**
+     * Marks the task as needing to be put back into the queue at its new time, because its schedule was changed while
+     * it was running. A one shot task that is marked runs again rather than being freed. Task manager thread only.
+     */
+    void markRescheduled() { timingInformation = TimerUnit(timingInformation | TM_TIME_RESCHEDULED); }
+
+    /**
+     * Clears the rescheduled flag
+     * @return true if it was set
+     */
+    bool clearRescheduled() {
+        if((timingInformation & TM_TIME_RESCHEDULED) == 0) return false;
+        timingInformation = TimerUnit(timingInformation & ~TM_TIME_RESCHEDULED);
+        return true;
+    }
+
+    /**
+     * Moves the start of the current interval so that the task next runs in the time given, rather than a full
+     * interval from now, later runs are at the usual interval. Only call before the task is put into the queue.
+     * @param remaining the time until it should next run, in the units of getTimerUnit(), at most the interval
+     */
+    void setFirstRunIn(sched_t remaining);
+
+    /**
+     * @return the diagnostic label of this task, or nullptr if it has none
+     */
+    const char* getLabel() const { return label; }
+
+    /**
+     * Set a label for diagnostics, it is cleared when the task is.
+     * @param newLabel a string that is never freed, such as a literal
+     */
+    void setLabel(const char* newLabel) { label = newLabel; }
+
+    /**
+     * @return the longest a single run of this task should take in microseconds, 0 for no limit
+     */
+    uint32_t getBudgetMicros() const { return budgetMicros; }
+
+    /**
+     * Set the longest a single run of this task should take, it is checked by TmOverrunMonitor.
+     * @param budget the budget in microseconds, 0 for no limit
+     */
+    void setBudgetMicros(uint32_t budget) { budgetMicros = budget; }
+
+    /**
+     * @return the number of runs in a row that went over budget
+     */
+    uint8_t getOverrunCount() const { return overrunCount; }
+
+    /**
+     * Record that the current run has gone over budget
+     * @return the number of runs in a row that have gone over budget
+     */
+    uint8_t markOverrun() {
+        if(overrunCount != 0xffU) overrunCount = overrunCount + 1;
+        return overrunCount;
+    }
+
+    /**
+     * Called when a run completes within budget, so that only overruns in a row are counted.
+     */
+    void clearOverruns() { overrunCount = 0; }
+
+    /**
+     * @return true if this task can be skipped or deferred when task manager is overloaded
+     */
+    bool isSheddable() const { return (executeMode & EXECTYPE_SHEDDABLE) != 0; }
+
+    /**
+     * Mark the task as one that can be skipped or deferred when task manager is overloaded, see TmOverloadPolicy.
+     * @param sheddable true if it can be shed
+     */
+    void setSheddable(bool sheddable) {
+        executeMode = ExecutionType(sheddable ? (executeMode | EXECTYPE_SHEDDABLE) : (executeMode & ~EXECTYPE_SHEDDABLE));
+    }
+
+    /**
+     * @return the number of times this has come due while overloaded, incremented by each call.
+     */
+    uint8_t incrementShedCount() { return ++shedCount; }
+
+    /**
+     * @return the generation of this slot, part of the ID of the task in it
+     */
+    taskid_t getGeneration() const { return generation; }
+
+    /**
+     * Sets the generation that a newly created slot starts at, only used by TaskBlock before the slot is ever used.
+     * @param startGeneration the generation to start at
+     */
+    void setGeneration(taskid_t startGeneration) { generation = startGeneration & TM_TASK_GENERATION_MASK; }
+
+    /**
+     * Registers a call that is working on this task through a task ID, and checks that the ID is still current. While
+     * registered, the task cannot be freed, so whatever is done to it applies to the task the ID was given for. This
+     * needs no lock, it is always paired with releaseHandle, even when the ID did not match.
+     * @param idGeneration the generation from the task ID
+     * @return true if the ID is still current, false if the task has finished or been cancelled since.
+     */
+    bool acquireHandle(taskid_t idGeneration) {
+#ifdef IOA_MULTITHREADED
+        tm_internal::atomicAddCounter(&handleUsers, 1);
+#endif
+        return generation == idGeneration && isInUse();
+    }
+
+    /**
+     * Ends a call started with acquireHandle.
+     * @return true if this was the last call working on a task that was freed meanwhile, task manager then needs to
+     * finish freeing it, see retireHandle.
+     */
+    bool releaseHandle() {
+#ifdef IOA_MULTITHREADED
+        return tm_internal::atomicAddCounter(&handleUsers, -1) == TM_HANDLE_RETIRING;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Moves the slot on to the next generation, so that the current ID no longer matches. Called on the task manager
+     * thread before freeing the slot. If a call is still working through the old ID, the slot is marked as retiring
+     * instead of waiting, and task manager finishes freeing it once the last such call ends, see finishRetiring.
+     * @return true if the slot can be freed straight away, false if it is now retiring.
+     */
+    bool retireHandle();
+
+    /**
+     * @return true if the task was freed while calls through its old ID were still working on it, it is not run again.
+     */
+    bool isRetiring() {
+#ifdef IOA_MULTITHREADED
+        return (tm_internal::atomicReadCounter(&handleUsers) & TM_HANDLE_RETIRING) != 0;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Ends retirement once no call is working through the old ID any longer, after which the slot can be freed.
+     * @return true if the slot can now be freed, otherwise false as there are still calls working on it.
+     */
+    bool finishRetiring() {
+#ifdef IOA_MULTITHREADED
+        return tm_internal::atomicSwapCounter(&handleUsers, TM_HANDLE_RETIRING, 0);
+#else
+        return true;
+#endif
+    }
+
+#ifdef IOA_MULTITHREADED
+    /**
+     * Records a schedule change made on a thread other than task manager's, for task manager to apply when it next
+     * deals with the task, see TaskManager::rescheduleTask. A later change replaces one not yet applied. There is no
+     * allocation, the change is held in the task, guarded by a small atomic state, so that task manager never reads
+     * one half written. Only call while holding the task through acquireHandle.
+     * @param when the new interval or delay
+     * @param unit the unit of when
+     * @param repeating true if the task should repeat, false to run once more
+     */
+    void setPendingSchedule(sched_t when, TimerUnit unit, bool repeating);
+
+    /**
+     * @return true if there is a schedule change waiting to be applied by takePendingSchedule
+     */
+    bool isSchedulePending() { return tm_internal::atomicReadCounter(&pendingState) == TM_PENDING_READY; }
+
+    /**
+     * Takes the schedule change recorded by setPendingSchedule, if there is one, task manager thread only.
+     * @param when filled in with the new interval or delay
+     * @param unit filled in with the unit of when
+     * @param repeating filled in with true if the task should repeat
+     * @return true if there was a change, false otherwise, in which case the parameters are left alone
+     */
+    bool takePendingSchedule(sched_t& when, TimerUnit& unit, bool& repeating);
+#endif // IOA_MULTITHREADED
+
+    /**
+     * @return how many microseconds past its due time this task is, 0 if it is not yet due
+     */
+    uint32_t microsOverdue();
+
+    /**
+     * Postpones the next run of the task, a one shot task runs after the time given, a repeating task after either
+     * the time given or its interval, whichever is shorter. Only call when the task is not in the queue.
+     * @param deferMicros the time to postpone by in microseconds
+     */
+    void deferFor(uint32_t deferMicros);
 };
 
 #endif //TASKMANAGER_IO_TASKTYPES_H
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TmAsyncSync.h"
+#include <IoLogging.h>
+
+TmAsyncWaitList::~TmAsyncWaitList() {
+    // task manager removes a completed event on its next pass, so it stops polling this one.
+    if(registered) setCompleted(true);
+}
+
+bool TmAsyncWaitList::enqueue(TmAsyncWaiter* waiter) {
+    if(!registered) {
+        // nothing would ever wake the waiter, so refuse it rather than park it for good.
+        if(taskMgr->registerEvent(this) == TASKMGR_INVALIDID) {
+            serlogF(SER_ERROR, "TM async reg fail");
+            return false;
+        }
+        registered = true;
+    }
+
+    waiter->nextWaiter = nullptr;
+    if(waitTail == nullptr) {
+        waitHead = waiter;
+    }
+    else {
+        waitTail->nextWaiter = waiter;
+    }
+    waitTail = waiter;
+
+    // whatever we are waiting for may already be available, so let the event decide on its next run.
+    markTriggeredAndNotify();
+    return true;
+}
+
+void TmAsyncWaitList::requeueFirst(TmAsyncWaiter* waiter) {
+    waiter->nextWaiter = waitHead;
+    waitHead = waiter;
+    if(waitTail == nullptr) waitTail = waiter;
+}
+
+TmAsyncWaiter* TmAsyncWaitList::dequeue() {
+    auto waiter = waitHead;
+    if(waiter == nullptr) return nullptr;
+    waitHead = waiter->nextWaiter;
+    if(waitHead == nullptr) waitTail = nullptr;
+    waiter->nextWaiter = nullptr;
+    return waiter;
+}
+
+bool TmAsyncWaitList::postFirstWaiter() {
+    if(taskMgr->execute(waitHead) == TASKMGR_INVALIDID) {
+        markTriggeredAndNotify();
+        return false;
+    }
+    dequeue();
+    return true;
+}
+
+bool TmAsyncSemaphore::takePermit() {
+    uint32_t available;
+    do {
+        available = tm_internal::atomicReadCounter(&permits);
+        if(available == 0) return false;
+    } while(!tm_internal::atomicSwapCounter(&permits, available, available - 1));
+    return true;
+}
+
+bool TmAsyncSemaphore::tryAcquire() {
+    // anything already parked has priority over a new arrival.
+    if(hasWaiters()) return false;
+    return takePermit();
+}
+
+ISR_ATTR void TmAsyncSemaphore::release() {
+    tm_internal::atomicAddCounter(&permits, 1);
+    markTriggeredAndNotify();
+}
+
+void TmAsyncSemaphore::wakeWaiters() {
+    // each permit goes to exactly one waiter, in the order that they waited.
+    while(hasWaiters() && takePermit()) {
+        if(!postFirstWaiter()) {
+            // task manager is full, so keep the permit for the waiter until the retry.
+            tm_internal::atomicAddCounter(&permits, 1);
+            return;
+        }
+    }
+}
+
+bool TmAsyncCondition::wait(TmAsyncWaiter* waiter) {
+    // until the first wait, the event has never run to discard notifications that nothing was waiting for.
+    if(!isRegistered()) {
+        tm_internal::atomicWriteCounter(&pendingNotifies, 0);
+        tm_internal::atomicWriteBool(&pendingNotifyAll, false);
+    }
+    if(!enqueue(waiter)) return false;
+    if(waitMutex != nullptr) waitMutex->unlock();
+    return true;
+}
+
+ISR_ATTR void TmAsyncCondition::notifyOne() {
+    tm_internal::atomicAddCounter(&pendingNotifies, 1);
+    markTriggeredAndNotify();
+}
+
+ISR_ATTR void TmAsyncCondition::notifyAll() {
+    tm_internal::atomicWriteBool(&pendingNotifyAll, true);
+    markTriggeredAndNotify();
+}
+
+void TmAsyncCondition::wakeWaiters() {
+    bool all = tm_internal::atomicSwapBool(&pendingNotifyAll, true, false);
+    uint32_t notifies;
+    do {
+        notifies = tm_internal::atomicReadCounter(&pendingNotifies);
+    } while(!tm_internal::atomicSwapCounter(&pendingNotifies, notifies, 0));
+
+    while(hasWaiters() && (all || notifies != 0)) {
+        // with a mutex, the waiter joins the mutex queue and runs once it owns the mutex again.
+        bool moved;
+        if(waitMutex != nullptr) {
+            auto waiter = dequeue();
+            moved = waitMutex->lock(waiter);
+            if(!moved) requeueFirst(waiter);
+        }
+        else {
+            moved = postFirstWaiter();
+        }
+        if(!moved) {
+            // task manager is full, put back what is left of the notifications for the retry.
+            if(all) tm_internal::atomicWriteBool(&pendingNotifyAll, true);
+            if(notifies != 0) tm_internal::atomicAddCounter(&pendingNotifies, notifies);
+            if(waitMutex != nullptr) markTriggeredAndNotify();
+            return;
+        }
+        if(notifies != 0) notifies--;
+    }
+}
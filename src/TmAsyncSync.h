@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMASYNCSYNC_H
+#define TASKMANAGERIO_TMASYNCSYNC_H
+
+/**
+ * @file TmAsyncSync.h
+ * @brief Semaphore, mutex and condition types where a waiting task parks its continuation instead of spinning.
+ */
+
+#include "TaskManagerIO.h"
+#include "TmCoroutine.h"
+
+/**
+ * A waiter is the continuation that is parked in a wait list until it can proceed, when woken it calls either the
+ * function or the executable that it was created with on the task manager thread. Waiters are linked directly into
+ * the wait list, so no memory is allocated, but each waiter can only be waiting on one thing at a time and must remain
+ * valid until it is woken. Declare them globally or as class members.
+ */
+class TmAsyncWaiter : public Executable {
+private:
+    friend class TmAsyncWaitList;
+    TmAsyncWaiter* nextWaiter;
+    TimerFn fnCallback;
+    Executable* theExecutable;
+protected:
+    TmAsyncWaiter() : nextWaiter(nullptr), fnCallback(nullptr), theExecutable(nullptr) {}
+public:
+    explicit TmAsyncWaiter(TimerFn fn) : nextWaiter(nullptr), fnCallback(fn), theExecutable(nullptr) {}
+    explicit TmAsyncWaiter(Executable* exec) : nextWaiter(nullptr), fnCallback(nullptr), theExecutable(exec) {}
+
+    void exec() override {
+        if(theExecutable != nullptr) {
+            theExecutable->exec();
+        }
+        else if(fnCallback != nullptr) {
+            fnCallback();
+        }
+    }
+};
+
+/**
+ * The wait list that is shared by all the asynchronous primitives. It is an event that registers itself with task
+ * manager the first time something waits on it. Waiting is only done on the task manager thread, so the list itself
+ * needs no lock. Releasing or notifying can be done from any thread or interrupt, it records the change atomically
+ * and then triggers this event, so waiters are woken on the task manager thread without any polling.
+ */
+class TmAsyncWaitList : public BaseEvent {
+private:
+    TaskManager* taskMgr;
+    TmAsyncWaiter* waitHead;
+    TmAsyncWaiter* waitTail;
+    bool registered;
+protected:
+    /**
+     * Adds a waiter to the end of the list, registering with task manager if needed, then triggers the event so that
+     * wakeWaiters is called on the next run.
+     * @return true if the waiter was queued, false when task manager had no room to register the event, in which case
+     * the waiter would never be woken and is not queued.
+     */
+    bool enqueue(TmAsyncWaiter* waiter);
+
+    /**
+     * Puts a waiter that was just removed with dequeue back at the front of the list.
+     */
+    void requeueFirst(TmAsyncWaiter* waiter);
+
+    /**
+     * @return the first waiter removed from the list, or nullptr if the list is empty.
+     */
+    TmAsyncWaiter* dequeue();
+
+    /**
+     * Posts the first waiter to task manager, so that it runs as a task of its own rather than from within this event,
+     * and removes it from the list. When task manager is full, the waiter stays first in line and the event triggers
+     * itself again, so that it is retried on the next run.
+     * @return true if the waiter was posted, otherwise false.
+     */
+    bool postFirstWaiter();
+
+    bool hasWaiters() const { return waitHead != nullptr; }
+
+    bool isRegistered() const { return registered; }
+
+    /**
+     * Called on the task manager thread whenever the event triggers, wake as many waiters as are now able to proceed.
+     * Waiters are never run directly from here, they are posted using postFirstWaiter.
+     */
+    virtual void wakeWaiters() = 0;
+public:
+    explicit TmAsyncWaitList(TaskManager* tm) : BaseEvent(tm), taskMgr(tm), waitHead(nullptr), waitTail(nullptr),
+                                                registered(false) {}
+
+    /**
+     * Marks the event complete so that task manager removes it, it must still be valid on the next task manager pass.
+     */
+    ~TmAsyncWaitList() override;
+
+    uint32_t timeOfNextCheck() override { return TM_IDLE_CHECK_MICROS; } // only ever woken by being triggered
+
+    void exec() override { wakeWaiters(); }
+};
+
+/**
+ * A counting semaphore for tasks, when there are no permits, acquire parks the waiter and returns straight away so the
+ * task can finish, and the waiter runs once a permit has been released to it. Permits are handed to waiters in the
+ * order that they waited, each release wakes exactly one waiter. Acquiring must be done on the task manager thread,
+ * release can be called from any thread or interrupt, for example when hardware has finished with a buffer.
+ *
+ * ```
+ * TmAsyncSemaphore freeBuffers(4);
+ * TmAsyncWaiter fillWaiter(fillBuffer);
+ * freeBuffers.acquire(&fillWaiter); // fillBuffer will run on task manager when a buffer is free
+ * ```
+ */
+class TmAsyncSemaphore : public TmAsyncWaitList {
+private:
+    tm_internal::TmAtomicCounter permits;
+    bool takePermit();
+protected:
+    void wakeWaiters() override;
+public:
+    explicit TmAsyncSemaphore(uint32_t initialPermits, TaskManager* tm = &taskManager) : TmAsyncWaitList(tm) {
+        tm_internal::atomicWriteCounter(&permits, initialPermits);
+    }
+
+    /**
+     * Take a permit now if one is available and nothing is already waiting, never parks.
+     * @return true if a permit was taken
+     */
+    bool tryAcquire();
+
+    /**
+     * Queue the waiter, it is run on the task manager thread holding a permit as soon as one is available. Only call
+     * this on the task manager thread.
+     * @param waiter the continuation to run with the permit
+     * @return true if queued, false if task manager was too full to register the semaphore and the waiter never runs
+     */
+    bool acquire(TmAsyncWaiter* waiter) { return enqueue(waiter); }
+
+    /**
+     * Return a permit, waking the longest waiting task if there is one. Can be called from any thread or interrupt.
+     */
+    void release();
+
+    /**
+     * @return the number of permits available right now
+     */
+    uint32_t getAvailablePermits() { return tm_internal::atomicReadCounter(&permits); }
+
+#ifdef TM_COROUTINES_AVAILABLE
+    /**
+     * The awaitable used by `co_await semaphore.acquireAsync()`, the coroutine resumes holding a permit. The result is
+     * false when the wait could not be queued, the coroutine then resumes straight away without a permit.
+     */
+    class Awaitable : public TmAsyncWaiter {
+    private:
+        TmAsyncSemaphore* semaphore;
+        std::coroutine_handle<> waiting;
+        bool acquired;
+    public:
+        explicit Awaitable(TmAsyncSemaphore* semaphore) : semaphore(semaphore), waiting(nullptr), acquired(true) {}
+        bool await_ready() { return semaphore->tryAcquire(); }
+        bool await_suspend(std::coroutine_handle<> h) {
+            waiting = h;
+            acquired = semaphore->acquire(this);
+            return acquired;
+        }
+        bool await_resume() const noexcept { return acquired; }
+        void exec() override { waiting.resume(); }
+    };
+
+    Awaitable acquireAsync() { return Awaitable(this); }
+#endif // TM_COROUTINES_AVAILABLE
+};
+
+/**
+ * A mutex for tasks, it is a semaphore with one permit, so lock parks the waiter until the mutex is unlocked, handing
+ * it over to waiters in the order they asked for it. It is not reentrant, and the lock is owned by whatever code runs
+ * between the waiter starting and unlock being called, which can span several tasks.
+ */
+class TmAsyncMutex : public TmAsyncSemaphore {
+public:
+    explicit TmAsyncMutex(TaskManager* tm = &taskManager) : TmAsyncSemaphore(1, tm) {}
+
+    /**
+     * Take the mutex now if it is free and nothing is waiting for it, never parks.
+     * @return true if the mutex was taken
+     */
+    bool tryLock() { return tryAcquire(); }
+
+    /**
+     * Queue the waiter, it is run on the task manager thread once it owns the mutex. Only call this on the task
+     * manager thread.
+     * @param waiter the continuation to run with the mutex held
+     * @return true if queued, false if task manager was too full to register the mutex and the waiter never runs
+     */
+    bool lock(TmAsyncWaiter* waiter) { return acquire(waiter); }
+
+    /**
+     * Release the mutex, handing it to the next waiter if any. Can be called from any thread or interrupt.
+     */
+    void unlock() { release(); }
+
+    /**
+     * @return true if the mutex is currently held
+     */
+    bool isLocked() { return getAvailablePermits() == 0; }
+
+#ifdef TM_COROUTINES_AVAILABLE
+    /**
+     * For use with `co_await mutex.lockAsync()`, the coroutine resumes owning the mutex.
+     */
+    Awaitable lockAsync() { return acquireAsync(); }
+#endif // TM_COROUTINES_AVAILABLE
+};
+
+/**
+ * A condition that tasks can wait on until they are notified. Notifying from any thread or interrupt wakes either the
+ * longest waiting task, or all of them. A notification when nothing is waiting is not remembered, although one that
+ * races with a wait may wake it, so as usual the state being waited for should be checked again once woken. When
+ * waiting with a mutex, the mutex is released while parked and the waiter only runs once it owns the mutex again.
+ */
+class TmAsyncCondition : public TmAsyncWaitList {
+private:
+    TmAsyncMutex* waitMutex;
+    tm_internal::TmAtomicCounter pendingNotifies;
+    tm_internal::TmAtomicBool pendingNotifyAll;
+protected:
+    void wakeWaiters() override;
+public:
+    explicit TmAsyncCondition(TmAsyncMutex* mutex = nullptr, TaskManager* tm = &taskManager) : TmAsyncWaitList(tm),
+                                                                                                 waitMutex(mutex) {
+        tm_internal::atomicWriteCounter(&pendingNotifies, 0);
+        tm_internal::atomicWriteBool(&pendingNotifyAll, false);
+    }
+
+    /**
+     * Park the waiter until notified, if the condition was created with a mutex, the caller must hold it, and it is
+     * released while waiting and taken again before the waiter runs. Only call this on the task manager thread.
+     * @param waiter the continuation to run once notified
+     * @return true if queued, false if task manager was too full to register the condition, the waiter never runs and
+     * any mutex is still held
+     */
+    bool wait(TmAsyncWaiter* waiter);
+
+    /**
+     * Wake the longest waiting task, can be called from any thread or interrupt.
+     */
+    void notifyOne();
+
+    /**
+     * Wake all tasks that are waiting now, can be called from any thread or interrupt.
+     */
+    void notifyAll();
+
+#ifdef TM_COROUTINES_AVAILABLE
+    /**
+     * The awaitable used by `co_await condition.waitAsync()`, it suspends until notified. The result is false when the
+     * wait could not be queued, the coroutine then resumes straight away.
+     */
+    class Awaitable : public TmAsyncWaiter {
+    private:
+        TmAsyncCondition* condition;
+        std::coroutine_handle<> waiting;
+        bool queued;
+    public:
+        explicit Awaitable(TmAsyncCondition* condition) : condition(condition), waiting(nullptr), queued(true) {}
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> h) {
+            waiting = h;
+            queued = condition->wait(this);
+            return queued;
+        }
+        bool await_resume() const noexcept { return queued; }
+        void exec() override { waiting.resume(); }
+    };
+
+    Awaitable waitAsync() { return Awaitable(this); }
+#endif // TM_COROUTINES_AVAILABLE
+};
+
+#endif //TASKMANAGERIO_TMASYNCSYNC_H
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TmCalendarSchedule.h"
+
+#define SECONDS_IN_DAY 86400UL
+#define MAX_CALENDAR_CHECK_SECONDS 3600UL
+#define CLOCK_NOT_SET_RECHECK_SECONDS 60UL
+// a match on the 29th February that is also restricted by weekday can take many years to come around
+#define MAX_DAYS_TO_SEARCH (366U * 28U)
+
+static TmWallClockFn calendarClock = nullptr;
+
+void setCalendarClock(TmWallClockFn clockFn) {
+    calendarClock = clockFn;
+}
+
+/**
+ * Converts days since 1970 into the date in the proleptic Gregorian calendar, based on the well known civil from days
+ * algorithm by Howard Hinnant.
+ */
+static void civilFromDays(uint32_t daysSince1970, uint16_t& year, uint8_t& month, uint8_t& day) {
+    int32_t z = int32_t(daysSince1970) + 719468;
+    int32_t era = z / 146097;
+    uint32_t dayOfEra = uint32_t(z - era * 146097);
+    uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    uint32_t mp = (5 * dayOfYear + 2) / 153;
+    day = uint8_t(dayOfYear - (153 * mp + 2) / 5 + 1);
+    month = uint8_t(mp < 10 ? mp + 3 : mp - 9);
+    year = uint16_t(int32_t(yearOfEra) + era * 400 + (month <= 2 ? 1 : 0));
+}
+
+uint32_t makeEpochSeconds(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second) {
+    int32_t y = int32_t(year) - (month <= 2 ? 1 : 0);
+    int32_t era = y / 400;
+    uint32_t yearOfEra = uint32_t(y - era * 400);
+    uint32_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    uint32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    uint32_t days = uint32_t(era * 146097 + int32_t(dayOfEra) - 719468);
+    return (days * SECONDS_IN_DAY) + (hour * 3600UL) + (minute * 60UL) + second;
+}
+
+static bool parseNumber(const char*& text, uint8_t& value) {
+    if(*text < '0' || *text > '9') return false;
+    uint16_t result = 0;
+    while(*text >= '0' && *text <= '9') {
+        result = (result * 10) + (*text - '0');
+        if(result > 255) return false;
+        text++;
+    }
+    value = uint8_t(result);
+    return true;
+}
+
+/**
+ * Parses one field of the expression into a bit per allowed value, advancing text to the end of the field.
+ * @return true if the field was valid
+ */
+static bool parseField(const char*& text, uint8_t minValue, uint8_t maxValue, uint64_t& bits, bool& restricted) {
+    bits = 0;
+    restricted = true;
+    while(true) {
+        uint8_t start, end, step = 1;
+        bool singleValue = false;
+        if(*text == '*') {
+            start = minValue;
+            end = maxValue;
+            restricted = false;
+            text++;
+        }
+        else {
+            if(!parseNumber(text, start)) return false;
+            end = start;
+            singleValue = true;
+            if(*text == '-') {
+                text++;
+                if(!parseNumber(text, end)) return false;
+                singleValue = false;
+            }
+        }
+
+        if(*text == '/') {
+            text++;
+            if(!parseNumber(text, step) || step == 0) return false;
+            // as with cron, a single value with a step runs from that value to the end of the range
+            if(singleValue) end = maxValue;
+            // a stepped star still restricts the field, for example every other day of the month
+            restricted = true;
+        }
+
+        if(start < minValue || end > maxValue || start > end) return false;
+        for(uint16_t i = start; i <= end; i += step) {
+            bits |= (1ULL << i);
+        }
+
+        if(*text != ',') break;
+        text++;
+    }
+    return (*text == ' ' || *text == 0);
+}
+
+static void skipSpaces(const char*& text) {
+    while(*text == ' ') text++;
+}
+
+TmCronExpression::TmCronExpression(const char* expression) : minutes(0), hours(0), daysOfMonth(0), months(0),
+                                                             daysOfWeek(0), restrictDayOfMonth(false),
+                                                             restrictDayOfWeek(false), valid(false) {
+    uint64_t bits;
+    bool restricted;
+    const char* text = expression;
+
+    skipSpaces(text);
+    if(!parseField(text, 0, 59, bits, restricted)) return;
+    minutes = bits;
+
+    skipSpaces(text);
+    if(!parseField(text, 0, 23, bits, restricted)) return;
+    hours = uint32_t(bits);
+
+    skipSpaces(text);
+    if(!parseField(text, 1, 31, bits, restrictDayOfMonth)) return;
+    daysOfMonth = uint32_t(bits);
+
+    skipSpaces(text);
+    if(!parseField(text, 1, 12, bits, restricted)) return;
+    months = uint16_t(bits);
+
+    skipSpaces(text);
+    if(!parseField(text, 0, 7, bits, restrictDayOfWeek)) return;
+    // Sunday can be either 0 or 7
+    daysOfWeek = uint8_t((bits & 0x7fU) | ((bits >> 7) & 0x01U));
+
+    skipSpaces(text);
+    valid = (*text == 0);
+}
+
+bool TmCronExpression::dayMatches(uint32_t daysSince1970) const {
+    uint16_t year;
+    uint8_t month, day;
+    civilFromDays(daysSince1970, year, month, day);
+    if((months & (1U << month)) == 0) return false;
+
+    // 1st January 1970 was a Thursday
+    uint8_t dayOfWeek = (daysSince1970 + 4) % 7;
+    bool domMatch = (daysOfMonth & (1UL << day)) != 0;
+    bool dowMatch = (daysOfWeek & (1U << dayOfWeek)) != 0;
+
+    // as with cron, when both are restricted either can match, otherwise both must.
+    if(restrictDayOfMonth && restrictDayOfWeek) return domMatch || dowMatch;
+    return domMatch && dowMatch;
+}
+
+uint32_t TmCronExpression::nextAfter(uint32_t epochSeconds) const {
+    if(!valid) return 0;
+
+    // start at the first whole minute after the time given
+    uint32_t start = ((epochSeconds / 60UL) + 1UL) * 60UL;
+    uint32_t day = start / SECONDS_IN_DAY;
+    uint16_t minuteOfDay = (start % SECONDS_IN_DAY) / 60UL;
+
+    for(uint16_t searched = 0; searched < MAX_DAYS_TO_SEARCH; searched++, day++, minuteOfDay = 0) {
+        if(!dayMatches(day)) continue;
+
+        for(uint8_t hour = minuteOfDay / 60; hour < 24; hour++) {
+            if((hours & (1UL << hour)) == 0) continue;
+            uint8_t firstMinute = (hour == minuteOfDay / 60) ? (minuteOfDay % 60) : 0;
+            for(uint8_t minute = firstMinute; minute < 60; minute++) {
+                if(minutes & (1ULL << minute)) {
+                    uint32_t result = (day * SECONDS_IN_DAY) + (hour * 3600UL) + (minute * 60UL);
+                    // past the end of 32 bit time, it will never fire.
+                    return (result > epochSeconds) ? result : 0;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+TmCalendarSchedule::TmCalendarSchedule(const char* cronExpression, TimerFn callee, TaskManager* tm)
+        : BaseEvent(tm), expression(cronExpression), fnCallback(callee), theExecutable(nullptr), nextFireTime(0),
+          lastClockTime(0) {
+}
+
+TmCalendarSchedule::TmCalendarSchedule(const char* cronExpression, Executable* callee, TaskManager* tm)
+        : BaseEvent(tm), expression(cronExpression), fnCallback(nullptr), theExecutable(callee), nextFireTime(0),
+          lastClockTime(0) {
+}
+
+void TmCalendarSchedule::exec() {
+    if(theExecutable != nullptr) {
+        theExecutable->exec();
+    }
+    else if(fnCallback != nullptr) {
+        fnCallback();
+    }
+}
+
+uint32_t TmCalendarSchedule::timeOfNextCheck() {
+    uint32_t now = (calendarClock != nullptr) ? calendarClock() : 0;
+    if(now == 0 || !expression.isValid()) {
+        // the clock is not available yet, check back again soon.
+        return CLOCK_NOT_SET_RECHECK_SECONDS * 1000000UL;
+    }
+
+    // first check, or the clock has been set backwards, either way the next time needs working out from now.
+    if(lastClockTime == 0 || now < lastClockTime) {
+        nextFireTime = expression.nextAfter(now);
+    }
+    lastClockTime = now;
+
+    if(nextFireTime == 0) {
+        return MAX_CALENDAR_CHECK_SECONDS * 1000000UL;
+    }
+
+    if(now >= nextFireTime) {
+        setTriggered(true);
+        nextFireTime = expression.nextAfter(now);
+        if(nextFireTime == 0) return MAX_CALENDAR_CHECK_SECONDS * 1000000UL;
+    }
+
+    // event checks are 32 bit micros, so we can wait at most about an hour before comparing with the clock again.
+    uint32_t secondsToWait = nextFireTime - now;
+    if(secondsToWait > MAX_CALENDAR_CHECK_SECONDS) secondsToWait = MAX_CALENDAR_CHECK_SECONDS;
+    return secondsToWait * 1000000UL;
+}
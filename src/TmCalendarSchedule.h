@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMCALENDARSCHEDULE_H
+#define TASKMANAGERIO_TMCALENDARSCHEDULE_H
+
+/**
+ * @file TmCalendarSchedule.h
+ * @brief cron like calendar schedules for task manager, based on a wall clock that you provide.
+ */
+
+#include "TaskManagerIO.h"
+
+/**
+ * Definition of the wall clock function that calendar schedules use, it must return the current local time as seconds
+ * since 1st January 1970, or 0 if the time is not yet known, for example before the RTC or NTP has been read.
+ */
+typedef uint32_t (*TmWallClockFn)();
+
+/**
+ * Sets the wall clock used by all calendar schedules, usually this would read from an RTC, or from the system time
+ * once NTP has synchronised. Add any time zone offset in this function, schedules match against the time it returns.
+ * @param clockFn the function that returns the local time in seconds since 1970
+ */
+void setCalendarClock(TmWallClockFn clockFn);
+
+/**
+ * Makes the seconds since 1970 value for a date and time, useful when providing a wall clock from an RTC.
+ * @param year the full year, from 1970 onwards
+ * @param month the month 1 to 12
+ * @param day the day of the month 1 to 31
+ * @param hour the hour 0 to 23
+ * @param minute the minute 0 to 59
+ * @param second the second 0 to 59
+ * @return the seconds since 1970
+ */
+uint32_t makeEpochSeconds(uint16_t year, uint8_t month, uint8_t day, uint8_t hour = 0, uint8_t minute = 0, uint8_t second = 0);
+
+/**
+ * A parsed cron expression with five fields separated by spaces: minute, hour, day of month, month and day of week.
+ * Each field can be `*`, a number, a range such as `1-5`, a list such as `0,15,30`, and ranges or `*` can have a step
+ * such as `0-59/10`. Day of week is 0 to 7 where both 0 and 7 are Sunday. As with cron, when both the day of month and
+ * day of week are restricted, a day matching either of them is used.
+ */
+class TmCronExpression {
+private:
+    uint64_t minutes;
+    uint32_t hours;
+    uint32_t daysOfMonth;
+    uint16_t months;
+    uint8_t daysOfWeek;
+    bool restrictDayOfMonth;
+    bool restrictDayOfWeek;
+    bool valid;
+
+    bool dayMatches(uint32_t daysSince1970) const;
+public:
+    /**
+     * Parse a cron expression, check isValid() afterwards.
+     * @param expression the five field expression
+     */
+    explicit TmCronExpression(const char* expression);
+
+    /**
+     * @return true if the expression was parsed successfully
+     */
+    bool isValid() const { return valid; }
+
+    /**
+     * Works out the next time that the expression matches, this is computed directly from the fields, a day at a time,
+     * rather than by testing every minute.
+     * @param epochSeconds the time to start from, the result is always after this
+     * @return the next matching time in seconds since 1970, or 0 if it never matches.
+     */
+    uint32_t nextAfter(uint32_t epochSeconds) const;
+};
+
+/**
+ * An event that calls a function or executable according to a cron expression, using the wall clock provided with
+ * setCalendarClock. The next fire time is computed directly from the expression each time it fires, so there is no
+ * limit on how far ahead that can be. Event checks are limited to about an hour, so between firings the event only
+ * compares the clock with the stored next time once an hour. This also means that the schedule follows the wall
+ * clock if it is corrected. If the clock goes backwards, the next fire time is worked out again. Missed firings, for
+ * example when the device was off, are not caught up, other than the one that is due. Register with task manager as
+ * with any other event:
+ *
+ * ```
+ * TmCalendarSchedule weekdayMornings("30 7 * * 1-5", startHeating);
+ * taskManager.registerEvent(&weekdayMornings);
+ * ```
+ */
+class TmCalendarSchedule : public BaseEvent {
+private:
+    TmCronExpression expression;
+    const TimerFn fnCallback;
+    Executable* const theExecutable;
+    uint32_t nextFireTime;
+    uint32_t lastClockTime;
+public:
+    /**
+     * Create a calendar schedule that calls a function
+     * @param cronExpression the five field cron expression, see TmCronExpression
+     * @param callee the function to call
+     * @param tm the task manager that this will be registered with
+     */
+    TmCalendarSchedule(const char* cronExpression, TimerFn callee, TaskManager* tm = &taskManager);
+
+    /**
+     * Create a calendar schedule that calls exec() on an executable
+     * @param cronExpression the five field cron expression, see TmCronExpression
+     * @param callee the executable to call
+     * @param tm the task manager that this will be registered with
+     */
+    TmCalendarSchedule(const char* cronExpression, Executable* callee, TaskManager* tm = &taskManager);
+
+    /**
+     * @return true if the expression was valid
+     */
+    bool isValid() const { return expression.isValid(); }
+
+    /**
+     * @return the next time this will fire in seconds since 1970, or 0 if it is not yet known
+     */
+    uint32_t getNextFireTime() const { return nextFireTime; }
+
+    void exec() override;
+
+    uint32_t timeOfNextCheck() override;
+};
+
+#endif //TASKMANAGERIO_TMCALENDARSCHEDULE_H
@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMCHANNEL_H
+#define TASKMANAGERIO_TMCHANNEL_H
+
+/**
+ * @file TmChannel.h
+ * @brief Lock free bounded channels that move data from threads or interrupts to a consumer event on task manager.
+ */
+
+#include "TaskManagerIO.h"
+
+//
+// The producer and consumer indexes of a channel are kept this many bytes apart, so that on multi core boards the
+// producer and consumer do not keep invalidating each others cache line. On 8 bit boards there is no cache and memory
+// is precious, so no padding is added. Define it yourself to change it.
+//
+#ifndef TM_CACHE_LINE_SIZE
+# ifdef __AVR__
+#  define TM_CACHE_LINE_SIZE 1
+# else
+#  define TM_CACHE_LINE_SIZE 64
+# endif
+#endif
+
+/**
+ * The parts of a channel that do not depend on the type or capacity: notifying the consumer, and keeping statistics.
+ * Along with the peak level and the number of items rejected when full, a channel has a high and low watermark. Once
+ * the level reaches the high watermark, isAboveHighWatermark returns true until the consumer has drained the level back
+ * down to the low watermark, so a producer can hold back while the consumer catches up.
+ */
+class TmChannelBase {
+private:
+    BaseEvent* volatile notifyEvent;
+    tm_internal::TmAtomicCounter peakLevel;
+    tm_internal::TmAtomicCounter rejectedCount;
+    tm_internal::TmAtomicCounter highCrossings;
+    tm_internal::TmAtomicBool aboveHigh;
+    uint32_t highWatermark;
+    uint32_t lowWatermark;
+protected:
+    explicit TmChannelBase(uint32_t capacity) : notifyEvent(nullptr), highWatermark((capacity * 3U) / 4U),
+                                                lowWatermark(capacity / 4U) {
+        resetStatistics();
+    }
+
+    void recordRejected() {
+        tm_internal::atomicAddCounter(&rejectedCount, 1);
+    }
+
+    void recordLevelAfterPush(uint32_t level) {
+        uint32_t peak;
+        do {
+            peak = tm_internal::atomicReadCounter(&peakLevel);
+        } while(level > peak && !tm_internal::atomicSwapCounter(&peakLevel, peak, level));
+
+        if(level >= highWatermark && tm_internal::atomicSwapBool(&aboveHigh, false, true)) {
+            tm_internal::atomicAddCounter(&highCrossings, 1);
+        }
+    }
+
+    void recordLevelAfterPop(uint32_t level) {
+        if(level <= lowWatermark) tm_internal::atomicSwapBool(&aboveHigh, true, false);
+    }
+
+    void notifyConsumer() {
+        auto event = notifyEvent;
+        if(event != nullptr && !event->isTriggered()) event->markTriggeredAndNotify();
+    }
+public:
+    /**
+     * Set the event that is triggered whenever an item is written, usually a TmChannelConsumer does this for you.
+     * @param event the event to trigger
+     */
+    void setNotifyEvent(BaseEvent* event) { notifyEvent = event; }
+
+    /**
+     * Change the watermarks, by default they are three quarters and one quarter of the capacity.
+     * @param high the level at which the channel is considered above the high watermark
+     * @param low the level the channel must drain to before it is no longer above the high watermark
+     */
+    void setWatermarks(uint32_t high, uint32_t low) {
+        highWatermark = high;
+        lowWatermark = low;
+    }
+
+    /**
+     * @return true once the level has reached the high watermark, until it has been drained to the low watermark.
+     */
+    bool isAboveHighWatermark() { return tm_internal::atomicReadBool(&aboveHigh); }
+
+    /**
+     * @return the highest number of items that have been waiting in the channel at once
+     */
+    uint32_t getPeakLevel() { return tm_internal::atomicReadCounter(&peakLevel); }
+
+    /**
+     * @return the number of writes that failed because the channel was full
+     */
+    uint32_t getRejectedCount() { return tm_internal::atomicReadCounter(&rejectedCount); }
+
+    /**
+     * @return the number of times the level has reached the high watermark
+     */
+    uint32_t getHighWatermarkCrossings() { return tm_internal::atomicReadCounter(&highCrossings); }
+
+    /**
+     * Clears the peak level, rejected count and watermark crossings.
+     */
+    void resetStatistics() {
+        tm_internal::atomicWriteCounter(&peakLevel, 0);
+        tm_internal::atomicWriteCounter(&rejectedCount, 0);
+        tm_internal::atomicWriteCounter(&highCrossings, 0);
+        tm_internal::atomicWriteBool(&aboveHigh, false);
+    }
+};
+
+/**
+ * A bounded single producer, single consumer channel. Exactly one thread or interrupt may write, and one may read,
+ * usually a task manager event. Neither side ever waits or locks, a write to a full channel fails and is counted. The
+ * producer and consumer indexes are on separate cache lines.
+ * @tparam T the type of item, it must be copyable
+ * @tparam CAPACITY the number of items that can be held, it must be a power of two
+ */
+template<class T, uint32_t CAPACITY> class TmSpscChannel : public TmChannelBase {
+private:
+    static_assert(CAPACITY != 0 && (CAPACITY & (CAPACITY - 1)) == 0, "Channel capacity must be a power of two");
+    alignas(TM_CACHE_LINE_SIZE) tm_internal::TmAtomicCounter writeIndex;
+    alignas(TM_CACHE_LINE_SIZE) tm_internal::TmAtomicCounter readIndex;
+    alignas(TM_CACHE_LINE_SIZE) T items[CAPACITY];
+public:
+    typedef T ValueType;
+
+    TmSpscChannel() : TmChannelBase(CAPACITY), items() {
+        tm_internal::atomicWriteCounter(&writeIndex, 0);
+        tm_internal::atomicWriteCounter(&readIndex, 0);
+    }
+
+    /**
+     * Write an item, only ever call from the one producer, which can be an interrupt.
+     * @param item the item to write
+     * @return true if written, false if the channel was full
+     */
+    bool push(const T& item) {
+        auto writePos = tm_internal::atomicReadCounter(&writeIndex);
+        auto level = writePos - tm_internal::atomicReadCounter(&readIndex);
+        if(level >= CAPACITY) {
+            recordRejected();
+            return false;
+        }
+        items[writePos & (CAPACITY - 1)] = item;
+        // the item must be visible before the index that publishes it.
+        tm_internal::memoryFence();
+        tm_internal::atomicWriteCounter(&writeIndex, writePos + 1);
+        recordLevelAfterPush(level + 1);
+        notifyConsumer();
+        return true;
+    }
+
+    /**
+     * Read up to maxItems into the array provided, only ever call from the one consumer.
+     * @param batch where to store the items
+     * @param maxItems the most items to read
+     * @return the number of items read
+     */
+    uint16_t popBatch(T* batch, uint16_t maxItems) {
+        auto readPos = tm_internal::atomicReadCounter(&readIndex);
+        auto available = tm_internal::atomicReadCounter(&writeIndex) - readPos;
+        uint16_t count = (available < maxItems) ? uint16_t(available) : maxItems;
+        tm_internal::memoryFence();
+        for(uint16_t i = 0; i < count; i++) {
+            batch[i] = items[(readPos + i) & (CAPACITY - 1)];
+        }
+        // the items must be copied out before the space is handed back to the producer.
+        tm_internal::memoryFence();
+        tm_internal::atomicWriteCounter(&readIndex, readPos + count);
+        recordLevelAfterPop(available - count);
+        return count;
+    }
+
+    /**
+     * Read one item, only ever call from the one consumer.
+     * @param item where to store the item
+     * @return true if an item was read
+     */
+    bool pop(T& item) { return popBatch(&item, 1) != 0; }
+
+    /**
+     * @return the number of items waiting, this is only a snapshot if the other side is active.
+     */
+    uint32_t size() { return tm_internal::atomicReadCounter(&writeIndex) - tm_internal::atomicReadCounter(&readIndex); }
+
+    uint32_t capacity() const { return CAPACITY; }
+};
+
+/**
+ * A bounded multiple producer, single consumer channel. Any number of threads and interrupts may write at once, and one
+ * consumer reads, usually a task manager event. It is based on the bounded queue by Dmitry Vyukov, where each cell
+ * has a sequence number that tells the producers and consumer whose turn it is, so producers only contend on a single
+ * compare and swap, and an interrupt can write even while it has interrupted another producer part way through.
+ * @tparam T the type of item, it must be copyable
+ * @tparam CAPACITY the number of items that can be held, it must be a power of two
+ */
+template<class T, uint32_t CAPACITY> class TmMpscChannel : public TmChannelBase {
+private:
+    static_assert(CAPACITY != 0 && (CAPACITY & (CAPACITY - 1)) == 0, "Channel capacity must be a power of two");
+    struct Cell {
+        tm_internal::TmAtomicCounter sequence;
+        T item;
+    };
+    alignas(TM_CACHE_LINE_SIZE) tm_internal::TmAtomicCounter writeIndex;
+    alignas(TM_CACHE_LINE_SIZE) tm_internal::TmAtomicCounter readIndex;
+    alignas(TM_CACHE_LINE_SIZE) Cell cells[CAPACITY];
+public:
+    typedef T ValueType;
+
+    TmMpscChannel() : TmChannelBase(CAPACITY), cells() {
+        for(uint32_t i = 0; i < CAPACITY; i++) {
+            tm_internal::atomicWriteCounter(&cells[i].sequence, i);
+        }
+        tm_internal::atomicWriteCounter(&writeIndex, 0);
+        tm_internal::atomicWriteCounter(&readIndex, 0);
+    }
+
+    /**
+     * Write an item, this can be called from any number of threads and interrupts at once.
+     * @param item the item to write
+     * @return true if written, false if the channel was full
+     */
+    bool push(const T& item) {
+        Cell* cell;
+        uint32_t writePos;
+        while(true) {
+            writePos = tm_internal::atomicReadCounter(&writeIndex);
+            cell = &cells[writePos & (CAPACITY - 1)];
+            auto difference = int32_t(tm_internal::atomicReadCounter(&cell->sequence) - writePos);
+            if(difference == 0) {
+                // the cell is free for this position, claim the position.
+                if(tm_internal::atomicSwapCounter(&writeIndex, writePos, writePos + 1)) break;
+            }
+            else if(difference < 0) {
+                // the cell still holds an item from the previous lap, so the channel is full.
+                recordRejected();
+                return false;
+            }
+        }
+
+        cell->item = item;
+        tm_internal::memoryFence();
+        tm_internal::atomicWriteCounter(&cell->sequence, writePos + 1);
+        // the consumer may already have read past our item, in which case there is no level worth recording.
+        auto level = int32_t(writePos + 1 - tm_internal::atomicReadCounter(&readIndex));
+        if(level > 0) recordLevelAfterPush(uint32_t(level));
+        notifyConsumer();
+        return true;
+    }
+
+    /**
+     * Read up to maxItems into the array provided, only ever call from the one consumer. Reading stops at the first
+     * item that has been claimed but not yet completely written by its producer.
+     * @param batch where to store the items
+     * @param maxItems the most items to read
+     * @return the number of items read
+     */
+    uint16_t popBatch(T* batch, uint16_t maxItems) {
+        auto readPos = tm_internal::atomicReadCounter(&readIndex);
+        uint16_t count = 0;
+        while(count < maxItems) {
+            auto& cell = cells[readPos & (CAPACITY - 1)];
+            if(tm_internal::atomicReadCounter(&cell.sequence) != readPos + 1) break;
+            tm_internal::memoryFence();
+            batch[count++] = cell.item;
+            tm_internal::memoryFence();
+            // hand the cell back to producers for the next lap
+            tm_internal::atomicWriteCounter(&cell.sequence, readPos + CAPACITY);
+            readPos++;
+        }
+        tm_internal::atomicWriteCounter(&readIndex, readPos);
+        recordLevelAfterPop(tm_internal::atomicReadCounter(&writeIndex) - readPos);
+        return count;
+    }
+
+    /**
+     * Read one item, only ever call from the one consumer.
+     * @param item where to store the item
+     * @return true if an item was read
+     */
+    bool pop(T& item) { return popBatch(&item, 1) != 0; }
+
+    /**
+     * @return the number of items claimed by producers and not yet read, this is only a snapshot.
+     */
+    uint32_t size() { return tm_internal::atomicReadCounter(&writeIndex) - tm_internal::atomicReadCounter(&readIndex); }
+
+    uint32_t capacity() const { return CAPACITY; }
+};
+
+/**
+ * An event that consumes a channel on task manager, it is triggered when items are written, and then drains the
+ * channel in batches of up to BATCH_SIZE, calling the batch function with each. To stop a busy producer holding up
+ * other tasks, one run drains at most one channel's capacity, and triggers itself again if more remains. Register it
+ * with task manager as with any other event.
+ *
+ * ```
+ * TmMpscChannel<SensorReading, 32> readings;
+ * TmChannelConsumer<TmMpscChannel<SensorReading, 32>> readingConsumer(readings, processReadings);
+ *
+ * void setup() {
+ *     taskManager.registerEvent(&readingConsumer);
+ * }
+ *
+ * // from any thread or interrupt
+ * readings.push(reading);
+ * ```
+ * @tparam CHANNEL the channel type, either TmSpscChannel or TmMpscChannel
+ * @tparam BATCH_SIZE the largest number of items passed to the batch function at once, they are copied to the stack.
+ */
+template<class CHANNEL, uint16_t BATCH_SIZE = 8> class TmChannelConsumer : public BaseEvent {
+public:
+    typedef typename CHANNEL::ValueType ValueType;
+    typedef void (*BatchFn)(ValueType* batch, uint16_t count);
+private:
+    CHANNEL& channel;
+    BatchFn batchFn;
+    uint32_t pollInterval;
+public:
+    /**
+     * Create a consumer for the channel, it takes over the channel's notification.
+     * @param channel the channel to consume
+     * @param batchFn the function that is called on task manager with each batch of items
+     * @param pollInterval how often the channel is checked without being triggered, defaults to TM_IDLE_CHECK_MICROS
+     * @param tm the task manager this event is registered with
+     */
+    TmChannelConsumer(CHANNEL& channel, BatchFn batchFn, uint32_t pollInterval = TM_IDLE_CHECK_MICROS,
+                      TaskManager* tm = &taskManager) : BaseEvent(tm), channel(channel), batchFn(batchFn),
+                                                        pollInterval(pollInterval) {
+        channel.setNotifyEvent(this);
+    }
+
+    uint32_t timeOfNextCheck() override {
+        if(channel.size() != 0) setTriggered(true);
+        return pollInterval;
+    }
+
+    void exec() override {
+        ValueType batch[BATCH_SIZE];
+        uint32_t drained = 0;
+        uint16_t count;
+        while(drained < channel.capacity() && (count = channel.popBatch(batch, BATCH_SIZE)) != 0) {
+            batchFn(batch, count);
+            drained += count;
+        }
+        if(channel.size() != 0) markTriggeredAndNotify();
+    }
+};
+
+#endif //TASKMANAGERIO_TMCHANNEL_H
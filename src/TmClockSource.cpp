@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TmClockSource.h"
+
+#ifdef TM_MONOTONIC_CLOCK_SUPPORT
+#include <time.h>
+#endif
+
+#ifdef TM_TSC_CLOCK_SUPPORT
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+uint64_t TmMicrosClockSource::nowMicros() {
+    while(true) {
+        // the state is read before the time, so the reading that the state records is never newer than ours.
+        uint32_t state = tm_internal::atomicReadCounter(&wrapState);
+        uint32_t now = (microsFn != nullptr) ? microsFn() : uint32_t(micros());
+        uint32_t wraps = state >> 1U;
+        bool wasUpperHalf = (state & 1U) != 0;
+        bool upperHalf = (now & 0x80000000UL) != 0;
+        if(wasUpperHalf && !upperHalf) wraps++;
+
+        uint32_t newState = (wraps << 1U) | (upperHalf ? 1U : 0U);
+        if(newState == state || tm_internal::atomicSwapCounter(&wrapState, state, newState)) {
+            return (uint64_t(wraps) << 32U) | now;
+        }
+        // another reader moved the state on meanwhile, read both again.
+    }
+}
+
+#ifdef TM_MONOTONIC_CLOCK_SUPPORT
+
+uint64_t TmMonotonicClockSource::nowMicros() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t(ts.tv_sec) * 1000000ULL) + (uint64_t(ts.tv_nsec) / 1000ULL);
+}
+
+uint64_t TmMonotonicClockSource::nowNanos() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t(ts.tv_sec) * 1000000000ULL) + uint64_t(ts.tv_nsec);
+}
+
+#endif // TM_MONOTONIC_CLOCK_SUPPORT
+
+#ifdef TM_TSC_CLOCK_SUPPORT
+
+bool TmTscClockSource::isInvariantTscAvailable() {
+    unsigned int eax, ebx, ecx, edx;
+    // the advanced power management leaf, bit 8 of EDX is set when the TSC is invariant.
+    if(!__get_cpuid(0x80000007U, &eax, &ebx, &ecx, &edx)) return false;
+    return (edx & (1U << 8U)) != 0;
+}
+
+bool TmTscClockSource::calibrate(uint32_t calibrationMicros) {
+    if(!isInvariantTscAvailable()) return false;
+
+    TmMonotonicClockSource monotonic;
+    uint64_t startNanos = monotonic.nowNanos();
+    uint64_t startTicks = __rdtsc();
+    uint64_t endNanos, endTicks;
+    do {
+        endNanos = monotonic.nowNanos();
+        endTicks = __rdtsc();
+    } while((endNanos - startNanos) < (uint64_t(calibrationMicros) * 1000ULL));
+
+    uint64_t ticks = endTicks - startTicks;
+    if(ticks == 0) return false;
+    nanosPerTick = uint64_t((static_cast<unsigned __int128>(endNanos - startNanos) << 32U) / ticks);
+    baseTicks = endTicks;
+    baseNanos = endNanos;
+    calibrated = true;
+    return true;
+}
+
+uint64_t TmTscClockSource::nowNanos() {
+    if(!calibrated) return TmMonotonicClockSource().nowNanos();
+    uint64_t ticks = __rdtsc() - baseTicks;
+    return baseNanos + uint64_t((static_cast<unsigned __int128>(ticks) * nanosPerTick) >> 32U);
+}
+
+#endif // TM_TSC_CLOCK_SUPPORT
+
+#if defined(TM_TSC_CLOCK_SUPPORT)
+TmClockSource* getBestClockSource() {
+    static TmTscClockSource tscClock;
+    static TmMonotonicClockSource monotonicClock;
+    static bool tscUsable = tscClock.calibrate();
+    return tscUsable ? static_cast<TmClockSource*>(&tscClock) : &monotonicClock;
+}
+#elif defined(TM_MONOTONIC_CLOCK_SUPPORT)
+static TmMonotonicClockSource monotonicClock;
+
+TmClockSource* getBestClockSource() {
+    return &monotonicClock;
+}
+#else
+static TmMicrosClockSource microsClock;
+
+TmClockSource* getBestClockSource() {
+    return &microsClock;
+}
+#endif
+
+#ifdef TM_SCHEDULER_CLOCK_SOURCE
+
+TmClockSource* volatile tm_internal::schedulerClock = nullptr;
+
+void setSchedulerClockSource(TmClockSource* clock) {
+    tm_internal::schedulerClock = clock;
+}
+
+TmClockSource* getSchedulerClockSource() {
+    return tm_internal::schedulerClock;
+}
+
+#endif // TM_SCHEDULER_CLOCK_SOURCE
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMCLOCKSOURCE_H
+#define TASKMANAGERIO_TMCLOCKSOURCE_H
+
+/**
+ * @file TmClockSource.h
+ * @brief Clock sources that give a 64 bit monotonic time that does not wrap, and the clock that the scheduler uses for
+ * its deadlines.
+ */
+
+#include "TaskPlatformDeps.h"
+
+#if defined(IOA_USE_MBED) || defined(BUILD_FOR_PICO_CMAKE) || defined(BUILD_FOR_HOSTED)
+uint32_t millis();
+uint32_t micros();
+#endif
+
+//
+// Unless turned off, the scheduler reads its time through the clock source that has been set, if any. On AVR the
+// extra check on each read is not worth it, so the scheduler always uses micros() and millis() directly.
+//
+#if !defined(TM_NO_SCHEDULER_CLOCK_SOURCE) && !defined(__AVR__)
+# define TM_SCHEDULER_CLOCK_SOURCE
+#endif
+
+//
+// CLOCK_MONOTONIC and the TSC are only available in a hosted build, see BUILD_FOR_HOSTED in TaskPlatformDeps.h.
+//
+#if defined(BUILD_FOR_HOSTED) && defined(__linux__)
+# define TM_MONOTONIC_CLOCK_SUPPORT
+# if defined(__x86_64__)
+#  define TM_TSC_CLOCK_SUPPORT
+# endif
+#endif
+
+/**
+ * A source of monotonic time in 64 bits, so that it does not wrap for the life of the device. Implementations must be
+ * safe to read from any thread.
+ */
+class TmClockSource {
+public:
+    virtual ~TmClockSource() = default;
+
+    /**
+     * @return the time in microseconds since an arbitrary starting point, it never goes backwards.
+     */
+    virtual uint64_t nowMicros() = 0;
+
+    /**
+     * @return the time in nanoseconds since the same starting point, by default microseconds multiplied up, so only
+     * sources that have a finer resolution override it.
+     */
+    virtual uint64_t nowNanos() { return nowMicros() * 1000ULL; }
+
+    /**
+     * @return a short name for the source, for reporting
+     */
+    virtual const char* getName() const = 0;
+};
+
+/**
+ * Definition of a function that reads a 32 bit microsecond counter that wraps, such as micros().
+ */
+typedef uint32_t (*TmMicrosFn)();
+
+/**
+ * A clock source that extends micros() to 64 bits by counting each time it wraps, available on every board. The wraps
+ * are tracked without locking, by keeping a count of the wraps along with which half of the 32 bit range the last
+ * reading was in, so it must be read at least once every half a wrap, about 35 minutes. When this is the scheduler
+ * clock, task manager reads it far more often than that.
+ */
+class TmMicrosClockSource : public TmClockSource {
+private:
+    TmMicrosFn microsFn;
+    tm_internal::TmAtomicCounter wrapState;
+public:
+    /**
+     * @param microsFn optionally a function to read a different 32 bit counter, by default micros() is used
+     */
+    explicit TmMicrosClockSource(TmMicrosFn microsFn = nullptr) : microsFn(microsFn) {
+        tm_internal::atomicWriteCounter(&wrapState, 0);
+    }
+
+    uint64_t nowMicros() override;
+
+    const char* getName() const override { return "micros"; }
+};
+
+#ifdef TM_MONOTONIC_CLOCK_SUPPORT
+/**
+ * A clock source backed by the Linux CLOCK_MONOTONIC clock, with nanosecond resolution, in the hosted build only.
+ */
+class TmMonotonicClockSource : public TmClockSource {
+public:
+    uint64_t nowMicros() override;
+    uint64_t nowNanos() override;
+    const char* getName() const override { return "monotonic"; }
+};
+#endif // TM_MONOTONIC_CLOCK_SUPPORT
+
+#ifdef TM_TSC_CLOCK_SUPPORT
+/**
+ * A clock source that reads the x86 time stamp counter, which is much cheaper to read than CLOCK_MONOTONIC. It can
+ * only be used on a processor with an invariant TSC, that counts at a constant rate in all power states. The rate is
+ * found by calibrating it against CLOCK_MONOTONIC, so call calibrate before use, it returns false when the TSC
+ * cannot be used. Times are relative to the moment of calibration, plus the monotonic time at that moment.
+ */
+class TmTscClockSource : public TmClockSource {
+private:
+    uint64_t baseTicks;
+    uint64_t baseNanos;
+    /** nanoseconds per tick, in 32.32 fixed point */
+    uint64_t nanosPerTick;
+    bool calibrated;
+public:
+    TmTscClockSource() : baseTicks(0), baseNanos(0), nanosPerTick(0), calibrated(false) {}
+
+    /**
+     * @return true if this processor has an invariant TSC
+     */
+    static bool isInvariantTscAvailable();
+
+    /**
+     * Measure the rate of the TSC against CLOCK_MONOTONIC, this waits for the time given. Call it once before the
+     * clock is used, and not while other threads could be reading it.
+     * @param calibrationMicros how long to measure for, longer gives a more accurate rate
+     * @return true if calibrated, false if the TSC is not invariant and so cannot be used
+     */
+    bool calibrate(uint32_t calibrationMicros = 20000);
+
+    bool isCalibrated() const { return calibrated; }
+
+    uint64_t nowMicros() override { return nowNanos() / 1000ULL; }
+    uint64_t nowNanos() override;
+    const char* getName() const override { return "tsc"; }
+};
+#endif // TM_TSC_CLOCK_SUPPORT
+
+/**
+ * Gets the best clock source for this platform: a TSC where one is available, which is calibrated the first time this
+ * is called, otherwise CLOCK_MONOTONIC in the hosted Linux build, otherwise micros() extended to 64 bits.
+ * @return the clock source, which lasts for the life of the program
+ */
+TmClockSource* getBestClockSource();
+
+#ifdef TM_SCHEDULER_CLOCK_SOURCE
+/**
+ * Sets the clock that the scheduler uses for all its deadlines, or nullptr to go back to micros() and millis(). With
+ * a clock set, each task records when it was scheduled as 64 bit microseconds from the clock, whatever its unit, so
+ * deadlines never wrap and tasks scheduled in milliseconds or seconds become due to the microsecond rather than on a
+ * millisecond boundary. Set it in setup before any tasks are scheduled, as the deadlines of tasks already scheduled
+ * are relative to the clock they were scheduled with.
+ * @param clock the clock source to use
+ */
+void setSchedulerClockSource(TmClockSource* clock);
+
+/**
+ * @return the clock source that the scheduler is using, or nullptr when it uses micros() and millis()
+ */
+TmClockSource* getSchedulerClockSource();
+#endif // TM_SCHEDULER_CLOCK_SOURCE
+
+namespace tm_internal {
+#ifdef TM_SCHEDULER_CLOCK_SOURCE
+    extern TmClockSource* volatile schedulerClock;
+
+    /**
+     * Internal: the time that a task was scheduled at. When a scheduler clock is set, it is the full 64 bit microsecond
+     * time from that clock for tasks of every unit, so deadlines never wrap and millisecond tasks are timed to the
+     * microsecond. Otherwise it is micros() or millis() depending on the unit of the task.
+     */
+    typedef uint64_t TmSchedTime;
+
+    /**
+     * Internal: the current time for short intervals in microseconds, from the scheduler clock when there is one. It
+     * wraps, so only compare two readings by subtracting them.
+     */
+    inline uint32_t schedulerMicros() {
+        auto clock = schedulerClock;
+        return (clock != nullptr) ? uint32_t(clock->nowMicros()) : uint32_t(micros());
+    }
+
+    /**
+     * Internal: the time now, to store as the time a task was scheduled at.
+     * @param inMicros true if the task is scheduled in microseconds, only used when there is no scheduler clock
+     */
+    inline TmSchedTime schedulerNow(bool inMicros) {
+        auto clock = schedulerClock;
+        if(clock != nullptr) return clock->nowMicros();
+        return inMicros ? TmSchedTime(uint32_t(micros())) : TmSchedTime(uint32_t(millis()));
+    }
+
+    /**
+     * Internal: the time a number of task units before now, to store as the time a task was scheduled at.
+     * @param units the number of microseconds or milliseconds to go back
+     * @param inMicros true if the task is scheduled in microseconds
+     */
+    inline TmSchedTime schedulerTimeBefore(uint32_t units, bool inMicros) {
+        auto clock = schedulerClock;
+        if(clock != nullptr) return clock->nowMicros() - (inMicros ? uint64_t(units) : uint64_t(units) * 1000ULL);
+        // without a clock the time is 32 bits, and it works in unsigned arithmetic even across a roll over.
+        return TmSchedTime(uint32_t(schedulerNow(inMicros)) - units);
+    }
+
+    /**
+     * Internal: the number of microseconds since a time from schedulerNow. Without a scheduler clock the time is 32
+     * bits and millisecond tasks are only timed to the millisecond.
+     * @param since the time that the task was scheduled at
+     * @param inMicros true if the task is scheduled in microseconds
+     */
+    inline uint64_t schedulerMicrosSince(TmSchedTime since, bool inMicros) {
+        auto clock = schedulerClock;
+        if(clock != nullptr) {
+            uint64_t now = clock->nowMicros();
+            return (now > since) ? (now - since) : 0;
+        }
+        if(inMicros) return uint32_t(uint32_t(micros()) - uint32_t(since));
+        return uint64_t(uint32_t(uint32_t(millis()) - uint32_t(since))) * 1000ULL;
+    }
+#else
+    typedef uint32_t TmSchedTime;
+
+    inline uint32_t schedulerMicros() { return micros(); }
+
+    inline TmSchedTime schedulerNow(bool inMicros) { return inMicros ? uint32_t(micros()) : uint32_t(millis()); }
+
+    inline TmSchedTime schedulerTimeBefore(uint32_t units, bool inMicros) { return schedulerNow(inMicros) - units; }
+
+    inline uint64_t schedulerMicrosSince(TmSchedTime since, bool inMicros) {
+        uint32_t taken = schedulerNow(inMicros) - since;
+        return inMicros ? uint64_t(taken) : uint64_t(taken) * 1000ULL;
+    }
+#endif // TM_SCHEDULER_CLOCK_SOURCE
+}
+
+#endif //TASKMANAGERIO_TMCLOCKSOURCE_H
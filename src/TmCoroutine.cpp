@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TmCoroutine.h"
+
+#ifdef TM_COROUTINES_AVAILABLE
+
+#include <new>
+#include <IoLogging.h>
+
+/**
+ * The default allocator when none is provided, simply uses the heap.
+ */
+class TmHeapFrameAllocator : public TmCoroutineFrameAllocator {
+public:
+    void* allocateFrame(size_t size) override {
+        return ::operator new(size, std::nothrow);
+    }
+
+    void releaseFrame(void* frame, size_t /*size*/) override {
+        ::operator delete(frame);
+    }
+};
+
+namespace {
+    TmHeapFrameAllocator heapFrameAllocator;
+    TmCoroutineFrameAllocator* volatile frameAllocator = &heapFrameAllocator;
+
+    // each frame is prefixed with the allocator that created it, so that it is always returned to the right place.
+    const size_t FRAME_HEADER_SIZE = (sizeof(TmCoroutineFrameAllocator*) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+}
+
+void setCoroutineFrameAllocator(TmCoroutineFrameAllocator* allocator) {
+    frameAllocator = (allocator != nullptr) ? allocator : &heapFrameAllocator;
+}
+
+TmCoroutineFrameAllocator* getCoroutineFrameAllocator() {
+    return frameAllocator;
+}
+
+void* TmCoroutine::promise_type::operator new(size_t size) noexcept {
+    auto allocator = frameAllocator;
+    auto mem = (uint8_t*)allocator->allocateFrame(size + FRAME_HEADER_SIZE);
+    if(mem == nullptr) {
+        serlogF2(SER_ERROR, "TM coroutine alloc fail ", (int)size);
+        return nullptr;
+    }
+    *(TmCoroutineFrameAllocator**)mem = allocator;
+    return mem + FRAME_HEADER_SIZE;
+}
+
+void TmCoroutine::promise_type::operator delete(void* frame, size_t size) noexcept {
+    if(frame == nullptr) return;
+    auto mem = (uint8_t*)frame - FRAME_HEADER_SIZE;
+    auto allocator = *(TmCoroutineFrameAllocator**)mem;
+    allocator->releaseFrame(mem, size + FRAME_HEADER_SIZE);
+}
+
+#endif // TM_COROUTINES_AVAILABLE
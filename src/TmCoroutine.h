@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMCOROUTINE_H
+#define TASKMANAGERIO_TMCOROUTINE_H
+
+/**
+ * @file TmCoroutine.h
+ * @brief C++20 coroutine support for task manager, awaiting suspends the coroutine and runLoop later resumes it.
+ */
+
+#include "TaskManagerIO.h"
+
+//
+// Coroutines need a C++20 compiler and the <coroutine> header, on boards where this is not available none of the
+// definitions in this file are made. You can test for TM_COROUTINES_AVAILABLE in your own code.
+//
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+# if __has_include(<coroutine>)
+#  define TM_COROUTINES_AVAILABLE
+# endif
+#endif
+
+#ifdef TM_COROUTINES_AVAILABLE
+
+#include <coroutine>
+#include <cstddef>
+
+/**
+ * Coroutine frames are allocated through an instance of this interface, you can provide your own by calling
+ * setCoroutineFrameAllocator(..) before starting any coroutines. By default, frames are allocated on the heap. To
+ * avoid heap use entirely, register a TmPooledFrameAllocator sized for your coroutines.
+ */
+class TmCoroutineFrameAllocator {
+public:
+    /**
+     * Allocate storage for a coroutine frame
+     * @param size the number of bytes needed
+     * @return the storage or nullptr if it could not be allocated
+     */
+    virtual void* allocateFrame(size_t size) = 0;
+
+    /**
+     * Release storage previously returned from allocateFrame.
+     * @param frame the storage to release
+     * @param size the size that was originally requested
+     */
+    virtual void releaseFrame(void* frame, size_t size) = 0;
+
+    virtual ~TmCoroutineFrameAllocator() = default;
+};
+
+/**
+ * A frame allocator that hands out frames from a fixed pool of FRAME_COUNT blocks that are each FRAME_SIZE bytes long.
+ * Allocation and release are lock free, using the same atomic flag approach as task slots, so coroutines can be
+ * started from any thread. Requests larger than FRAME_SIZE, or when the pool is exhausted, fail.
+ * @tparam FRAME_SIZE the largest frame that can be allocated
+ * @tparam FRAME_COUNT the number of frames in the pool
+ */
+template<size_t FRAME_SIZE, size_t FRAME_COUNT> class TmPooledFrameAllocator : public TmCoroutineFrameAllocator {
+private:
+    static_assert(FRAME_SIZE % alignof(std::max_align_t) == 0, "FRAME_SIZE must keep every frame aligned");
+    alignas(std::max_align_t) uint8_t frames[FRAME_COUNT][FRAME_SIZE];
+    tm_internal::TmAtomicBool frameInUse[FRAME_COUNT];
+public:
+    TmPooledFrameAllocator() {
+        for(size_t i = 0; i < FRAME_COUNT; i++) tm_internal::atomicWriteBool(&frameInUse[i], false);
+    }
+
+    void* allocateFrame(size_t size) override {
+        if(size > FRAME_SIZE) return nullptr;
+        for(size_t i = 0; i < FRAME_COUNT; i++) {
+            if(tm_internal::atomicSwapBool(&frameInUse[i], false, true)) return frames[i];
+        }
+        return nullptr;
+    }
+
+    void releaseFrame(void* frame, size_t /*size*/) override {
+        auto index = size_t((uint8_t*)frame - frames[0]) / FRAME_SIZE;
+        if(index < FRAME_COUNT) tm_internal::atomicWriteBool(&frameInUse[index], false);
+    }
+};
+
+/**
+ * Sets the allocator that will be used for all coroutine frames created after this call. Frames that are already
+ * allocated are always returned to the allocator that created them.
+ * @param allocator the new allocator, or nullptr to go back to heap allocation.
+ */
+void setCoroutineFrameAllocator(TmCoroutineFrameAllocator* allocator);
+
+/**
+ * @return the allocator presently used for coroutine frames.
+ */
+TmCoroutineFrameAllocator* getCoroutineFrameAllocator();
+
+/**
+ * Internal class: held within each coroutine promise, this is what task manager actually schedules when a coroutine
+ * is suspended, its exec() method resumes the coroutine. As it lives in the frame, suspending never allocates.
+ */
+class TmCoroutineResumer : public Executable {
+private:
+    std::coroutine_handle<> handle;
+public:
+    void setHandle(std::coroutine_handle<> h) { handle = h; }
+
+    void exec() override {
+        // if the coroutine runs to completion, this object is destroyed along with the frame, do nothing after resume.
+        handle.resume();
+    }
+};
+
+/**
+ * The return type of any coroutine that is to be run by task manager. Within the coroutine you can await any of
+ * delayMillis(..), delayMicros(..), yieldNow() or a TmAwaitableEvent. Each await suspends the coroutine and task
+ * manager resumes it from runLoop when the condition is met. For example:
+ *
+ * ```
+ * TmCoroutine blinkLed() {
+ *     while(true) {
+ *         digitalWrite(LED_BUILTIN, HIGH);
+ *         co_await delayMillis(250);
+ *         digitalWrite(LED_BUILTIN, LOW);
+ *         co_await delayMillis(750);
+ *     }
+ * }
+ *
+ * void setup() {
+ *     blinkLed().start();
+ * }
+ * ```
+ *
+ * A coroutine does not run until start is called, after that task manager owns it and it is destroyed automatically
+ * once it finishes. If it is never started, the frame is released when the TmCoroutine object goes out of scope.
+ */
+class TmCoroutine {
+public:
+    struct promise_type {
+        TaskManager* taskMgr = &taskManager;
+        TmCoroutineResumer resumer;
+
+        TmCoroutine get_return_object() noexcept {
+            auto handle = std::coroutine_handle<promise_type>::from_promise(*this);
+            resumer.setHandle(handle);
+            return TmCoroutine(handle);
+        }
+
+        static TmCoroutine get_return_object_on_allocation_failure() noexcept { return TmCoroutine(nullptr); }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept {}
+
+        static void* operator new(size_t size) noexcept;
+        static void operator delete(void* frame, size_t size) noexcept;
+    };
+    typedef std::coroutine_handle<promise_type> handle_type;
+
+private:
+    handle_type handle;
+public:
+    explicit TmCoroutine(handle_type h) : handle(h) {}
+    TmCoroutine(const TmCoroutine&) = delete;
+    TmCoroutine& operator=(const TmCoroutine&) = delete;
+    TmCoroutine(TmCoroutine&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+
+    ~TmCoroutine() {
+        if(handle) handle.destroy();
+    }
+
+    /**
+     * @return true if the coroutine frame could be allocated, otherwise false.
+     */
+    bool isValid() const { return (bool)handle; }
+
+    /**
+     * Hands the coroutine over to a task manager, where it will start running as soon as possible. After this call
+     * the coroutine is owned by task manager and this object becomes empty.
+     * @param tm the task manager that will run the coroutine, defaults to the global one.
+     * @return true if scheduled, otherwise false if the frame was not allocated or task manager was full.
+     */
+    bool start(TaskManager* tm = &taskManager) {
+        if(!handle) return false;
+        auto& promise = handle.promise();
+        promise.taskMgr = tm;
+        if(tm->execute(&promise.resumer) == TASKMGR_INVALIDID) return false;
+        handle = nullptr;
+        return true;
+    }
+};
+
+/**
+ * An awaitable that suspends the coroutine for a period of time by scheduling its resumption with task manager.
+ * Normally created using delayMillis(..), delayMicros(..), delaySeconds(..) or yieldNow(). The await gives true when
+ * the delay took place, or false when task manager was full, in which case the coroutine carried on without waiting:
+ *
+ * ```
+ * if(!co_await delayMillis(100)) handleNoTaskSlots();
+ * ```
+ */
+class TmDelayAwaitable {
+private:
+    uint32_t amount;
+    TimerUnit unit;
+    bool scheduled;
+public:
+    TmDelayAwaitable(uint32_t amount, TimerUnit unit) : amount(amount), unit(unit), scheduled(false) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(TmCoroutine::handle_type h) noexcept {
+        auto& promise = h.promise();
+        // if task manager is full we cannot suspend, returning false continues running the coroutine straight away.
+        scheduled = promise.taskMgr->scheduleOnce(amount, &promise.resumer, unit) != TASKMGR_INVALIDID;
+        return scheduled;
+    }
+
+    bool await_resume() const noexcept { return scheduled; }
+};
+
+/**
+ * Suspend the coroutine for the given number of milliseconds
+ * @param millis the time to wait for
+ */
+inline TmDelayAwaitable delayMillis(uint32_t millis) { return {millis, TIME_MILLIS}; }
+
+/**
+ * Suspend the coroutine for the given number of microseconds
+ * @param micros the time to wait for
+ */
+inline TmDelayAwaitable delayMicros(uint32_t micros) { return {micros, TIME_MICROS}; }
+
+/**
+ * Suspend the coroutine for the given number of seconds
+ * @param seconds the time to wait for
+ */
+inline TmDelayAwaitable delaySeconds(uint32_t seconds) { return {seconds, TIME_SECONDS}; }
+
+/**
+ * Suspend the coroutine and let any other waiting tasks run first, equivalent to taskManager.execute(..)
+ */
+inline TmDelayAwaitable yieldNow() { return {2, TIME_MICROS}; }
+
+/**
+ * An event that coroutines can await on using `co_await myEvent`. Register it with task manager just like any other
+ * event, then trigger it using markTriggeredAndNotify() from any thread or interrupt. When it fires the waiting
+ * coroutine is resumed. A trigger that arrives when no coroutine is waiting is remembered, so the next await completes
+ * immediately. Only one coroutine can wait on an event at once.
+ */
+class TmAwaitableEvent : public BaseEvent {
+private:
+    std::coroutine_handle<> waiting;
+    uint32_t pollInterval;
+    volatile bool latched;
+public:
+    /**
+     * Create an awaitable event
+     * @param pollInterval how often timeOfNextCheck is called, defaults to TM_IDLE_CHECK_MICROS as the event is not polled
+     * @param tm the task manager this event will be registered with
+     */
+    explicit TmAwaitableEvent(uint32_t pollInterval = TM_IDLE_CHECK_MICROS, TaskManager* tm = &taskManager)
+            : BaseEvent(tm), waiting(nullptr), pollInterval(pollInterval), latched(false) {}
+
+    uint32_t timeOfNextCheck() override { return pollInterval; }
+
+    void exec() override {
+        auto toResume = waiting;
+        if(toResume) {
+            waiting = nullptr;
+            toResume.resume();
+        }
+        else {
+            latched = true;
+        }
+    }
+
+    bool await_ready() noexcept {
+        if(latched) {
+            latched = false;
+            return true;
+        }
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> h) noexcept { waiting = h; }
+
+    void await_resume() const noexcept {}
+};
+
+#endif // TM_COROUTINES_AVAILABLE
+
+#endif //TASKMANAGERIO_TMCOROUTINE_H
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TmDiagnostics.h"
+
+void readSlotInfo(TimerTask* task, taskid_t id, TmSlotInfo& info) {
+    info.id = id;
+
+    // a free slot may still hold the type of its last task without the object behind it, read nothing else.
+    if(!task->isInUse()) {
+        info.kind = TM_KIND_FREE;
+        info.label = nullptr;
+        info.enabled = info.running = info.repeating = false;
+        info.interval = 0;
+        info.unit = TIME_MILLIS;
+        info.timeToNextRun = 0;
+        return;
+    }
+
+    info.label = task->getLabel();
+    info.running = task->isRunning();
+    info.enabled = task->isEnabled();
+    info.repeating = task->isRepeating();
+    info.interval = task->getSchedule();
+    info.unit = task->getTimerUnit();
+
+    switch(task->getExecutionType()) {
+        case EXECTYPE_EVENT:
+            info.kind = TM_KIND_EVENT;
+            break;
+        case EXECTYPE_EXECUTABLE:
+            info.kind = TM_KIND_EXECUTABLE;
+            break;
+        default:
+            info.kind = TM_KIND_FUNCTION;
+            break;
+    }
+    info.timeToNextRun = info.enabled ? task->unitsFromNow() : 0;
+}
+
+bool TmSlotIterator::next(TmSlotInfo& info) {
+    while(true) {
+        auto task = taskMgr->getTaskInSlot(nextSlot++);
+        if(task == nullptr) return false;
+        if(includeFree || task->isInUse()) {
+            readSlotInfo(task, taskMgr->getTaskId(task), info);
+            return true;
+        }
+    }
+}
+
+bool TmQueueIterator::next(TmSlotInfo& info) {
+    auto task = nextTask;
+    if(task == nullptr) return false;
+    nextTask = task->getNext();
+    readSlotInfo(task, taskMgr->getTaskId(task), info);
+    return true;
+}
+
+void TmBufferDiagnosticSink::write(const char* text) {
+    if(bufferSize == 0) {
+        overflowed = true;
+        return;
+    }
+    while(*text) {
+        if(length >= bufferSize - 1) {
+            overflowed = true;
+            break;
+        }
+        buffer[length++] = *text++;
+    }
+    buffer[length] = 0;
+}
+
+static void writeNumber(TmDiagnosticSink& sink, uint32_t value) {
+    char digits[11];
+    int position = sizeof(digits) - 1;
+    digits[position] = 0;
+    do {
+        digits[--position] = char('0' + (value % 10));
+        value /= 10;
+    } while(value != 0);
+    sink.write(&digits[position]);
+}
+
+static const char* unitText(TimerUnit unit) {
+    return (unit == TIME_MICROS) ? "us" : "ms";
+}
+
+static void writeTextLine(TmDiagnosticSink& sink, const TmSlotInfo& info) {
+    static const char kindChars[] = { '-', 'F', 'X', 'E' };
+    char flags[4];
+    int position = 0;
+    flags[position++] = kindChars[info.kind];
+    char repeat = info.repeating ? 'R' : 'O';
+    flags[position++] = info.running ? char(repeat + ('a' - 'A')) : repeat;
+    if(!info.enabled) flags[position++] = 'D';
+    flags[position] = 0;
+
+    writeNumber(sink, info.id);
+    sink.write(" ");
+    sink.write(flags);
+    sink.write(" ");
+    writeNumber(sink, info.interval);
+    sink.write(unitText(info.unit));
+    sink.write(" ");
+    writeNumber(sink, info.timeToNextRun);
+    sink.write(unitText(info.unit));
+    if(info.label != nullptr) {
+        sink.write(" ");
+        sink.write(info.label);
+    }
+    sink.write("\n");
+}
+
+static void writeJsonString(TmDiagnosticSink& sink, const char* text) {
+    char piece[2] = { 0, 0 };
+    sink.write("\"");
+    while(*text) {
+        char ch = *text++;
+        if(ch == '"' || ch == '\\') {
+            sink.write("\\");
+        }
+        else if(uint8_t(ch) < 0x20) {
+            // control characters have no place in a label, keep the JSON valid by replacing them.
+            ch = ' ';
+        }
+        piece[0] = ch;
+        sink.write(piece);
+    }
+    sink.write("\"");
+}
+
+static void writeJsonObject(TmDiagnosticSink& sink, const TmSlotInfo& info) {
+    static const char* const kindNames[] = { "free", "function", "executable", "event" };
+    sink.write("{\"id\":");
+    writeNumber(sink, info.id);
+    sink.write(",\"kind\":\"");
+    sink.write(kindNames[info.kind]);
+    sink.write("\",\"interval\":");
+    writeNumber(sink, info.interval);
+    sink.write(",\"next\":");
+    writeNumber(sink, info.timeToNextRun);
+    sink.write(",\"unit\":\"");
+    sink.write(unitText(info.unit));
+    sink.write("\",\"enabled\":");
+    sink.write(info.enabled ? "true" : "false");
+    sink.write(",\"running\":");
+    sink.write(info.running ? "true" : "false");
+    sink.write(",\"repeating\":");
+    sink.write(info.repeating ? "true" : "false");
+    sink.write(",\"label\":");
+    if(info.label != nullptr) {
+        writeJsonString(sink, info.label);
+    }
+    else {
+        sink.write("null");
+    }
+    sink.write("}");
+}
+
+template<class ITERATOR> static void writeAllText(TmDiagnosticSink& sink, ITERATOR& iterator) {
+    TmSlotInfo info;
+    while(iterator.next(info)) {
+        writeTextLine(sink, info);
+    }
+}
+
+template<class ITERATOR> static void writeAllJson(TmDiagnosticSink& sink, ITERATOR& iterator) {
+    TmSlotInfo info;
+    bool first = true;
+    sink.write("[");
+    while(iterator.next(info)) {
+        if(!first) sink.write(",");
+        first = false;
+        writeJsonObject(sink, info);
+    }
+    sink.write("]");
+}
+
+void dumpTasksAsText(TmDiagnosticSink& sink, TmDumpOrder order, TaskManager* tm) {
+    if(order == TM_DUMP_SLOTS) {
+        TmSlotIterator slots(tm);
+        writeAllText(sink, slots);
+    }
+    else {
+        TmQueueIterator queue(tm);
+        writeAllText(sink, queue);
+    }
+}
+
+void dumpTasksAsJson(TmDiagnosticSink& sink, TmDumpOrder order, TaskManager* tm) {
+    if(order == TM_DUMP_SLOTS) {
+        TmSlotIterator slots(tm);
+        writeAllJson(sink, slots);
+    }
+    else {
+        TmQueueIterator queue(tm);
+        writeAllJson(sink, queue);
+    }
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMDIAGNOSTICS_H
+#define TASKMANAGERIO_TMDIAGNOSTICS_H
+
+/**
+ * @file TmDiagnostics.h
+ * @brief Iterate over the task slots or the run queue, and write them out as compact text or JSON without allocating.
+ */
+
+#include "TaskManagerIO.h"
+
+/**
+ * What a task slot is being used for
+ */
+enum TmTaskKind : uint8_t {
+    /** the slot is not in use */
+    TM_KIND_FREE,
+    /** the task calls a function */
+    TM_KIND_FUNCTION,
+    /** the task calls an executable */
+    TM_KIND_EXECUTABLE,
+    /** the task is an event */
+    TM_KIND_EVENT
+};
+
+/**
+ * A copy of the state of one task slot at the time it was read, all times are in the unit given.
+ */
+struct TmSlotInfo {
+    taskid_t id;
+    TmTaskKind kind;
+    /** either TIME_MICROS or TIME_MILLIS, events are always in microseconds */
+    TimerUnit unit;
+    bool enabled;
+    bool running;
+    bool repeating;
+    /** the interval of a repeating task, the delay of a one shot task, or the last poll time of an event */
+    uint32_t interval;
+    /** the time until it next runs, 0 if due or disabled */
+    uint32_t timeToNextRun;
+    /** the label set with setTaskLabel, or nullptr */
+    const char* label;
+};
+
+/**
+ * Iterates over every task slot in slot order, by default only the ones in use. Use on the task manager thread so that
+ * slots are not changed while being read.
+ *
+ * ```
+ * TmSlotIterator slots;
+ * TmSlotInfo info;
+ * while(slots.next(info)) { ... }
+ * ```
+ */
+class TmSlotIterator {
+private:
+    TaskManager* taskMgr;
+    taskid_t nextSlot;
+    bool includeFree;
+public:
+    explicit TmSlotIterator(TaskManager* tm = &taskManager, bool includeFree = false)
+            : taskMgr(tm), nextSlot(0), includeFree(includeFree) {}
+
+    /**
+     * @param info filled in with the next slot
+     * @return true if info was filled in, false when there are no more slots
+     */
+    bool next(TmSlotInfo& info);
+};
+
+/**
+ * Iterates over the tasks in the run queue, in the order that they will run. The running task is not in the queue, and
+ * a disabled task leaves it the next time it is due. Use on the task manager thread, tasks are only ever removed from
+ * the queue on that thread, so the links remain valid while iterating.
+ */
+class TmQueueIterator {
+private:
+    TaskManager* taskMgr;
+    TimerTask* nextTask;
+public:
+    explicit TmQueueIterator(TaskManager* tm = &taskManager) : taskMgr(tm), nextTask(tm->getFirstTask()) {}
+
+    /**
+     * @param info filled in with the next task in the queue
+     * @return true if info was filled in, false at the end of the queue
+     */
+    bool next(TmSlotInfo& info);
+};
+
+/**
+ * Reads the state of a single task into a slot info structure
+ * @param task the task to read
+ * @param id the ID of the task
+ * @param info the structure to fill in
+ */
+void readSlotInfo(TimerTask* task, taskid_t id, TmSlotInfo& info);
+
+/**
+ * Somewhere that diagnostics can be written as they are generated, for example a serial port or a socket. Text is
+ * written in small pieces, so nothing needs buffering.
+ *
+ * ```
+ * class SerialSink : public TmDiagnosticSink {
+ *     void write(const char* text) override { Serial.print(text); }
+ * };
+ * ```
+ */
+class TmDiagnosticSink {
+public:
+    virtual ~TmDiagnosticSink() = default;
+    virtual void write(const char* text) = 0;
+};
+
+/**
+ * A diagnostic sink that writes into a fixed char buffer, always zero terminated, any output that does not fit is
+ * dropped and isOverflowed returns true.
+ */
+class TmBufferDiagnosticSink : public TmDiagnosticSink {
+private:
+    char* buffer;
+    size_t bufferSize;
+    size_t length;
+    bool overflowed;
+public:
+    TmBufferDiagnosticSink(char* buffer, size_t bufferSize) : buffer(buffer), bufferSize(bufferSize), length(0),
+                                                              overflowed(false) {
+        if(bufferSize != 0) buffer[0] = 0;
+    }
+
+    void write(const char* text) override;
+
+    const char* getText() const { return buffer; }
+    size_t getLength() const { return length; }
+    bool isOverflowed() const { return overflowed; }
+};
+
+/**
+ * Which tasks to write out, and in what order
+ */
+enum TmDumpOrder : uint8_t {
+    /** every task that is in use, in slot order */
+    TM_DUMP_SLOTS,
+    /** the tasks in the run queue, in the order they will run */
+    TM_DUMP_QUEUE
+};
+
+/**
+ * Writes one line per task as compact text, for example `3 FR 1000ms 250ms sensor`. The fields are the task ID,
+ * then the kind: 'F' function, 'X' executable or 'E' event, then 'R' repeating or 'O' once, in lower case when it is
+ * running, followed by 'D' when disabled. Then the interval and time to the next run, and the label if there is one.
+ * @param sink where to write the text
+ * @param order whether to write all slots or the run queue
+ * @param tm the task manager to dump
+ */
+void dumpTasksAsText(TmDiagnosticSink& sink, TmDumpOrder order = TM_DUMP_QUEUE, TaskManager* tm = &taskManager);
+
+/**
+ * Writes the tasks as a JSON array, with one object per task, for example
+ * `[{"id":3,"kind":"function","interval":1000,"next":250,"unit":"ms","enabled":true,"running":false,"repeating":true,"label":"sensor"}]`
+ * @param sink where to write the JSON
+ * @param order whether to write all slots or the run queue
+ * @param tm the task manager to dump
+ */
+void dumpTasksAsJson(TmDiagnosticSink& sink, TmDumpOrder order = TM_DUMP_QUEUE, TaskManager* tm = &taskManager);
+
+#endif //TASKMANAGERIO_TMDIAGNOSTICS_H
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TmEventAdaptors.h"
+
+// the trigger methods are called from interrupts, so they must only use the tm_internal atomics, which save and
+// restore the interrupt state rather than calling interrupts(), that would turn interrupts back on within the ISR.
+
+TmDebouncedEvent::TmDebouncedEvent(uint32_t quietMicros, TimerFn fn, TmDebounceEdge edge, TaskManager* tm)
+        : BaseEvent(tm), taskMgr(tm), fnCallback(fn), theExecutable(nullptr), quietMicros(quietMicros),
+          executionCount(0), edge(edge) {
+    tm_internal::atomicWriteCounter(&lastTriggerMicros, 0);
+    tm_internal::atomicWriteCounter(&triggerCount, 0);
+    tm_internal::atomicWriteBool(&burstActive, false);
+}
+
+TmDebouncedEvent::TmDebouncedEvent(uint32_t quietMicros, Executable* exec, TmDebounceEdge edge, TaskManager* tm)
+        : BaseEvent(tm), taskMgr(tm), fnCallback(nullptr), theExecutable(exec), quietMicros(quietMicros),
+          executionCount(0), edge(edge) {
+    tm_internal::atomicWriteCounter(&lastTriggerMicros, 0);
+    tm_internal::atomicWriteCounter(&triggerCount, 0);
+    tm_internal::atomicWriteBool(&burstActive, false);
+}
+
+ISR_ATTR void TmDebouncedEvent::trigger() {
+    // the time is written before the count, so that when the count has been seen, so has the time.
+    tm_internal::atomicWriteCounter(&lastTriggerMicros, micros());
+    tm_internal::atomicAddCounter(&triggerCount, 1);
+
+    // only the first trigger of a burst wakes task manager, the event times the rest of the burst itself.
+    if(tm_internal::atomicSwapBool(&burstActive, false, true)) {
+        if(edge == TM_DEBOUNCE_LEADING) setTriggered(true);
+        taskMgr->triggerEvents();
+    }
+}
+
+uint32_t TmDebouncedEvent::timeOfNextCheck() {
+    if(!tm_internal::atomicReadBool(&burstActive)) return TM_IDLE_CHECK_MICROS;
+
+    auto countBefore = tm_internal::atomicReadCounter(&triggerCount);
+    uint32_t sinceLast = micros() - tm_internal::atomicReadCounter(&lastTriggerMicros);
+    if(sinceLast < quietMicros) return quietMicros - sinceLast;
+
+    // the burst is over, from here on a trigger starts a new burst and wakes task manager again. A trigger that came
+    // in while ending the burst saw it still active, so it did not wake us, and it becomes the start of the next one.
+    tm_internal::atomicWriteBool(&burstActive, false);
+    if(tm_internal::atomicReadCounter(&triggerCount) != countBefore &&
+            tm_internal::atomicSwapBool(&burstActive, false, true)) {
+        setTriggered(true);
+        return quietMicros;
+    }
+
+    if(edge == TM_DEBOUNCE_TRAILING) setTriggered(true);
+    return TM_IDLE_CHECK_MICROS;
+}
+
+void TmDebouncedEvent::exec() {
+    executionCount++;
+    if(theExecutable != nullptr) {
+        theExecutable->exec();
+    }
+    else if(fnCallback != nullptr) {
+        fnCallback();
+    }
+}
+
+TmThrottledEvent::TmThrottledEvent(uint16_t maxPerPeriod, uint32_t periodMicros, TimerFn fn, TaskManager* tm)
+        : BaseEvent(tm), taskMgr(tm), fnCallback(fn), theExecutable(nullptr), periodMicros(periodMicros),
+          periodStart(0), executionCount(0), maxPerPeriod(maxPerPeriod), runsThisPeriod(0) {
+    tm_internal::atomicWriteCounter(&triggerCount, 0);
+    tm_internal::atomicWriteBool(&pending, false);
+}
+
+TmThrottledEvent::TmThrottledEvent(uint16_t maxPerPeriod, uint32_t periodMicros, Executable* exec, TaskManager* tm)
+        : BaseEvent(tm), taskMgr(tm), fnCallback(nullptr), theExecutable(exec), periodMicros(periodMicros),
+          periodStart(0), executionCount(0), maxPerPeriod(maxPerPeriod), runsThisPeriod(0) {
+    tm_internal::atomicWriteCounter(&triggerCount, 0);
+    tm_internal::atomicWriteBool(&pending, false);
+}
+
+ISR_ATTR void TmThrottledEvent::trigger() {
+    tm_internal::atomicAddCounter(&triggerCount, 1);
+    // while a run is already pending, further triggers are merged into it without waking task manager.
+    if(tm_internal::atomicSwapBool(&pending, false, true)) {
+        taskMgr->triggerEvents();
+    }
+}
+
+uint32_t TmThrottledEvent::timeOfNextCheck() {
+    uint32_t now = micros();
+    uint32_t intoPeriod = now - periodStart;
+    if(intoPeriod >= periodMicros) {
+        periodStart = now;
+        runsThisPeriod = 0;
+        intoPeriod = 0;
+    }
+
+    if(!tm_internal::atomicReadBool(&pending)) return TM_IDLE_CHECK_MICROS;
+
+    if(runsThisPeriod < maxPerPeriod) {
+        // cleared before the run, so that a trigger from now on is another run.
+        tm_internal::atomicWriteBool(&pending, false);
+        runsThisPeriod++;
+        setTriggered(true);
+        return TM_IDLE_CHECK_MICROS;
+    }
+
+    // used up for this period, the pending run happens at the start of the next.
+    return periodMicros - intoPeriod;
+}
+
+void TmThrottledEvent::exec() {
+    executionCount++;
+    if(theExecutable != nullptr) {
+        theExecutable->exec();
+    }
+    else if(fnCallback != nullptr) {
+        fnCallback();
+    }
+}
+
+TmCountingEvent::TmCountingEvent(TmCountedEventFn fn, TaskManager* tm)
+        : BaseEvent(tm), taskMgr(tm), fnCallback(fn), batchCount(0), totalHandled(0), batchesHandled(0) {
+    tm_internal::atomicWriteCounter(&pendingCount, 0);
+}
+
+ISR_ATTR void TmCountingEvent::trigger(uint32_t count) {
+    if(count == 0) return;
+    // only when the count was zero does task manager need waking, otherwise a batch is already on its way.
+    if(tm_internal::atomicAddCounter(&pendingCount, int32_t(count)) == count) {
+        taskMgr->triggerEvents();
+    }
+}
+
+uint32_t TmCountingEvent::timeOfNextCheck() {
+    // take the whole count, leaving zero so that the next trigger wakes task manager again.
+    uint32_t count;
+    do {
+        count = tm_internal::atomicReadCounter(&pendingCount);
+        if(count == 0) return TM_IDLE_CHECK_MICROS;
+    } while(!tm_internal::atomicSwapCounter(&pendingCount, count, 0));
+
+    batchCount = count;
+    setTriggered(true);
+    return TM_IDLE_CHECK_MICROS;
+}
+
+void TmCountingEvent::exec() {
+    totalHandled += batchCount;
+    batchesHandled++;
+    handleBatch(batchCount);
+}
+
+void TmCountingEvent::handleBatch(uint32_t count) {
+    if(fnCallback != nullptr) {
+        fnCallback(count);
+    }
+}
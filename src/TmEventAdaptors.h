@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMEVENTADAPTORS_H
+#define TASKMANAGERIO_TMEVENTADAPTORS_H
+
+/**
+ * @file TmEventAdaptors.h
+ * @brief Debounce, throttle and counting events, that absorb bursts of triggers from interrupts so that task manager
+ * only does work for each real event, or each batch of them.
+ */
+
+#include "TaskManagerIO.h"
+
+/**
+ * Which edge of a burst of triggers a debounced event runs on
+ */
+enum TmDebounceEdge : uint8_t {
+    /** run once the triggers have stopped for the quiet time, for example once a switch has settled */
+    TM_DEBOUNCE_TRAILING,
+    /** run straight away on the first trigger, then ignore triggers until they stop for the quiet time */
+    TM_DEBOUNCE_LEADING
+};
+
+/**
+ * An event that runs a function or executable once for each burst of triggers, such as the bounces of a mechanical
+ * switch or a noisy ready line. Call trigger() from the interrupt in place of markTriggeredAndNotify, only the first
+ * trigger of a burst wakes task manager, the rest just record the time, so there is one pass over the events for each
+ * burst rather than for every trigger. The end of the burst is then timed by the event's own poll time.
+ *
+ * ```
+ * TmDebouncedEvent buttonEvent(20000, onButtonPressed);   // 20ms quiet time
+ * taskManager.registerEvent(&buttonEvent);
+ *
+ * void ISR_ATTR buttonIsr() { buttonEvent.trigger(); }
+ * ```
+ */
+class TmDebouncedEvent : public BaseEvent {
+private:
+    TaskManager* taskMgr;
+    TimerFn fnCallback;
+    Executable* theExecutable;
+    uint32_t quietMicros;
+    tm_internal::TmAtomicCounter lastTriggerMicros;
+    tm_internal::TmAtomicCounter triggerCount;
+    tm_internal::TmAtomicBool burstActive;
+    uint32_t executionCount;
+    TmDebounceEdge edge;
+public:
+    /**
+     * Create a debounced event that calls a function
+     * @param quietMicros how long the triggers must stop for before the burst is over
+     * @param fn the function to call once per burst
+     * @param edge whether to run at the start or end of the burst
+     * @param tm the task manager that this will be registered with
+     */
+    TmDebouncedEvent(uint32_t quietMicros, TimerFn fn, TmDebounceEdge edge = TM_DEBOUNCE_TRAILING,
+                     TaskManager* tm = &taskManager);
+
+    /**
+     * Create a debounced event that calls exec() on an executable
+     * @param quietMicros how long the triggers must stop for before the burst is over
+     * @param exec the executable to run once per burst
+     * @param edge whether to run at the start or end of the burst
+     * @param tm the task manager that this will be registered with
+     */
+    TmDebouncedEvent(uint32_t quietMicros, Executable* exec, TmDebounceEdge edge = TM_DEBOUNCE_TRAILING,
+                     TaskManager* tm = &taskManager);
+
+    /**
+     * Records a trigger, safe to call from an interrupt or another thread. Called within an interrupt, interrupts stay
+     * disabled throughout, as it only uses the tm_internal atomics that save and restore the interrupt state.
+     */
+    void trigger();
+
+    /**
+     * @return the number of triggers recorded
+     */
+    uint32_t getTriggerCount() { return tm_internal::atomicReadCounter(&triggerCount); }
+
+    /**
+     * @return the number of times the function or executable has run, one for each burst
+     */
+    uint32_t getExecutionCount() const { return executionCount; }
+
+    uint32_t timeOfNextCheck() override;
+
+    void exec() override;
+};
+
+/**
+ * An event that runs a function or executable at most a given number of times in each period, however often it is
+ * triggered. Triggers beyond that are merged into one more run at the start of the next period, so the last trigger
+ * is never lost. As with the debounced event, call trigger() from the interrupt, only a trigger that arrives when
+ * none is pending wakes task manager.
+ *
+ * ```
+ * TmThrottledEvent sensorReady(2, 100000, readSensor);    // at most twice every 100ms
+ * taskManager.registerEvent(&sensorReady);
+ * ```
+ */
+class TmThrottledEvent : public BaseEvent {
+private:
+    TaskManager* taskMgr;
+    TimerFn fnCallback;
+    Executable* theExecutable;
+    uint32_t periodMicros;
+    uint32_t periodStart;
+    uint32_t executionCount;
+    tm_internal::TmAtomicCounter triggerCount;
+    tm_internal::TmAtomicBool pending;
+    uint16_t maxPerPeriod;
+    uint16_t runsThisPeriod;
+public:
+    /**
+     * Create a throttled event that calls a function
+     * @param maxPerPeriod the most times that the function is called in each period
+     * @param periodMicros the length of each period
+     * @param fn the function to call
+     * @param tm the task manager that this will be registered with
+     */
+    TmThrottledEvent(uint16_t maxPerPeriod, uint32_t periodMicros, TimerFn fn, TaskManager* tm = &taskManager);
+
+    /**
+     * Create a throttled event that calls exec() on an executable
+     * @param maxPerPeriod the most times that the executable is run in each period
+     * @param periodMicros the length of each period
+     * @param exec the executable to run
+     * @param tm the task manager that this will be registered with
+     */
+    TmThrottledEvent(uint16_t maxPerPeriod, uint32_t periodMicros, Executable* exec, TaskManager* tm = &taskManager);
+
+    /**
+     * Records a trigger, safe to call from an interrupt or another thread. Called within an interrupt, interrupts stay
+     * disabled throughout, as it only uses the tm_internal atomics that save and restore the interrupt state.
+     */
+    void trigger();
+
+    /**
+     * @return the number of triggers recorded
+     */
+    uint32_t getTriggerCount() { return tm_internal::atomicReadCounter(&triggerCount); }
+
+    /**
+     * @return the number of times the function or executable has run
+     */
+    uint32_t getExecutionCount() const { return executionCount; }
+
+    uint32_t timeOfNextCheck() override;
+
+    void exec() override;
+};
+
+/**
+ * Definition of a function that handles a batch of triggers from a counting event, it is given the number of triggers
+ * since it was last called.
+ */
+#ifdef TM_ALLOW_CAPTURED_LAMBDA
+typedef std::function<void(uint32_t)> TmCountedEventFn;
+#else
+typedef void (*TmCountedEventFn)(uint32_t count);
+#endif
+
+/**
+ * An event that counts its triggers rather than just flagging them, and passes the count to the handler, so that all
+ * the work that arrived before task manager got to the event is handled in one call, without losing how much there
+ * was. For example a pulse counter, or a receive interrupt where each trigger is one more item in a buffer. Only the
+ * trigger that takes the count from zero wakes task manager.
+ *
+ * Either give a function to call, or extend this class and override handleBatch.
+ *
+ * ```
+ * TmCountingEvent pulses([](uint32_t count) { totalPulses += count; });
+ * taskManager.registerEvent(&pulses);
+ *
+ * void ISR_ATTR pulseIsr() { pulses.trigger(); }
+ * ```
+ */
+class TmCountingEvent : public BaseEvent {
+private:
+    TaskManager* taskMgr;
+    TmCountedEventFn fnCallback;
+    tm_internal::TmAtomicCounter pendingCount;
+    uint32_t batchCount;
+    uint32_t totalHandled;
+    uint32_t batchesHandled;
+public:
+    /**
+     * Create a counting event
+     * @param fn the function to call with each batch, or nullptr when handleBatch is overridden
+     * @param tm the task manager that this will be registered with
+     */
+    explicit TmCountingEvent(TmCountedEventFn fn = nullptr, TaskManager* tm = &taskManager);
+
+    /**
+     * Adds to the count of triggers, safe to call from an interrupt or another thread. Called within an interrupt,
+     * interrupts stay disabled throughout, the count is added with the atomic that saves and restores their state.
+     * @param count the number of triggers to add, for example the number of items just received
+     */
+    void trigger(uint32_t count = 1);
+
+    /**
+     * @return the number of triggers that have not yet been passed to the handler
+     */
+    uint32_t getPendingCount() { return tm_internal::atomicReadCounter(&pendingCount); }
+
+    /**
+     * @return the total of all the counts passed to the handler
+     */
+    uint32_t getTotalHandled() const { return totalHandled; }
+
+    /**
+     * @return the number of times the handler has been called
+     */
+    uint32_t getBatchesHandled() const { return batchesHandled; }
+
+    /**
+     * Called on the task manager thread with each batch, by default calls the function given in the constructor.
+     * @param count the number of triggers since the last batch, always at least 1
+     */
+    virtual void handleBatch(uint32_t count);
+
+    uint32_t timeOfNextCheck() override;
+
+    void exec() override;
+};
+
+#endif //TASKMANAGERIO_TMEVENTADAPTORS_H
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMFUTURE_H
+#define TASKMANAGERIO_TMFUTURE_H
+
+/**
+ * @file TmFuture.h
+ * @brief Allocation free promise and future types, where continuations are called back on the task manager thread.
+ */
+
+#include "TaskManagerIO.h"
+
+class TmPromiseBase;
+
+/**
+ * Internal definition of a continuation, it is passed the promise that became ready along with the function and
+ * parameter that were registered with it.
+ */
+typedef void (*TmContinuationFn)(TmPromiseBase* promise, void (*userFn)(), void* userParam);
+
+/**
+ * The non-templated part of a promise that deals with readiness and dispatching the continuation. A promise is an
+ * Executable, when both a value and a continuation are present it is executed once on its task manager, using one
+ * task slot only while the continuation is pending. You would not normally use this class directly.
+ */
+class TmPromiseBase : public Executable {
+private:
+    TaskManager* taskMgr;
+    TmContinuationFn continuation;
+    void (*userFn)();
+    void* userParam;
+    tm_internal::TmAtomicBool valueReady;
+    tm_internal::TmAtomicBool continuationReady;
+    tm_internal::TmAtomicBool dispatched;
+
+    void dispatchIfPossible() {
+        if(tm_internal::atomicReadBool(&valueReady) && tm_internal::atomicReadBool(&continuationReady)
+                && tm_internal::atomicSwapBool(&dispatched, false, true)) {
+            // when task manager is full, clear the flag again so that the next poll tries once more.
+            if(taskMgr->execute(this) == TASKMGR_INVALIDID) {
+                tm_internal::atomicWriteBool(&dispatched, false);
+            }
+        }
+    }
+protected:
+    /**
+     * Called by the promise after the value is stored, this may dispatch the continuation.
+     */
+    void markReady() {
+        tm_internal::atomicWriteBool(&valueReady, true);
+        dispatchIfPossible();
+    }
+public:
+    explicit TmPromiseBase(TaskManager* tm) : taskMgr(tm), continuation(nullptr), userFn(nullptr), userParam(nullptr) {
+        tm_internal::atomicWriteBool(&valueReady, false);
+        tm_internal::atomicWriteBool(&continuationReady, false);
+        tm_internal::atomicWriteBool(&dispatched, false);
+    }
+
+    /**
+     * @return true if the value has been set.
+     */
+    bool isReady() { return tm_internal::atomicReadBool(&valueReady); }
+
+    /**
+     * If the value and continuation are both present, but task manager was full when the last of them arrived, the
+     * continuation could not be scheduled. This tries to schedule it again, call it from time to time when there is
+     * a chance task manager was full. Can be called from any thread.
+     * @return true if the continuation has been scheduled, otherwise false
+     */
+    bool poll() {
+        dispatchIfPossible();
+        return tm_internal::atomicReadBool(&dispatched);
+    }
+
+    /**
+     * Register the continuation that is called on task manager once the value is ready, only one continuation can
+     * be registered for each promise. If the value is already available, it is scheduled right away.
+     */
+    void setContinuation(TmContinuationFn fn, void (*callerFn)(), void* callerParam) {
+        continuation = fn;
+        userFn = callerFn;
+        userParam = callerParam;
+        tm_internal::atomicWriteBool(&continuationReady, true);
+        dispatchIfPossible();
+    }
+
+    /**
+     * Resets the promise back to the initial state so that it can be used again, only call this when nothing is
+     * pending on the promise, for example from within the continuation itself.
+     */
+    void reset() {
+        tm_internal::atomicWriteBool(&continuationReady, false);
+        tm_internal::atomicWriteBool(&valueReady, false);
+        tm_internal::atomicWriteBool(&dispatched, false);
+        continuation = nullptr;
+    }
+
+    void exec() override {
+        if(continuation) continuation(this, userFn, userParam);
+    }
+};
+
+template<class T> class TmPromise;
+
+/**
+ * Internal helper that stops the mapping function taking part in template deduction, so lambdas can be passed to then
+ * and the result type is taken from the next promise instead.
+ */
+template<class T, class R> struct TmMapperFn {
+    typedef R (*type)(const T&);
+};
+
+/**
+ * The read side of a TmPromise, it can be checked for readiness, and continuations can be chained onto it with then.
+ * A future is just a lightweight reference to the promise, so the promise must outlive it.
+ * @tparam T the type of value held
+ */
+template<class T> class TmFuture {
+private:
+    TmPromise<T>* promise;
+
+    template<class R> static void chainedContinuation(TmPromiseBase* p, void (*fn)(), void* next) {
+        auto ourPromise = static_cast<TmPromise<T>*>(p);
+        auto mapper = reinterpret_cast<typename TmMapperFn<T, R>::type>(fn);
+        static_cast<TmPromise<R>*>(next)->setValue(mapper(ourPromise->getValue()));
+    }
+
+    static void consumerContinuation(TmPromiseBase* p, void (*fn)(), void* /*unused*/) {
+        auto consumer = reinterpret_cast<void (*)(const T&)>(fn);
+        consumer(static_cast<TmPromise<T>*>(p)->getValue());
+    }
+public:
+    explicit TmFuture(TmPromise<T>* promise) : promise(promise) {}
+
+    /**
+     * @return true if the value is available
+     */
+    bool isReady() const { return promise->isReady(); }
+
+    /**
+     * Retries scheduling a continuation that could not be scheduled because task manager was full, see
+     * TmPromiseBase::poll.
+     * @return true if the continuation has been scheduled, otherwise false
+     */
+    bool poll() { return promise->poll(); }
+
+    /**
+     * @return the value, only valid once isReady() is true.
+     */
+    const T& get() const { return promise->getValue(); }
+
+    /**
+     * Call a function on task manager with the value once it is ready, this ends the chain.
+     * @param consumer the function to be called with the value
+     */
+    void then(void (*consumer)(const T&)) {
+        promise->setContinuation(consumerContinuation, reinterpret_cast<void (*)()>(consumer), nullptr);
+    }
+
+    /**
+     * Call a function on task manager once the value is ready, the value it returns is used to complete the next
+     * promise, whose future is returned so that further continuations can be chained.
+     * @param mapper the function that converts this value into the next value
+     * @param nextPromise the storage for the next value in the chain
+     * @return the future of the next promise
+     */
+    template<class R> TmFuture<R> then(typename TmMapperFn<T, R>::type mapper, TmPromise<R>& nextPromise) {
+        promise->setContinuation(chainedContinuation<R>, reinterpret_cast<void (*)()>(mapper), &nextPromise);
+        return nextPromise.getFuture();
+    }
+
+    /**
+     * Internal use, registers a raw continuation, used by combinators such as TmWhenAll.
+     */
+    void thenRaw(TmContinuationFn fn, void* param) {
+        promise->setContinuation(fn, nullptr, param);
+    }
+};
+
+/**
+ * A promise holds a value that will be provided later, possibly from another thread, for example work started with
+ * taskManager.execute(..) running elsewhere. The value is stored in-place, no heap or std::function is ever used.
+ * Once the value is set, any continuation registered on the future is called back on the task manager thread. For
+ * example:
+ *
+ * ```
+ * TmPromise<int> reading;
+ * TmPromise<float> scaled;
+ *
+ * reading.getFuture().then(scaleReading, scaled).then(publishReading);
+ * // later, from any thread
+ * reading.setValue(analogRead(A0));
+ * ```
+ *
+ * Promises must outlive any work that refers to them, declare them globally or as class members.
+ * @tparam T the type of the value, it must be default constructable and copyable.
+ */
+template<class T> class TmPromise : public TmPromiseBase {
+private:
+    T value;
+public:
+    explicit TmPromise(TaskManager* tm = &taskManager) : TmPromiseBase(tm), value() {}
+
+    /**
+     * Sets the value of the promise and schedules the continuation if there is one. Can be called from any thread.
+     * @param newValue the value to complete the promise with
+     */
+    void setValue(const T& newValue) {
+        value = newValue;
+        markReady();
+    }
+
+    /**
+     * @return the value, only valid once the promise is ready
+     */
+    const T& getValue() const { return value; }
+
+    /**
+     * @return the future associated with this promise
+     */
+    TmFuture<T> getFuture() { return TmFuture<T>(this); }
+};
+
+/**
+ * A combinator that completes once all the futures added to it are ready. Its own future holds the number of futures
+ * that completed, and continuations are called on task manager as usual. Add futures using add, or the whenAll helper,
+ * and note that it takes up the continuation of each future added. When fewer than MAX_FUTURES are added with add,
+ * call finishAdding afterwards, the whenAll helper does this for you. For example:
+ *
+ * ```
+ * TmWhenAll<2> bothReady;
+ * whenAll(bothReady, temperature.getFuture(), humidity.getFuture()).then(publishBoth);
+ * ```
+ *
+ * @tparam MAX_FUTURES the number of futures that must complete
+ */
+template<int MAX_FUTURES> class TmWhenAll {
+private:
+    static_assert(MAX_FUTURES > 0, "TmWhenAll must wait for at least one future");
+    TmPromise<uint8_t> allDone;
+    // one for each future added that is not yet ready, plus one until adding has finished.
+    tm_internal::TmAtomicCounter remaining;
+    uint8_t added;
+    bool addingFinished;
+
+    void countDown() {
+        if(tm_internal::atomicAddCounter(&remaining, -1) == 0) {
+            allDone.setValue(added);
+        }
+    }
+
+    static void futureCompleted(TmPromiseBase* /*promise*/, void (*)(), void* param) {
+        static_cast<TmWhenAll*>(param)->countDown();
+    }
+public:
+    explicit TmWhenAll(TaskManager* tm = &taskManager) : allDone(tm), added(0), addingFinished(false) {
+        tm_internal::atomicWriteCounter(&remaining, 1);
+    }
+
+    /**
+     * Add a future that must be ready before this combinator completes. Adding the last of MAX_FUTURES finishes
+     * adding, otherwise call finishAdding once all have been added.
+     * @param future the future to wait on
+     * @return true if added, false if adding has already finished.
+     */
+    template<class T> bool add(TmFuture<T> future) {
+        if(addingFinished) return false;
+        added++;
+        tm_internal::atomicAddCounter(&remaining, 1);
+        future.thenRaw(futureCompleted, this);
+        if(added == MAX_FUTURES) finishAdding();
+        return true;
+    }
+
+    /**
+     * Marks that no more futures will be added, the combinator then completes once those that were added are ready,
+     * or straight away if they already are. Calling this again has no effect.
+     */
+    void finishAdding() {
+        if(addingFinished) return;
+        addingFinished = true;
+        countDown();
+    }
+
+    /**
+     * @return the future that is completed once all added futures are ready
+     */
+    TmFuture<uint8_t> getFuture() { return allDone.getFuture(); }
+};
+
+/**
+ * Adds all the futures provided to the TmWhenAll combinator and returns its future.
+ * @param combinator the combinator that provides the storage
+ * @param futures the futures to wait for
+ * @return the future that is ready once all futures have completed.
+ */
+template<int MAX_FUTURES, class... FUTURES> TmFuture<uint8_t> whenAll(TmWhenAll<MAX_FUTURES>& combinator, FUTURES... futures) {
+    static_assert(sizeof...(FUTURES) <= MAX_FUTURES, "More futures given than the combinator can hold");
+    bool added[] = { combinator.add(futures)... };
+    (void)added;
+    combinator.finishAdding();
+    return combinator.getFuture();
+}
+
+#endif //TASKMANAGERIO_TMFUTURE_H
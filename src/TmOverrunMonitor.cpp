@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TmOverrunMonitor.h"
+
+TmOverrunMonitor::TmOverrunMonitor(TmOverrunFn overrunFn, uint8_t disableAfter, TaskManager* tm)
+        : taskMgr(tm), overrunFn(overrunFn), disableAfter(disableAfter) {
+    tm_internal::atomicWritePtr(&lastReportedTask, nullptr);
+    tm_internal::atomicWriteCounter(&lastReportedStart, 0);
+    tm_internal::atomicWriteCounter(&overrunCount, 0);
+}
+
+bool TmOverrunMonitor::check() {
+    auto task = taskMgr->getRunningTask();
+    if(task == nullptr) return false;
+
+    // the start time is written before the running task is set, and after it is restored, so if the task is the same
+    // afterwards, the time is its own.
+    uint32_t started = taskMgr->getRunningTaskStartMicros();
+    if(taskMgr->getRunningTask() != task) return false;
+
+    auto budget = task->getBudgetMicros();
+    if(budget == 0) return false;
+    uint32_t runningFor = micros() - started;
+    if(runningFor <= budget) return false;
+
+    // only report each run once, however long it stays stuck for, even when checked from more than one place.
+    auto reportedStart = tm_internal::atomicReadCounter(&lastReportedStart);
+    if(task == tm_internal::atomicReadPtr(&lastReportedTask) && started == reportedStart) return false;
+    if(!tm_internal::atomicSwapCounter(&lastReportedStart, reportedStart, started)) return false;
+    tm_internal::atomicWritePtr(&lastReportedTask, task);
+    tm_internal::atomicAddCounter(&overrunCount, 1);
+
+    bool disabled = false;
+    if(task->markOverrun() >= disableAfter && disableAfter != 0) {
+        task->setEnabled(false);
+        disabled = true;
+    }
+
+    if(overrunFn != nullptr) overrunFn(taskMgr->getTaskId(task), runningFor, disabled);
+    return true;
+}
+
+#ifdef ESP32
+
+struct TmMonitorThreadParams {
+    TmOverrunMonitor* monitor;
+    uint32_t periodMillis;
+};
+
+static TmMonitorThreadParams monitorThreadParams;
+
+static void overrunMonitorThread(void* param) {
+    auto params = static_cast<TmMonitorThreadParams*>(param);
+    auto ticks = pdMS_TO_TICKS(params->periodMillis);
+    if(ticks == 0) ticks = 1;
+    while(true) {
+        params->monitor->check();
+        vTaskDelay(ticks);
+    }
+}
+
+bool TmOverrunMonitor::startMonitorThread(uint32_t periodMillis, uint32_t stackSize) {
+    // one monitor thread is enough, it is rare to have more than one task manager on a board.
+    if(monitorThreadParams.monitor != nullptr) return false;
+    monitorThreadParams.monitor = this;
+    monitorThreadParams.periodMillis = periodMillis;
+    return xTaskCreate(overrunMonitorThread, "tmOverrun", stackSize, &monitorThreadParams, tskIDLE_PRIORITY + 2,
+                       nullptr) == pdPASS;
+}
+
+#elif defined(TM_OVERRUN_MONITOR_THREAD)
+
+static TmOverrunMonitor* threadMonitor = nullptr;
+static uint32_t threadPeriodMillis = 0;
+
+static void overrunMonitorThread() {
+    while(true) {
+        threadMonitor->check();
+        rtos::ThisThread::sleep_for(std::chrono::milliseconds(threadPeriodMillis));
+    }
+}
+
+bool TmOverrunMonitor::startMonitorThread(uint32_t periodMillis, uint32_t stackSize) {
+    // one monitor thread is enough, it is rare to have more than one task manager on a board.
+    if(threadMonitor != nullptr) return false;
+    threadMonitor = this;
+    threadPeriodMillis = (periodMillis == 0) ? 1 : periodMillis;
+    auto thread = new rtos::Thread(osPriorityAboveNormal, stackSize, nullptr, "tmOverrun");
+    return thread->start(mbed::callback(overrunMonitorThread)) == osOK;
+}
+
+#endif // ESP32 or mbed
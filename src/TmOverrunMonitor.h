@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMOVERRUNMONITOR_H
+#define TASKMANAGERIO_TMOVERRUNMONITOR_H
+
+/**
+ * @file TmOverrunMonitor.h
+ * @brief Detects a task that is taking longer than its budget while it is still running.
+ */
+
+#include "TaskManagerIO.h"
+
+//
+// Boards where the monitor can start its own thread, see TmOverrunMonitor::startMonitorThread.
+//
+#if defined(ESP32) || defined(ARDUINO_MBED_MODE) || (defined(IOA_USE_MBED) && !defined(PIO_NEEDS_RTOS_WORKAROUND))
+# define TM_OVERRUN_MONITOR_THREAD
+#endif
+
+/**
+ * Called when a task goes over budget, it is called from wherever check() was called, which may be an interrupt.
+ * @param taskId the ID of the task that is over budget
+ * @param runningMicros how long the task has been running for
+ * @param disabled true if the task has now been disabled, it will not be scheduled again once it returns
+ */
+typedef void (*TmOverrunFn)(taskid_t taskId, uint32_t runningMicros, bool disabled);
+
+/**
+ * Watches the running task of a task manager, and reports any task that has been running for longer than the budget
+ * set with TaskManager::setTaskBudget. As the task is stuck, the check must be made from somewhere else, either another
+ * thread or a timer interrupt, and it must be made more often than the budgets being checked. Each run of a task is
+ * reported once. Optionally, a task can be disabled after a number of overruns in a row, it is not stopped, but once
+ * it returns it is not scheduled again until enabled.
+ *
+ * On ESP32 and mbed, startMonitorThread creates a thread that checks periodically. Other boards have no thread that
+ * can be started here, so call check from a thread of your own, or from a hardware timer interrupt, in which case keep
+ * the overrun function short.
+ *
+ * ```
+ * TmOverrunMonitor monitor(onOverrun, 3);
+ * taskManager.setTaskBudget(i2cTaskId, 2000);
+ * monitor.startMonitorThread(1);
+ * ```
+ */
+class TmOverrunMonitor {
+private:
+    TaskManager* taskMgr;
+    TmOverrunFn overrunFn;
+    tm_internal::TimerTaskAtomicPtr lastReportedTask;
+    tm_internal::TmAtomicCounter lastReportedStart;
+    tm_internal::TmAtomicCounter overrunCount;
+    uint8_t disableAfter;
+public:
+    /**
+     * Create an overrun monitor
+     * @param overrunFn called each time a task goes over budget, can be nullptr to only count them
+     * @param disableAfter disable a task after this many overruns in a row, 0 never disables
+     * @param tm the task manager to monitor
+     */
+    explicit TmOverrunMonitor(TmOverrunFn overrunFn, uint8_t disableAfter = 0, TaskManager* tm = &taskManager);
+
+    /**
+     * Check if the running task is over budget, call periodically from another thread or a timer interrupt.
+     * @return true if an overrun was reported by this call
+     */
+    bool check();
+
+    /**
+     * @return the number of overruns reported since creation
+     */
+    uint32_t getOverrunCount() { return tm_internal::atomicReadCounter(&overrunCount); }
+
+#ifdef TM_OVERRUN_MONITOR_THREAD
+    /**
+     * Starts a thread that calls check periodically, a FreeRTOS task on ESP32 or an rtos::Thread on mbed, the monitor
+     * must outlive it. Only one monitor thread can be started.
+     * @param periodMillis how often to check, this should be less than the smallest budget
+     * @param stackSize the stack size of the monitor task
+     * @return true if the task was created
+     */
+    bool startMonitorThread(uint32_t periodMillis, uint32_t stackSize = 2048);
+#endif
+};
+
+#endif //TASKMANAGERIO_TMOVERRUNMONITOR_H
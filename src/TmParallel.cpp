@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TmParallel.h"
+#include <IoLogging.h>
+
+TmParallelHelper::TmParallelHelper() {
+    tm_internal::atomicWriteBool(&queued, false);
+    tm_internal::atomicWriteCounter(&generation, 0);
+}
+
+void TmParallelHelper::exec() {
+    // from here on the next job must queue this helper again.
+    tm_internal::atomicWriteBool(&queued, false);
+
+    // register as active before checking the job is open, the caller closes the job and then waits for active helpers
+    // to finish, so a helper either sees the job closed, or the caller waits for it.
+    tm_internal::atomicAddCounter(&pool->activeHelpers, 1);
+    if(tm_internal::atomicReadBool(&pool->jobOpen)
+            && tm_internal::atomicReadCounter(&generation) == tm_internal::atomicReadCounter(&pool->jobGeneration)) {
+        pool->runChunks(participant);
+    }
+    tm_internal::atomicAddCounter(&pool->activeHelpers, -1);
+}
+
+TmWorkerPool::TmWorkerPool() : workers{}, workerCount(0), chunkFn(nullptr), chunkContext(nullptr), rangeBegin(0),
+                               rangeEnd(0), grainSize(1), chunkCount(0) {
+    tm_internal::atomicWriteBool(&busy, false);
+    tm_internal::atomicWriteBool(&jobOpen, false);
+    tm_internal::atomicWriteCounter(&activeHelpers, 0);
+    tm_internal::atomicWriteCounter(&nextChunk, 0);
+    tm_internal::atomicWriteCounter(&jobGeneration, 0);
+}
+
+bool TmWorkerPool::addWorker(TaskManager* worker) {
+    if(workerCount >= TM_MAX_PARALLEL_WORKERS) return false;
+    helpers[workerCount].pool = this;
+    helpers[workerCount].participant = workerCount + 1;
+    workers[workerCount] = worker;
+    workerCount++;
+    return true;
+}
+
+void TmWorkerPool::runChunks(uint8_t participant) {
+    uint32_t chunk;
+    while((chunk = tm_internal::atomicAddCounter(&nextChunk, 1) - 1) < chunkCount) {
+        auto chunkStart = rangeBegin + (chunk * grainSize);
+        auto chunkEnd = (rangeEnd - chunkStart) > grainSize ? chunkStart + grainSize : rangeEnd;
+        chunkFn(chunkContext, participant, chunkStart, chunkEnd);
+    }
+}
+
+void TmWorkerPool::runJob(uint32_t begin, uint32_t end, uint32_t grain, TmChunkFn fn, void* context) {
+    if(end <= begin) return;
+    if(grain == 0) grain = 1;
+    auto chunks = ((end - begin) + grain - 1) / grain;
+
+    // with nothing to share, or another job already in progress, the caller does all the work, still a grain at a time.
+    if(workerCount == 0 || chunks == 1 || !tm_internal::atomicSwapBool(&busy, false, true)) {
+        auto chunkStart = begin;
+        while(chunkStart < end) {
+            auto chunkEnd = (end - chunkStart) > grain ? chunkStart + grain : end;
+            fn(context, 0, chunkStart, chunkEnd);
+            chunkStart = chunkEnd;
+        }
+        return;
+    }
+
+    chunkFn = fn;
+    chunkContext = context;
+    rangeBegin = begin;
+    rangeEnd = end;
+    grainSize = grain;
+    chunkCount = chunks;
+    tm_internal::atomicWriteCounter(&nextChunk, 0);
+    auto thisJob = tm_internal::atomicAddCounter(&jobGeneration, 1);
+    tm_internal::atomicWriteBool(&jobOpen, true);
+
+    for(uint8_t i = 0; i < workerCount; i++) {
+        auto& helper = helpers[i];
+        tm_internal::atomicWriteCounter(&helper.generation, thisJob);
+        // a helper still queued from an earlier job that its worker did not get to takes part in this one instead.
+        if(!tm_internal::atomicSwapBool(&helper.queued, false, true)) continue;
+        if(workers[i]->execute(&helper) == TASKMGR_INVALIDID) {
+            tm_internal::atomicWriteBool(&helper.queued, false);
+            serlogF2(SER_WARNING, "TM parallel no slot ", i);
+        }
+    }
+
+    // the calling thread takes part too, and by the time this returns every chunk has been handed out.
+    runChunks(0);
+
+    // close the job and wait for any helpers still working on their last chunk.
+    tm_internal::atomicWriteBool(&jobOpen, false);
+    while(tm_internal::atomicReadCounter(&activeHelpers) != 0) {
+        yield();
+    }
+    tm_internal::atomicWriteBool(&busy, false);
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMPARALLEL_H
+#define TASKMANAGERIO_TMPARALLEL_H
+
+/**
+ * @file TmParallel.h
+ * @brief Data parallel helpers that split a range of work across task managers running on other threads or cores.
+ */
+
+#include "TaskManagerIO.h"
+
+//
+// The maximum number of worker task managers that can be added to a pool, the calling thread always takes part in
+// addition to these. Define it yourself to change.
+//
+#ifndef TM_MAX_PARALLEL_WORKERS
+#define TM_MAX_PARALLEL_WORKERS 4
+#endif
+
+/**
+ * Internal definition of the function that processes one chunk of the range on behalf of a participant.
+ */
+typedef void (*TmChunkFn)(void* context, uint8_t participant, uint32_t begin, uint32_t end);
+
+class TmWorkerPool;
+
+/**
+ * Internal class: one helper per worker, it is what gets executed on the worker task manager to join a job.
+ */
+class TmParallelHelper : public Executable {
+private:
+    friend class TmWorkerPool;
+    TmWorkerPool* pool = nullptr;
+    uint8_t participant = 0;
+    // set while the helper is waiting in its worker's queue, so that it is never queued twice.
+    tm_internal::TmAtomicBool queued;
+    // the job that the helper was last queued for, it only takes part in that job.
+    tm_internal::TmAtomicCounter generation;
+public:
+    TmParallelHelper();
+    void exec() override;
+};
+
+/**
+ * A pool of worker task managers that can share out data parallel work. Each worker is a TaskManager whose runLoop is
+ * called on another thread or core, for example a FreeRTOS task pinned to the second core of an ESP32. When a parallel
+ * operation starts, one helper is queued on each worker, and the range is then handed out a chunk at a time using an
+ * atomic index, so there is no task slot per element. The calling thread also processes chunks, and the call only
+ * returns once every chunk has completed. If there are no workers, or the pool is already in use, the caller simply
+ * processes the whole range itself. A helper that did not get to run before the last job finished stays queued on
+ * its worker, and is moved on to the next job rather than being queued again.
+ *
+ * ```
+ * TmWorkerPool pool;
+ * pool.addWorker(&secondCoreTaskManager);
+ * pool.parallelFor(0, SAMPLES, 64, [](uint32_t begin, uint32_t end) {
+ *     for(auto i = begin; i < end; i++) output[i] = filter(input[i]);
+ * });
+ * ```
+ */
+class TmWorkerPool {
+private:
+    friend class TmParallelHelper;
+    TaskManager* workers[TM_MAX_PARALLEL_WORKERS];
+    TmParallelHelper helpers[TM_MAX_PARALLEL_WORKERS];
+    uint8_t workerCount;
+    tm_internal::TmAtomicBool busy;
+    tm_internal::TmAtomicBool jobOpen;
+    tm_internal::TmAtomicCounter activeHelpers;
+    tm_internal::TmAtomicCounter nextChunk;
+    tm_internal::TmAtomicCounter jobGeneration;
+    TmChunkFn chunkFn;
+    void* chunkContext;
+    uint32_t rangeBegin;
+    uint32_t rangeEnd;
+    uint32_t grainSize;
+    uint32_t chunkCount;
+
+    void runChunks(uint8_t participant);
+    void runJob(uint32_t begin, uint32_t end, uint32_t grain, TmChunkFn fn, void* context);
+
+    template<class F> struct ForContext {
+        F* fn;
+        static void call(void* context, uint8_t /*participant*/, uint32_t begin, uint32_t end) {
+            (*static_cast<ForContext*>(context)->fn)(begin, end);
+        }
+    };
+
+    template<class T, class MAP, class COMBINE> struct ReduceContext {
+        MAP* map;
+        COMBINE* combine;
+        T partials[TM_MAX_PARALLEL_WORKERS + 1];
+        static void call(void* context, uint8_t participant, uint32_t begin, uint32_t end) {
+            auto ctx = static_cast<ReduceContext*>(context);
+            ctx->partials[participant] = (*ctx->combine)(ctx->partials[participant], (*ctx->map)(begin, end));
+        }
+    };
+public:
+    TmWorkerPool();
+
+    /**
+     * Add a worker task manager to the pool, its runLoop must be called from a thread other than the callers.
+     * @param worker the task manager to add
+     * @return true if added, false if the pool is full.
+     */
+    bool addWorker(TaskManager* worker);
+
+    /**
+     * @return the number of threads that can take part, which is the workers plus the calling thread.
+     */
+    uint8_t getParticipantCount() const { return workerCount + 1; }
+
+    /**
+     * Calls fn(chunkBegin, chunkEnd) for consecutive chunks of up to grain items that together cover [begin, end),
+     * spreading the chunks over the workers and the calling thread. Returns once all chunks have completed.
+     * @param begin the first index
+     * @param end one past the last index
+     * @param grain the number of items in each chunk, choose it so that a chunk is worth handing to another thread
+     * @param fn any callable taking (uint32_t begin, uint32_t end), it is called from multiple threads at once.
+     */
+    template<class F> void parallelFor(uint32_t begin, uint32_t end, uint32_t grain, F fn) {
+        ForContext<F> context = { &fn };
+        runJob(begin, end, grain, ForContext<F>::call, &context);
+    }
+
+    /**
+     * Reduces the range [begin, end) to a single value in parallel. Each chunk is mapped to a value using
+     * map(chunkBegin, chunkEnd), which is then combined with the other results using combine(a, b). As results are
+     * combined in no particular order, combine must be associative and commutative, with identity being its neutral
+     * value. For example, a sum would use 0 as identity, and a + b as combine.
+     * @param begin the first index
+     * @param end one past the last index
+     * @param grain the number of items in each chunk
+     * @param identity the neutral value for combine
+     * @param map callable taking (uint32_t begin, uint32_t end) returning T
+     * @param combine callable taking (T, T) returning T
+     * @return the combined result
+     */
+    template<class T, class MAP, class COMBINE> T parallelReduce(uint32_t begin, uint32_t end, uint32_t grain, T identity,
+                                                                 MAP map, COMBINE combine) {
+        ReduceContext<T, MAP, COMBINE> context;
+        context.map = &map;
+        context.combine = &combine;
+        for(auto& partial : context.partials) partial = identity;
+
+        runJob(begin, end, grain, ReduceContext<T, MAP, COMBINE>::call, &context);
+
+        T result = identity;
+        for(auto& partial : context.partials) result = combine(result, partial);
+        return result;
+    }
+};
+
+#endif //TASKMANAGERIO_TMPARALLEL_H
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMPAYLOADEVENT_H
+#define TASKMANAGERIO_TMPAYLOADEVENT_H
+
+/**
+ * @file TmPayloadEvent.h
+ * @brief An event that is triggered with a pointer to a preallocated buffer, and a pool for those buffers, so that data
+ * such as a received packet is handed to task manager in order without being copied.
+ */
+
+#include "TaskManagerIO.h"
+#include "TmChannel.h"
+
+/**
+ * The pool logic shared by all sizes of buffer pool, see TmBufferPool for the class that you create. Buffers are
+ * tracked with one bit each, set while in use, so acquiring and releasing is a single compare and swap, and can be done
+ * from any thread or interrupt at once.
+ * @tparam T the type of buffer
+ */
+template<class T> class TmBufferPoolBase {
+private:
+    T* buffers;
+    tm_internal::TmAtomicCounter* inUseBits;
+    uint16_t poolSize;
+protected:
+    TmBufferPoolBase(T* buffers, tm_internal::TmAtomicCounter* inUseBits, uint16_t poolSize)
+            : buffers(buffers), inUseBits(inUseBits), poolSize(poolSize) {}
+public:
+    /**
+     * Take a free buffer from the pool, safe to call from an interrupt or another thread. Within an interrupt,
+     * interrupts stay disabled, as only the tm_internal atomics that save and restore their state are used.
+     * @return a buffer, or nullptr if they are all in use
+     */
+    T* acquire() {
+        for(uint16_t word = 0; word < ((poolSize + 31U) / 32U); word++) {
+            while(true) {
+                uint32_t bits = tm_internal::atomicReadCounter(&inUseBits[word]);
+                uint8_t bit = 0;
+                while(bit < 32 && (bits & (1UL << bit)) != 0) bit++;
+                // the free bits past the end of the pool are never used
+                uint16_t index = (word * 32U) + bit;
+                if(bit == 32 || index >= poolSize) break;
+                if(tm_internal::atomicSwapCounter(&inUseBits[word], bits, bits | (1UL << bit))) return &buffers[index];
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Give a buffer back to the pool, safe to call from an interrupt or another thread, as with acquire.
+     * @param buffer a buffer that was acquired from this pool, anything else is ignored
+     */
+    void release(T* buffer) {
+        if(buffer < buffers || buffer >= &buffers[poolSize]) return;
+        uint16_t index = buffer - buffers;
+        auto word = &inUseBits[index / 32U];
+        uint32_t mask = 1UL << (index % 32U);
+        uint32_t bits;
+        do {
+            bits = tm_internal::atomicReadCounter(word);
+        } while((bits & mask) != 0 && !tm_internal::atomicSwapCounter(word, bits, bits & ~mask));
+    }
+
+    /**
+     * @return the number of buffers that are not in use, this is only a snapshot if others are active.
+     */
+    uint16_t getAvailable() {
+        uint16_t available = poolSize;
+        for(uint16_t word = 0; word < ((poolSize + 31U) / 32U); word++) {
+            uint32_t bits = tm_internal::atomicReadCounter(&inUseBits[word]);
+            while(bits != 0) {
+                bits &= bits - 1;
+                available--;
+            }
+        }
+        return available;
+    }
+
+    uint16_t getPoolSize() const { return poolSize; }
+};
+
+/**
+ * A fixed pool of buffers that can be taken and given back from any thread or interrupt without locking or heap use.
+ * Usually the producer acquires a buffer, fills it, for example by DMA, and then triggers a TmPayloadEvent with it,
+ * which releases it back to the pool once handled.
+ * @tparam T the type of buffer
+ * @tparam POOL_SIZE the number of buffers
+ */
+template<class T, uint16_t POOL_SIZE> class TmBufferPool : public TmBufferPoolBase<T> {
+private:
+    static_assert(POOL_SIZE != 0, "A buffer pool must have at least one buffer");
+    T storage[POOL_SIZE];
+    tm_internal::TmAtomicCounter inUseStorage[(POOL_SIZE + 31U) / 32U];
+public:
+    TmBufferPool() : TmBufferPoolBase<T>(storage, inUseStorage, POOL_SIZE), storage() {
+        for(auto& bits : inUseStorage) {
+            tm_internal::atomicWriteCounter(&bits, 0);
+        }
+    }
+};
+
+/**
+ * An event that carries data, it is triggered with a pointer to a buffer, and the handler is then called on task manager
+ * with each buffer in the order they were triggered. Only the pointer is queued, so nothing is copied, and as each
+ * trigger has its own buffer, triggers that overlap cannot overwrite each other's data. When a pool is given, each
+ * buffer is released back to it once the handler returns, so the handler must not keep the pointer.
+ *
+ * Either give a function to call, or extend this class and override handlePayload.
+ *
+ * ```
+ * TmBufferPool<Packet, 8> packetPool;
+ * TmPayloadEvent<Packet, 8> packetReceived(onPacket, &packetPool);
+ *
+ * void ISR_ATTR rxComplete() {
+ *     Packet* packet = packetPool.acquire();
+ *     if(packet != nullptr) {
+ *         readPacketInto(packet);
+ *         packetReceived.trigger(packet);
+ *     }
+ * }
+ * ```
+ * @tparam T the type of buffer
+ * @tparam CAPACITY the most buffers that can be waiting, it must be a power of two, and usually at least the pool size
+ */
+template<class T, uint32_t CAPACITY> class TmPayloadEvent : public BaseEvent {
+public:
+    typedef void (*PayloadFn)(T* payload);
+private:
+    TmMpscChannel<T*, CAPACITY> queue;
+    PayloadFn payloadFn;
+    TmBufferPoolBase<T>* pool;
+    uint32_t handledCount;
+public:
+    /**
+     * Create a payload event
+     * @param fn the function to call with each payload, or nullptr when handlePayload is overridden
+     * @param pool the pool to release each payload to once handled, or nullptr to not release them
+     * @param tm the task manager this event is registered with
+     */
+    explicit TmPayloadEvent(PayloadFn fn = nullptr, TmBufferPoolBase<T>* pool = nullptr,
+                            TaskManager* tm = &taskManager) : BaseEvent(tm), payloadFn(fn), pool(pool),
+                                                              handledCount(0) {
+        queue.setNotifyEvent(this);
+    }
+
+    /**
+     * Queue a payload for the handler and notify task manager, this can be called from any number of threads and
+     * interrupts at once. Like the pool, the queue only uses the atomics that restore the interrupt state.
+     * @param payload the buffer to hand over, it must not be changed until it has been handled
+     * @return true if queued, otherwise the queue was full and the caller still owns the buffer
+     */
+    bool trigger(T* payload) { return queue.push(payload); }
+
+    /**
+     * Called on task manager with each payload in turn, by default calls the function given in the constructor.
+     * @param payload the buffer that was triggered
+     */
+    virtual void handlePayload(T* payload) {
+        if(payloadFn != nullptr) payloadFn(payload);
+    }
+
+    /**
+     * @return the number of payloads waiting to be handled
+     */
+    uint32_t getPendingCount() { return queue.size(); }
+
+    /**
+     * @return the number of payloads that have been handled
+     */
+    uint32_t getHandledCount() const { return handledCount; }
+
+    /**
+     * @return the number of triggers that failed because the queue was full
+     */
+    uint32_t getRejectedCount() { return queue.getRejectedCount(); }
+
+    uint32_t timeOfNextCheck() override {
+        if(queue.size() != 0) setTriggered(true);
+        return TM_IDLE_CHECK_MICROS;
+    }
+
+    void exec() override {
+        // as with channel consumers, one run handles at most the capacity, so a busy producer cannot hold up others.
+        T* payload;
+        uint32_t handled = 0;
+        while(handled < CAPACITY && queue.pop(payload)) {
+            handlePayload(payload);
+            if(pool != nullptr) pool->release(payload);
+            handled++;
+        }
+        handledCount += handled;
+        if(queue.size() != 0) markTriggeredAndNotify();
+    }
+};
+
+#endif //TASKMANAGERIO_TMPAYLOADEVENT_H
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TmPinInterrupts.h"
+#include <IoLogging.h>
+
+BaseEvent* volatile TmPinInterrupts::pinEvents[TM_MAX_INTERRUPT_PINS];
+TmPinHandlerEvent* TmPinInterrupts::ownedEvents[TM_MAX_INTERRUPT_PINS];
+tm_internal::TmAtomicCounter TmPinInterrupts::dispatching[TM_MAX_INTERRUPT_PINS];
+
+/**
+ * The raw ISR for a given pin when it is dispatched through the pin table, one is generated for each pin.
+ */
+template<pintype_t PIN> struct PinTableIsr {
+    static ISR_ATTR void handle() {
+        TmPinInterrupts::dispatch(PIN);
+    }
+};
+
+void TmPinHandlerEvent::exec() {
+    if(theExecutable != nullptr) {
+        theExecutable->exec();
+    }
+    else if(fnCallback != nullptr) {
+        fnCallback(pin);
+    }
+}
+
+void TmPinHandlerEvent::release() {
+    // events are processed on every interrupt, so notifying is enough for task manager to see it is complete.
+    setCompleted(true);
+    taskMgr->triggerEvents();
+}
+
+ISR_ATTR void TmPinInterrupts::dispatch(pintype_t pin) {
+    // count the dispatch in before reading the event, so that detach either sees it, or this sees the event cleared.
+    tm_internal::atomicAddCounter(&dispatching[pin], 1);
+    tm_internal::memoryFence();
+    auto event = pinEvents[pin];
+    if(event != nullptr) event->markTriggeredAndNotify();
+    tm_internal::atomicAddCounter(&dispatching[pin], -1);
+}
+
+bool TmPinInterrupts::attachEvent(InterruptAbstraction* ioDevice, pintype_t pin, uint8_t mode, BaseEvent* event,
+                                  TmPinHandlerEvent* owned) {
+    detach(pin);
+    ownedEvents[pin] = owned;
+    pinEvents[pin] = event;
+    ioDevice->attachInterrupt(pin, tm_internal::TrampolineSelector<PinTableIsr, TM_MAX_INTERRUPT_PINS>::select(pin), mode);
+    return true;
+}
+
+bool TmPinInterrupts::attach(InterruptAbstraction* ioDevice, pintype_t pin, uint8_t mode, InterruptFn fn, TaskManager* tm) {
+    if(pin >= TM_MAX_INTERRUPT_PINS) {
+        serlogF2(SER_ERROR, "TM pin range ", pin);
+        return false;
+    }
+    auto event = new TmPinHandlerEvent(tm, pin, fn, nullptr);
+    if(tm->registerEvent(event, true) == TASKMGR_INVALIDID) {
+        delete event;
+        return false;
+    }
+    return attachEvent(ioDevice, pin, mode, event, event);
+}
+
+bool TmPinInterrupts::attach(InterruptAbstraction* ioDevice, pintype_t pin, uint8_t mode, Executable* executable, TaskManager* tm) {
+    if(pin >= TM_MAX_INTERRUPT_PINS) {
+        serlogF2(SER_ERROR, "TM pin range ", pin);
+        return false;
+    }
+    auto event = new TmPinHandlerEvent(tm, pin, nullptr, executable);
+    if(tm->registerEvent(event, true) == TASKMGR_INVALIDID) {
+        delete event;
+        return false;
+    }
+    return attachEvent(ioDevice, pin, mode, event, event);
+}
+
+bool TmPinInterrupts::attach(InterruptAbstraction* ioDevice, pintype_t pin, uint8_t mode, BaseEvent* event) {
+    if(pin >= TM_MAX_INTERRUPT_PINS) {
+        serlogF2(SER_ERROR, "TM pin range ", pin);
+        return false;
+    }
+    return attachEvent(ioDevice, pin, mode, event, nullptr);
+}
+
+void TmPinInterrupts::detach(pintype_t pin) {
+    if(pin >= TM_MAX_INTERRUPT_PINS) return;
+    pinEvents[pin] = nullptr;
+    tm_internal::memoryFence();
+
+    // an interrupt on another core may have read the event just before it was cleared, wait until it has finished
+    // with it, as the event can be deleted as soon as it is released.
+    while(tm_internal::atomicReadCounter(&dispatching[pin]) != 0);
+
+    auto owned = ownedEvents[pin];
+    ownedEvents[pin] = nullptr;
+    if(owned != nullptr) owned->release();
+}
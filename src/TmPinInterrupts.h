@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMPININTERRUPTS_H
+#define TASKMANAGERIO_TMPININTERRUPTS_H
+
+/**
+ * @file TmPinInterrupts.h
+ * @brief A per pin interrupt dispatch table, each pin has its own handler and can be bound to any task manager.
+ */
+
+#include "TaskManagerIO.h"
+
+/**
+ * Internal class: the event that is created when a function or executable is attached to a pin, it is owned by the
+ * dispatch table and deleted by task manager once the pin is detached.
+ */
+class TmPinHandlerEvent : public BaseEvent {
+private:
+    TaskManager* taskMgr;
+    InterruptFn fnCallback;
+    Executable* theExecutable;
+    pintype_t pin;
+public:
+    TmPinHandlerEvent(TaskManager* tm, pintype_t pin, InterruptFn fn, Executable* exec)
+            : BaseEvent(tm), taskMgr(tm), fnCallback(fn), theExecutable(exec), pin(pin) {}
+
+    uint32_t timeOfNextCheck() override { return TM_IDLE_CHECK_MICROS; } // only ever triggered by the interrupt
+
+    void exec() override;
+
+    /**
+     * Marks the event complete and asks task manager to remove it, after which it is deleted.
+     */
+    void release();
+};
+
+/**
+ * A dispatch table that gives each interrupt pin its own handler, in place of the single interrupt callback that is
+ * shared by all pins added with taskManager.addInterrupt. A raw ISR trampoline is generated at compile time for every
+ * pin below TM_MAX_INTERRUPT_PINS, each one knows its pin and goes straight to that pin's entry in the table, so
+ * dispatch takes the same time regardless of how many pins are in use.
+ *
+ * Pins are independent of each other and of the global taskManager, each handler is marshalled onto the task manager
+ * that it was attached with, and can be a function taking the pin, an Executable, or your own BaseEvent. As with any
+ * event, interrupts that occur before the handler has run are coalesced into one call, use the timed interrupt callback
+ * on TaskManager if you need to see every interrupt.
+ *
+ * ```
+ * TmPinInterrupts::attach(ioDevice, BUTTON_PIN, FALLING, onButtonPressed);
+ * TmPinInterrupts::attach(ioDevice, ENCODER_PIN, CHANGE, &encoderExecutable, &secondCoreTaskManager);
+ * ```
+ */
+class TmPinInterrupts {
+private:
+    static BaseEvent* volatile pinEvents[TM_MAX_INTERRUPT_PINS];
+    static TmPinHandlerEvent* ownedEvents[TM_MAX_INTERRUPT_PINS];
+    // the number of dispatches in progress for each pin, detach waits for this to be zero before releasing the event.
+    static tm_internal::TmAtomicCounter dispatching[TM_MAX_INTERRUPT_PINS];
+
+    static bool attachEvent(InterruptAbstraction* ioDevice, pintype_t pin, uint8_t mode, BaseEvent* event,
+                            TmPinHandlerEvent* owned);
+public:
+    /**
+     * Attach a function that is called on task manager with the pin number each time the pin interrupts.
+     * @param ioDevice the interrupt abstraction for the device that owns the pin
+     * @param pin the pin, it must be below TM_MAX_INTERRUPT_PINS
+     * @param mode the mode in which to register, eg. CHANGE, RISING, FALLING
+     * @param fn the function to call
+     * @param tm the task manager that the function is called on
+     * @return true if attached, otherwise false if the pin is out of range or the event could not be registered
+     */
+    static bool attach(InterruptAbstraction* ioDevice, pintype_t pin, uint8_t mode, InterruptFn fn,
+                       TaskManager* tm = &taskManager);
+
+    /**
+     * Attach an executable that is run on task manager each time the pin interrupts, it is never deleted by the table.
+     * @param ioDevice the interrupt abstraction for the device that owns the pin
+     * @param pin the pin, it must be below TM_MAX_INTERRUPT_PINS
+     * @param mode the mode in which to register, eg. CHANGE, RISING, FALLING
+     * @param executable the executable to run
+     * @param tm the task manager that the executable is run on
+     * @return true if attached, otherwise false if the pin is out of range or the event could not be registered
+     */
+    static bool attach(InterruptAbstraction* ioDevice, pintype_t pin, uint8_t mode, Executable* executable,
+                       TaskManager* tm = &taskManager);
+
+    /**
+     * Attach your own event, which you must have registered already with registerEvent on the task manager that it was
+     * constructed with. The interrupt calls markTriggeredAndNotify on it, so it runs on that task manager.
+     * @param ioDevice the interrupt abstraction for the device that owns the pin
+     * @param pin the pin, it must be below TM_MAX_INTERRUPT_PINS
+     * @param mode the mode in which to register, eg. CHANGE, RISING, FALLING
+     * @param event the event to trigger
+     * @return true if attached, otherwise false if the pin is out of range
+     */
+    static bool attach(InterruptAbstraction* ioDevice, pintype_t pin, uint8_t mode, BaseEvent* event);
+
+    /**
+     * Stop dispatching interrupts for a pin, the raw interrupt remains attached but is ignored. Any function or
+     * executable handler is removed from its task manager. If the pin's interrupt is being dispatched on another core
+     * at the time, this waits for that to finish first, so do not call it from the pin's own interrupt.
+     * @param pin the pin to detach
+     */
+    static void detach(pintype_t pin);
+
+    /**
+     * Called by the generated trampolines in interrupt context, marks the event for the pin as triggered.
+     * @param pin the pin that interrupted
+     */
+    static void dispatch(pintype_t pin);
+
+    /**
+     * @param pin the pin to check
+     * @return true if a handler is attached to the pin
+     */
+    static bool isAttached(pintype_t pin) { return pin < TM_MAX_INTERRUPT_PINS && pinEvents[pin] != nullptr; }
+};
+
+#endif //TASKMANAGERIO_TMPININTERRUPTS_H
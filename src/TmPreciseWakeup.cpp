@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TmPreciseWakeup.h"
+#include "TmClockSource.h"
+
+#if defined(BUILD_FOR_HOSTED)
+#include <unistd.h>
+#endif
+
+// until the first sleeps have been measured, wake this early, so that the first deadlines are not missed.
+#define INITIAL_MARGIN_MICROS 500
+
+static void defaultSleep(uint32_t sleepMicros) {
+#if defined(BUILD_FOR_HOSTED)
+    usleep(sleepMicros);
+#elif defined(IOA_USE_MBED) || defined(BUILD_FOR_PICO_CMAKE)
+    delayMicroseconds(sleepMicros);
+#else
+    // on RTOS based boards delay lets other threads run, but it only waits in whole milliseconds, and on AVR it is a
+    // busy wait anyway, so the part millisecond is waited for with delayMicroseconds rather than not at all.
+    if(sleepMicros >= 1000UL) delay(sleepMicros / 1000UL);
+    if((sleepMicros % 1000UL) != 0) delayMicroseconds(sleepMicros % 1000UL);
+#endif
+}
+
+TmPreciseWakeup::TmPreciseWakeup(TmSleepFn sleepFn, uint32_t maxSleepMicros, TaskManager* tm)
+        : taskMgr(tm), sleepFn(sleepFn != nullptr ? sleepFn : defaultSleep), maxSleepMicros(maxSleepMicros),
+          overshootEstimate(INITIAL_MARGIN_MICROS), pollCostEstimate(0), marginMicros(INITIAL_MARGIN_MICROS),
+          sleepCount(0), totalSpinMicros(0), lateWakeCount(0) {
+}
+
+void TmPreciseWakeup::calibrate(uint32_t requested, uint32_t slept, uint32_t pollCost) {
+    uint32_t overshoot = (slept > requested) ? (slept - requested) : 0;
+    if(overshoot > TM_PRECISE_MAX_MARGIN_MICROS) overshoot = TM_PRECISE_MAX_MARGIN_MICROS;
+
+    // follow a worse overshoot straight away, but only come down slowly, so that the margin stays near the worst of the
+    // recent sleeps. Coming down faster made sleeps that overshot the margin common enough that the average lateness
+    // was sometimes worse than just sleeping until the task was due.
+    if(overshoot >= overshootEstimate) {
+        overshootEstimate = overshoot;
+    }
+    else {
+        overshootEstimate -= (overshootEstimate - overshoot) / 64U;
+    }
+    pollCostEstimate = ((pollCostEstimate * 7U) + pollCost) / 8U;
+    updateMargin();
+}
+
+void TmPreciseWakeup::updateMargin() {
+    // the spin checks the queue in a loop, so allow for a couple of checks on top of the overshoot
+    uint32_t margin = overshootEstimate + (2U * pollCostEstimate);
+    if(margin < TM_PRECISE_MIN_MARGIN_MICROS) margin = TM_PRECISE_MIN_MARGIN_MICROS;
+    if(margin > TM_PRECISE_MAX_MARGIN_MICROS) margin = TM_PRECISE_MAX_MARGIN_MICROS;
+    marginMicros = margin;
+}
+
+// all the times here are taken from the scheduler clock, as that is what microsToNextTask is measured against.
+bool TmPreciseWakeup::waitForNextTask(uint32_t maxWaitMicros) {
+    uint32_t waitStart = tm_internal::schedulerMicros();
+    uint32_t spinStart = 0;
+    bool spinning = false;
+    bool slept = false;
+
+    while(true) {
+        uint32_t pollStart = tm_internal::schedulerMicros();
+        bool ready = taskMgr->isInterruptPending();
+        uint32_t untilDue = ready ? 0 : taskMgr->microsToNextTask();
+        uint32_t now = tm_internal::schedulerMicros();
+        uint32_t pollCost = now - pollStart;
+
+        uint32_t waited = now - waitStart;
+        if(untilDue == 0 || waited >= maxWaitMicros) {
+            if(spinning) totalSpinMicros += now - spinStart;
+            if(spinning && !slept) {
+                // with a margin as long as the time between tasks there would never be a sleep to measure, so a wait
+                // that only spun brings the estimate down a little, until sleeps happen again.
+                overshootEstimate -= overshootEstimate / 16U;
+                updateMargin();
+            }
+            return untilDue == 0;
+        }
+
+        // only sleep up to the deadline when it comes before the end of the wait
+        bool sleepToDeadline = untilDue <= (maxWaitMicros - waited);
+        uint32_t untilWake = sleepToDeadline ? untilDue : (maxWaitMicros - waited);
+
+        if(untilWake > marginMicros) {
+            uint32_t toSleep = untilWake - marginMicros;
+            bool fullSleep = sleepToDeadline && toSleep <= maxSleepMicros;
+            if(toSleep > maxSleepMicros) toSleep = maxSleepMicros;
+
+            uint32_t marginBefore = marginMicros;
+            uint32_t sleepStart = tm_internal::schedulerMicros();
+            sleepFn(toSleep);
+            uint32_t sleptFor = tm_internal::schedulerMicros() - sleepStart;
+            slept = true;
+            sleepCount++;
+            if(fullSleep && sleptFor > (toSleep + marginBefore)) lateWakeCount++;
+            calibrate(toSleep, sleptFor, pollCost);
+        }
+        else if(!spinning) {
+            spinning = true;
+            spinStart = now;
+        }
+    }
+}
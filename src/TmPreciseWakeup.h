@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMPRECISEWAKEUP_H
+#define TASKMANAGERIO_TMPRECISEWAKEUP_H
+
+/**
+ * @file TmPreciseWakeup.h
+ * @brief Waits for the next task by sleeping until just before it is due, then spinning until it is, so that tasks
+ * are dispatched on time without polling the whole time in between.
+ */
+
+#include "TaskManagerIO.h"
+
+/** The least the early wake margin can be calibrated down to, in microseconds */
+#define TM_PRECISE_MIN_MARGIN_MICROS 20
+/** The most the early wake margin can be calibrated up to, in microseconds */
+#define TM_PRECISE_MAX_MARGIN_MICROS 20000
+
+/**
+ * Definition of a function that sleeps for about the number of microseconds given, it may sleep for longer, but
+ * should not return much earlier.
+ */
+typedef void (*TmSleepFn)(uint32_t micros);
+
+/**
+ * Runs task manager with a precise wakeup: rather than calling runLoop continuously, or sleeping until the next task
+ * and waking late by however much the sleep overshoots, it sleeps until a margin before the next task is due, and then
+ * spins reading the clock until it is due. The margin calibrates itself: it follows the worst sleep overshoot seen,
+ * decaying slowly so that one long sleep does not keep it high, plus the time taken to check the queue while spinning.
+ * A wait that spins without sleeping at all also brings it down slowly, so it recovers even when one very long sleep
+ * pushed it beyond the time between tasks.
+ * So the sleep ends early enough to spin up to the deadline, and the spin only lasts for about the margin.
+ *
+ * Sleeps are split into pieces of at most the maximum sleep, and an interrupt or event trigger that is waiting stops
+ * the wait early. On boards where the sleep cannot be woken, the maximum sleep is the most that processing of an
+ * interrupt or trigger can be delayed by.
+ *
+ * ```
+ * TmPreciseWakeup preciseWakeup;
+ *
+ * void loop() {
+ *     preciseWakeup.runLoop();
+ * }
+ * ```
+ */
+class TmPreciseWakeup {
+private:
+    TaskManager* taskMgr;
+    TmSleepFn sleepFn;
+    uint32_t maxSleepMicros;
+    uint32_t overshootEstimate;
+    uint32_t pollCostEstimate;
+    uint32_t marginMicros;
+    uint32_t sleepCount;
+    uint32_t totalSpinMicros;
+    uint32_t lateWakeCount;
+
+    void calibrate(uint32_t requested, uint32_t slept, uint32_t pollCost);
+    void updateMargin();
+public:
+    /**
+     * Create a precise wakeup for a task manager
+     * @param sleepFn the function to sleep with, nullptr for the platform default, usleep in the hosted build, sleep_us or
+     * wait_us on pico and mbed, otherwise delay for the whole milliseconds and delayMicroseconds for the rest
+     * @param maxSleepMicros the longest single sleep, between which pending interrupts and triggers are checked
+     * @param tm the task manager to run
+     */
+    explicit TmPreciseWakeup(TmSleepFn sleepFn = nullptr, uint32_t maxSleepMicros = 100000UL,
+                             TaskManager* tm = &taskManager);
+
+    /**
+     * Waits until the next task is due, an interrupt or trigger is pending, or the maximum wait has passed.
+     * @param maxWaitMicros the longest to wait for
+     * @return true if a task is due or an interrupt or trigger is pending
+     */
+    bool waitForNextTask(uint32_t maxWaitMicros = 0xffffffffUL);
+
+    /**
+     * Waits for the next task as above, then calls runLoop, call from loop in place of taskManager.runLoop().
+     */
+    void runLoop() {
+        waitForNextTask();
+        taskMgr->runLoop();
+    }
+
+    /**
+     * @return the current early wake margin in microseconds
+     */
+    uint32_t getMarginMicros() const { return marginMicros; }
+
+    /**
+     * @return the estimate of how far a sleep overshoots the time asked for, in microseconds
+     */
+    uint32_t getOvershootEstimate() const { return overshootEstimate; }
+
+    /**
+     * @return the number of sleeps made
+     */
+    uint32_t getSleepCount() const { return sleepCount; }
+
+    /**
+     * @return the total time spent spinning before deadlines in microseconds, as a measure of the cost of the margin
+     */
+    uint32_t getTotalSpinMicros() const { return totalSpinMicros; }
+
+    /**
+     * @return the number of sleeps that overshot the margin, and so woke after the task was already due
+     */
+    uint32_t getLateWakeCount() const { return lateWakeCount; }
+};
+
+#endif //TASKMANAGERIO_TMPRECISEWAKEUP_H
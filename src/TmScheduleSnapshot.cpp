@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TmScheduleSnapshot.h"
+#include "TaskBlock.h"
+#include <IoLogging.h>
+
+// flag bits stored in each record
+#define SNAPSHOT_FLAG_REPEATING 0x01U
+#define SNAPSHOT_FLAG_ENABLED 0x02U
+#define SNAPSHOT_FLAG_MICROS 0x04U
+#define SNAPSHOT_FLAG_SHEDDABLE 0x08U
+
+// all values are stored little endian, so a snapshot can be read on any board
+static void writeLE16(uint8_t* data, uint16_t value) {
+    data[0] = uint8_t(value);
+    data[1] = uint8_t(value >> 8);
+}
+
+static void writeLE32(uint8_t* data, uint32_t value) {
+    writeLE16(data, uint16_t(value));
+    writeLE16(data + 2, uint16_t(value >> 16));
+}
+
+static uint16_t readLE16(const uint8_t* data) {
+    return uint16_t(data[0] | (uint16_t(data[1]) << 8));
+}
+
+static uint32_t readLE32(const uint8_t* data) {
+    return readLE16(data) | (uint32_t(readLE16(data + 2)) << 16);
+}
+
+TmScheduleSnapshotBase::TmScheduleSnapshotBase(TaskManager* tm, TmSnapshotCallable* callables, uint8_t maxCallables)
+        : taskMgr(tm), callables(callables), maxCallables(maxCallables), callableCount(0), lastRecordCount(0),
+          lastSkippedCount(0) {
+}
+
+bool TmScheduleSnapshotBase::addCallable(uint16_t key, TimerFnPointer fn, Executable* exec) {
+    if(callableCount >= maxCallables || findCallable(key) != nullptr) {
+        serlogF2(SER_ERROR, "TM snapshot reg fail ", key);
+        return false;
+    }
+    callables[callableCount].key = key;
+    callables[callableCount].fnCallback = fn;
+    callables[callableCount].theExecutable = exec;
+    callableCount++;
+    return true;
+}
+
+TmSnapshotCallable* TmScheduleSnapshotBase::findCallable(uint16_t key) {
+    for(uint8_t i = 0; i < callableCount; i++) {
+        if(callables[i].key == key) return &callables[i];
+    }
+    return nullptr;
+}
+
+TmSnapshotCallable* TmScheduleSnapshotBase::findCallable(TimerTask* task) {
+    auto exec = task->getExecutable();
+    auto fn = task->getFunctionPointer();
+    if(exec == nullptr && fn == nullptr) return nullptr;
+
+    for(uint8_t i = 0; i < callableCount; i++) {
+        if(exec != nullptr && callables[i].theExecutable == exec) return &callables[i];
+        if(fn != nullptr && callables[i].fnCallback == fn) return &callables[i];
+    }
+    return nullptr;
+}
+
+uint16_t TmScheduleSnapshotBase::countSavableTasks() {
+    uint16_t count = 0;
+    for(taskid_t block = 0; block < taskMgr->numberOfBlocks; block++) {
+        auto taskBlock = taskMgr->taskBlocks[block];
+        for(taskid_t id = taskBlock->firstSlot(); id <= taskBlock->lastSlot(); id++) {
+            auto task = taskBlock->getContainedTask(id);
+            // a one shot task that is running now has finished as far as the snapshot is concerned.
+            if(!task->isInUse() || task->isEvent() || (task->isRunning() && !task->isRepeating())) continue;
+            if(findCallable(task) != nullptr) count++;
+        }
+    }
+    return count;
+}
+
+bool TmScheduleSnapshotBase::save(TmSnapshotWriter& writer) {
+    lastRecordCount = 0;
+    lastSkippedCount = 0;
+
+    // the count goes in the header so that restore knows where the snapshot ends when it is streamed.
+    uint16_t count = countSavableTasks();
+    uint8_t header[TM_SNAPSHOT_HEADER_SIZE] = { 'T', 'M', 'S', TM_SNAPSHOT_VERSION };
+    writeLE16(&header[4], count);
+    if(!writer.write(header, sizeof header)) return false;
+
+    uint8_t record[TM_SNAPSHOT_RECORD_SIZE];
+    for(taskid_t block = 0; block < taskMgr->numberOfBlocks; block++) {
+        auto taskBlock = taskMgr->taskBlocks[block];
+        for(taskid_t id = taskBlock->firstSlot(); id <= taskBlock->lastSlot(); id++) {
+            auto task = taskBlock->getContainedTask(id);
+            if(!task->isInUse() || task->isEvent() || (task->isRunning() && !task->isRepeating())) continue;
+            auto callable = findCallable(task);
+            if(callable == nullptr) {
+                lastSkippedCount++;
+                continue;
+            }
+            if(lastRecordCount == count) break;
+
+            uint8_t flags = 0;
+            if(task->isRepeating()) flags |= SNAPSHOT_FLAG_REPEATING;
+            if(task->isEnabled()) flags |= SNAPSHOT_FLAG_ENABLED;
+            if(task->isMicrosSchedule()) flags |= SNAPSHOT_FLAG_MICROS;
+            if(task->isSheddable()) flags |= SNAPSHOT_FLAG_SHEDDABLE;
+
+            // a running task starts a full interval once it finishes, as does a disabled one when enabled again.
+            sched_t remaining = (task->isRunning() || !task->isEnabled()) ? task->getSchedule() : task->unitsFromNow();
+
+            writeLE16(&record[0], callable->key);
+            record[2] = flags;
+            record[3] = 0;
+            writeLE32(&record[4], uint32_t(taskMgr->getTaskId(task)));
+            writeLE32(&record[8], task->getSchedule());
+            writeLE32(&record[12], remaining);
+            if(!writer.write(record, sizeof record)) return false;
+            lastRecordCount++;
+        }
+    }
+
+    // the header promised count records, so if anything changed meanwhile, the snapshot is not usable.
+    return lastRecordCount == count;
+}
+
+taskid_t TmScheduleSnapshotBase::restoreRecord(const uint8_t* record, TmSnapshotCallable* callable) {
+    uint8_t flags = record[2];
+    auto taskId = taskMgr->findFreeTask();
+    if(taskId == TASKMGR_INVALIDID) return TASKMGR_INVALIDID;
+
+    auto task = taskMgr->getTask(taskId);
+    auto interval = sched_t(readLE32(&record[8]));
+    auto unit = (flags & SNAPSHOT_FLAG_MICROS) ? TIME_MICROS : TIME_MILLIS;
+    bool repeating = (flags & SNAPSHOT_FLAG_REPEATING) != 0;
+    if(callable->theExecutable != nullptr) {
+        task->initialise(interval, unit, callable->theExecutable, false, repeating);
+    }
+    else {
+        task->initialise(interval, unit, callable->fnCallback, repeating);
+    }
+
+    // keep the phase by running next when it was due, instead of a whole interval from now.
+    task->setFirstRunIn(sched_t(readLE32(&record[12])));
+    task->setEnabled((flags & SNAPSHOT_FLAG_ENABLED) != 0);
+    task->setSheddable((flags & SNAPSHOT_FLAG_SHEDDABLE) != 0);
+    taskMgr->putItemIntoQueue(task);
+    return taskId;
+}
+
+bool TmScheduleSnapshotBase::restore(TmSnapshotReader& reader, TmRestoredTaskFn restoredFn) {
+    lastRecordCount = 0;
+    lastSkippedCount = 0;
+
+    uint8_t header[TM_SNAPSHOT_HEADER_SIZE];
+    if(!reader.read(header, sizeof header)) return false;
+    if(header[0] != 'T' || header[1] != 'M' || header[2] != 'S' || header[3] != TM_SNAPSHOT_VERSION) {
+        serlogF(SER_ERROR, "TM snapshot invalid");
+        return false;
+    }
+
+    // each record is scheduled as it is read, so the snapshot is only read once and needs no buffer.
+    uint16_t count = readLE16(&header[4]);
+    uint8_t record[TM_SNAPSHOT_RECORD_SIZE];
+    bool allScheduled = true;
+    for(uint16_t i = 0; i < count; i++) {
+        if(!reader.read(record, sizeof record)) return false;
+        uint16_t key = readLE16(&record[0]);
+        auto callable = findCallable(key);
+        if(callable == nullptr) {
+            lastSkippedCount++;
+            continue;
+        }
+
+        auto newId = restoreRecord(record, callable);
+        if(newId == TASKMGR_INVALIDID) {
+            serlogF2(SER_ERROR, "TM snapshot restore fail ", key);
+            allScheduled = false;
+            continue;
+        }
+        lastRecordCount++;
+        if(restoredFn != nullptr) restoredFn(key, taskid_t(readLE32(&record[4])), newId);
+    }
+    return allScheduled;
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMSCHEDULESNAPSHOT_H
+#define TASKMANAGERIO_TMSCHEDULESNAPSHOT_H
+
+/**
+ * @file TmScheduleSnapshot.h
+ * @brief Save the timed tasks in task manager to a compact binary form, and restore them with their phase intact.
+ */
+
+#include <string.h>
+#include "TaskManagerIO.h"
+
+#if !defined(TM_SNAPSHOT_FILE_SUPPORT) && (defined(__linux__) || defined(_WIN32) || defined(__APPLE__))
+#define TM_SNAPSHOT_FILE_SUPPORT
+#endif
+
+#ifdef TM_SNAPSHOT_FILE_SUPPORT
+#include <stdio.h>
+#endif
+
+/** The snapshot format version, written in the header */
+#define TM_SNAPSHOT_VERSION 1
+/** The size of the snapshot header in bytes: 'T', 'M', 'S', version, then the record count as 16 bits */
+#define TM_SNAPSHOT_HEADER_SIZE 6
+/** The size of each task record in bytes */
+#define TM_SNAPSHOT_RECORD_SIZE 16
+
+/**
+ * Calculates the number of bytes needed for a snapshot of a given number of tasks, for sizing buffers or flash regions.
+ */
+#define TM_SNAPSHOT_SIZE(tasks) (TM_SNAPSHOT_HEADER_SIZE + ((tasks) * TM_SNAPSHOT_RECORD_SIZE))
+
+/**
+ * Somewhere that a snapshot can be written to, a byte at a time in order, so that it can be streamed.
+ */
+class TmSnapshotWriter {
+public:
+    virtual ~TmSnapshotWriter() = default;
+    /**
+     * @return true if all the bytes were written
+     */
+    virtual bool write(const uint8_t* data, size_t len) = 0;
+};
+
+/**
+ * Somewhere that a snapshot can be read back from, in the same order it was written.
+ */
+class TmSnapshotReader {
+public:
+    virtual ~TmSnapshotReader() = default;
+    /**
+     * @return true if all the bytes were read
+     */
+    virtual bool read(uint8_t* data, size_t len) = 0;
+};
+
+/**
+ * Reads and writes a snapshot in a memory buffer, for example to then copy into a flash region, EEPROM or RTC memory
+ * that survives a reset. Call rewind between writing and reading back.
+ */
+class TmBufferSnapshotStream : public TmSnapshotWriter, public TmSnapshotReader {
+private:
+    uint8_t* buffer;
+    size_t bufferSize;
+    size_t position;
+public:
+    TmBufferSnapshotStream(uint8_t* buffer, size_t bufferSize) : buffer(buffer), bufferSize(bufferSize), position(0) {}
+
+    bool write(const uint8_t* data, size_t len) override {
+        if(len > bufferSize - position) return false;
+        memcpy(&buffer[position], data, len);
+        position += len;
+        return true;
+    }
+
+    bool read(uint8_t* data, size_t len) override {
+        if(len > bufferSize - position) return false;
+        memcpy(data, &buffer[position], len);
+        position += len;
+        return true;
+    }
+
+    void rewind() { position = 0; }
+
+    /** @return the number of bytes written or read so far */
+    size_t getPosition() const { return position; }
+};
+
+#ifdef TM_SNAPSHOT_FILE_SUPPORT
+/**
+ * Reads and writes a snapshot using a stdio file that you have opened in binary mode, and that you close afterwards.
+ */
+class TmFileSnapshotStream : public TmSnapshotWriter, public TmSnapshotReader {
+private:
+    FILE* file;
+public:
+    explicit TmFileSnapshotStream(FILE* file) : file(file) {}
+
+    bool write(const uint8_t* data, size_t len) override { return fwrite(data, 1, len, file) == len; }
+
+    bool read(uint8_t* data, size_t len) override { return fread(data, 1, len, file) == len; }
+};
+#endif // TM_SNAPSHOT_FILE_SUPPORT
+
+/**
+ * Called for each task that is restored, so that any task IDs you have stored can be updated.
+ */
+typedef void (*TmRestoredTaskFn)(uint16_t key, taskid_t oldTaskId, taskid_t newTaskId);
+
+/**
+ * Internal class: associates a key with a function or executable that can be saved in a snapshot.
+ */
+struct TmSnapshotCallable {
+    TimerFnPointer fnCallback;
+    Executable* theExecutable;
+    uint16_t key;
+};
+
+/**
+ * The snapshot logic shared by all sizes of callable registry, see TmScheduleSnapshot for the class that you create.
+ *
+ * Functions and executables cannot be saved directly as their addresses change between builds, so each one that
+ * should be saved is registered with a key that you choose, keep the keys the same between builds. Each timed task
+ * that calls a registered function or executable is saved with its key, interval, time remaining, and whether it is enabled and sheddable.
+ * Events and tasks calling anything not registered, such as captured lambdas, are skipped and must be created again
+ * in the usual way.
+ *
+ * On restore, each task is scheduled again so that it next runs after the time that remained when saved, rather than
+ * a full interval from now. The relative timing of all the tasks is kept as it was, instead of them all starting
+ * together and running at the same time.
+ */
+class TmScheduleSnapshotBase {
+private:
+    TaskManager* taskMgr;
+    TmSnapshotCallable* callables;
+    uint8_t maxCallables;
+    uint8_t callableCount;
+    uint16_t lastRecordCount;
+    uint16_t lastSkippedCount;
+
+    TmSnapshotCallable* findCallable(TimerTask* task);
+    TmSnapshotCallable* findCallable(uint16_t key);
+    bool addCallable(uint16_t key, TimerFnPointer fn, Executable* exec);
+    taskid_t restoreRecord(const uint8_t* record, TmSnapshotCallable* callable);
+protected:
+    TmScheduleSnapshotBase(TaskManager* tm, TmSnapshotCallable* callables, uint8_t maxCallables);
+public:
+    /**
+     * Register a function that can be saved, tasks calling it are saved with the key given.
+     * @param key the key that identifies this function in a snapshot, must be unique and stay the same between builds
+     * @param fn the function
+     * @return true if registered, false if the registry is full or the key is already used
+     */
+    bool registerCallable(uint16_t key, TimerFnPointer fn) { return addCallable(key, fn, nullptr); }
+
+    /**
+     * Register an executable that can be saved, tasks calling it are saved with the key given. The executable must
+     * outlive the task manager, tasks that task manager deletes when done cannot be restored.
+     * @param key the key that identifies this executable in a snapshot, must be unique and stay the same between builds
+     * @param exec the executable
+     * @return true if registered, false if the registry is full or the key is already used
+     */
+    bool registerCallable(uint16_t key, Executable* exec) { return addCallable(key, nullptr, exec); }
+
+    /**
+     * @return the number of tasks that would be saved by a snapshot right now, see TM_SNAPSHOT_SIZE.
+     */
+    uint16_t countSavableTasks();
+
+    /**
+     * Write a snapshot of all the savable tasks, call on the task manager thread so that nothing changes meanwhile.
+     * @param writer where to write the snapshot
+     * @return true if the whole snapshot was written
+     */
+    bool save(TmSnapshotWriter& writer);
+
+    /**
+     * Read a snapshot and schedule all the tasks that it contains, normally done in setup before anything else is
+     * scheduled. Records with a key that is not registered are skipped.
+     * @param reader where to read the snapshot from
+     * @param restoredFn optionally called with the old and new ID of each task restored
+     * @return true if the snapshot was valid and read in full, and no task failed to schedule
+     */
+    bool restore(TmSnapshotReader& reader, TmRestoredTaskFn restoredFn = nullptr);
+
+    /**
+     * @return the number of tasks that were written or restored by the last save or restore.
+     */
+    uint16_t getLastRecordCount() const { return lastRecordCount; }
+
+    /**
+     * @return the number of tasks skipped by the last save or restore, because they were not registered.
+     */
+    uint16_t getLastSkippedCount() const { return lastSkippedCount; }
+};
+
+/**
+ * Saves and restores the timed tasks in task manager, with storage for the callable registry. See
+ * TmScheduleSnapshotBase for how it works.
+ *
+ * ```
+ * TmScheduleSnapshot<8> snapshot;
+ * snapshot.registerCallable(1, readSensors);
+ * snapshot.registerCallable(2, &displayUpdater);
+ * ```
+ *
+ * @tparam MAX_CALLABLES the number of functions and executables that can be registered
+ */
+template<uint8_t MAX_CALLABLES> class TmScheduleSnapshot : public TmScheduleSnapshotBase {
+private:
+    TmSnapshotCallable callableStorage[MAX_CALLABLES];
+public:
+    explicit TmScheduleSnapshot(TaskManager* tm = &taskManager) : TmScheduleSnapshotBase(tm, callableStorage, MAX_CALLABLES) {}
+};
+
+#endif //TASKMANAGERIO_TMSCHEDULESNAPSHOT_H
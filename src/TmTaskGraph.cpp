@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "TmTaskGraph.h"
+#include <IoLogging.h>
+
+void TmGraphNode::exec() {
+    auto started = micros();
+    if(theExecutable != nullptr) {
+        theExecutable->exec();
+    }
+    else if(fnCallback != nullptr) {
+        fnCallback();
+    }
+    graph->nodeCompleted(this, micros() - started);
+}
+
+TmTaskGraphBase::TmTaskGraphBase(TaskManager* tm, TmGraphNode* nodes, uint8_t maxNodes, TmGraphEdge* edges, uint8_t maxEdges)
+        : taskMgr(tm), nodes(nodes), edges(edges), maxNodes(maxNodes), maxEdges(maxEdges), nodeCount(0), edgeCount(0),
+          validated(false), completionCallback(nullptr), runStartedAt(0), lastRunMicros(0), lastCriticalPathMicros(0),
+          runCount(0), failedRunCount(0) {
+    tm_internal::atomicWriteCounter(&activeCount, 0);
+    tm_internal::atomicWriteBool(&running, false);
+    tm_internal::atomicWriteBool(&abandoned, false);
+}
+
+tmnode_t TmTaskGraphBase::initialiseNode(TimerFn fn, Executable* exec) {
+    if(nodeCount >= maxNodes || nodeCount == TM_INVALID_NODE || isRunning()) return TM_INVALID_NODE;
+    auto& node = nodes[nodeCount];
+    node.graph = this;
+    node.fnCallback = fn;
+    node.theExecutable = exec;
+    node.predecessorCount = 0;
+    node.nodeId = nodeCount;
+    validated = false;
+    return nodeCount++;
+}
+
+tmnode_t TmTaskGraphBase::addNode(TimerFn fn) {
+    return initialiseNode(fn, nullptr);
+}
+
+tmnode_t TmTaskGraphBase::addNode(Executable* exec) {
+    return initialiseNode(nullptr, exec);
+}
+
+bool TmTaskGraphBase::addDependency(tmnode_t before, tmnode_t after) {
+    if(edgeCount >= maxEdges || before >= nodeCount || after >= nodeCount || before == after || isRunning()) return false;
+    edges[edgeCount].from = before;
+    edges[edgeCount].to = after;
+    edgeCount++;
+    nodes[after].predecessorCount++;
+    validated = false;
+    return true;
+}
+
+bool TmTaskGraphBase::validate() {
+    if(nodeCount == 0) return false;
+
+    // Kahn's algorithm, using the remaining counters as the in-degree, and a bit per node to record visits.
+    uint8_t visited[32] = {};
+    for(tmnode_t i = 0; i < nodeCount; i++) {
+        tm_internal::atomicWriteCounter(&nodes[i].remaining, nodes[i].predecessorCount);
+    }
+
+    uint8_t visitCount = 0;
+    bool progress = true;
+    while(progress) {
+        progress = false;
+        for(tmnode_t i = 0; i < nodeCount; i++) {
+            if((visited[i / 8] & (1U << (i % 8))) || tm_internal::atomicReadCounter(&nodes[i].remaining) != 0) continue;
+            visited[i / 8] |= (1U << (i % 8));
+            visitCount++;
+            progress = true;
+            for(uint8_t e = 0; e < edgeCount; e++) {
+                if(edges[e].from == i) tm_internal::atomicAddCounter(&nodes[edges[e].to].remaining, -1);
+            }
+        }
+    }
+
+    if(visitCount != nodeCount) {
+        serlogF(SER_ERROR, "TM graph cycle");
+        return false;
+    }
+    return true;
+}
+
+bool TmTaskGraphBase::run() {
+    if(!tm_internal::atomicSwapBool(&running, false, true)) return false;
+    if(!validated && !validate()) {
+        tm_internal::atomicWriteBool(&running, false);
+        return false;
+    }
+    validated = true;
+
+    for(tmnode_t i = 0; i < nodeCount; i++) {
+        tm_internal::atomicWriteCounter(&nodes[i].remaining, nodes[i].predecessorCount);
+        nodes[i].longestPathToStart = 0;
+        nodes[i].longestPathToEnd = 0;
+    }
+    tm_internal::atomicWriteBool(&abandoned, false);
+    // hold one count while scheduling, so that the run cannot finish until all the starting nodes are scheduled.
+    tm_internal::atomicWriteCounter(&activeCount, 1);
+    runStartedAt = micros();
+
+    bool started = true;
+    for(tmnode_t i = 0; i < nodeCount && started; i++) {
+        if(nodes[i].predecessorCount == 0) started = scheduleNode(&nodes[i]);
+    }
+    releaseActive();
+    return started;
+}
+
+bool TmTaskGraphBase::scheduleNode(TmGraphNode* node) {
+    tm_internal::atomicAddCounter(&activeCount, 1);
+    if(taskMgr->execute(node) != TASKMGR_INVALIDID) return true;
+
+    // the node and all that depend on it can never run now, so the run is abandoned
+    serlogF(SER_ERROR, "TM graph sched fail");
+    tm_internal::atomicWriteBool(&abandoned, true);
+    releaseActive();
+    return false;
+}
+
+void TmTaskGraphBase::releaseActive() {
+    if(tm_internal::atomicAddCounter(&activeCount, -1) != 0) return;
+
+    // nothing is scheduled or running any more, so the run is over, either complete or abandoned.
+    bool failed = tm_internal::atomicReadBool(&abandoned);
+    if(failed) {
+        failedRunCount++;
+    }
+    else {
+        uint32_t criticalPath = 0;
+        for(tmnode_t i = 0; i < nodeCount; i++) {
+            if(nodes[i].longestPathToEnd > criticalPath) criticalPath = nodes[i].longestPathToEnd;
+        }
+        lastCriticalPathMicros = criticalPath;
+        lastRunMicros = micros() - runStartedAt;
+        runCount++;
+    }
+    tm_internal::atomicWriteBool(&running, false);
+    if(!failed && completionCallback) completionCallback();
+}
+
+void TmTaskGraphBase::nodeCompleted(TmGraphNode* node, uint32_t execMicros) {
+    node->longestPathToEnd = node->longestPathToStart + execMicros;
+
+    for(uint8_t e = 0; e < edgeCount && !tm_internal::atomicReadBool(&abandoned); e++) {
+        if(edges[e].from != node->nodeId) continue;
+        auto& successor = nodes[edges[e].to];
+        if(node->longestPathToEnd > successor.longestPathToStart) successor.longestPathToStart = node->longestPathToEnd;
+        // the last predecessor to complete is responsible for scheduling the successor.
+        if(tm_internal::atomicAddCounter(&successor.remaining, -1) == 0) scheduleNode(&successor);
+    }
+
+    // a successor scheduled above has already been counted, so this only reaches zero once the run is over.
+    releaseActive();
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry)..
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef TASKMANAGERIO_TMTASKGRAPH_H
+#define TASKMANAGERIO_TMTASKGRAPH_H
+
+/**
+ * @file TmTaskGraph.h
+ * @brief A dependency graph of tasks, where each node is scheduled on task manager once all its predecessors finish.
+ */
+
+#include "TaskManagerIO.h"
+
+/** Identifies a node within a task graph */
+typedef uint8_t tmnode_t;
+
+/** Returned when a node could not be added to the graph */
+#define TM_INVALID_NODE 0xffU
+
+class TmTaskGraphBase;
+
+/**
+ * Internal class that represents one node in the graph, you should not need to use this directly. Each node is the
+ * Executable that gets scheduled when its last predecessor completes.
+ */
+class TmGraphNode : public Executable {
+private:
+    friend class TmTaskGraphBase;
+    TmTaskGraphBase* graph;
+    TimerFn fnCallback;
+    Executable* theExecutable;
+    tm_internal::TmAtomicCounter remaining;
+    uint32_t longestPathToStart;
+    uint32_t longestPathToEnd;
+    uint8_t predecessorCount;
+    tmnode_t nodeId;
+public:
+    TmGraphNode() : graph(nullptr), fnCallback(nullptr), theExecutable(nullptr), longestPathToStart(0),
+                    longestPathToEnd(0), predecessorCount(0), nodeId(TM_INVALID_NODE) {
+        tm_internal::atomicWriteCounter(&remaining, 0);
+    }
+
+    void exec() override;
+};
+
+/**
+ * Internal class: a dependency edge in the graph, from must complete before to is scheduled.
+ */
+struct TmGraphEdge {
+    tmnode_t from;
+    tmnode_t to;
+};
+
+/**
+ * The graph logic that is shared by all sizes of graph, see TmTaskGraph for the class that you create. All storage is
+ * provided by the derived class so that running the graph never allocates.
+ */
+class TmTaskGraphBase {
+private:
+    friend class TmGraphNode;
+    TaskManager* taskMgr;
+    TmGraphNode* nodes;
+    TmGraphEdge* edges;
+    const uint8_t maxNodes;
+    const uint8_t maxEdges;
+    uint8_t nodeCount;
+    uint8_t edgeCount;
+    // the number of nodes scheduled or running, plus one while run is still scheduling the starting nodes.
+    tm_internal::TmAtomicCounter activeCount;
+    tm_internal::TmAtomicBool running;
+    tm_internal::TmAtomicBool abandoned;
+    bool validated;
+    TimerFn completionCallback;
+    uint32_t runStartedAt;
+    uint32_t lastRunMicros;
+    uint32_t lastCriticalPathMicros;
+    uint32_t runCount;
+    uint32_t failedRunCount;
+
+    tmnode_t initialiseNode(TimerFn fn, Executable* exec);
+    void nodeCompleted(TmGraphNode* node, uint32_t execMicros);
+    bool scheduleNode(TmGraphNode* node);
+    void releaseActive();
+
+    /**
+     * Checks that the graph has no cycles, as a graph with a cycle would never complete. The result is kept until
+     * another node or dependency is added, so only the first run after a change does the check.
+     * @return true if the graph is acyclic and has at least one node.
+     */
+    bool validate();
+protected:
+    TmTaskGraphBase(TaskManager* tm, TmGraphNode* nodes, uint8_t maxNodes, TmGraphEdge* edges, uint8_t maxEdges);
+public:
+    /**
+     * Adds a node that calls a function when it runs
+     * @param fn the function to call
+     * @return the node id, or TM_INVALID_NODE if the graph is full or running.
+     */
+    tmnode_t addNode(TimerFn fn);
+
+    /**
+     * Adds a node that calls exec() on an Executable when it runs. The graph never takes ownership of the executable.
+     * @param exec the executable to call
+     * @return the node id, or TM_INVALID_NODE if the graph is full or running.
+     */
+    tmnode_t addNode(Executable* exec);
+
+    /**
+     * Adds a dependency such that `after` is not scheduled until `before` has completed.
+     * @param before the node that must complete first
+     * @param after the node that depends upon it
+     * @return true if added, otherwise false if the edge storage is full, the nodes are invalid, or it is running
+     */
+    bool addDependency(tmnode_t before, tmnode_t after);
+
+    /**
+     * Start a run of the graph, all nodes without predecessors are scheduled immediately, each other node is scheduled
+     * as soon as its last predecessor completes. The graph can be run again once the previous run has completed,
+     * no memory is allocated in doing so.
+     *
+     * Should task manager be full when a node needs scheduling, the run is abandoned: nodes already scheduled finish,
+     * but nothing more is started, the completion callback is not called, and the failed run count goes up. The graph
+     * can then be run again.
+     * @return true if the run started, false if it is already running, empty, has a cycle, or task manager was full.
+     */
+    bool run();
+
+    /**
+     * Sets a function that will be called on task manager once every node has completed in a run.
+     * @param onComplete the function to call
+     */
+    void setCompletionCallback(TimerFn onComplete) { completionCallback = onComplete; }
+
+    /**
+     * @return true if the graph is presently running
+     */
+    bool isRunning() { return tm_internal::atomicReadBool(&running); }
+
+    /**
+     * @return the number of micros between the last run starting and the last node completing.
+     */
+    uint32_t getLastRunMicros() const { return lastRunMicros; }
+
+    /**
+     * @return the sum of the execution times along the slowest chain of dependencies in the last run, this is the
+     * shortest time in which the graph could possibly have completed.
+     */
+    uint32_t getLastCriticalPathMicros() const { return lastCriticalPathMicros; }
+
+    /**
+     * @return the number of runs that have completed.
+     */
+    uint32_t getRunCount() const { return runCount; }
+
+    /**
+     * @return the number of runs that were abandoned because task manager was full when a node needed scheduling.
+     */
+    uint32_t getFailedRunCount() const { return failedRunCount; }
+
+    uint8_t getNodeCount() const { return nodeCount; }
+};
+
+/**
+ * A task graph, nodes are functions or Executables and edges are dependencies between them. For example a sensor
+ * pipeline that reads, filters and then publishes and logs in parallel:
+ *
+ * ```
+ * TmTaskGraph<4> pipeline;
+ * auto read = pipeline.addNode(readSensors);
+ * auto filter = pipeline.addNode(filterReadings);
+ * pipeline.addDependency(read, filter);
+ * pipeline.addDependency(filter, pipeline.addNode(publishReadings));
+ * pipeline.addDependency(filter, pipeline.addNode(logReadings));
+ * taskManager.schedule(repeatMillis(100), [] { pipeline.run(); });
+ * ```
+ *
+ * @tparam MAX_NODES the maximum number of nodes (up to 254)
+ * @tparam MAX_EDGES the maximum number of dependencies, defaults to twice the nodes
+ */
+template<uint8_t MAX_NODES, uint8_t MAX_EDGES = (MAX_NODES > 127 ? 254 : MAX_NODES * 2)> class TmTaskGraph : public TmTaskGraphBase {
+private:
+    TmGraphNode nodeStorage[MAX_NODES];
+    TmGraphEdge edgeStorage[MAX_EDGES];
+public:
+    explicit TmTaskGraph(TaskManager* tm = &taskManager) : TmTaskGraphBase(tm, nodeStorage, MAX_NODES, edgeStorage, MAX_EDGES) {}
+};
+
+#endif //TASKMANAGERIO_TMTASKGRAPH_H
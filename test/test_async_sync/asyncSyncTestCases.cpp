@@ -0,0 +1,186 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmAsyncSync.h"
+#include "../utils/test_utils.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+int wakeOrder[4];
+int wakeCount = 0;
+
+void recordWake(int who) {
+    if(wakeCount < 4) wakeOrder[wakeCount] = who;
+    wakeCount++;
+}
+
+void runTaskManager() {
+    for(int i = 0; i < 5; i++) {
+        taskManager.yieldForMicros(100);
+    }
+}
+
+TmAsyncSemaphore bufferSemaphore(1);
+TmAsyncWaiter semWaiter1([] { recordWake(1); });
+TmAsyncWaiter semWaiter2([] { recordWake(2); });
+TmAsyncWaiter semWaiter3([] { recordWake(3); });
+
+void testSemaphoreWakesOneWaiterPerReleaseInOrder() {
+    wakeCount = 0;
+
+    // the one permit goes to the first waiter, the others stay parked
+    bufferSemaphore.acquire(&semWaiter1);
+    bufferSemaphore.acquire(&semWaiter2);
+    bufferSemaphore.acquire(&semWaiter3);
+    runTaskManager();
+    TEST_ASSERT_EQUAL(1, wakeCount);
+    TEST_ASSERT_EQUAL(1, wakeOrder[0]);
+    TEST_ASSERT_FALSE(bufferSemaphore.tryAcquire());
+
+    // each release wakes exactly one more waiter, in the order they waited
+    bufferSemaphore.release();
+    runTaskManager();
+    TEST_ASSERT_EQUAL(2, wakeCount);
+    TEST_ASSERT_EQUAL(2, wakeOrder[1]);
+
+    bufferSemaphore.release();
+    runTaskManager();
+    TEST_ASSERT_EQUAL(3, wakeCount);
+    TEST_ASSERT_EQUAL(3, wakeOrder[2]);
+
+    // nothing waiting, so the permit is kept for the next caller
+    bufferSemaphore.release();
+    runTaskManager();
+    TEST_ASSERT_EQUAL(1U, bufferSemaphore.getAvailablePermits());
+    TEST_ASSERT_TRUE(bufferSemaphore.tryAcquire());
+    TEST_ASSERT_EQUAL(0U, bufferSemaphore.getAvailablePermits());
+    bufferSemaphore.release();
+}
+
+TmAsyncMutex sharedMutex;
+TmAsyncWaiter mutexWaiter1([] { recordWake(1); });
+TmAsyncWaiter mutexWaiter2([] { recordWake(2); sharedMutex.unlock(); });
+
+void testMutexHandsOverOnUnlock() {
+    wakeCount = 0;
+    TEST_ASSERT_TRUE(sharedMutex.tryLock());
+    TEST_ASSERT_TRUE(sharedMutex.isLocked());
+
+    sharedMutex.lock(&mutexWaiter1);
+    sharedMutex.lock(&mutexWaiter2);
+    runTaskManager();
+    TEST_ASSERT_EQUAL(0, wakeCount);
+
+    // unlocking hands the mutex to the first waiter, it keeps it until it unlocks
+    sharedMutex.unlock();
+    runTaskManager();
+    TEST_ASSERT_EQUAL(1, wakeCount);
+    TEST_ASSERT_TRUE(sharedMutex.isLocked());
+
+    // the second waiter unlocks once it has run, leaving the mutex free
+    sharedMutex.unlock();
+    runTaskManager();
+    TEST_ASSERT_EQUAL(2, wakeCount);
+    TEST_ASSERT_EQUAL(2, wakeOrder[1]);
+    TEST_ASSERT_FALSE(sharedMutex.isLocked());
+}
+
+TmAsyncMutex conditionMutex;
+TmAsyncCondition dataReady(&conditionMutex);
+TmAsyncWaiter condWaiter1([] { recordWake(1); conditionMutex.unlock(); });
+TmAsyncWaiter condWaiter2([] { recordWake(2); conditionMutex.unlock(); });
+TmAsyncWaiter condWaiter3([] { recordWake(3); conditionMutex.unlock(); });
+
+void testConditionNotifyOneAndAll() {
+    wakeCount = 0;
+
+    // a notification with nothing waiting is not remembered
+    dataReady.notifyOne();
+
+    TEST_ASSERT_TRUE(conditionMutex.tryLock());
+    dataReady.wait(&condWaiter1);
+    TEST_ASSERT_TRUE(conditionMutex.tryLock());
+    dataReady.wait(&condWaiter2);
+    TEST_ASSERT_TRUE(conditionMutex.tryLock());
+    dataReady.wait(&condWaiter3);
+    runTaskManager();
+    TEST_ASSERT_EQUAL(0, wakeCount);
+    TEST_ASSERT_FALSE(conditionMutex.isLocked());
+
+    dataReady.notifyOne();
+    runTaskManager();
+    TEST_ASSERT_EQUAL(1, wakeCount);
+    TEST_ASSERT_EQUAL(1, wakeOrder[0]);
+
+    dataReady.notifyAll();
+    runTaskManager();
+    TEST_ASSERT_EQUAL(3, wakeCount);
+    TEST_ASSERT_EQUAL(2, wakeOrder[1]);
+    TEST_ASSERT_EQUAL(3, wakeOrder[2]);
+    TEST_ASSERT_FALSE(conditionMutex.isLocked());
+}
+
+TmAsyncSemaphore fullSemaphore(0);
+TmAsyncWaiter fullWaiter([] { recordWake(1); });
+
+void testWaiterPostedOnceTaskManagerHasSpace() {
+    wakeCount = 0;
+    fullSemaphore.acquire(&fullWaiter);
+    runTaskManager();
+    TEST_ASSERT_EQUAL(0, wakeCount);
+
+    // with every slot taken, the waiter cannot be posted, so it keeps its place and the permit.
+    while(taskManager.scheduleOnce(250, [] {}) != TASKMGR_INVALIDID);
+    fullSemaphore.release();
+    runTaskManager();
+    TEST_ASSERT_EQUAL(0, wakeCount);
+    TEST_ASSERT_EQUAL(1U, fullSemaphore.getAvailablePermits());
+
+    // once the slots free up, it is posted and runs holding the permit.
+    int loops = 500;
+    while(--loops && wakeCount == 0) {
+        taskManager.yieldForMicros(1000);
+    }
+    TEST_ASSERT_EQUAL(1, wakeCount);
+    TEST_ASSERT_EQUAL(0U, fullSemaphore.getAvailablePermits());
+}
+
+TmAsyncMutex unregisteredMutex;
+TmAsyncWaiter unregisteredWaiter([] { recordWake(1); });
+
+void testWaitFailsWhenEventCannotRegister() {
+    wakeCount = 0;
+    TEST_ASSERT_TRUE(unregisteredMutex.tryLock());
+
+    // with every slot taken the mutex cannot register, so the waiter is refused rather than parked for good.
+    while(taskManager.scheduleOnce(250, [] {}) != TASKMGR_INVALIDID);
+    TEST_ASSERT_FALSE(unregisteredMutex.lock(&unregisteredWaiter));
+    unregisteredMutex.unlock();
+
+    int loops = 500;
+    while(--loops) {
+        taskManager.yieldForMicros(1000);
+    }
+    TEST_ASSERT_EQUAL(0, wakeCount);
+
+    // once there is room, waiting works as usual.
+    TEST_ASSERT_TRUE(unregisteredMutex.tryLock());
+    TEST_ASSERT_TRUE(unregisteredMutex.lock(&unregisteredWaiter));
+    unregisteredMutex.unlock();
+    runTaskManager();
+    TEST_ASSERT_EQUAL(1, wakeCount);
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testSemaphoreWakesOneWaiterPerReleaseInOrder);
+    RUN_TEST(testMutexHandsOverOnUnlock);
+    RUN_TEST(testConditionNotifyOneAndAll);
+    RUN_TEST(testWaiterPostedOnceTaskManagerHasSpace);
+    RUN_TEST(testWaitFailsWhenEventCannotRegister);
+    UNITY_END();
+}
+
+void loop() {}
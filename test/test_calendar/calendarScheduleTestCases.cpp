@@ -0,0 +1,98 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmCalendarSchedule.h"
+#include "../utils/test_utils.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+void testEpochConversion() {
+    TEST_ASSERT_EQUAL_UINT32(0UL, makeEpochSeconds(1970, 1, 1));
+    TEST_ASSERT_EQUAL_UINT32(951782400UL, makeEpochSeconds(2000, 2, 29));
+    TEST_ASSERT_EQUAL_UINT32(1700000000UL, makeEpochSeconds(2023, 11, 14, 22, 13, 20));
+}
+
+void testCronParsing() {
+    TEST_ASSERT_TRUE(TmCronExpression("* * * * *").isValid());
+    TEST_ASSERT_TRUE(TmCronExpression("0,15,30,45 8-17 1 */2 1-5").isValid());
+    TEST_ASSERT_TRUE(TmCronExpression("5/10 * * * 7").isValid());
+    TEST_ASSERT_FALSE(TmCronExpression("60 * * * *").isValid());
+    TEST_ASSERT_FALSE(TmCronExpression("* * * *").isValid());
+    TEST_ASSERT_FALSE(TmCronExpression("* * 0 * *").isValid());
+    TEST_ASSERT_FALSE(TmCronExpression("* * * * * *").isValid());
+    TEST_ASSERT_FALSE(TmCronExpression("*/0 * * * *").isValid());
+    TEST_ASSERT_FALSE(TmCronExpression("5-1 * * * *").isValid());
+}
+
+void testNextFireTimes() {
+    // Tuesday 14th November 2023 22:13:20
+    uint32_t now = 1700000000UL;
+
+    TEST_ASSERT_EQUAL_UINT32(makeEpochSeconds(2023, 11, 14, 22, 14), TmCronExpression("* * * * *").nextAfter(now));
+    TEST_ASSERT_EQUAL_UINT32(makeEpochSeconds(2023, 11, 14, 22, 15), TmCronExpression("5/10 * * * *").nextAfter(now));
+
+    // weekday mornings, so the next is Wednesday
+    TEST_ASSERT_EQUAL_UINT32(makeEpochSeconds(2023, 11, 15, 7, 30), TmCronExpression("30 7 * * 1-5").nextAfter(now));
+
+    // Sundays as both 0 and 7
+    TEST_ASSERT_EQUAL_UINT32(makeEpochSeconds(2023, 11, 19), TmCronExpression("0 0 * * 0").nextAfter(now));
+    TEST_ASSERT_EQUAL_UINT32(makeEpochSeconds(2023, 11, 19), TmCronExpression("0 0 * * 7").nextAfter(now));
+
+    // first of the month, or any Friday, as both day fields are restricted
+    TEST_ASSERT_EQUAL_UINT32(makeEpochSeconds(2023, 11, 17, 12), TmCronExpression("0 12 1 * 5").nextAfter(now));
+
+    // well over 49 days away, the next 29th of February
+    TEST_ASSERT_EQUAL_UINT32(makeEpochSeconds(2024, 2, 29, 6), TmCronExpression("0 6 29 2 *").nextAfter(now));
+
+    // never matches
+    TEST_ASSERT_EQUAL_UINT32(0UL, TmCronExpression("0 0 31 2 *").nextAfter(now));
+}
+
+uint32_t fakeWallClock = 0;
+int calendarFired = 0;
+
+uint32_t readFakeClock() {
+    return fakeWallClock;
+}
+
+void testCalendarScheduleFiresFromClock() {
+    setCalendarClock(readFakeClock);
+    TmCalendarSchedule everyHour("0 * * * *", [] { calendarFired++; });
+    TEST_ASSERT_TRUE(everyHour.isValid());
+
+    // no clock yet, so it waits and checks again later
+    TEST_ASSERT_EQUAL_UINT32(60000000UL, everyHour.timeOfNextCheck());
+    TEST_ASSERT_EQUAL_UINT32(0UL, everyHour.getNextFireTime());
+
+    // with a clock, it waits until the next hour, and is never longer than an hour between checks
+    fakeWallClock = makeEpochSeconds(2023, 11, 14, 22, 59, 50);
+    TEST_ASSERT_EQUAL_UINT32(10000000UL, everyHour.timeOfNextCheck());
+    TEST_ASSERT_FALSE(everyHour.isTriggered());
+    TEST_ASSERT_EQUAL_UINT32(makeEpochSeconds(2023, 11, 14, 23), everyHour.getNextFireTime());
+
+    fakeWallClock += 10;
+    TEST_ASSERT_EQUAL_UINT32(3600000000UL, everyHour.timeOfNextCheck());
+    TEST_ASSERT_TRUE(everyHour.isTriggered());
+    TEST_ASSERT_EQUAL_UINT32(makeEpochSeconds(2023, 11, 15, 0), everyHour.getNextFireTime());
+
+    // when the clock is set backwards, the next time is worked out again
+    everyHour.setTriggered(false);
+    fakeWallClock = makeEpochSeconds(2023, 11, 14, 10, 30);
+    TEST_ASSERT_EQUAL_UINT32(1800000000UL, everyHour.timeOfNextCheck());
+    TEST_ASSERT_FALSE(everyHour.isTriggered());
+    TEST_ASSERT_EQUAL_UINT32(makeEpochSeconds(2023, 11, 14, 11), everyHour.getNextFireTime());
+    setCalendarClock(nullptr);
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testEpochConversion);
+    RUN_TEST(testCronParsing);
+    RUN_TEST(testNextFireTimes);
+    RUN_TEST(testCalendarScheduleFiresFromClock);
+    UNITY_END();
+}
+
+void loop() {}
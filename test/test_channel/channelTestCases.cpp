@@ -0,0 +1,169 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmChannel.h"
+#include "../utils/test_utils.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+void testSpscChannelOrderAndFull() {
+    TmSpscChannel<int, 4> channel;
+    TEST_ASSERT_EQUAL(0U, channel.size());
+    for(int i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(channel.push(i + 10));
+    }
+    TEST_ASSERT_FALSE(channel.push(99));
+    TEST_ASSERT_EQUAL(1U, channel.getRejectedCount());
+    TEST_ASSERT_EQUAL(4U, channel.getPeakLevel());
+
+    // items come out in order, and the space is reused across the wrap
+    int value = 0;
+    TEST_ASSERT_TRUE(channel.pop(value));
+    TEST_ASSERT_EQUAL(10, value);
+    TEST_ASSERT_TRUE(channel.push(14));
+    int batch[8];
+    TEST_ASSERT_EQUAL(4, channel.popBatch(batch, 8));
+    for(int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL(11 + i, batch[i]);
+    }
+    TEST_ASSERT_FALSE(channel.pop(value));
+}
+
+void testMpscChannelOrderFullAndWatermarks() {
+    TmMpscChannel<uint16_t, 8> channel;
+    channel.setWatermarks(6, 2);
+
+    for(uint16_t i = 0; i < 5; i++) TEST_ASSERT_TRUE(channel.push(i));
+    TEST_ASSERT_FALSE(channel.isAboveHighWatermark());
+    TEST_ASSERT_TRUE(channel.push(5));
+    TEST_ASSERT_TRUE(channel.isAboveHighWatermark());
+    TEST_ASSERT_EQUAL(1U, channel.getHighWatermarkCrossings());
+    TEST_ASSERT_TRUE(channel.push(6));
+    TEST_ASSERT_TRUE(channel.push(7));
+    TEST_ASSERT_FALSE(channel.push(8));
+    TEST_ASSERT_EQUAL(1U, channel.getRejectedCount());
+    TEST_ASSERT_EQUAL(8U, channel.getPeakLevel());
+
+    // stays above the high watermark until drained down to the low watermark
+    uint16_t batch[4];
+    TEST_ASSERT_EQUAL(4, channel.popBatch(batch, 4));
+    TEST_ASSERT_EQUAL(0, batch[0]);
+    TEST_ASSERT_EQUAL(3, batch[3]);
+    TEST_ASSERT_TRUE(channel.isAboveHighWatermark());
+    TEST_ASSERT_EQUAL(2, channel.popBatch(batch, 2));
+    TEST_ASSERT_FALSE(channel.isAboveHighWatermark());
+
+    // laps around the cells more than once
+    for(uint16_t lap = 0; lap < 20; lap++) {
+        TEST_ASSERT_TRUE(channel.push(100 + lap));
+        uint16_t value;
+        TEST_ASSERT_TRUE(channel.pop(value));
+        TEST_ASSERT_EQUAL(lap == 0 ? 6 : (lap == 1 ? 7 : 100 + lap - 2), value);
+    }
+    TEST_ASSERT_EQUAL(1U, channel.getHighWatermarkCrossings());
+}
+
+TmMpscChannel<int, 16> consumedChannel;
+int batchesSeen = 0;
+int itemsSeen = 0;
+int lastItem = -1;
+bool inOrder = true;
+
+void consumeBatch(int* batch, uint16_t count) {
+    batchesSeen++;
+    for(uint16_t i = 0; i < count; i++) {
+        if(batch[i] != lastItem + 1) inOrder = false;
+        lastItem = batch[i];
+        itemsSeen++;
+    }
+}
+
+TmChannelConsumer<TmMpscChannel<int, 16>, 4> channelConsumer(consumedChannel, consumeBatch);
+
+void testConsumerEventDrainsInBatches() {
+    taskManager.registerEvent(&channelConsumer);
+    taskManager.yieldForMicros(100);
+    TEST_ASSERT_EQUAL(0, batchesSeen);
+
+    for(int i = 0; i < 10; i++) {
+        TEST_ASSERT_TRUE(consumedChannel.push(i));
+    }
+    taskManager.yieldForMicros(1000);
+
+    TEST_ASSERT_EQUAL(10, itemsSeen);
+    TEST_ASSERT_EQUAL(3, batchesSeen);
+    TEST_ASSERT_TRUE(inOrder);
+    TEST_ASSERT_EQUAL(0U, consumedChannel.size());
+
+    // a write later on triggers the event again
+    TEST_ASSERT_TRUE(consumedChannel.push(10));
+    taskManager.yieldForMicros(1000);
+    TEST_ASSERT_EQUAL(11, itemsSeen);
+    TEST_ASSERT_TRUE(inOrder);
+}
+
+#if defined(IOA_MULTITHREADED) && defined(__has_include)
+# if __has_include(<thread>)
+#  define TM_TEST_WITH_THREADS
+# endif
+#endif
+
+#ifdef TM_TEST_WITH_THREADS
+#include <thread>
+
+#define CONTENDING_PRODUCERS 4
+#define ITEMS_PER_PRODUCER 5000
+
+TmMpscChannel<uint32_t, 64> contendedChannel;
+
+void testMpscChannelWithContendingProducers() {
+    std::thread producers[CONTENDING_PRODUCERS];
+    for(uint32_t p = 0; p < CONTENDING_PRODUCERS; p++) {
+        producers[p] = std::thread([p] {
+            for(uint32_t i = 0; i < ITEMS_PER_PRODUCER; i++) {
+                // the channel is much smaller than the number of items, so producers keep finding it full.
+                while(!contendedChannel.push((p << 16U) | i)) yield();
+            }
+        });
+    }
+
+    // every item arrives exactly once, and each producer's items arrive in the order they were written.
+    uint32_t nextExpected[CONTENDING_PRODUCERS] = {};
+    uint32_t received = 0;
+    uint32_t batch[16];
+    while(received < CONTENDING_PRODUCERS * ITEMS_PER_PRODUCER) {
+        auto count = contendedChannel.popBatch(batch, 16);
+        for(uint16_t i = 0; i < count; i++) {
+            auto producer = batch[i] >> 16U;
+            TEST_ASSERT_TRUE(producer < CONTENDING_PRODUCERS);
+            TEST_ASSERT_EQUAL_UINT32(nextExpected[producer], batch[i] & 0xffffU);
+            nextExpected[producer]++;
+        }
+        received += count;
+        if(count == 0) yield();
+    }
+
+    for(auto& producer : producers) producer.join();
+    TEST_ASSERT_EQUAL(0U, contendedChannel.size());
+}
+
+#else
+
+void testMpscChannelWithContendingProducers() {
+    TEST_IGNORE_MESSAGE("Needs a multithreaded board with std::thread");
+}
+
+#endif // TM_TEST_WITH_THREADS
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testSpscChannelOrderAndFull);
+    RUN_TEST(testMpscChannelOrderFullAndWatermarks);
+    RUN_TEST(testConsumerEventDrainsInBatches);
+    RUN_TEST(testMpscChannelWithContendingProducers);
+    UNITY_END();
+}
+
+void loop() {}
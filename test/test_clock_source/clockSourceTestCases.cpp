@@ -0,0 +1,137 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmClockSource.h"
+#include "../utils/test_utils.h"
+
+void setUp() {
+    taskManager.reset();
+}
+
+void tearDown() {
+    setSchedulerClockSource(nullptr);
+}
+
+uint32_t fakeMicrosValue = 0;
+
+uint32_t readFakeMicros() {
+    return fakeMicrosValue;
+}
+
+void testMicrosClockSourceCountsWraps() {
+    fakeMicrosValue = 0xfffff000UL;
+    TmMicrosClockSource clock(readFakeMicros);
+    TEST_ASSERT_EQUAL_UINT64(0xfffff000ULL, clock.nowMicros());
+
+    // across the wrap, the time keeps going up
+    fakeMicrosValue = 0x00000100UL;
+    TEST_ASSERT_EQUAL_UINT64(0x100000100ULL, clock.nowMicros());
+    TEST_ASSERT_EQUAL_UINT64(0x100000100ULL, clock.nowMicros());
+
+    // through both halves of the next lap and around again
+    fakeMicrosValue = 0x90000000UL;
+    TEST_ASSERT_EQUAL_UINT64(0x190000000ULL, clock.nowMicros());
+    fakeMicrosValue = 0x10000000UL;
+    TEST_ASSERT_EQUAL_UINT64(0x210000000ULL, clock.nowMicros());
+    TEST_ASSERT_EQUAL_UINT64(0x210000000ULL * 1000ULL, clock.nowNanos());
+}
+
+void testClockSourcesAreMonotonic() {
+    TmMicrosClockSource microsClock;
+    TmClockSource* sources[] = { &microsClock, getBestClockSource() };
+    for(auto source : sources) {
+        uint64_t last = source->nowNanos();
+        for(int i = 0; i < 10000; i++) {
+            uint64_t now = source->nowNanos();
+            TEST_ASSERT_TRUE(now >= last);
+            last = now;
+        }
+    }
+}
+
+#ifdef TM_TSC_CLOCK_SUPPORT
+void testTscAgreesWithMonotonic() {
+    TmTscClockSource tsc;
+    if(!tsc.calibrate()) {
+        TEST_IGNORE_MESSAGE("No invariant TSC");
+    }
+    TmMonotonicClockSource monotonic;
+    delay(50);
+    int64_t difference = int64_t(tsc.nowNanos() - monotonic.nowNanos());
+    // the rate is measured over 20ms, so after 50ms they should still agree to well within 100 microseconds
+    TEST_ASSERT_TRUE(difference > -100000 && difference < 100000);
+}
+#endif
+
+class ManualClockSource : public TmClockSource {
+public:
+    uint64_t now = 0;
+    uint64_t nowMicros() override { return now; }
+    const char* getName() const override { return "manual"; }
+};
+
+int clockTaskRuns = 0;
+
+void testSchedulerUsesClockSource() {
+    ManualClockSource clock;
+    // just before the low 32 bits wrap, which the scheduler must handle
+    clock.now = 0x2ffffff00ULL;
+    setSchedulerClockSource(&clock);
+    TEST_ASSERT_EQUAL_PTR(&clock, getSchedulerClockSource());
+
+    clockTaskRuns = 0;
+    taskManager.scheduleFixedRate(500, [] { clockTaskRuns++; }, TIME_MICROS);
+    taskManager.scheduleOnce(2, [] { clockTaskRuns += 100; });
+
+    // the tasks only run when the clock source says they are due, however much real time has passed
+    taskManager.runLoop();
+    delay(5);
+    taskManager.runLoop();
+    TEST_ASSERT_EQUAL(0, clockTaskRuns);
+
+    clock.now += 499;
+    taskManager.runLoop();
+    TEST_ASSERT_EQUAL(0, clockTaskRuns);
+    clock.now += 1;
+    taskManager.runLoop();
+    TEST_ASSERT_EQUAL(1, clockTaskRuns);
+
+    // the one shot task is in milliseconds, both are now due
+    clock.now += 1500;
+    taskManager.runLoop();
+    taskManager.runLoop();
+    TEST_ASSERT_EQUAL(102, clockTaskRuns);
+}
+
+void testMillisTaskDeadlineIsInMicros() {
+    ManualClockSource clock;
+    // part way through a millisecond, the deadline must be three milliseconds from here, not from a boundary
+    clock.now = 0x2ffffff00ULL + 250;
+    setSchedulerClockSource(&clock);
+
+    clockTaskRuns = 0;
+    taskManager.scheduleOnce(3, [] { clockTaskRuns++; });
+
+    clock.now += 2999;
+    taskManager.runLoop();
+    TEST_ASSERT_EQUAL(0, clockTaskRuns);
+    TEST_ASSERT_EQUAL_UINT32(1, taskManager.microsToNextTask());
+
+    clock.now += 1;
+    taskManager.runLoop();
+    TEST_ASSERT_EQUAL(1, clockTaskRuns);
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testMicrosClockSourceCountsWraps);
+    RUN_TEST(testClockSourcesAreMonotonic);
+#ifdef TM_TSC_CLOCK_SUPPORT
+    RUN_TEST(testTscAgreesWithMonotonic);
+#endif
+    RUN_TEST(testSchedulerUsesClockSource);
+    RUN_TEST(testMillisTaskDeadlineIsInMicros);
+    UNITY_END();
+}
+
+void loop() {}
@@ -169,6 +169,225 @@ void testCancellingAJobAfterCreation() {
     TEST_ASSERT_EQUAL(nullptr, taskManager.getFirstTask());
 }
 
+void testStaleTaskIdIsIgnored() {
+    taskManager.reset();
+    count1 = count2 = 0;
+
+    auto oldId = taskManager.scheduleOnce(0, recordingJob, TIME_MICROS);
+    taskManager.yieldForMicros(100);
+    TEST_ASSERT_EQUAL(1, count1);
+    TEST_ASSERT_NULL(taskManager.getTask(oldId));
+
+    // the new task goes into the same slot, but has a different ID
+    auto newId = taskManager.scheduleFixedRate(1, recordingJob2, TIME_MILLIS);
+    TEST_ASSERT_EQUAL(tmSlotOfTaskId(oldId), tmSlotOfTaskId(newId));
+    TEST_ASSERT_NOT_EQUAL(oldId, newId);
+
+    // so late calls with the old ID leave the new task alone
+    taskManager.setTaskEnabled(oldId, false);
+    taskManager.cancelTask(oldId);
+    TEST_ASSERT_TRUE(taskManager.getTask(newId)->isEnabled());
+    taskManager.yieldForMicros(5000);
+    TEST_ASSERT_TRUE(count2 > 0);
+    fixture.assertTasksSpacesTaken(1);
+
+    // after a reset, no earlier ID matches
+    taskManager.reset();
+    TEST_ASSERT_NULL(taskManager.getTask(newId));
+}
+
+#ifdef IOA_MULTITHREADED
+void testTaskFreedWhileHeldIsFreedOnRelease() {
+    taskManager.reset();
+    auto taskId = taskManager.scheduleOnce(10, recordingJob, TIME_SECONDS);
+    auto task = taskManager.getTask(taskId);
+
+    // another thread is working on the task through its ID when it is cancelled, so the slot cannot be freed yet
+    TEST_ASSERT_TRUE(task->acquireHandle(tmGenerationOfTaskId(taskId)));
+    taskManager.cancelTask(taskId);
+    taskManager.yieldForMicros(1000);
+    TEST_ASSERT_NULL(taskManager.getTask(taskId));
+    TEST_ASSERT_TRUE(task->isRetiring());
+    fixture.assertTasksSpacesTaken(1);
+
+    // once it finishes, task manager frees the slot the next time it deals with interrupts, as the holder signals.
+    TEST_ASSERT_TRUE(task->releaseHandle());
+    taskManager.queueInterrupt(0);
+    taskManager.runLoop();
+    TEST_ASSERT_FALSE(task->isRetiring());
+    TEST_ASSERT_FALSE(task->isInUse());
+    fixture.assertTasksSpacesTaken(0);
+    TEST_ASSERT_EQUAL(0, count1);
+}
+#else
+void testTaskFreedWhileHeldIsFreedOnRelease() {
+    TEST_IGNORE_MESSAGE("Needs a multithreaded board");
+}
+#endif // IOA_MULTITHREADED
+
+void testRescheduleTaskInPlace() {
+    taskManager.reset();
+    count1 = count2 = 0;
+    auto taskId = taskManager.scheduleFixedRate(10, recordingJob, TIME_SECONDS);
+    auto otherId = taskManager.scheduleFixedRate(5, recordingJob2, TIME_SECONDS);
+    TEST_ASSERT_EQUAL(taskManager.getTask(otherId), taskManager.getFirstTask());
+
+    // the same task moves to the front of the queue at its new rate, without using another slot
+    TEST_ASSERT_TRUE(taskManager.rescheduleTask(taskId, repeatMillis(2)));
+    TEST_ASSERT_EQUAL(taskManager.getTask(taskId), taskManager.getFirstTask());
+    TEST_ASSERT_EQUAL(2, taskManager.getTask(taskId)->getSchedule());
+    TEST_ASSERT_EQUAL(2, taskManager.getSlotsInUse());
+
+    taskManager.yieldForMicros(20000);
+    TEST_ASSERT_TRUE(count1 >= 4);
+    TEST_ASSERT_EQUAL(0, count2);
+    TEST_ASSERT_EQUAL(2, taskManager.getSlotsInUse());
+
+    // a repeating task can become a one shot, after which it is freed
+    TEST_ASSERT_TRUE(taskManager.rescheduleTask(taskId, onceMicros(100)));
+    taskManager.yieldForMicros(5000);
+    TEST_ASSERT_NULL(taskManager.getTask(taskId));
+    TEST_ASSERT_FALSE(taskManager.rescheduleTask(taskId, onceMicros(100)));
+    taskManager.reset();
+}
+
+#if defined(IOA_MULTITHREADED) && defined(__has_include)
+# if __has_include(<thread>)
+#  define TM_TEST_WITH_THREADS
+# endif
+#endif
+
+#ifdef TM_TEST_WITH_THREADS
+#include <thread>
+
+void testRescheduleFromAnotherThread() {
+    taskManager.reset();
+    count1 = 0;
+    auto taskId = taskManager.scheduleFixedRate(10, recordingJob, TIME_SECONDS);
+
+    // the change is stored in the task for task manager to apply, so nothing about the task changes until runLoop,
+    // and a later change replaces one not yet applied. No other slot is used to carry it over.
+    bool changed = false;
+    std::thread other([&changed, taskId] {
+        changed = taskManager.rescheduleTask(taskId, repeatSeconds(5));
+        changed = changed && taskManager.rescheduleTask(taskId, repeatMillis(2));
+    });
+    other.join();
+    TEST_ASSERT_TRUE(changed);
+    TEST_ASSERT_EQUAL(10000, taskManager.getTask(taskId)->getSchedule());
+    TEST_ASSERT_EQUAL(1, taskManager.getSlotsInUse());
+
+    taskManager.yieldForMicros(20000);
+    TEST_ASSERT_EQUAL(2, taskManager.getTask(taskId)->getSchedule());
+    TEST_ASSERT_TRUE(count1 >= 4);
+    TEST_ASSERT_EQUAL(1, taskManager.getSlotsInUse());
+
+    taskManager.reset();
+}
+
+taskid_t finishingTaskId;
+
+void testRescheduleOfFinishedTaskIsDropped() {
+    taskManager.reset();
+
+    // the change arrives while the one shot task runs, it then finishes and is freed before the change is applied.
+    finishingTaskId = taskManager.scheduleOnce(1, [] {
+        std::thread other([] { taskManager.rescheduleTask(finishingTaskId, onceMicros(1)); });
+        other.join();
+    });
+    taskManager.yieldForMicros(5000);
+    TEST_ASSERT_EQUAL(0, taskManager.getSlotsInUse());
+
+    // the next task in the same slot must not pick up the change.
+    auto nextId = taskManager.scheduleFixedRate(10, recordingJob, TIME_SECONDS);
+    TEST_ASSERT_EQUAL(tmSlotOfTaskId(finishingTaskId), tmSlotOfTaskId(nextId));
+    // an interrupt makes task manager look through the slots for changes again.
+    TaskManager::markInterrupted(0);
+    taskManager.runLoop();
+    TEST_ASSERT_NOT_NULL(taskManager.getTask(nextId));
+    TEST_ASSERT_EQUAL(10000, taskManager.getTask(nextId)->getSchedule());
+    TEST_ASSERT_TRUE(taskManager.getTask(nextId)->microsFromNow() > 9000000UL);
+    taskManager.reset();
+}
+#else
+void testRescheduleFromAnotherThread() {
+    TEST_IGNORE_MESSAGE("Needs a multithreaded board with std::thread");
+}
+
+void testRescheduleOfFinishedTaskIsDropped() {
+    TEST_IGNORE_MESSAGE("Needs a multithreaded board with std::thread");
+}
+#endif // TM_TEST_WITH_THREADS
+
+int selfRescheduleRuns = 0;
+
+void testRunningTaskSetsItsOwnDelay() {
+    taskManager.reset();
+    selfRescheduleRuns = 0;
+    taskManager.scheduleOnce(0, [] {
+        // a one shot task that runs again after a short delay, until it has run three times
+        if(++selfRescheduleRuns < 3) taskManager.rescheduleRunningTask(onceMicros(500));
+    }, TIME_MICROS);
+    TEST_ASSERT_EQUAL(1, taskManager.getSlotsInUse());
+
+    taskManager.yieldForMicros(10000);
+    TEST_ASSERT_EQUAL(3, selfRescheduleRuns);
+    TEST_ASSERT_EQUAL(0, taskManager.getSlotsInUse());
+    TEST_ASSERT_FALSE(taskManager.rescheduleRunningTask(onceMicros(500)));
+}
+
+int sliceRuns = 0;
+
+void testRunLoopForReturnsWithWorkPending() {
+    taskManager.reset();
+    sliceRuns = 0;
+    for(int i = 0; i < 3; i++) {
+        taskManager.scheduleFixedRate(1000, [] { sliceRuns++; }, TIME_MICROS);
+    }
+    delayMicroseconds(2000);
+
+    // one task at a time, and it tells us that there is more to do
+    TEST_ASSERT_TRUE(taskManager.runLoopFor(0, 1));
+    TEST_ASSERT_EQUAL(1, sliceRuns);
+
+    TEST_ASSERT_TRUE(taskManager.runLoopFor(100000, 1));
+    TEST_ASSERT_EQUAL(2, sliceRuns);
+
+    // the last one that was due, so nothing else is pending
+    TEST_ASSERT_FALSE(taskManager.runLoopFor(100000, 1));
+    TEST_ASSERT_EQUAL(3, sliceRuns);
+    taskManager.reset();
+}
+
+uint8_t deepestYield = 0;
+
+void yieldingTask() {
+    if(taskManager.getYieldDepth() > deepestYield) deepestYield = taskManager.getYieldDepth();
+    taskManager.yieldForMicros(2000);
+}
+
+void testYieldDepthIsLimited() {
+    taskManager.reset();
+    deepestYield = 0;
+    taskManager.setMaxYieldDepth(2);
+    for(int i = 0; i < 4; i++) {
+        taskManager.scheduleOnce(0, yieldingTask, TIME_MICROS);
+    }
+    taskManager.yieldForMicros(30000);
+    TEST_ASSERT_EQUAL(2, deepestYield);
+    TEST_ASSERT_EQUAL(0, taskManager.getYieldDepth());
+    TEST_ASSERT_NULL(taskManager.getFirstTask());
+
+    // and with a higher limit, each task nests within the previous one.
+    deepestYield = 0;
+    taskManager.setMaxYieldDepth(TM_DEFAULT_MAX_YIELD_DEPTH);
+    for(int i = 0; i < 4; i++) {
+        taskManager.scheduleOnce(0, yieldingTask, TIME_MICROS);
+    }
+    taskManager.yieldForMicros(30000);
+    TEST_ASSERT_EQUAL(4, deepestYield);
+}
+
 void setup() {
     UNITY_BEGIN();
     RUN_TEST(testRunningUsingExecutorClass);
@@ -179,6 +398,14 @@ void setup() {
     RUN_TEST(testEnableAndDisableSupport);
     RUN_TEST(testScheduleFixedRate);
     RUN_TEST(testCancellingAJobAfterCreation);
+    RUN_TEST(testStaleTaskIdIsIgnored);
+    RUN_TEST(testTaskFreedWhileHeldIsFreedOnRelease);
+    RUN_TEST(testRescheduleTaskInPlace);
+    RUN_TEST(testRescheduleFromAnotherThread);
+    RUN_TEST(testRescheduleOfFinishedTaskIsDropped);
+    RUN_TEST(testRunningTaskSetsItsOwnDelay);
+    RUN_TEST(testRunLoopForReturnsWithWorkPending);
+    RUN_TEST(testYieldDepthIsLimited);
     UNITY_END();
 }
 
@@ -0,0 +1,178 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmCoroutine.h"
+#include "TmAsyncSync.h"
+#include "../utils/test_utils.h"
+
+TimingHelpFixture fixture;
+
+void setUp() {
+    fixture.setup();
+}
+
+void tearDown() {}
+
+// these variables are set during test runs to time and verify tasks are run.
+bool scheduled = false;
+bool scheduled2ndJob = false;
+unsigned long microsStarted = 0, microsExecuted = 0, microsExecuted2ndJob = 0;
+int count1 = 0, count2 = 0;
+uint8_t pinNo = 0;
+
+#ifdef TM_COROUTINES_AVAILABLE
+
+TmPooledFrameAllocator<256, 2> framePool;
+TmAwaitableEvent awaitableEvent;
+int stepsCompleted = 0;
+bool finished = false;
+
+TmCoroutine multiStepCoroutine() {
+    stepsCompleted++;
+    co_await delayMillis(20);
+    stepsCompleted++;
+    co_await yieldNow();
+    stepsCompleted++;
+    co_await delayMicros(500);
+    stepsCompleted++;
+    microsExecuted = micros();
+    scheduled = true;
+}
+
+TmCoroutine eventWaitingCoroutine() {
+    for(int i = 0; i < 3; i++) {
+        co_await awaitableEvent;
+        count1++;
+    }
+    finished = true;
+}
+
+void testCoroutineWithDelaysRunsInOrder() {
+    setCoroutineFrameAllocator(&framePool);
+    stepsCompleted = 0;
+    auto coroutine = multiStepCoroutine();
+    TEST_ASSERT_TRUE(coroutine.isValid());
+    TEST_ASSERT_EQUAL(0, stepsCompleted);
+    TEST_ASSERT_TRUE(coroutine.start());
+    TEST_ASSERT_FALSE(coroutine.isValid());
+
+    fixture.assertThatTaskRunsOnTime(20500, MILLIS_ALLOWANCE);
+    TEST_ASSERT_EQUAL(4, stepsCompleted);
+
+    // the frame must have been returned to the pool, so we can allocate both frames again.
+    auto first = multiStepCoroutine();
+    auto second = multiStepCoroutine();
+    TEST_ASSERT_TRUE(first.isValid());
+    TEST_ASSERT_TRUE(second.isValid());
+
+    // and now the pool is exhausted.
+    auto third = multiStepCoroutine();
+    TEST_ASSERT_FALSE(third.isValid());
+    TEST_ASSERT_FALSE(third.start());
+    setCoroutineFrameAllocator(nullptr);
+}
+
+void testCoroutineAwaitingAnEvent() {
+    finished = false;
+    taskManager.registerEvent(&awaitableEvent);
+    TEST_ASSERT_TRUE(eventWaitingCoroutine().start());
+
+    taskManager.yieldForMicros(1000);
+    TEST_ASSERT_EQUAL(0, count1);
+
+    for(int i = 0; i < 3; i++) {
+        awaitableEvent.markTriggeredAndNotify();
+        taskManager.yieldForMicros(1000);
+        TEST_ASSERT_EQUAL(i + 1, count1);
+    }
+
+    TEST_ASSERT_TRUE(finished);
+    fixture.assertTasksSpacesTaken(1);
+}
+
+TmAsyncMutex coroutineMutex;
+int insideMutex = 0;
+int maxInsideMutex = 0;
+int mutexSectionsDone = 0;
+
+TmCoroutine mutexUsingCoroutine() {
+    co_await coroutineMutex.lockAsync();
+    insideMutex++;
+    if(insideMutex > maxInsideMutex) maxInsideMutex = insideMutex;
+    co_await delayMillis(2);
+    insideMutex--;
+    mutexSectionsDone++;
+    coroutineMutex.unlock();
+}
+
+void testCoroutinesAwaitingAnAsyncMutex() {
+    TEST_ASSERT_TRUE(mutexUsingCoroutine().start());
+    TEST_ASSERT_TRUE(mutexUsingCoroutine().start());
+
+    int loops = 100;
+    while(--loops && mutexSectionsDone != 2) {
+        taskManager.yieldForMicros(1000);
+    }
+
+    // both got the mutex in turn, and never at the same time
+    TEST_ASSERT_EQUAL(2, mutexSectionsDone);
+    TEST_ASSERT_EQUAL(1, maxInsideMutex);
+    TEST_ASSERT_FALSE(coroutineMutex.isLocked());
+}
+
+bool delayResult = true;
+
+TmCoroutine delayWhenFullCoroutine() {
+    delayResult = co_await delayMillis(10);
+    finished = true;
+}
+
+void testDelayReportsWhenTaskManagerFull() {
+    finished = false;
+    delayResult = true;
+    TEST_ASSERT_TRUE(delayWhenFullCoroutine().start());
+
+    // fill every slot, so that the delay cannot be scheduled
+    while(taskManager.scheduleOnce(100, [] {}, TIME_SECONDS) != TASKMGR_INVALIDID);
+
+    int loops = 100;
+    while(--loops && !finished) {
+        taskManager.runLoop();
+    }
+
+    // the coroutine carried on straight away, and was told that the delay did not happen
+    TEST_ASSERT_TRUE(finished);
+    TEST_ASSERT_FALSE(delayResult);
+    taskManager.reset();
+}
+
+#else
+
+void testDelayReportsWhenTaskManagerFull() {
+    TEST_IGNORE_MESSAGE("Coroutines are not available with this compiler");
+}
+
+void testCoroutinesAwaitingAnAsyncMutex() {
+    TEST_IGNORE_MESSAGE("Coroutines are not available with this compiler");
+}
+
+void testCoroutineWithDelaysRunsInOrder() {
+    TEST_IGNORE_MESSAGE("Coroutines are not available with this compiler");
+}
+
+void testCoroutineAwaitingAnEvent() {
+    TEST_IGNORE_MESSAGE("Coroutines are not available with this compiler");
+}
+
+#endif // TM_COROUTINES_AVAILABLE
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testCoroutineWithDelaysRunsInOrder);
+    RUN_TEST(testCoroutineAwaitingAnEvent);
+    RUN_TEST(testCoroutinesAwaitingAnAsyncMutex);
+    RUN_TEST(testDelayReportsWhenTaskManagerFull);
+    UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,151 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmDiagnostics.h"
+#include "../utils/test_utils.h"
+
+void setUp() {
+    taskManager.reset();
+}
+
+void tearDown() {}
+
+void doNothing() {}
+
+class NothingExecutable : public Executable {
+public:
+    void exec() override {}
+} nothingExecutable;
+
+class OneShotEvent : public BaseEvent {
+public:
+    uint32_t timeOfNextCheck() override {
+        setTriggered(true);
+        return 1000;
+    }
+
+    void exec() override { setCompleted(true); }
+} oneShotEvent;
+
+void testSlotIteratorReportsEachTask() {
+    auto first = taskManager.scheduleFixedRate(1000, doNothing);
+    auto second = taskManager.scheduleOnce(20, &nothingExecutable, TIME_MICROS);
+    taskManager.setTaskLabel(first, "sensor");
+    taskManager.setTaskEnabled(second, false);
+
+    TmSlotIterator slots;
+    TmSlotInfo info;
+    TEST_ASSERT_TRUE(slots.next(info));
+    TEST_ASSERT_EQUAL(first, info.id);
+    TEST_ASSERT_EQUAL(TM_KIND_FUNCTION, info.kind);
+    TEST_ASSERT_EQUAL(TIME_MILLIS, info.unit);
+    TEST_ASSERT_TRUE(info.repeating);
+    TEST_ASSERT_TRUE(info.enabled);
+    TEST_ASSERT_FALSE(info.running);
+    TEST_ASSERT_EQUAL_UINT32(1000, info.interval);
+    TEST_ASSERT_UINT32_WITHIN(50, 1000, info.timeToNextRun);
+    TEST_ASSERT_EQUAL_STRING("sensor", info.label);
+
+    TEST_ASSERT_TRUE(slots.next(info));
+    TEST_ASSERT_EQUAL(second, info.id);
+    TEST_ASSERT_EQUAL(TM_KIND_EXECUTABLE, info.kind);
+    TEST_ASSERT_EQUAL(TIME_MICROS, info.unit);
+    TEST_ASSERT_FALSE(info.enabled);
+    TEST_ASSERT_FALSE(info.repeating);
+    TEST_ASSERT_NULL(info.label);
+
+    TEST_ASSERT_FALSE(slots.next(info));
+
+    // including free slots, every slot is visited
+    TmSlotIterator allSlots(&taskManager, true);
+    int count = 0;
+    while(allSlots.next(info)) count++;
+    TEST_ASSERT_EQUAL(DEFAULT_TASK_SIZE, count);
+}
+
+void testQueueIteratorIsInRunOrder() {
+    auto later = taskManager.scheduleFixedRate(500, doNothing);
+    auto sooner = taskManager.scheduleFixedRate(100, doNothing);
+    TEST_ASSERT_EQUAL(later, taskManager.getTaskId(taskManager.getTask(later)));
+    TEST_ASSERT_EQUAL(TASKMGR_INVALIDID, taskManager.getTaskId(nullptr));
+
+    TmQueueIterator queue;
+    TmSlotInfo info;
+    TEST_ASSERT_TRUE(queue.next(info));
+    TEST_ASSERT_EQUAL(sooner, info.id);
+    TEST_ASSERT_TRUE(queue.next(info));
+    TEST_ASSERT_EQUAL(later, info.id);
+    TEST_ASSERT_FALSE(queue.next(info));
+}
+
+void testTextAndJsonDumps() {
+    auto id = taskManager.scheduleFixedRate(1000, doNothing);
+    taskManager.setTaskLabel(id, "say \"hi\"");
+
+    char text[64];
+    TmBufferDiagnosticSink textSink(text, sizeof text);
+    dumpTasksAsText(textSink);
+    TEST_ASSERT_FALSE(textSink.isOverflowed());
+    char expected[32];
+    snprintf(expected, sizeof expected, "%u FR 1000ms ", id);
+    TEST_ASSERT_EQUAL(0, strncmp(text, expected, strlen(expected)));
+    TEST_ASSERT_NOT_NULL(strstr(text, "ms say \"hi\"\n"));
+
+    char json[200];
+    TmBufferDiagnosticSink jsonSink(json, sizeof json);
+    dumpTasksAsJson(jsonSink, TM_DUMP_SLOTS);
+    TEST_ASSERT_FALSE(jsonSink.isOverflowed());
+    snprintf(expected, sizeof expected, "[{\"id\":%u,\"kind\":", id);
+    TEST_ASSERT_EQUAL(0, strncmp(json, expected, strlen(expected)));
+    TEST_ASSERT_NOT_NULL(strstr(json, ",\"kind\":\"function\",\"interval\":1000,\"next\":"));
+    TEST_ASSERT_NOT_NULL(strstr(json, ",\"unit\":\"ms\",\"enabled\":true,\"running\":false,\"repeating\":true,\"label\":\"say \\\"hi\\\"\"}]"));
+
+    // output that does not fit is truncated, but always terminated
+    char tiny[8];
+    TmBufferDiagnosticSink tinySink(tiny, sizeof tiny);
+    dumpTasksAsJson(tinySink);
+    TEST_ASSERT_TRUE(tinySink.isOverflowed());
+    TEST_ASSERT_EQUAL(7, strlen(tiny));
+
+    // the label goes when the task does
+    taskManager.cancelTask(id);
+    taskManager.yieldForMicros(1000);
+    TEST_ASSERT_NULL(taskManager.getTask(id));
+    TEST_ASSERT_NULL(taskManager.getTaskInSlot(tmSlotOfTaskId(id))->getLabel());
+}
+
+void testFreedEventSlotIsReportedAsFree() {
+    auto id = taskManager.registerEvent(&oneShotEvent);
+    TEST_ASSERT_NOT_EQUAL(TASKMGR_INVALIDID, id);
+    auto slot = taskManager.getTaskInSlot(tmSlotOfTaskId(id));
+
+    unsigned long start = millis();
+    while(slot->isInUse() && (millis() - start) < 1000) {
+        taskManager.yieldForMicros(1000);
+    }
+    TEST_ASSERT_FALSE(slot->isInUse());
+
+    // walking the free slots must not touch the event that used to be there
+    TmSlotIterator allSlots(&taskManager, true);
+    TmSlotInfo info;
+    bool found = false;
+    while(allSlots.next(info)) {
+        if(tmSlotOfTaskId(info.id) != tmSlotOfTaskId(id)) continue;
+        found = true;
+        TEST_ASSERT_EQUAL(TM_KIND_FREE, info.kind);
+        TEST_ASSERT_FALSE(info.repeating);
+        TEST_ASSERT_NULL(info.label);
+    }
+    TEST_ASSERT_TRUE(found);
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testSlotIteratorReportsEachTask);
+    RUN_TEST(testQueueIteratorIsInRunOrder);
+    RUN_TEST(testTextAndJsonDumps);
+    RUN_TEST(testFreedEventSlotIsReportedAsFree);
+    UNITY_END();
+}
+
+void loop() {}
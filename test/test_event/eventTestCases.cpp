@@ -153,7 +153,7 @@ void testNotifyEventThatStartsAnotherTask() {
     TEST_ASSERT_EQUAL(0, externalEvent.getExecCalls());
 
     // it should not be in task manager any longer.
-    TEST_ASSERT_FALSE(taskManager.getTask(taskId)->isEvent());
+    TEST_ASSERT_NULL(taskManager.getTask(taskId));
 
     TEST_ASSERT_TRUE(timelyChecker.ensureTimely());
 }
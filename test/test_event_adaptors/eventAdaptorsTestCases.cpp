@@ -0,0 +1,146 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmEventAdaptors.h"
+#include "../utils/test_utils.h"
+
+int adaptorRuns = 0;
+
+void countAdaptorRun() {
+    adaptorRuns++;
+}
+
+void setUp() {
+    taskManager.reset();
+    adaptorRuns = 0;
+}
+
+void tearDown() {}
+
+void triggerBurst(TmDebouncedEvent& event, int triggers) {
+    for(int i = 0; i < triggers; i++) {
+        event.trigger();
+        taskManager.runLoop();
+        delayMicroseconds(100);
+    }
+}
+
+void testTrailingDebounceRunsOncePerBurst() {
+    TmDebouncedEvent event(20000, countAdaptorRun);
+    taskManager.registerEvent(&event);
+
+    triggerBurst(event, 50);
+    TEST_ASSERT_EQUAL(0, adaptorRuns);
+
+    runLoopForMillis(100);
+    TEST_ASSERT_EQUAL(1, adaptorRuns);
+    TEST_ASSERT_EQUAL_UINT32(1, event.getExecutionCount());
+    TEST_ASSERT_EQUAL_UINT32(50, event.getTriggerCount());
+
+    // a second burst after the quiet time is another run
+    triggerBurst(event, 10);
+    runLoopForMillis(100);
+    TEST_ASSERT_EQUAL(2, adaptorRuns);
+}
+
+void testLeadingDebounceRunsStraightAway() {
+    TmDebouncedEvent event(20000, countAdaptorRun, TM_DEBOUNCE_LEADING);
+    taskManager.registerEvent(&event);
+
+    event.trigger();
+    taskManager.runLoop();
+    TEST_ASSERT_EQUAL(1, adaptorRuns);
+
+    // the rest of the burst is ignored, and the end of it does not run again
+    triggerBurst(event, 50);
+    runLoopForMillis(100);
+    TEST_ASSERT_EQUAL(1, adaptorRuns);
+
+    triggerBurst(event, 10);
+    runLoopForMillis(100);
+    TEST_ASSERT_EQUAL(2, adaptorRuns);
+    TEST_ASSERT_EQUAL_UINT32(61, event.getTriggerCount());
+}
+
+void testThrottleLimitsRunsInEachPeriod() {
+    TmThrottledEvent event(2, 200000, countAdaptorRun);
+    taskManager.registerEvent(&event);
+
+    // keep triggering for well under a period, only two runs are allowed in it
+    unsigned long start = millis();
+    while((millis() - start) < 30) {
+        event.trigger();
+        taskManager.runLoop();
+        delayMicroseconds(100);
+    }
+    TEST_ASSERT_EQUAL(2, adaptorRuns);
+
+    // the triggers beyond the limit are merged into one run at the start of the next period
+    runLoopForMillis(400);
+    TEST_ASSERT_EQUAL(3, adaptorRuns);
+    TEST_ASSERT_EQUAL_UINT32(3, event.getExecutionCount());
+    TEST_ASSERT_TRUE(event.getTriggerCount() > 3);
+}
+
+uint32_t countedTotal = 0;
+int countedBatches = 0;
+
+void testCountingEventPassesTheCountToTheHandler() {
+    countedTotal = 0;
+    countedBatches = 0;
+    TmCountingEvent event([](uint32_t count) {
+        countedTotal += count;
+        countedBatches++;
+    });
+    taskManager.registerEvent(&event);
+    taskManager.runLoop();
+
+    // many triggers before task manager gets to the event are handled as one batch, with the count
+    for(int i = 0; i < 25; i++) {
+        event.trigger();
+    }
+    event.trigger(5);
+    TEST_ASSERT_EQUAL_UINT32(30, event.getPendingCount());
+    runLoopForMillis(20);
+    TEST_ASSERT_EQUAL(1, countedBatches);
+    TEST_ASSERT_EQUAL_UINT32(30, countedTotal);
+    TEST_ASSERT_EQUAL_UINT32(0, event.getPendingCount());
+
+    // and the next trigger wakes task manager again
+    event.trigger();
+    runLoopForMillis(20);
+    TEST_ASSERT_EQUAL(2, countedBatches);
+    TEST_ASSERT_EQUAL_UINT32(31, countedTotal);
+    TEST_ASSERT_EQUAL_UINT32(31, event.getTotalHandled());
+    TEST_ASSERT_EQUAL_UINT32(2, event.getBatchesHandled());
+}
+
+class ItemCountingEvent : public TmCountingEvent {
+public:
+    uint32_t lastBatch = 0;
+    void handleBatch(uint32_t count) override { lastBatch = count; }
+};
+
+void testCountingEventCanBeExtended() {
+    ItemCountingEvent event;
+    taskManager.registerEvent(&event);
+    taskManager.runLoop();
+
+    event.trigger(3);
+    event.trigger(4);
+    runLoopForMillis(20);
+    TEST_ASSERT_EQUAL_UINT32(7, event.lastBatch);
+    TEST_ASSERT_EQUAL_UINT32(1, event.getBatchesHandled());
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testTrailingDebounceRunsOncePerBurst);
+    RUN_TEST(testLeadingDebounceRunsStraightAway);
+    RUN_TEST(testThrottleLimitsRunsInEachPeriod);
+    RUN_TEST(testCountingEventPassesTheCountToTheHandler);
+    RUN_TEST(testCountingEventCanBeExtended);
+    UNITY_END();
+}
+
+void loop() {}
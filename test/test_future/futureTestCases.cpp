@@ -0,0 +1,130 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmFuture.h"
+#include "../utils/test_utils.h"
+
+TimingHelpFixture fixture;
+
+void setUp() {
+    fixture.setup();
+}
+
+void tearDown() {}
+
+// these variables are set during test runs to time and verify tasks are run.
+bool scheduled = false;
+bool scheduled2ndJob = false;
+unsigned long microsStarted = 0, microsExecuted = 0, microsExecuted2ndJob = 0;
+int count1 = 0, count2 = 0;
+uint8_t pinNo = 0;
+
+TmPromise<int> rawReading;
+TmPromise<float> scaledReading;
+float publishedValue = 0.0F;
+
+TmPromise<int> firstSensor;
+TmPromise<int> secondSensor;
+TmWhenAll<2> bothSensors;
+uint8_t sensorsCompleted = 0;
+
+void testContinuationRunsOnTaskManagerWhenValueSet() {
+    rawReading.reset();
+    scaledReading.reset();
+    publishedValue = 0.0F;
+
+    rawReading.getFuture().then([](const int& raw) { return raw / 2.0F; }, scaledReading).then([](const float& scaled) {
+        publishedValue = scaled;
+        count1++;
+    });
+    TEST_ASSERT_FALSE(rawReading.isReady());
+
+    // the value is provided from another task, continuations must not run until task manager runs them.
+    taskManager.scheduleOnce(5, [] { rawReading.setValue(101); });
+    taskManager.yieldForMicros(1000);
+    TEST_ASSERT_EQUAL(0, count1);
+
+    taskManager.yieldForMicros(10000);
+    TEST_ASSERT_TRUE(rawReading.isReady());
+    TEST_ASSERT_TRUE(scaledReading.isReady());
+    TEST_ASSERT_EQUAL(1, count1);
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, 50.5F, publishedValue);
+
+    // once complete, no slots should be in use at all.
+    fixture.assertTasksSpacesTaken(0);
+}
+
+void testContinuationAddedAfterValueIsReady() {
+    rawReading.reset();
+    rawReading.setValue(42);
+    taskManager.yieldForMicros(1000);
+    TEST_ASSERT_EQUAL(0, count1);
+
+    rawReading.getFuture().then([](const int& value) {
+        count1 = value;
+    });
+    taskManager.yieldForMicros(1000);
+    TEST_ASSERT_EQUAL(42, count1);
+}
+
+void testWhenAllCompletesOnceAllFuturesReady() {
+    whenAll(bothSensors, firstSensor.getFuture(), secondSensor.getFuture()).then([](const uint8_t& completed) {
+        sensorsCompleted = completed;
+        count2++;
+    });
+
+    firstSensor.setValue(10);
+    taskManager.yieldForMicros(1000);
+    TEST_ASSERT_EQUAL(0, count2);
+
+    secondSensor.setValue(20);
+    taskManager.yieldForMicros(1000);
+    TEST_ASSERT_EQUAL(1, count2);
+    TEST_ASSERT_EQUAL(2, sensorsCompleted);
+    TEST_ASSERT_EQUAL(10, firstSensor.getFuture().get());
+    TEST_ASSERT_EQUAL(20, secondSensor.getFuture().get());
+}
+
+TmPromise<int> onlySensor;
+TmWhenAll<3> upToThreeSensors;
+
+void testWhenAllCompletesWithFewerFutures() {
+    whenAll(upToThreeSensors, onlySensor.getFuture()).then([](const uint8_t& completed) {
+        sensorsCompleted = completed;
+        count2++;
+    });
+
+    onlySensor.setValue(5);
+    taskManager.yieldForMicros(1000);
+    TEST_ASSERT_EQUAL(1, count2);
+    TEST_ASSERT_EQUAL(1, sensorsCompleted);
+}
+
+TmPromise<int> promiseWhenFull;
+
+void testContinuationRetriedWhenTaskManagerWasFull() {
+    promiseWhenFull.getFuture().then([](const int& value) { count1 = value; });
+
+    // fill every slot, so that the continuation cannot be scheduled when the value arrives
+    while(taskManager.scheduleOnce(100, [] {}, TIME_SECONDS) != TASKMGR_INVALIDID);
+    promiseWhenFull.setValue(99);
+    TEST_ASSERT_FALSE(promiseWhenFull.getFuture().poll());
+
+    // once there is space again, polling schedules it
+    taskManager.reset();
+    TEST_ASSERT_TRUE(promiseWhenFull.getFuture().poll());
+    taskManager.yieldForMicros(1000);
+    TEST_ASSERT_EQUAL(99, count1);
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testContinuationRunsOnTaskManagerWhenValueSet);
+    RUN_TEST(testContinuationAddedAfterValueIsReady);
+    RUN_TEST(testWhenAllCompletesOnceAllFuturesReady);
+    RUN_TEST(testWhenAllCompletesWithFewerFutures);
+    RUN_TEST(testContinuationRetriedWhenTaskManagerWasFull);
+    UNITY_END();
+}
+
+void loop() {}
@@ -118,7 +118,7 @@ void taskManagerHighThroughputTest() {
 // it then waits for the other jobs scheduled after the cancelled to run. See github #38
 // Kindly isolated and reported by @martin-klima
 //
-uint8_t taskId1;
+taskid_t taskId1;
 bool taskCancelled;
 int storedCount1;
 int storedCount2;
@@ -180,10 +180,116 @@ void testCancellingsTasksWithinAnotherTask() {
     TEST_ASSERT_NOT_EQUAL(counts[2], storedCount1);
 }
 
+void testBlockAllocationAndQueueLocksUncontended() {
+    TaskManager localTaskManager;
+    counts[0] = 0;
+
+    // enough tasks to need more than one block, so both the block and queue locks are taken many times.
+    for(int i = 0; i < 30; i++) {
+        TEST_ASSERT_NOT_EQUAL(TASKMGR_INVALIDID, localTaskManager.scheduleOnce(i, testCall1, TIME_MICROS));
+    }
+    int loops = 100;
+    while(--loops && counts[0] != 30) {
+        localTaskManager.yieldForMicros(100);
+    }
+    TEST_ASSERT_EQUAL(30, counts[0]);
+
+    // with only one thread, nothing should ever have waited for either lock.
+    TEST_ASSERT_EQUAL(0U, localTaskManager.getLockContentionCount());
+    TEST_ASSERT_EQUAL(0U, localTaskManager.getLockMaxWaitMicros());
+}
+
+#if defined(IOA_MULTITHREADED) && defined(__has_include)
+# if __has_include(<thread>)
+#  define TM_TEST_WITH_THREADS
+# endif
+#endif
+
+#ifdef TM_TEST_WITH_THREADS
+#include <thread>
+
+#define FAIR_LOCK_WAITERS 4
+tm_internal::TmTicketLock fairLock;
+volatile int acquiredOrder[FAIR_LOCK_WAITERS];
+volatile int acquiredCount = 0;
+
+void testTicketLockServesWaitersInOrder() {
+    tm_internal::atomicWriteCounter(&fairLock.nextTicket, 0);
+    tm_internal::atomicWriteCounter(&fairLock.nowServing, 0);
+    tm_internal::atomicWriteCounter(&fairLock.contendedCount, 0);
+    tm_internal::atomicWriteCounter(&fairLock.maxWaitMicros, 0);
+    acquiredCount = 0;
+
+    std::thread waiters[FAIR_LOCK_WAITERS];
+    {
+        TmSpinLock held(&fairLock);
+        for(int i = 0; i < FAIR_LOCK_WAITERS; i++) {
+            waiters[i] = std::thread([i] {
+                TmSpinLock lock(&fairLock);
+                acquiredOrder[acquiredCount] = i;
+                acquiredCount = acquiredCount + 1;
+            });
+            // wait until this waiter has taken its ticket, so that each one queues up behind the one before.
+            while(tm_internal::atomicReadCounter(&fairLock.nextTicket) != uint32_t(i + 2)) {
+                yield();
+            }
+        }
+    }
+
+    for(auto& waiter : waiters) waiter.join();
+
+    // the lock was handed over in the order it was asked for, and every waiter had to wait.
+    TEST_ASSERT_EQUAL(FAIR_LOCK_WAITERS, acquiredCount);
+    for(int i = 0; i < FAIR_LOCK_WAITERS; i++) {
+        TEST_ASSERT_EQUAL(i, acquiredOrder[i]);
+    }
+    TEST_ASSERT_EQUAL(uint32_t(FAIR_LOCK_WAITERS), tm_internal::atomicReadCounter(&fairLock.contendedCount));
+}
+
+void testTicketLockWaiterOutlastsLongHold() {
+    tm_internal::atomicWriteCounter(&fairLock.nextTicket, 0);
+    tm_internal::atomicWriteCounter(&fairLock.nowServing, 0);
+    tm_internal::atomicWriteCounter(&fairLock.contendedCount, 0);
+    tm_internal::atomicWriteCounter(&fairLock.maxWaitMicros, 0);
+    volatile bool acquired = false;
+
+    std::thread waiter;
+    {
+        TmSpinLock held(&fairLock);
+        waiter = std::thread([&acquired] {
+            TmSpinLock lock(&fairLock);
+            acquired = true;
+        });
+        // long enough for the waiter to use up its spins and yields and go on to sleeping between checks.
+        delay(30);
+        TEST_ASSERT_FALSE(acquired);
+    }
+    waiter.join();
+
+    TEST_ASSERT_TRUE(acquired);
+    TEST_ASSERT_EQUAL(1U, tm_internal::atomicReadCounter(&fairLock.contendedCount));
+    TEST_ASSERT_TRUE(tm_internal::atomicReadCounter(&fairLock.maxWaitMicros) >= 25000U);
+}
+
+#else
+
+void testTicketLockServesWaitersInOrder() {
+    TEST_IGNORE_MESSAGE("Needs a multithreaded board with std::thread");
+}
+
+void testTicketLockWaiterOutlastsLongHold() {
+    TEST_IGNORE_MESSAGE("Needs a multithreaded board with std::thread");
+}
+
+#endif // TM_TEST_WITH_THREADS
+
 void setup() {
     UNITY_BEGIN();
     RUN_TEST(taskManagerHighThroughputTest);
     RUN_TEST(testCancellingsTasksWithinAnotherTask);
+    RUN_TEST(testBlockAllocationAndQueueLocksUncontended);
+    RUN_TEST(testTicketLockServesWaitersInOrder);
+    RUN_TEST(testTicketLockWaiterOutlastsLongHold);
     UNITY_END();
 }
 
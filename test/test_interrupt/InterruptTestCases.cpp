@@ -1,6 +1,7 @@
 #include <Arduino.h>
 #include <unity.h>
 #include "TaskManagerIO.h"
+#include "TmPinInterrupts.h"
 #include "../utils/test_utils.h"
 
 TimingHelpFixture fixture;
@@ -83,9 +84,109 @@ void testInterruptSupportMarshalling() {
     TEST_ASSERT_EQUAL(2, pinNo);
 }
 
+pintype_t timedPins[TM_INTERRUPT_QUEUE_SIZE];
+uint32_t timedMicros[TM_INTERRUPT_QUEUE_SIZE];
+
+void timedIntHandler(pintype_t pin, uint32_t microsAtInterrupt) {
+    if(count2 < TM_INTERRUPT_QUEUE_SIZE) {
+        timedPins[count2] = pin;
+        timedMicros[count2] = microsAtInterrupt;
+    }
+    count2++;
+}
+
+void testEveryInterruptDeliveredInOrderWithTime() {
+    taskManager.setTimedInterruptCallback(timedIntHandler);
+    MockedInterruptAbstraction pin3Abs;
+    MockedInterruptAbstraction pin5Abs;
+    taskManager.addInterrupt(&pin3Abs, 3, CHANGE);
+    taskManager.addInterrupt(&pin5Abs, 5, CHANGE);
+
+    // both pins fire, and then pin 3 again, before task manager gets a chance to run
+    auto beforeInterrupts = micros();
+    pin3Abs.runInterrupt();
+    pin5Abs.runInterrupt();
+    pin3Abs.runInterrupt();
+    taskManager.yieldForMicros(100);
+
+    TEST_ASSERT_EQUAL(3, count2);
+    TEST_ASSERT_EQUAL(3, timedPins[0]);
+    TEST_ASSERT_EQUAL(5, timedPins[1]);
+    TEST_ASSERT_EQUAL(3, timedPins[2]);
+    TEST_ASSERT_TRUE(timedMicros[0] - beforeInterrupts < 1000UL);
+    TEST_ASSERT_TRUE(timedMicros[1] - timedMicros[0] < 1000UL);
+    TEST_ASSERT_EQUAL(0U, taskManager.getInterruptOverflowCount());
+
+    // now overflow the queue, everything that fits is delivered and the rest are counted.
+    count2 = 0;
+    for(int i = 0; i < TM_INTERRUPT_QUEUE_SIZE + 2; i++) {
+        pin5Abs.runInterrupt();
+    }
+    taskManager.yieldForMicros(100);
+    TEST_ASSERT_EQUAL(TM_INTERRUPT_QUEUE_SIZE, count2);
+    TEST_ASSERT_EQUAL(2U, taskManager.getInterruptOverflowCount());
+    taskManager.setTimedInterruptCallback(nullptr);
+}
+
+int pin7Count = 0;
+pintype_t pin7LastPin = 0;
+
+void pin7Handler(pintype_t pin) {
+    pin7Count++;
+    pin7LastPin = pin;
+}
+
+class CountingExecutable : public Executable {
+public:
+    int count = 0;
+    void exec() override { count++; }
+};
+
+void testPerPinHandlersAreIndependent() {
+    TaskManager otherTaskManager;
+    CountingExecutable pin9Exec;
+    MockedInterruptAbstraction pin7Abs;
+    MockedInterruptAbstraction pin9Abs;
+    TEST_ASSERT_TRUE(TmPinInterrupts::attach(&pin7Abs, 7, RISING, pin7Handler));
+    TEST_ASSERT_TRUE(TmPinInterrupts::attach(&pin9Abs, 9, FALLING, &pin9Exec, &otherTaskManager));
+    TEST_ASSERT_FALSE(TmPinInterrupts::attach(&pin9Abs, TM_MAX_INTERRUPT_PINS, FALLING, pin7Handler));
+    TEST_ASSERT_EQUAL(9, pin9Abs.getInterruptPin());
+    TEST_ASSERT_EQUAL(FALLING, pin9Abs.getTheMode());
+    taskManager.yieldForMicros(100);
+    otherTaskManager.yieldForMicros(100);
+
+    // pin 7 only runs its own handler on the global task manager
+    pin7Abs.runInterrupt();
+    taskManager.yieldForMicros(100);
+    TEST_ASSERT_EQUAL(1, pin7Count);
+    TEST_ASSERT_EQUAL(7, pin7LastPin);
+    TEST_ASSERT_EQUAL(0, pin9Exec.count);
+
+    // pin 9 runs on the other task manager and not on the global one
+    pin9Abs.runInterrupt();
+    taskManager.yieldForMicros(100);
+    TEST_ASSERT_EQUAL(0, pin9Exec.count);
+    otherTaskManager.yieldForMicros(100);
+    TEST_ASSERT_EQUAL(1, pin9Exec.count);
+    TEST_ASSERT_EQUAL(1, pin7Count);
+
+    // once detached the pin is ignored, and the handler event is removed from task manager
+    TmPinInterrupts::detach(9);
+    TEST_ASSERT_FALSE(TmPinInterrupts::isAttached(9));
+    otherTaskManager.yieldForMicros(100);
+    pin9Abs.runInterrupt();
+    otherTaskManager.yieldForMicros(100);
+    TEST_ASSERT_EQUAL(1, pin9Exec.count);
+    TEST_ASSERT_FALSE(otherTaskManager.getTaskInSlot(0)->isInUse());
+    TmPinInterrupts::detach(7);
+    taskManager.yieldForMicros(100);
+}
+
 void setup() {
     UNITY_BEGIN();
     RUN_TEST(testInterruptSupportMarshalling);
+    RUN_TEST(testEveryInterruptDeliveredInOrderWithTime);
+    RUN_TEST(testPerPinHandlersAreIndependent);
     UNITY_END();
 }
 
@@ -0,0 +1,129 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "../utils/test_utils.h"
+
+void setUp() {
+    taskManager.reset();
+    taskManager.setOverloadPolicy(TmOverloadPolicy { 0, 0, TM_SHED_SKIP, 2, 10000UL, 0 });
+    taskManager.runLoop();
+}
+
+void tearDown() {}
+
+int sheddableRuns = 0;
+int normalRuns = 0;
+
+void testNotOverloadedWithoutPolicy() {
+    taskManager.scheduleFixedRate(1, [] { normalRuns++; });
+    delay(20);
+    taskManager.runLoop();
+    TEST_ASSERT_FALSE(taskManager.isOverloaded());
+}
+
+void testLateQueueShedsSheddableTasks() {
+    sheddableRuns = normalRuns = 0;
+    auto episodes = taskManager.getOverloadEpisodes();
+    auto shed = taskManager.getShedExecutions();
+    taskManager.setOverloadPolicy(TmOverloadPolicy { 2000UL, 0, TM_SHED_SKIP, 2, 10000UL, 0 });
+
+    auto sheddable = taskManager.scheduleFixedRate(1000, [] { sheddableRuns++; }, TIME_MICROS);
+    taskManager.setTaskSheddable(sheddable, true);
+    TEST_ASSERT_TRUE(taskManager.getTask(sheddable)->isSheddable());
+    taskManager.scheduleFixedRate(2000, [] { normalRuns++; }, TIME_MICROS);
+
+    // nothing runs for a while, so the queue falls well behind.
+    delay(10);
+    taskManager.runLoop();
+    taskManager.runLoop();
+    TEST_ASSERT_TRUE(taskManager.isOverloaded());
+    TEST_ASSERT_EQUAL_UINT32(episodes + 1, taskManager.getOverloadEpisodes());
+    TEST_ASSERT_EQUAL_UINT32(shed + 1, taskManager.getShedExecutions());
+    TEST_ASSERT_EQUAL(0, sheddableRuns);
+    TEST_ASSERT_EQUAL(1, normalRuns);
+
+    // the skipped task is a whole interval away, and once caught up, it runs again.
+    TEST_ASSERT_UINT32_WITHIN(300, 1000, taskManager.getTask(sheddable)->unitsFromNow());
+    taskManager.yieldForMicros(20000);
+    TEST_ASSERT_FALSE(taskManager.isOverloaded());
+    TEST_ASSERT_TRUE(sheddableRuns > 0);
+}
+
+void testLatenessOverloadDwellsBeforeRecovering() {
+    normalRuns = 0;
+    auto episodes = taskManager.getOverloadEpisodes();
+    taskManager.setOverloadPolicy(TmOverloadPolicy { 2000UL, 0, TM_SHED_SKIP, 2, 10000UL, 30000UL });
+    taskManager.scheduleFixedRate(1000, [] { normalRuns++; }, TIME_MICROS);
+
+    delay(10);
+    taskManager.runLoop();
+    TEST_ASSERT_TRUE(taskManager.isOverloaded());
+    TEST_ASSERT_EQUAL_UINT32(episodes + 1, taskManager.getOverloadEpisodes());
+
+    // the queue catches up straight away, but it stays overloaded until it has been recovered for the dwell time.
+    runLoopForMillis(10);
+    TEST_ASSERT_TRUE(normalRuns > 1);
+    TEST_ASSERT_TRUE(taskManager.isOverloaded());
+
+    runLoopForMillis(40);
+    TEST_ASSERT_FALSE(taskManager.isOverloaded());
+    TEST_ASSERT_EQUAL_UINT32(episodes + 1, taskManager.getOverloadEpisodes());
+}
+
+void testShortDeferRoundsUpForMillisTasks() {
+    taskManager.setOverloadPolicy(TmOverloadPolicy { 2000UL, 0, TM_SHED_DEFER, 2, 500UL, 0 });
+    auto sheddable = taskManager.scheduleOnce(1, [] { sheddableRuns++; });
+    taskManager.setTaskSheddable(sheddable, true);
+    taskManager.scheduleFixedRate(1000, [] { normalRuns++; }, TIME_MICROS);
+
+    delay(10);
+    taskManager.runLoop();
+    TEST_ASSERT_TRUE(taskManager.isOverloaded());
+
+    // half a millisecond is postponed by a whole one, rather than truncated to nothing.
+    auto task = taskManager.getTask(sheddable);
+    TEST_ASSERT_NOT_NULL(task);
+    TEST_ASSERT_EQUAL_UINT32(1, task->getSchedule());
+}
+
+void testStretchRunsOneInFactor() {
+    sheddableRuns = normalRuns = 0;
+    // use utilization rather than lateness, so that once overloaded it stays that way while the busy task runs.
+    taskManager.setOverloadPolicy(TmOverloadPolicy { 0, 30, TM_SHED_STRETCH, 3, 10000UL, 0 });
+
+    auto sheddable = taskManager.scheduleFixedRate(1000, [] { sheddableRuns++; }, TIME_MICROS);
+    taskManager.setTaskSheddable(sheddable, true);
+    // a task that takes longer than its interval keeps task manager busy.
+    taskManager.scheduleFixedRate(1000, [] { normalRuns++; busyForMicros(2000); }, TIME_MICROS);
+
+    auto start = millis();
+    while(!taskManager.isOverloaded() && (millis() - start) < 2000) {
+        taskManager.runLoop();
+    }
+    TEST_ASSERT_TRUE(taskManager.isOverloaded());
+
+    auto shed = taskManager.getShedExecutions();
+    auto runsBefore = sheddableRuns;
+    runLoopForMillis(300);
+    TEST_ASSERT_TRUE(taskManager.isOverloaded());
+    taskManager.reset();
+
+    auto runs = sheddableRuns - runsBefore;
+    TEST_ASSERT_TRUE(normalRuns > 50);
+    TEST_ASSERT_TRUE(runs > 0);
+    // two in every three were shed
+    TEST_ASSERT_TRUE((taskManager.getShedExecutions() - shed) >= uint32_t(runs));
+    TEST_ASSERT_TRUE(taskManager.getUtilizationEstimate() > 25);
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testNotOverloadedWithoutPolicy);
+    RUN_TEST(testLateQueueShedsSheddableTasks);
+    RUN_TEST(testLatenessOverloadDwellsBeforeRecovering);
+    RUN_TEST(testShortDeferRoundsUpForMillisTasks);
+    RUN_TEST(testStretchRunsOneInFactor);
+    UNITY_END();
+}
+
+void loop() {}
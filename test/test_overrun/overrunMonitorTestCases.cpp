@@ -0,0 +1,104 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmOverrunMonitor.h"
+#include "../utils/test_utils.h"
+
+void setUp() {
+    taskManager.reset();
+}
+
+void tearDown() {}
+
+taskid_t reportedTask = TASKMGR_INVALIDID;
+uint32_t reportedMicros = 0;
+bool reportedDisabled = false;
+int reports = 0;
+
+void onOverrun(taskid_t taskId, uint32_t runningMicros, bool disabled) {
+    reportedTask = taskId;
+    reportedMicros = runningMicros;
+    reportedDisabled = disabled;
+    reports++;
+}
+
+TmOverrunMonitor monitor(onOverrun, 2);
+bool checkedWhileRunning = false;
+uint32_t busyMicros = 3000;
+
+void busyTask() {
+    // the task is stuck for longer than its budget, here we check from within, as a timer interrupt would.
+    auto start = micros();
+    while((micros() - start) < busyMicros);
+    checkedWhileRunning = monitor.check();
+    TEST_ASSERT_FALSE(monitor.check());
+}
+
+void runUntilNextRun() {
+    checkedWhileRunning = false;
+    auto before = reports;
+    auto start = millis();
+    while(reports == before && (millis() - start) < 1000) {
+        taskManager.yieldForMicros(1000);
+    }
+}
+
+void testOverrunReportedAndDisabledAfterRepeats() {
+    reports = 0;
+    auto taskId = taskManager.scheduleFixedRate(5, busyTask);
+    taskManager.setTaskBudget(taskId, 1000);
+    TEST_ASSERT_FALSE(monitor.check());
+
+    runUntilNextRun();
+    TEST_ASSERT_TRUE(checkedWhileRunning);
+    TEST_ASSERT_EQUAL(1, reports);
+    TEST_ASSERT_EQUAL(taskId, reportedTask);
+    TEST_ASSERT_TRUE(reportedMicros >= 3000);
+    TEST_ASSERT_FALSE(reportedDisabled);
+    TEST_ASSERT_EQUAL(1, taskManager.getTask(taskId)->getOverrunCount());
+
+    // the second overrun in a row disables it, and it is not scheduled again.
+    runUntilNextRun();
+    TEST_ASSERT_EQUAL(2, reports);
+    TEST_ASSERT_TRUE(reportedDisabled);
+    TEST_ASSERT_FALSE(taskManager.getTask(taskId)->isEnabled());
+    TEST_ASSERT_EQUAL_UINT32(2, monitor.getOverrunCount());
+
+    taskManager.cancelTask(taskId);
+    taskManager.yieldForMicros(1000);
+}
+
+void testRunWithinBudgetResetsOverruns() {
+    reports = 0;
+    busyMicros = 3000;
+    auto taskId = taskManager.scheduleFixedRate(5, busyTask);
+    taskManager.setTaskBudget(taskId, 1000);
+    runUntilNextRun();
+    TEST_ASSERT_EQUAL(1, taskManager.getTask(taskId)->getOverrunCount());
+
+    // a run within budget is not reported, and clears the count, so it is not disabled by the next overrun
+    taskManager.setTaskBudget(taskId, 100000);
+    taskManager.yieldForMicros(20000);
+    TEST_ASSERT_EQUAL(1, reports);
+    TEST_ASSERT_EQUAL(0, taskManager.getTask(taskId)->getOverrunCount());
+
+    taskManager.setTaskBudget(taskId, 1000);
+    runUntilNextRun();
+    TEST_ASSERT_EQUAL(2, reports);
+    TEST_ASSERT_FALSE(reportedDisabled);
+    TEST_ASSERT_TRUE(taskManager.getTask(taskId)->isEnabled());
+
+    // without a budget nothing is ever reported
+    taskManager.setTaskBudget(taskId, 0);
+    taskManager.yieldForMicros(20000);
+    TEST_ASSERT_EQUAL(2, reports);
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testOverrunReportedAndDisabledAfterRepeats);
+    RUN_TEST(testRunWithinBudgetResetsOverruns);
+    UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,145 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmParallel.h"
+#include "../utils/test_utils.h"
+
+TimingHelpFixture fixture;
+
+void setUp() {
+    fixture.setup();
+}
+
+void tearDown() {}
+
+// these variables are set during test runs to time and verify tasks are run.
+bool scheduled = false;
+bool scheduled2ndJob = false;
+unsigned long microsStarted = 0, microsExecuted = 0, microsExecuted2ndJob = 0;
+int count1 = 0, count2 = 0;
+uint8_t pinNo = 0;
+
+#define PARALLEL_ITEMS 1000
+
+uint8_t timesVisited[PARALLEL_ITEMS];
+TaskManager workerTaskManager;
+TmWorkerPool callerOnlyPool;
+TmWorkerPool workerPool;
+
+void clearVisits() {
+    for(auto& visits : timesVisited) visits = 0;
+}
+
+void assertEachVisitedOnce() {
+    for(auto visits : timesVisited) {
+        TEST_ASSERT_EQUAL(1, visits);
+    }
+}
+
+int queuedOnWorker() {
+    int queued = 0;
+    for(auto task = workerTaskManager.getFirstTask(); task != nullptr; task = task->getNext()) queued++;
+    return queued;
+}
+
+// without threads, the worker is run from within the first chunk, so that its helper takes part while the job is open
+bool runningWorker = false;
+
+void runWorkerFromFirstChunk(uint32_t begin) {
+    if(begin != 0) return;
+    runningWorker = true;
+    while(queuedOnWorker() != 0) {
+        workerTaskManager.runLoop();
+    }
+    runningWorker = false;
+}
+
+void testParallelForWithoutWorkers() {
+    clearVisits();
+    TEST_ASSERT_EQUAL(1, callerOnlyPool.getParticipantCount());
+    static uint32_t largestChunk;
+    largestChunk = 0;
+    callerOnlyPool.parallelFor(0, PARALLEL_ITEMS, 64, [](uint32_t begin, uint32_t end) {
+        if((end - begin) > largestChunk) largestChunk = end - begin;
+        for(auto i = begin; i < end; i++) timesVisited[i]++;
+    });
+    assertEachVisitedOnce();
+
+    // even when the caller does all the work, it is still called a grain at a time
+    TEST_ASSERT_EQUAL(64U, largestChunk);
+}
+
+void testParallelForSharesChunksWithWorker() {
+    workerPool.addWorker(&workerTaskManager);
+    TEST_ASSERT_EQUAL(2, workerPool.getParticipantCount());
+
+    clearVisits();
+    workerPool.parallelFor(0, PARALLEL_ITEMS, 10, [](uint32_t begin, uint32_t end) {
+        runWorkerFromFirstChunk(begin);
+        if(runningWorker) count1++;
+        for(auto i = begin; i < end; i++) timesVisited[i]++;
+    });
+    assertEachVisitedOnce();
+    // the helper took all the chunks that were left once the worker ran
+    TEST_ASSERT_EQUAL(99, count1);
+    TEST_ASSERT_EQUAL(0, queuedOnWorker());
+}
+
+void testStaleHelperIsNotQueuedTwice() {
+    // the worker never runs during these jobs, so the caller does everything, and the helper stays queued.
+    for(int job = 0; job < 3; job++) {
+        clearVisits();
+        workerPool.parallelFor(0, PARALLEL_ITEMS, 100, [](uint32_t begin, uint32_t end) {
+            for(auto i = begin; i < end; i++) timesVisited[i]++;
+        });
+        assertEachVisitedOnce();
+        TEST_ASSERT_EQUAL(1, queuedOnWorker());
+    }
+
+    // when it finally runs, there is no job open, so it does nothing, and it is queued afresh for the next job.
+    workerTaskManager.runLoop();
+    TEST_ASSERT_EQUAL(0, queuedOnWorker());
+    clearVisits();
+    workerPool.parallelFor(0, PARALLEL_ITEMS, 100, [](uint32_t begin, uint32_t end) {
+        for(auto i = begin; i < end; i++) timesVisited[i]++;
+    });
+    assertEachVisitedOnce();
+    TEST_ASSERT_EQUAL(1, queuedOnWorker());
+    while(queuedOnWorker() != 0) {
+        workerTaskManager.runLoop();
+    }
+}
+
+void testParallelReduceSumsAllChunks() {
+    uint32_t expected = 0;
+    for(uint32_t i = 0; i < PARALLEL_ITEMS; i++) expected += i;
+
+    count1 = 0;
+    auto sumRange = [](uint32_t begin, uint32_t end) {
+        // partial results come from both participants, as the worker is run from the first chunk.
+        runWorkerFromFirstChunk(begin);
+        if(runningWorker) count1++;
+        uint32_t sum = 0;
+        for(auto i = begin; i < end; i++) sum += i;
+        return sum;
+    };
+    auto add = [](uint32_t a, uint32_t b) { return a + b; };
+
+    TEST_ASSERT_EQUAL_UINT32(expected, workerPool.parallelReduce(0, PARALLEL_ITEMS, 7, 0UL, sumRange, add));
+    TEST_ASSERT_TRUE(count1 > 0);
+    TEST_ASSERT_EQUAL_UINT32(expected, callerOnlyPool.parallelReduce(0, PARALLEL_ITEMS, 7, 0UL, sumRange, add));
+
+    // an empty range is just the identity
+    TEST_ASSERT_EQUAL_UINT32(0, workerPool.parallelReduce(10, 10, 7, 0UL, sumRange, add));
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testParallelForWithoutWorkers);
+    RUN_TEST(testParallelForSharesChunksWithWorker);
+    RUN_TEST(testStaleHelperIsNotQueuedTwice);
+    RUN_TEST(testParallelReduceSumsAllChunks);
+    UNITY_END();
+}
+
+void loop() {}
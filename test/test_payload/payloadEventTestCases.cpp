@@ -0,0 +1,113 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmPayloadEvent.h"
+#include "../utils/test_utils.h"
+
+struct TestPacket {
+    uint16_t sequence;
+    uint8_t data[32];
+};
+
+void setUp() {
+    taskManager.reset();
+}
+
+void tearDown() {}
+
+void testBufferPoolAcquireAndRelease() {
+    TmBufferPool<TestPacket, 40> pool;
+    TEST_ASSERT_EQUAL(40, pool.getAvailable());
+
+    // every buffer is handed out once, then the pool is empty
+    TestPacket* taken[40];
+    for(auto& packet : taken) {
+        packet = pool.acquire();
+        TEST_ASSERT_NOT_NULL(packet);
+    }
+    TEST_ASSERT_NULL(pool.acquire());
+    TEST_ASSERT_EQUAL(0, pool.getAvailable());
+    for(int i = 1; i < 40; i++) {
+        TEST_ASSERT_TRUE(taken[i] != taken[i - 1]);
+    }
+
+    // a released buffer is the one that is acquired next, and anything not from the pool is ignored
+    pool.release(taken[35]);
+    TestPacket notPooled;
+    pool.release(&notPooled);
+    TEST_ASSERT_EQUAL(1, pool.getAvailable());
+    TEST_ASSERT_EQUAL_PTR(taken[35], pool.acquire());
+
+    for(auto& packet : taken) {
+        pool.release(packet);
+    }
+    TEST_ASSERT_EQUAL(40, pool.getAvailable());
+}
+
+TmBufferPool<TestPacket, 8> packetPool;
+uint16_t handledSequences[16];
+int handledPackets = 0;
+bool poolWasInUse = false;
+
+void onPacket(TestPacket* packet) {
+    // the buffer is still ours while handling, and only released once we return
+    poolWasInUse = poolWasInUse || packetPool.getAvailable() != 8;
+    handledSequences[handledPackets++] = packet->sequence;
+}
+
+void testPayloadsAreDeliveredInOrderAndReleased() {
+    handledPackets = 0;
+    TmPayloadEvent<TestPacket, 8> packetReceived(onPacket, &packetPool);
+    taskManager.registerEvent(&packetReceived);
+    taskManager.runLoop();
+
+    for(uint16_t i = 0; i < 8; i++) {
+        TestPacket* packet = packetPool.acquire();
+        TEST_ASSERT_NOT_NULL(packet);
+        packet->sequence = i + 100;
+        TEST_ASSERT_TRUE(packetReceived.trigger(packet));
+    }
+    TEST_ASSERT_NULL(packetPool.acquire());
+    TEST_ASSERT_EQUAL_UINT32(8, packetReceived.getPendingCount());
+
+    runLoopForMillis(20);
+    TEST_ASSERT_EQUAL(8, handledPackets);
+    for(int i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL_UINT16(i + 100, handledSequences[i]);
+    }
+    TEST_ASSERT_TRUE(poolWasInUse);
+    TEST_ASSERT_EQUAL(8, packetPool.getAvailable());
+    TEST_ASSERT_EQUAL_UINT32(8, packetReceived.getHandledCount());
+}
+
+class KeepLastPayload : public TmPayloadEvent<TestPacket, 2> {
+public:
+    TestPacket* lastPayload = nullptr;
+    void handlePayload(TestPacket* payload) override { lastPayload = payload; }
+};
+
+void testPayloadEventWithoutPoolAndFullQueue() {
+    KeepLastPayload event;
+    taskManager.registerEvent(&event);
+    taskManager.runLoop();
+
+    TestPacket first, second, third;
+    TEST_ASSERT_TRUE(event.trigger(&first));
+    TEST_ASSERT_TRUE(event.trigger(&second));
+    TEST_ASSERT_FALSE(event.trigger(&third));
+    TEST_ASSERT_EQUAL_UINT32(1, event.getRejectedCount());
+
+    runLoopForMillis(20);
+    TEST_ASSERT_EQUAL_PTR(&second, event.lastPayload);
+    TEST_ASSERT_EQUAL_UINT32(2, event.getHandledCount());
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testBufferPoolAcquireAndRelease);
+    RUN_TEST(testPayloadsAreDeliveredInOrderAndReleased);
+    RUN_TEST(testPayloadEventWithoutPoolAndFullQueue);
+    UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,61 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmPreciseWakeup.h"
+#include "../utils/test_utils.h"
+
+void setUp() {
+    taskManager.reset();
+}
+
+void tearDown() {}
+
+// a sleep that always overshoots by 400 micros, as a coarse OS tick would
+void overshootingSleep(uint32_t sleepMicros) {
+    delayMicroseconds(sleepMicros + 400);
+}
+
+int wakeupTaskRuns = 0;
+
+void testMarginCalibratesToSleepOvershoot() {
+    TmPreciseWakeup wakeup(overshootingSleep);
+    wakeupTaskRuns = 0;
+    taskManager.scheduleFixedRate(20000, [] { wakeupTaskRuns++; }, TIME_MICROS);
+
+    while(wakeupTaskRuns < 20) {
+        wakeup.runLoop();
+    }
+
+    // the margin must cover the overshoot, so the sleep nearly always ends before the deadline, and the rest is spun
+    TEST_ASSERT_TRUE(wakeup.getOvershootEstimate() >= 400);
+    TEST_ASSERT_TRUE(wakeup.getMarginMicros() >= 400);
+    TEST_ASSERT_TRUE(wakeup.getMarginMicros() <= TM_PRECISE_MAX_MARGIN_MICROS);
+    TEST_ASSERT_TRUE(wakeup.getSleepCount() >= 20);
+    TEST_ASSERT_TRUE(wakeup.getLateWakeCount() < 10);
+}
+
+void testWaitEndsForTriggerOrMaxWait() {
+    TmPreciseWakeup wakeup;
+    taskManager.scheduleOnce(10, [] {}, TIME_SECONDS);
+    taskManager.runLoop();
+
+    // nothing is due for ten seconds, so the wait ends at the maximum
+    unsigned long start = millis();
+    TEST_ASSERT_FALSE(wakeup.waitForNextTask(5000));
+    TEST_ASSERT_TRUE((millis() - start) < 1000);
+
+    // a pending trigger ends the wait straight away
+    taskManager.triggerEvents();
+    start = millis();
+    TEST_ASSERT_TRUE(wakeup.waitForNextTask());
+    TEST_ASSERT_TRUE((millis() - start) < 1000);
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testMarginCalibratesToSleepOvershoot);
+    RUN_TEST(testWaitEndsForTriggerOrMaxWait);
+    UNITY_END();
+}
+
+void loop() {}
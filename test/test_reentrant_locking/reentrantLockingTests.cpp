@@ -59,9 +59,88 @@ void testGettingRunningTaskAlwaysCorrect() {
     TEST_ASSERT_GREATER_THAN(250, runCount2);
 }
 
+#if defined(IOA_MULTITHREADED) && defined(__has_include)
+# if __has_include(<thread>)
+#  define TM_TEST_WITH_THREADS
+# endif
+#endif
+
+#ifdef TM_TEST_WITH_THREADS
+#include <thread>
+
+#define LOCK_CONTENDERS 4
+#define LOCKS_PER_CONTENDER 2000
+SimpleSpinLock contendedLock;
+volatile int insideLock = 0;
+volatile int lockOverlaps = 0;
+volatile int lockedIncrements = 0;
+
+void testContendedLockExcludesAndWakesWaiters() {
+    insideLock = lockOverlaps = lockedIncrements = 0;
+
+    std::thread contenders[LOCK_CONTENDERS];
+    contendedLock.lock();
+    for(auto& contender : contenders) {
+        contender = std::thread([] {
+            for(int i = 0; i < LOCKS_PER_CONTENDER; i++) {
+                TaskMgrLock locked(contendedLock);
+                if(++insideLock != 1) lockOverlaps = lockOverlaps + 1;
+                lockedIncrements = lockedIncrements + 1;
+                --insideLock;
+            }
+        });
+    }
+
+    // hold the lock long enough that the contenders stop spinning and park, unlock must then wake them.
+    delay(20);
+    contendedLock.unlock();
+    for(auto& contender : contenders) contender.join();
+
+    TEST_ASSERT_EQUAL(0, lockOverlaps);
+    TEST_ASSERT_EQUAL(LOCK_CONTENDERS * LOCKS_PER_CONTENDER, lockedIncrements);
+    TEST_ASSERT_FALSE(contendedLock.isLocked());
+}
+
+void testSpinLockGivesUpWhileHeldElsewhere() {
+    volatile bool holding = false;
+    volatile bool release = false;
+    std::thread holder([&] {
+        contendedLock.lock();
+        holding = true;
+        while(!release) yield();
+        contendedLock.unlock();
+    });
+    while(!holding) yield();
+
+    // 100 iterations is about 5 milliseconds, a parked waiter must still give up around then.
+    auto started = millis();
+    TEST_ASSERT_FALSE(contendedLock.spinLock(100));
+    auto took = millis() - started;
+    TEST_ASSERT_TRUE(took >= 4 && took < 100);
+
+    release = true;
+    holder.join();
+    TEST_ASSERT_TRUE(contendedLock.spinLock(100));
+    contendedLock.unlock();
+}
+
+#else
+
+void testContendedLockExcludesAndWakesWaiters() {
+    TEST_IGNORE_MESSAGE("Needs a multithreaded board with std::thread");
+}
+
+void testSpinLockGivesUpWhileHeldElsewhere() {
+    TEST_IGNORE_MESSAGE("Needs a multithreaded board with std::thread");
+}
+
+#endif // TM_TEST_WITH_THREADS
+
 void setup() {
     UNITY_BEGIN();
     RUN_TEST(testGettingRunningTaskAlwaysCorrect);
+    RUN_TEST(testContendedLockExcludesAndWakesWaiters);
+    RUN_TEST(testSpinLockGivesUpWhileHeldElsewhere);
     UNITY_END();
 }
 
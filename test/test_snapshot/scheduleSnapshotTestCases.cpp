@@ -0,0 +1,182 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmScheduleSnapshot.h"
+#include "../utils/test_utils.h"
+
+void setUp() {
+    taskManager.reset();
+}
+
+void tearDown() {}
+
+int sensorRuns = 0;
+int displayRuns = 0;
+
+void readSensor() { sensorRuns++; }
+
+class DisplayUpdater : public Executable {
+public:
+    void exec() override { displayRuns++; }
+} displayUpdater;
+
+taskid_t lastOldId = TASKMGR_INVALIDID;
+taskid_t lastNewId = TASKMGR_INVALIDID;
+
+void onRestored(uint16_t /*key*/, taskid_t oldId, taskid_t newId) {
+    lastOldId = oldId;
+    lastNewId = newId;
+}
+
+void testSnapshotSavesOnlyRegisteredTasks() {
+    TmScheduleSnapshot<4> snapshot;
+    TEST_ASSERT_TRUE(snapshot.registerCallable(1, readSensor));
+    TEST_ASSERT_TRUE(snapshot.registerCallable(2, &displayUpdater));
+    TEST_ASSERT_FALSE(snapshot.registerCallable(2, readSensor));
+
+    taskManager.scheduleFixedRate(1000, readSensor);
+    taskManager.scheduleFixedRate(250, &displayUpdater);
+    taskManager.scheduleOnce(100, [] { sensorRuns += 100; });
+    TEST_ASSERT_EQUAL_UINT16(2, snapshot.countSavableTasks());
+
+    uint8_t data[TM_SNAPSHOT_SIZE(4)];
+    TmBufferSnapshotStream stream(data, sizeof data);
+    TEST_ASSERT_TRUE(snapshot.save(stream));
+    TEST_ASSERT_EQUAL_UINT16(2, snapshot.getLastRecordCount());
+    TEST_ASSERT_EQUAL_UINT16(1, snapshot.getLastSkippedCount());
+    TEST_ASSERT_EQUAL(TM_SNAPSHOT_SIZE(2), stream.getPosition());
+
+    // too small for both records
+    uint8_t small[TM_SNAPSHOT_SIZE(1)];
+    TmBufferSnapshotStream smallStream(small, sizeof small);
+    TEST_ASSERT_FALSE(snapshot.save(smallStream));
+}
+
+void sensorViaPointer() { sensorRuns++; }
+
+void testFunctionRecordedWhenTaskCreated() {
+    void (*fnVariable)() = sensorViaPointer;
+    auto byName = taskManager.getTask(taskManager.scheduleFixedRate(1000, readSensor));
+    auto byPointer = taskManager.getTask(taskManager.scheduleOnce(1000, fnVariable));
+    auto byExecute = taskManager.getTask(taskManager.execute(readSensor));
+    TEST_ASSERT_TRUE(byName->getFunctionPointer() == readSensor);
+    TEST_ASSERT_TRUE(byPointer->getFunctionPointer() == sensorViaPointer);
+    TEST_ASSERT_TRUE(byExecute->getFunctionPointer() == readSensor);
+    TEST_ASSERT_NULL(taskManager.getTask(taskManager.scheduleOnce(100, &displayUpdater))->getFunctionPointer());
+
+#ifdef TM_ALLOW_CAPTURED_LAMBDA
+    // a lambda, even one without captures, is not a function that can be matched.
+    auto byLambda = taskManager.getTask(taskManager.scheduleOnce(100, [] { sensorRuns++; }));
+    TEST_ASSERT_NULL(byLambda->getFunctionPointer());
+#endif
+}
+
+void testRestoreKeepsPhase() {
+    TmScheduleSnapshot<4> snapshot;
+    snapshot.registerCallable(1, readSensor);
+    snapshot.registerCallable(2, &displayUpdater);
+
+    auto sensorId = taskManager.scheduleFixedRate(1000, readSensor);
+    auto displayId = taskManager.scheduleFixedRate(5000, &displayUpdater);
+    taskManager.setTaskEnabled(displayId, false);
+    taskManager.setTaskSheddable(displayId, true);
+
+    // move the sensor task part way through its interval
+    delay(300);
+
+    uint8_t data[TM_SNAPSHOT_SIZE(4)];
+    TmBufferSnapshotStream stream(data, sizeof data);
+    TEST_ASSERT_TRUE(snapshot.save(stream));
+
+    // as if restarted, then restore.
+    taskManager.reset();
+    stream.rewind();
+    TEST_ASSERT_TRUE(snapshot.restore(stream, onRestored));
+    TEST_ASSERT_EQUAL_UINT16(2, snapshot.getLastRecordCount());
+    TEST_ASSERT_EQUAL_UINT16(0, snapshot.getLastSkippedCount());
+    TEST_ASSERT_EQUAL(displayId, lastOldId);
+
+    auto display = taskManager.getTask(lastNewId);
+    TEST_ASSERT_NOT_NULL(display);
+    TEST_ASSERT_FALSE(display->isEnabled());
+    TEST_ASSERT_TRUE(display->isRepeating());
+    TEST_ASSERT_TRUE(display->isSheddable());
+
+    // the sensor task is the only one queued, and is due in what remained of its interval, not a full one
+    auto first = taskManager.getFirstTask();
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_NULL(first->getNext());
+    TEST_ASSERT_TRUE(first->isRepeating());
+    TEST_ASSERT_FALSE(first->isSheddable());
+    TEST_ASSERT_EQUAL_UINT32(1000, first->getSchedule());
+    TEST_ASSERT_UINT32_WITHIN(60, 700, first->unitsFromNow());
+    (void)sensorId;
+
+    // after running it goes back to the full interval
+    sensorRuns = 0;
+    unsigned long start = millis();
+    while(sensorRuns == 0 && (millis() - start) < 2000) {
+        taskManager.yieldForMicros(10000);
+    }
+    TEST_ASSERT_EQUAL(1, sensorRuns);
+    TEST_ASSERT_UINT32_WITHIN(60, 1000, taskManager.getFirstTask()->unitsFromNow());
+}
+
+void testRestoreRejectsBadData() {
+    TmScheduleSnapshot<2> snapshot;
+    snapshot.registerCallable(1, readSensor);
+
+    uint8_t data[TM_SNAPSHOT_SIZE(1)] = { 'X', 'M', 'S', TM_SNAPSHOT_VERSION };
+    TmBufferSnapshotStream badHeader(data, sizeof data);
+    TEST_ASSERT_FALSE(snapshot.restore(badHeader));
+
+    // a header that promises more records than there are
+    uint8_t truncated[TM_SNAPSHOT_HEADER_SIZE] = { 'T', 'M', 'S', TM_SNAPSHOT_VERSION, 3, 0 };
+    TmBufferSnapshotStream shortStream(truncated, sizeof truncated);
+    TEST_ASSERT_FALSE(snapshot.restore(shortStream));
+    TEST_ASSERT_NULL(taskManager.getFirstTask());
+}
+
+#ifdef TM_SNAPSHOT_FILE_SUPPORT
+void testSnapshotStreamsToFile() {
+    TmScheduleSnapshot<2> snapshot;
+    snapshot.registerCallable(7, readSensor);
+    taskManager.scheduleFixedRate(20, readSensor, TIME_MICROS);
+    taskManager.scheduleOnce(2, readSensor, TIME_SECONDS);
+
+    FILE* file = tmpfile();
+    TEST_ASSERT_NOT_NULL(file);
+    TmFileSnapshotStream fileStream(file);
+    TEST_ASSERT_TRUE(snapshot.save(fileStream));
+
+    taskManager.reset();
+    rewind(file);
+    TEST_ASSERT_TRUE(snapshot.restore(fileStream));
+    fclose(file);
+    TEST_ASSERT_EQUAL_UINT16(2, snapshot.getLastRecordCount());
+
+    // the micros task is first, then the one shot, which was held in millis
+    auto first = taskManager.getFirstTask();
+    TEST_ASSERT_TRUE(first->isMicrosSchedule());
+    TEST_ASSERT_TRUE(first->isRepeating());
+    auto second = first->getNext();
+    TEST_ASSERT_NOT_NULL(second);
+    TEST_ASSERT_TRUE(second->isMillisSchedule());
+    TEST_ASSERT_FALSE(second->isRepeating());
+    TEST_ASSERT_EQUAL_UINT32(2000, second->getSchedule());
+}
+#endif
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testSnapshotSavesOnlyRegisteredTasks);
+    RUN_TEST(testFunctionRecordedWhenTaskCreated);
+    RUN_TEST(testRestoreKeepsPhase);
+    RUN_TEST(testRestoreRejectsBadData);
+#ifdef TM_SNAPSHOT_FILE_SUPPORT
+    RUN_TEST(testSnapshotStreamsToFile);
+#endif
+    UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,154 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "../utils/test_utils.h"
+
+int tasksRun = 0;
+
+void setUp() {
+    tasksRun = 0;
+}
+
+void tearDown() {}
+
+void countingTask() {
+    tasksRun++;
+}
+
+bool scheduleTasks(TaskManager& tm, int howMany) {
+    for(int i = 0; i < howMany; i++) {
+        if(tm.scheduleOnce(0, countingTask, TIME_MICROS) == TASKMGR_INVALIDID) return false;
+    }
+    return true;
+}
+
+void runUntilTasksRun(TaskManager& tm, int expected) {
+    // each call to runLoop stops after a one shot task completes, so keep going until all are done
+    int loops = 0;
+    while(tasksRun < expected && loops++ < 1000) {
+        tm.runLoop();
+    }
+}
+
+#if TM_MAX_TASK_BLOCKS > DEFAULT_TASK_BLOCKS
+void testGrowsBeyondDefaultBlocksUpToLimit() {
+    TaskManager tm;
+    TEST_ASSERT_EQUAL(1, tm.getNumberOfBlocks());
+
+    TEST_ASSERT_TRUE(scheduleTasks(tm, (DEFAULT_TASK_BLOCKS * DEFAULT_TASK_SIZE) + 1));
+    TEST_ASSERT_EQUAL(DEFAULT_TASK_BLOCKS + 1, tm.getNumberOfBlocks());
+
+    // fill up to the limit, then one more cannot be allocated
+    auto remaining = (TM_MAX_TASK_BLOCKS * DEFAULT_TASK_SIZE) - tm.getSlotsInUse();
+    TEST_ASSERT_TRUE(scheduleTasks(tm, remaining));
+    TEST_ASSERT_EQUAL(TM_MAX_TASK_BLOCKS, tm.getNumberOfBlocks());
+    TEST_ASSERT_EQUAL(TASKMGR_INVALIDID, tm.scheduleOnce(0, countingTask, TIME_MICROS));
+
+    TEST_ASSERT_EQUAL(TM_MAX_TASK_BLOCKS * DEFAULT_TASK_SIZE, tm.getPeakSlotsInUse());
+}
+#else
+void testGrowsBeyondDefaultBlocksUpToLimit() {
+    TEST_IGNORE_MESSAGE("TM_MAX_TASK_BLOCKS does not allow more than DEFAULT_TASK_BLOCKS on this board");
+}
+#endif // TM_MAX_TASK_BLOCKS > DEFAULT_TASK_BLOCKS
+
+void testReserveAllocatesUpFront() {
+    TaskManager tm;
+    TEST_ASSERT_TRUE(tm.reserve((DEFAULT_TASK_SIZE * 3) + 1));
+    TEST_ASSERT_EQUAL(4, tm.getNumberOfBlocks());
+    TEST_ASSERT_EQUAL(DEFAULT_TASK_SIZE * 4, tm.getSlotCapacity());
+
+    // reserved blocks are never reclaimed, even when empty
+    for(int i = 0; i < 3; i++) tm.reclaimEmptyBlocks(0);
+    TEST_ASSERT_EQUAL(4, tm.getNumberOfBlocks());
+
+    TEST_ASSERT_FALSE(tm.reserve((TM_MAX_TASK_BLOCKS * DEFAULT_TASK_SIZE) + 1));
+    TEST_ASSERT_EQUAL(TM_MAX_TASK_BLOCKS, tm.getNumberOfBlocks());
+}
+
+void testPeakSlotsInUseIsKept() {
+    TaskManager tm;
+    TEST_ASSERT_TRUE(scheduleTasks(tm, 20));
+    TEST_ASSERT_EQUAL(20, tm.getSlotsInUse());
+    runUntilTasksRun(tm, 20);
+    TEST_ASSERT_EQUAL(20, tasksRun);
+
+    TEST_ASSERT_EQUAL(0, tm.getSlotsInUse());
+    TEST_ASSERT_EQUAL(20, tm.getPeakSlotsInUse());
+
+    TEST_ASSERT_TRUE(scheduleTasks(tm, 5));
+    tm.resetPeakSlotsInUse();
+    TEST_ASSERT_EQUAL(5, tm.getPeakSlotsInUse());
+}
+
+void testEmptyBlocksAreReclaimedAfterStayingEmpty() {
+    TaskManager tm;
+    auto keptId = tm.scheduleFixedRate(10, countingTask, TIME_SECONDS);
+    TEST_ASSERT_TRUE(scheduleTasks(tm, DEFAULT_TASK_SIZE * 2));
+    TEST_ASSERT_EQUAL(3, tm.getNumberOfBlocks());
+    runUntilTasksRun(tm, DEFAULT_TASK_SIZE * 2);
+    TEST_ASSERT_EQUAL(DEFAULT_TASK_SIZE * 2, tasksRun);
+
+    // the first call marks the empty blocks as retiring, they are only freed once they have been retiring long enough
+    TEST_ASSERT_EQUAL(0, tm.reclaimEmptyBlocks(50));
+    TEST_ASSERT_EQUAL(3, tm.getNumberOfBlocks());
+    TEST_ASSERT_EQUAL(0, tm.reclaimEmptyBlocks(50));
+    TEST_ASSERT_EQUAL(3, tm.getNumberOfBlocks());
+    delay(60);
+    TEST_ASSERT_EQUAL(2, tm.reclaimEmptyBlocks(50));
+    TEST_ASSERT_EQUAL(1, tm.getNumberOfBlocks());
+
+    // the remaining task is unaffected, and blocks are added again as needed
+    TEST_ASSERT_NOT_NULL(tm.getTask(keptId));
+    TEST_ASSERT_TRUE(tm.getTask(keptId)->isInUse());
+    TEST_ASSERT_TRUE(scheduleTasks(tm, DEFAULT_TASK_SIZE));
+    TEST_ASSERT_EQUAL(2, tm.getNumberOfBlocks());
+}
+
+void testRetiringBlocksAreUsedBeforeAddingMore() {
+    TaskManager tm;
+    TEST_ASSERT_TRUE(scheduleTasks(tm, DEFAULT_TASK_SIZE * 3));
+    runUntilTasksRun(tm, DEFAULT_TASK_SIZE * 3);
+    tm.reclaimEmptyBlocks(0);
+    TEST_ASSERT_EQUAL(3, tm.getNumberOfBlocks());
+
+    // all three blocks are used again rather than allocating a fourth
+    TEST_ASSERT_TRUE(scheduleTasks(tm, DEFAULT_TASK_SIZE * 3));
+    TEST_ASSERT_EQUAL(3, tm.getNumberOfBlocks());
+
+    // and as they are now in use, nothing is reclaimed
+    tm.reclaimEmptyBlocks(0);
+    tm.reclaimEmptyBlocks(0);
+    TEST_ASSERT_EQUAL(3, tm.getNumberOfBlocks());
+}
+
+void testIdsFromFreedBlockDoNotMatchItsReplacement() {
+    TaskManager tm;
+    taskid_t staleId = TASKMGR_INVALIDID;
+    for(int i = 0; i < DEFAULT_TASK_SIZE * 2; i++) staleId = tm.scheduleOnce(0, countingTask, TIME_MICROS);
+    runUntilTasksRun(tm, DEFAULT_TASK_SIZE * 2);
+    tm.reclaimEmptyBlocks(0);
+    TEST_ASSERT_EQUAL(1, tm.reclaimEmptyBlocks(0));
+    TEST_ASSERT_EQUAL(1, tm.getNumberOfBlocks());
+
+    // the block is created again with every slot in use, but the ID from the freed block must not match any of them
+    TEST_ASSERT_TRUE(scheduleTasks(tm, DEFAULT_TASK_SIZE * 2));
+    TEST_ASSERT_EQUAL(2, tm.getNumberOfBlocks());
+    auto slotTask = tm.getTaskInSlot(tmSlotOfTaskId(staleId));
+    TEST_ASSERT_NOT_NULL(slotTask);
+    TEST_ASSERT_TRUE(slotTask->isInUse());
+    TEST_ASSERT_NULL(tm.getTask(staleId));
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testGrowsBeyondDefaultBlocksUpToLimit);
+    RUN_TEST(testReserveAllocatesUpFront);
+    RUN_TEST(testPeakSlotsInUseIsKept);
+    RUN_TEST(testEmptyBlocksAreReclaimedAfterStayingEmpty);
+    RUN_TEST(testRetiringBlocksAreUsedBeforeAddingMore);
+    RUN_TEST(testIdsFromFreedBlockDoNotMatchItsReplacement);
+    UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,125 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "TmTaskGraph.h"
+#include "../utils/test_utils.h"
+
+TimingHelpFixture fixture;
+
+void setUp() {
+    fixture.setup();
+}
+
+void tearDown() {}
+
+// these variables are set during test runs to time and verify tasks are run.
+bool scheduled = false;
+bool scheduled2ndJob = false;
+unsigned long microsStarted = 0, microsExecuted = 0, microsExecuted2ndJob = 0;
+int count1 = 0, count2 = 0;
+uint8_t pinNo = 0;
+
+// each node records the order in which it ran, so that dependencies can be checked.
+int runOrder[4];
+int runPosition = 0;
+
+void recordNode(int node) {
+    runOrder[node] = runPosition++;
+}
+
+class SlowPublishExec : public Executable {
+public:
+    void exec() override {
+        delayMicroseconds(2000);
+        recordNode(2);
+    }
+} slowPublish;
+
+TmTaskGraph<4> pipeline;
+tmnode_t readNode, filterNode, publishNode, logNode;
+
+void testGraphRunsNodesInDependencyOrder() {
+    readNode = pipeline.addNode([] { recordNode(0); });
+    filterNode = pipeline.addNode([] { recordNode(1); });
+    publishNode = pipeline.addNode(&slowPublish);
+    logNode = pipeline.addNode([] { recordNode(3); });
+    TEST_ASSERT_NOT_EQUAL(TM_INVALID_NODE, logNode);
+    TEST_ASSERT_TRUE(pipeline.addDependency(readNode, filterNode));
+    TEST_ASSERT_TRUE(pipeline.addDependency(filterNode, publishNode));
+    TEST_ASSERT_TRUE(pipeline.addDependency(filterNode, logNode));
+
+    // the graph is full, no more nodes can be added.
+    TEST_ASSERT_EQUAL(TM_INVALID_NODE, pipeline.addNode([] {}));
+
+    pipeline.setCompletionCallback([] { count1++; });
+
+    for(int run = 0; run < 3; run++) {
+        runPosition = 0;
+        TEST_ASSERT_TRUE(pipeline.run());
+        // cannot start again while it is running.
+        TEST_ASSERT_FALSE(pipeline.run());
+
+        taskManager.yieldForMicros(20000);
+
+        TEST_ASSERT_FALSE(pipeline.isRunning());
+        TEST_ASSERT_EQUAL(run + 1, count1);
+        TEST_ASSERT_EQUAL(4, runPosition);
+        TEST_ASSERT_EQUAL(0, runOrder[0]);
+        TEST_ASSERT_EQUAL(1, runOrder[1]);
+        TEST_ASSERT_GREATER_THAN(1, runOrder[2]);
+        TEST_ASSERT_GREATER_THAN(1, runOrder[3]);
+    }
+
+    // the publish node takes at least two millis, so the critical path must include it.
+    TEST_ASSERT_GREATER_OR_EQUAL(2000U, pipeline.getLastCriticalPathMicros());
+    TEST_ASSERT_GREATER_OR_EQUAL(pipeline.getLastCriticalPathMicros(), pipeline.getLastRunMicros());
+    TEST_ASSERT_EQUAL(3U, pipeline.getRunCount());
+    fixture.assertTasksSpacesTaken(0);
+}
+
+void testGraphWithCycleDoesNotRun() {
+    TmTaskGraph<2> cyclic;
+    auto a = cyclic.addNode([] { count2++; });
+    auto b = cyclic.addNode([] { count2++; });
+    TEST_ASSERT_TRUE(cyclic.addDependency(a, b));
+    TEST_ASSERT_TRUE(cyclic.addDependency(b, a));
+    TEST_ASSERT_FALSE(cyclic.run());
+    TEST_ASSERT_FALSE(cyclic.isRunning());
+    taskManager.yieldForMicros(1000);
+    TEST_ASSERT_EQUAL(0, count2);
+}
+
+TmTaskGraph<2> smallGraph;
+
+void testGraphAbandonedWhenTaskManagerFull() {
+    auto first = smallGraph.addNode([] { count1++; });
+    smallGraph.addDependency(first, smallGraph.addNode([] { count2++; }));
+
+    // fill every slot, so that not even the first node can be scheduled
+    while(taskManager.scheduleOnce(100, [] {}, TIME_SECONDS) != TASKMGR_INVALIDID);
+    TEST_ASSERT_FALSE(smallGraph.run());
+    TEST_ASSERT_FALSE(smallGraph.isRunning());
+    TEST_ASSERT_EQUAL(1, smallGraph.getFailedRunCount());
+
+    // with space again, it runs in full
+    taskManager.reset();
+    TEST_ASSERT_TRUE(smallGraph.run());
+    int loops = 100;
+    while(--loops && smallGraph.isRunning()) {
+        taskManager.yieldForMicros(1000);
+    }
+    TEST_ASSERT_FALSE(smallGraph.isRunning());
+    TEST_ASSERT_EQUAL(1, count1);
+    TEST_ASSERT_EQUAL(1, count2);
+    TEST_ASSERT_EQUAL(1, smallGraph.getRunCount());
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testGraphRunsNodesInDependencyOrder);
+    RUN_TEST(testGraphWithCycleDoesNotRun);
+    RUN_TEST(testGraphAbandonedWhenTaskManagerFull);
+    UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,55 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TaskManagerIO.h"
+#include "../utils/test_utils.h"
+
+void setUp() {
+    taskManager.reset();
+}
+
+void tearDown() {}
+
+void testUtilizationWindowsTrackBusyTime() {
+    // settle any time since start up into a sample first
+    runLoopForMillis(1100);
+    TEST_ASSERT_TRUE(taskManager.getUtilization(TM_UTILIZATION_1S) < 100);
+
+    // busy for 5ms out of every 10ms, so about half the time
+    auto taskId = taskManager.scheduleFixedRate(5000, [] { busyForMicros(5000); }, TIME_MICROS);
+    runLoopForMillis(2300);
+    TEST_ASSERT_UINT32_WITHIN(150, 500, taskManager.getUtilization(TM_UTILIZATION_1S));
+
+    // the longer windows still include the idle seconds before
+    auto tenSeconds = taskManager.getUtilization(TM_UTILIZATION_10S);
+    TEST_ASSERT_TRUE(tenSeconds < taskManager.getUtilization(TM_UTILIZATION_1S));
+    TEST_ASSERT_TRUE(tenSeconds > 100);
+    TEST_ASSERT_EQUAL(tenSeconds, taskManager.getUtilization(TM_UTILIZATION_60S));
+
+    // and once the task stops, it goes back to idle
+    taskManager.cancelTask(taskId);
+    runLoopForMillis(2100);
+    TEST_ASSERT_TRUE(taskManager.getUtilization(TM_UTILIZATION_1S) < 100);
+}
+
+void testTimeYieldingIsNotBusy() {
+    runLoopForMillis(1100);
+
+    // one task waits 5ms of every 10ms in yieldForMicros, while another does 2ms of real work in every 10ms, often
+    // nested inside the wait, so only the real work is busy time.
+    auto waiting = taskManager.scheduleFixedRate(10000, [] { taskManager.yieldForMicros(5000); }, TIME_MICROS);
+    auto working = taskManager.scheduleFixedRate(10000, [] { busyForMicros(2000); }, TIME_MICROS);
+    runLoopForMillis(2300);
+    TEST_ASSERT_UINT32_WITHIN(100, 200, taskManager.getUtilization(TM_UTILIZATION_1S));
+
+    taskManager.cancelTask(waiting);
+    taskManager.cancelTask(working);
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(testUtilizationWindowsTrackBusyTime);
+    RUN_TEST(testTimeYieldingIsNotBusy);
+    UNITY_END();
+}
+
+void loop() {}
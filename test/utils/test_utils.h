@@ -108,4 +108,22 @@ void dumpTasks() {
     }
 }
 
+/**
+ * Keeps task manager running for the given number of milliseconds.
+ */
+void runLoopForMillis(unsigned long period) {
+    unsigned long start = millis();
+    while((millis() - start) < period) {
+        taskManager.runLoop();
+    }
+}
+
+/**
+ * Spins without yielding for the given number of microseconds, as a task doing real work would.
+ */
+void busyForMicros(uint32_t howLong) {
+    auto start = micros();
+    while((micros() - start) < howLong);
+}
+
 #endif //TASKMANGERIO_TEST_UTILS_H